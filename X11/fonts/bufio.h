@@ -46,6 +46,7 @@ from The Open Group.
 
 typedef unsigned char BufChar;
 typedef struct _buffile *BufFilePtr;
+typedef struct _buffilemap *BufFileMapPtr;
 
 typedef struct _buffile {
     BufChar *bufp;
@@ -66,6 +67,7 @@ extern BufFilePtr BufFileCreate (
     int (*)(BufFilePtr, int),
     int (*)(BufFilePtr, int));
 extern BufFilePtr BufFileOpenRead ( int );
+extern BufFilePtr BufFileOpenMapped ( int );
 extern BufFilePtr BufFileOpenWrite ( int );
 extern BufFilePtr BufFilePushCompressed ( BufFilePtr );
 #ifdef X_GZIP_FONT_COMPRESSION
@@ -77,6 +79,8 @@ extern BufFilePtr BufFilePushBZIP2 ( BufFilePtr );
 extern int BufFileClose ( BufFilePtr, int );
 extern int BufFileRead ( BufFilePtr, char*, int );
 extern int BufFileWrite ( BufFilePtr, char*, int );
+extern BufFileMapPtr BufFileGetMap ( BufFilePtr, BufChar ** );
+extern void BufFileUnmap ( BufFileMapPtr );
 
 #define BufFileGet(f)	((f)->left-- ? *(f)->bufp++ : ((f)->eof = (*(f)->input) (f)))
 #define BufFilePut(c,f)	(--(f)->left ? *(f)->bufp++ = ((unsigned char)(c)) : (*(f)->output) ((unsigned char)(c),f))
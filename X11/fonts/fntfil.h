@@ -74,6 +74,7 @@ typedef struct _FontRenderer	    *FontRendererPtr;
 #define FontDirFile	    "fonts.dir"
 #define FontAliasFile	    "fonts.alias"
 #define FontScalableFile    "fonts.scale"
+#define FontDirIndexFile    "fonts.idx"
 
 extern int FontFileNameCheck ( char *name );
 extern int FontFileInitFPE ( FontPathElementPtr fpe );
@@ -178,5 +179,12 @@ extern int FontFileMatchBitmapSource ( FontPathElementPtr fpe,
 
 extern int FontFileReadDirectory ( char *directory, FontDirectoryPtr *pdir );
 extern Bool FontFileDirectoryChanged ( FontDirectoryPtr dir );
+extern int FontFileReadDirectoryIndex ( const char *directory,
+					 const char *dir_path,
+					 FontDirectoryPtr *pdir );
+extern void FontFileWriteDirectoryIndex ( const char *dir_path,
+					  FontDirectoryPtr dir );
+
+extern Bool FontFileWriteIndexes;
 
 #endif /* _FONTFILE_H_ */
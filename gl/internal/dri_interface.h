@@ -418,6 +418,7 @@ typedef struct __DRIsystemTimeExtensionRec __DRIsystemTimeExtension;
 typedef struct __DRIdamageExtensionRec __DRIdamageExtension;
 typedef struct __DRIloaderExtensionRec __DRIloaderExtension;
 typedef struct __DRIswrastLoaderExtensionRec __DRIswrastLoaderExtension;
+typedef struct __DRIswrastMapLoaderExtensionRec __DRIswrastMapLoaderExtension;
 
 
 /**
@@ -541,6 +542,42 @@ struct __DRIswrastLoaderExtensionRec {
                       char *data, void *loaderPrivate);
 };
 
+/**
+ * SWRast map loader extension.
+ *
+ * Lets the swrast driver draw straight into the loader's drawables.  It is
+ * kept apart from the SWRast loader extension, whose later versions are
+ * laid out by upstream Mesa.
+ */
+#define __DRI_SWRAST_MAP_LOADER "DRI_SWRastMapLoader"
+#define __DRI_SWRAST_MAP_LOADER_VERSION 1
+struct __DRIswrastMapLoaderExtensionRec {
+    __DRIextension base;
+
+    /**
+     * Map the drawable's pixels for direct access
+     *
+     * If the drawable is width x height, its pixels are bpp bits each in
+     * memory the driver can reach, and writing them there is the same as
+     * drawing them with putImage, returns the address of the top-left
+     * pixel and sets stride to the distance between rows in bytes.
+     * Returns NULL otherwise, and the driver uses getImage and putImage.
+     *
+     * The mapping is only good until the driver returns to the loader.
+     * Anything written through it is reported with damageDrawable.
+     */
+    void *(*mapDrawable)(__DRIdrawable *drawable, int bpp,
+                         int width, int height, int *stride,
+                         void *loaderPrivate);
+
+    /**
+     * Report pixels written through mapDrawable
+     */
+    void (*damageDrawable)(__DRIdrawable *drawable,
+                           int x, int y, int width, int height,
+                           void *loaderPrivate);
+};
+
 /**
  * Invalidate loader extension.  The presence of this extension
  * indicates to the DRI driver that the loader will call invalidate in
@@ -55,6 +55,9 @@
 /* Build GLX DRI loader */
 #undef GLX_DRI
 
+/* Support running GLX render commands on per-context threads */
+#define GLX_RENDER_THREADS 1
+
 /* Path to DRI drivers */
 #define DRI_DRIVER_PATH ""
 
@@ -368,6 +371,9 @@
 /* Build XKB */
 #define XKB 1
 
+/* xkbcomp's compiler as a library, used instead of xkbcomp if it loads. */
+#define XKBCOMP_LIBRARY "libxkbcomp.dll"
+
 /* Vendor release */
 #undef XORG_RELEASE
 
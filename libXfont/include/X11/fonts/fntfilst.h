@@ -106,6 +106,7 @@ typedef struct _FontTable {
     int		    size;
     FontEntryPtr    entries;
     Bool	    sorted;
+    struct _FontXLFDIndex *xlfd;    /* made by the first wildcard search */
 } FontTableRec;
 
 typedef struct _FontDirectory {
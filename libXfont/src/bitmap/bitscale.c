@@ -1447,6 +1447,25 @@ ScaleBitmap(FontPtr pFont, CharInfoPtr opci, CharInfoPtr pci,
     }
 }
 
+/*
+ * Glyph bits of the originating font may only be loaded when get_glyphs
+ * first returns the glyph; index is its place in the encoding.
+ */
+static Bool
+LoadSourceBits(FontPtr opf, int index)
+{
+    int		cols = opf->info.lastCol - opf->info.firstCol + 1;
+    unsigned char chars[2];
+    unsigned long count;
+    CharInfoPtr	pci;
+
+    chars[0] = index / cols + opf->info.firstRow;
+    chars[1] = index % cols + opf->info.firstCol;
+    return (*opf->get_glyphs) (opf, 1, chars, TwoD16Bit,
+			       &count, &pci) == Successful &&
+	count == 1 && pci->bits;
+}
+
 static FontPtr
 BitmapScaleBitmaps(FontPtr pf,          /* scaled font */
 		   FontPtr opf,         /* originating font */
@@ -1506,6 +1525,8 @@ BitmapScaleBitmaps(FontPtr pf,          /* scaled font */
 	if ((pci = ACCESSENCODING(bitmapFont->encoding, i)) &&
 	    (opci = ACCESSENCODING(obitmapFont->encoding, OLDINDEX(i))))
 	{
+	    if (!opci->bits && !LoadSourceBits(opf, OLDINDEX(i)))
+		goto bail;
 	    pci->bits = glyphBytes;
 	    ScaleBitmap (pf, opci, pci, inv_xform,
 			 widthMult, heightMult);
@@ -41,6 +41,9 @@ from The Open Group.
 #ifndef MAX
 #define   MAX(a,b)    (((a)>(b)) ? a : b)
 #endif
+#ifndef MIN
+#define   MIN(a,b)    (((a)<(b)) ? a : b)
+#endif
 
 #include <stdarg.h>
 #include <stdint.h>
@@ -60,8 +63,32 @@ pcfError(const char* message, ...)
 /* Read PCF font files */
 
 static void pcfUnloadFont ( FontPtr pFont );
+static void pcfUnloadMappedFont ( FontPtr pFont );
 static int  position;
 
+/*
+ * Fonts read from a mapped file keep their bitmaps in the mapping.  When
+ * the file's bitmap format is the one asked for, glyphs point straight at
+ * them; otherwise each glyph is converted the first time get_glyphs
+ * returns it, so opening a font with tens of thousands of glyphs only
+ * reads its metrics and encoding, and pages of the file are shared with
+ * every other open of it.
+ */
+typedef struct _PCFMappedFont {
+    BitmapFontRec   bitmapFont;	/* pFont->fontPrivate points here */
+    BufFileMapPtr   map;
+    char	   *bitmaps;	/* in the mapping */
+    CARD32	    sizebitmaps;
+    CARD32	    format;	/* of the bitmaps table */
+    CARD32	   *offsets;	/* of each glyph in bitmaps, when converting */
+    char	   *chunk;	/* converted glyphs, chained through the */
+    char	   *chunkFree;	/* first pointer of each chunk */
+    int		    chunkLeft;
+} PCFMappedFontRec, *PCFMappedFontPtr;
+
+#define PCF_CHUNK_SIZE	16384
+#define PCF_CHUNK_ALIGN	8	/* the widest glyph pad */
+
 
 #define IS_EOF(file) ((file)->eof == BUFFILEEOF)
 
@@ -384,6 +411,122 @@ Bail:
     return FALSE;
 }
 
+/*
+ * The unit in which bitmaps in the file's format need their bytes swapped
+ * to be in the format asked for, or 1
+ */
+static int
+pcfSwapUnit(CARD32 format, int bit, int byte, int scan)
+{
+    if ((PCF_BYTE_ORDER(format) == PCF_BIT_ORDER(format)) != (bit == byte))
+	return bit == byte ? PCF_SCAN_UNIT(format) : scan;
+    return 1;
+}
+
+static char *
+pcfAllocGlyphBits(PCFMappedFontPtr mapped, int size)
+{
+    char       *chunk;
+    char       *bits;
+    int         chunkSize;
+
+    size = (size + PCF_CHUNK_ALIGN - 1) & ~(PCF_CHUNK_ALIGN - 1);
+    if (size > mapped->chunkLeft) {
+	chunkSize = MAX(size, PCF_CHUNK_SIZE);
+	chunk = malloc(PCF_CHUNK_ALIGN + chunkSize);
+	if (!chunk)
+	    return NULL;
+	*(char **) chunk = mapped->chunk;
+	mapped->chunk = chunk;
+	mapped->chunkFree = chunk + PCF_CHUNK_ALIGN;
+	mapped->chunkLeft = chunkSize;
+    }
+    bits = mapped->chunkFree;
+    mapped->chunkFree += size;
+    mapped->chunkLeft -= size;
+    return bits;
+}
+
+/*
+ * Converts one glyph as pcfReadFont converts the whole bitmaps table of
+ * an unmapped font: the bytes around it are swapped in the same units,
+ * so the result is the same.
+ */
+static Bool
+pcfLoadGlyphBits(FontPtr pFont, CharInfoPtr pci)
+{
+    PCFMappedFontPtr mapped = (PCFMappedFontPtr) pFont->fontPrivate;
+    CARD32      format = mapped->format;
+    int         width = GLYPHWIDTHPIXELS(pci);
+    int         height = GLYPHHEIGHTPIXELS(pci);
+    int         unit = pcfSwapUnit(format, pFont->bit, pFont->byte,
+				   pFont->scan);
+    CARD32      offset, start, end;
+    char        stack[256];
+    char       *tmp, *bits;
+    int         size;
+
+    if (width <= 0 || height <= 0) {
+	pci->bits = pcfAllocGlyphBits(mapped, 1);
+	return pci->bits != NULL;
+    }
+
+    offset = mapped->offsets[pci - mapped->bitmapFont.metrics];
+    start = offset - offset % unit;
+    end = offset + BYTES_PER_ROW(width, PCF_GLYPH_PAD(format)) * height;
+    end = MIN(end + (unit - end % unit) % unit, mapped->sizebitmaps);
+    size = BYTES_PER_ROW(width, pFont->glyph) * height;
+
+    tmp = end - start <= sizeof(stack) ? stack : malloc(end - start);
+    bits = pcfAllocGlyphBits(mapped, size);
+    if (!tmp || !bits) {
+	if (tmp != stack)
+	    free(tmp);
+	return FALSE;
+    }
+
+    memcpy(tmp, mapped->bitmaps + start, end - start);
+    if (PCF_BIT_ORDER(format) != pFont->bit)
+	BitOrderInvert((unsigned char *) tmp, end - start);
+    switch (unit) {
+    case 2:
+	TwoByteSwap((unsigned char *) tmp, end - start);
+	break;
+    case 4:
+	FourByteSwap((unsigned char *) tmp, end - start);
+	break;
+    }
+    if (PCF_GLYPH_PAD(format) != pFont->glyph)
+	RepadBitmap(tmp + offset - start, bits, PCF_GLYPH_PAD(format),
+		    pFont->glyph, width, height);
+    else
+	memcpy(bits, tmp + offset - start, size);
+
+    if (tmp != stack)
+	free(tmp);
+    pci->bits = bits;
+    return TRUE;
+}
+
+static int
+pcfGetGlyphs(FontPtr pFont, unsigned long count, unsigned char *chars,
+	     FontEncoding charEncoding,
+	     unsigned long *glyphCount,	/* RETURN */
+	     CharInfoPtr *glyphs)	/* RETURN */
+{
+    unsigned long i;
+    int         ret;
+
+    ret = bitmapGetGlyphs(pFont, count, chars, charEncoding,
+			  glyphCount, glyphs);
+    if (ret != Successful)
+	return ret;
+    for (i = 0; i < *glyphCount; i++)
+	if (!glyphs[i]->bits && !pcfLoadGlyphBits(pFont, glyphs[i]))
+	    return AllocError;
+    return Successful;
+}
+
 int
 pcfReadFont(FontPtr pFont, FontFilePtr file,
 	    int bit, int byte, int glyph, int scan)
@@ -407,6 +550,11 @@ pcfReadFont(FontPtr pFont, FontFilePtr file,
     CARD32      bitmapSizes[GLYPHPADOPTIONS];
     CARD32     *offsets = 0;
     Bool	hasBDFAccelerators;
+    BufFileMapPtr map = 0;
+    BufChar    *mapData;
+    Bool	convert = FALSE;
+    CARD32	bitmapsFormat = 0;
+    PCFMappedFontPtr mapped = 0;
 
     pFont->info.nprops = 0;
     pFont->info.props = 0;
@@ -491,61 +639,92 @@ pcfReadFont(FontPtr pFont, FontFilePtr file,
     }
 
     sizebitmaps = bitmapSizes[PCF_GLYPH_PAD_INDEX(format)];
-    /* guard against completely empty font */
-    bitmaps = malloc(sizebitmaps ? sizebitmaps : 1);
-    if (!bitmaps) {
-      pcfError("pcfReadFont(): Couldn't allocate bitmaps (%d)\n", sizebitmaps ? sizebitmaps : 1);
-	goto Bail;
-    }
-    FontFileRead(file, bitmaps, sizebitmaps);
-    if (IS_EOF(file)) goto Bail;
-    position += sizebitmaps;
-
-    if (PCF_BIT_ORDER(format) != bit)
-	BitOrderInvert((unsigned char *)bitmaps, sizebitmaps);
-    if ((PCF_BYTE_ORDER(format) == PCF_BIT_ORDER(format)) != (bit == byte)) {
-	switch (bit == byte ? PCF_SCAN_UNIT(format) : scan) {
-	case 1:
-	    break;
-	case 2:
-	    TwoByteSwap((unsigned char *)bitmaps, sizebitmaps);
-	    break;
-	case 4:
-	    FourByteSwap((unsigned char *)bitmaps, sizebitmaps);
-	    break;
+    map = BufFileGetMap(file, &mapData);
+    if (map) {
+	bitmaps = (char *) mapData + position;
+	if (!FontFileSkip(file, sizebitmaps))
+	    goto Bail;
+	position += sizebitmaps;
+
+	for (i = 0; i < nbitmaps; i++) {
+	    xCharInfo  *metric = &metrics[i].metrics;
+	    int		width = metric->rightSideBearing - metric->leftSideBearing;
+	    int		height = metric->ascent + metric->descent;
+
+	    if (width > 0 && height > 0 &&
+		(offsets[i] > sizebitmaps ||
+		 BYTES_PER_ROW(width, PCF_GLYPH_PAD(format)) * height >
+		 sizebitmaps - offsets[i]))
+		goto Bail;
 	}
-    }
-    if (PCF_GLYPH_PAD(format) != glyph) {
-	char       *padbitmaps;
-	int         sizepadbitmaps;
-	int         old,
-	            new;
-	xCharInfo  *metric;
-
-	sizepadbitmaps = bitmapSizes[PCF_SIZE_TO_INDEX(glyph)];
-	padbitmaps = malloc(sizepadbitmaps);
-	if (!padbitmaps) {
-          pcfError("pcfReadFont(): Couldn't allocate padbitmaps (%d)\n", sizepadbitmaps);
+
+	convert = PCF_BIT_ORDER(format) != bit ||
+	    pcfSwapUnit(format, bit, byte, scan) != 1 ||
+	    PCF_GLYPH_PAD(format) != glyph;
+	bitmapsFormat = format;
+	for (i = 0; i < nbitmaps; i++)
+	    metrics[i].bits = convert ? NULL : bitmaps + offsets[i];
+	if (!convert) {
+	    free(offsets);
+	    offsets = NULL;
+	}
+    } else {
+	/* guard against completely empty font */
+	bitmaps = malloc(sizebitmaps ? sizebitmaps : 1);
+	if (!bitmaps) {
+	  pcfError("pcfReadFont(): Couldn't allocate bitmaps (%d)\n", sizebitmaps ? sizebitmaps : 1);
 	    goto Bail;
 	}
-	new = 0;
-	for (i = 0; i < nbitmaps; i++) {
-	    old = offsets[i];
-	    metric = &metrics[i].metrics;
-	    offsets[i] = new;
-	    new += RepadBitmap(bitmaps + old, padbitmaps + new,
-			       PCF_GLYPH_PAD(format), glyph,
-			  metric->rightSideBearing - metric->leftSideBearing,
-			       metric->ascent + metric->descent);
+	FontFileRead(file, bitmaps, sizebitmaps);
+	if (IS_EOF(file)) goto Bail;
+	position += sizebitmaps;
+
+	if (PCF_BIT_ORDER(format) != bit)
+	    BitOrderInvert((unsigned char *)bitmaps, sizebitmaps);
+	if ((PCF_BYTE_ORDER(format) == PCF_BIT_ORDER(format)) != (bit == byte)) {
+	    switch (bit == byte ? PCF_SCAN_UNIT(format) : scan) {
+	    case 1:
+		break;
+	    case 2:
+		TwoByteSwap((unsigned char *)bitmaps, sizebitmaps);
+		break;
+	    case 4:
+		FourByteSwap((unsigned char *)bitmaps, sizebitmaps);
+		break;
+	    }
 	}
-	free(bitmaps);
-	bitmaps = padbitmaps;
-    }
-    for (i = 0; i < nbitmaps; i++)
-	metrics[i].bits = bitmaps + offsets[i];
+	if (PCF_GLYPH_PAD(format) != glyph) {
+	    char       *padbitmaps;
+	    int         sizepadbitmaps;
+	    int         old,
+			new;
+	    xCharInfo  *metric;
+
+	    sizepadbitmaps = bitmapSizes[PCF_SIZE_TO_INDEX(glyph)];
+	    padbitmaps = malloc(sizepadbitmaps);
+	    if (!padbitmaps) {
+	      pcfError("pcfReadFont(): Couldn't allocate padbitmaps (%d)\n", sizepadbitmaps);
+		goto Bail;
+	    }
+	    new = 0;
+	    for (i = 0; i < nbitmaps; i++) {
+		old = offsets[i];
+		metric = &metrics[i].metrics;
+		offsets[i] = new;
+		new += RepadBitmap(bitmaps + old, padbitmaps + new,
+				   PCF_GLYPH_PAD(format), glyph,
+			      metric->rightSideBearing - metric->leftSideBearing,
+				   metric->ascent + metric->descent);
+	    }
+	    free(bitmaps);
+	    bitmaps = padbitmaps;
+	}
+	for (i = 0; i < nbitmaps; i++)
+	    metrics[i].bits = bitmaps + offsets[i];
 
-    free(offsets);
-    offsets = NULL;
+	free(offsets);
+	offsets = NULL;
+    }
 
     /* ink metrics ? */
 
@@ -631,11 +810,29 @@ pcfReadFont(FontPtr pFont, FontFilePtr file,
 	if (!pcfGetAccel (&pFont->info, file, tables, ntables, PCF_BDF_ACCELERATORS))
 	    goto Bail;
 
-    bitmapFont = malloc(sizeof *bitmapFont);
-    if (!bitmapFont) {
-	pcfError("pcfReadFont(): Couldn't allocate bitmapFont (%d)\n",
-		 (int) sizeof *bitmapFont);
-	goto Bail;
+    if (map) {
+	mapped = calloc(1, sizeof *mapped);
+	if (!mapped) {
+	    pcfError("pcfReadFont(): Couldn't allocate mapped font (%d)\n",
+		     (int) sizeof *mapped);
+	    goto Bail;
+	}
+	mapped->map = map;
+	mapped->bitmaps = bitmaps;
+	mapped->sizebitmaps = sizebitmaps;
+	mapped->format = bitmapsFormat;
+	mapped->offsets = offsets;
+	map = NULL;
+	bitmaps = NULL;
+	offsets = NULL;
+	bitmapFont = &mapped->bitmapFont;
+    } else {
+	bitmapFont = malloc(sizeof *bitmapFont);
+	if (!bitmapFont) {
+	    pcfError("pcfReadFont(): Couldn't allocate bitmapFont (%d)\n",
+		     (int) sizeof *bitmapFont);
+	    goto Bail;
+	}
     }
 
     bitmapFont->version_num = PCF_FILE_VERSION;
@@ -663,9 +860,9 @@ pcfReadFont(FontPtr pFont, FontFilePtr file,
     }
     bitmapFont->bitmapExtra = (BitmapExtraPtr) 0;
     pFont->fontPrivate = (pointer) bitmapFont;
-    pFont->get_glyphs = bitmapGetGlyphs;
+    pFont->get_glyphs = convert ? pcfGetGlyphs : bitmapGetGlyphs;
     pFont->get_metrics = bitmapGetMetrics;
-    pFont->unload_font = pcfUnloadFont;
+    pFont->unload_font = mapped ? pcfUnloadMappedFont : pcfUnloadFont;
     pFont->unload_glyphs = NULL;
     pFont->bit = bit;
     pFont->byte = byte;
@@ -680,7 +877,10 @@ Bail:
             free(encoding[i]);
     }
     free(encoding);
-    free(bitmaps);
+    if (map)
+	BufFileUnmap(map);
+    else
+	free(bitmaps);
     free(metrics);
     free(pFont->info.props);
     pFont->info.nprops = 0;
@@ -788,3 +988,19 @@ pcfUnloadFont(FontPtr pFont)
     free(bitmapFont);
     DestroyFontRec(pFont);
 }
+
+static void
+pcfUnloadMappedFont(FontPtr pFont)
+{
+    PCFMappedFontPtr mapped = (PCFMappedFontPtr) pFont->fontPrivate;
+    char       *chunk;
+
+    while ((chunk = mapped->chunk)) {
+	mapped->chunk = *(char **) chunk;
+	free(chunk);
+    }
+    free(mapped->offsets);
+    BufFileUnmap(mapped->map);
+    /* the rest, mapped included, is freed with the bitmap font */
+    pcfUnloadFont(pFont);
+}
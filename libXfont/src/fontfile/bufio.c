@@ -38,6 +38,11 @@ from The Open Group.
 #include <X11/fonts/fontmisc.h>
 #include <X11/fonts/bufio.h>
 #include <errno.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#endif
 
 BufFilePtr
 BufFileCreate (char *private,
@@ -129,6 +134,153 @@ BufFileOpenRead (int fd)
     return BufFileCreate ((char *)(long) fd, BufFileRawFill, 0, BufFileRawSkip, BufFileRawClose);
 }
 
+/*
+ * Mapped files are read straight out of the mapping, with no copying and
+ * no system calls.  A file opened several times shares one mapping,
+ * which lasts as long as some open file or BufFileGetMap() reference
+ * holds it, so readers may keep pointers into the file.  A file is
+ * recognized by device, inode, size and modification time: fonts are
+ * replaced by writing a new file, not rewritten in place.
+ */
+
+typedef struct _buffilemap {
+    struct _buffilemap *next;
+    BufChar *data;
+    int	    refcnt;
+#ifdef HAVE_MMAP
+    dev_t   dev;
+    ino_t   ino;
+    off_t   size;
+    time_t  mtime;
+#endif
+} BufFileMapRec;
+
+#ifdef HAVE_MMAP
+
+static BufFileMapPtr bufFileMaps;
+
+#define FileMap(f)  ((BufFileMapPtr) (f)->private)
+
+static int
+BufFileMapFill (BufFilePtr f)
+{
+    f->left = 0;
+    return BUFFILEEOF;
+}
+
+static int
+BufFileMapSkip (BufFilePtr f, int count)
+{
+    if (count > f->left) {
+	f->bufp += f->left;
+	f->left = 0;
+	return BUFFILEEOF;
+    }
+    f->bufp += count;
+    f->left -= count;
+    return count;
+}
+
+static int
+BufFileMapClose (BufFilePtr f, int doClose)
+{
+    BufFileUnmap (FileMap (f));
+    return 1;
+}
+
+#endif
+
+/*
+ * Returns 0 when the file can't be mapped; otherwise the file descriptor
+ * has been closed, the mapping doesn't need it.
+ */
+BufFilePtr
+BufFileOpenMapped (int fd)
+{
+#ifdef HAVE_MMAP
+    struct stat	    st;
+    BufFileMapPtr   map;
+    BufFilePtr	    f;
+    void	    *data;
+
+    if (fstat (fd, &st) == -1 || !S_ISREG (st.st_mode) ||
+	st.st_size <= 0 || st.st_size > INT_MAX)
+	return 0;
+
+    for (map = bufFileMaps; map; map = map->next)
+	if (map->dev == st.st_dev && map->ino == st.st_ino &&
+	    map->size == st.st_size && map->mtime == st.st_mtime)
+	    break;
+
+    if (map)
+	map->refcnt++;
+    else {
+	data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+	    return 0;
+	map = malloc (sizeof *map);
+	if (!map) {
+	    munmap (data, st.st_size);
+	    return 0;
+	}
+	map->data = data;
+	map->refcnt = 1;
+	map->dev = st.st_dev;
+	map->ino = st.st_ino;
+	map->size = st.st_size;
+	map->mtime = st.st_mtime;
+	map->next = bufFileMaps;
+	bufFileMaps = map;
+    }
+
+    f = BufFileCreate ((char *) map, BufFileMapFill, 0, BufFileMapSkip,
+		       BufFileMapClose);
+    if (!f) {
+	BufFileUnmap (map);
+	return 0;
+    }
+    f->bufp = map->data;
+    f->left = map->size;
+    close (fd);
+    return f;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * For a file from BufFileOpenMapped, a new reference to its mapping, and
+ * the start of the file in *data.  Returns 0 for any other file.
+ */
+BufFileMapPtr
+BufFileGetMap (BufFilePtr f, BufChar **data)
+{
+#ifdef HAVE_MMAP
+    if (f->input == BufFileMapFill) {
+	FileMap (f)->refcnt++;
+	*data = FileMap (f)->data;
+	return FileMap (f);
+    }
+#endif
+    return 0;
+}
+
+void
+BufFileUnmap (BufFileMapPtr map)
+{
+#ifdef HAVE_MMAP
+    BufFileMapPtr *prev;
+
+    if (--map->refcnt)
+	return;
+    for (prev = &bufFileMaps; *prev != map; prev = &(*prev)->next)
+	;
+    *prev = map->next;
+    munmap (map->data, map->size);
+    free (map);
+#endif
+}
+
 static int
 BufFileRawFlush (int c, BufFilePtr f)
 {
@@ -174,6 +326,14 @@ BufFileRead (BufFilePtr f, char *b, int n)
 {
     int	    c, cnt;
     cnt = n;
+    if (f->left > 0) {
+	c = f->left < n ? f->left : n;
+	memcpy (b, f->bufp, c);
+	f->bufp += c;
+	f->left -= c;
+	b += c;
+	cnt -= c;
+    }
     while (cnt--) {
 	c = BufFileGet (f);
 	if (c == BUFFILEEOF)
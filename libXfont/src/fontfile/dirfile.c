@@ -65,6 +65,7 @@ FontFileReadDirectory (const char *directory, FontDirectoryPtr *pdir)
                 num_fonts,
                 status;
     struct stat	statb;
+    Bool	complete = TRUE;
     static char format[24] = "";
 #if defined(WIN32)
     int i;
@@ -87,6 +88,8 @@ FontFileReadDirectory (const char *directory, FontDirectoryPtr *pdir)
     } else {
 	strcpy(dir_path, directory);
     }
+    if (FontFileReadDirectoryIndex(directory, dir_path, pdir) == Successful)
+	return Successful;
     strcpy(dir_file, dir_path);
     if (dir_file[strlen(dir_file) - 1] != '/')
 	strcat(dir_file, "/");
@@ -135,7 +138,8 @@ FontFileReadDirectory (const char *directory, FontDirectoryPtr *pdir)
 	     * In theory, we might want to warn that some of the fonts
 	     * couldn't be loaded.
 	     */
-	    FontFileAddFontFile (dir, font_name, file_name);
+	    if (!FontFileAddFontFile (dir, font_name, file_name))
+		complete = FALSE;
 	}
 	fclose(file);
 
@@ -152,6 +156,10 @@ FontFileReadDirectory (const char *directory, FontDirectoryPtr *pdir)
 	return BadFontPath;
 
     FontFileSortDir(dir);
+    /* Leave out the index when fonts were skipped, a renderer for them
+       may be there next time */
+    if (complete && FontFileWriteIndexes)
+	FontFileWriteDirectoryIndex(dir_path, dir);
 
     *pdir = dir;
     return Successful;
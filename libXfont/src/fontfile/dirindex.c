@@ -0,0 +1,570 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software without
+ * specific, written prior permission.  The copyright holders make no
+ * representations about the suitability of this software for any purpose.
+ * It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * dirindex.c
+ *
+ * Read and write fonts.idx, a binary image of the font directory built
+ * from fonts.dir and fonts.alias.
+ *
+ * The index holds both tables already sorted, with the names lowercased
+ * and their dashes counted, the scaled instances of each scalable font
+ * and, for each, the index of its bitmap entry.  Everything is referred
+ * to by offset, so the file can be used straight from a mapping.  It
+ * records the modification times of fonts.dir and fonts.alias it was
+ * built from and the defaults FontFileAddFontFile() used, and is only
+ * used while all of them still match; otherwise the text files are
+ * parsed again.  The server only writes indexes when FontFileWriteIndexes
+ * is set (-fontindex); otherwise they come from whoever maintains the
+ * directory.
+ * The index is in native byte order: on another architecture, it just
+ * looks stale.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <X11/fonts/fntfilst.h>
+#include <X11/fonts/fntfilio.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+Bool FontFileWriteIndexes = FALSE;
+
+#define FONT_DIR_INDEX_MAGIC	0x49444658	/* "XFDI" */
+#define FONT_DIR_INDEX_VERSION	1
+
+typedef struct _FontDirIndexHeader {
+    CARD32	magic;
+    CARD32	version;
+    CARD32	size;		/* of the whole file */
+    CARD32	scalableSize;	/* sizeof (FontScalableRec) */
+    CARD32	dirMtime;
+    CARD32	aliasMtime;
+    CARD32	pointSize;	/* GetDefaultPointSize () */
+    CARD32	xResolution;	/* the default resolution */
+    CARD32	yResolution;
+    CARD32	attributes;	/* string, or 0 */
+    CARD32	numScalable;
+    CARD32	numNonScalable;
+    CARD32	numVals;
+    CARD32	entries;	/* offset of the entries, scalable first */
+    CARD32	vals;		/* offset of the FontDirIndexValsRecs */
+    CARD32	strings;	/* offset of the string pool */
+} FontDirIndexHeaderRec, *FontDirIndexHeaderPtr;
+
+typedef struct _FontDirIndexEntry {
+    CARD32	name;		/* string */
+    CARD16	length;
+    CARD16	ndashes;
+    CARD32	type;
+    CARD32	string;		/* file name, or the resolved name of an alias */
+    CARD32	vals;		/* scalable: index of the defaults, followed
+				   by the scaled instances */
+    CARD32	numScaled;
+} FontDirIndexEntryRec, *FontDirIndexEntryPtr;
+
+typedef struct _FontDirIndexVals {
+    FontScalableRec	vals;	/* with no ranges or xlfdName */
+    CARD32		bitmap;	/* scaled instance: nonScalable entry */
+} FontDirIndexValsRec, *FontDirIndexValsPtr;
+
+#define FontDirIndexAlign(n)	(((n) + 7) & ~7)
+
+static void
+FontDirIndexDefaults (CARD32 *pointSize, CARD32 *x, CARD32 *y)
+{
+    FontResolutionPtr	resolution;
+    int			num;
+
+    *pointSize = GetDefaultPointSize ();
+    resolution = GetClientResolutions (&num);
+    if (resolution && num > 0) {
+	*x = resolution->x_resolution;
+	*y = resolution->y_resolution;
+    } else {
+	*x = 75;
+	*y = 75;
+    }
+}
+
+/*
+ * The modification time of directory/file, 0 when it doesn't exist
+ */
+static Bool
+FontDirIndexMtime (const char *directory, const char *file, CARD32 *mtime)
+{
+    char	path[MAXFONTFILENAMELEN];
+    struct stat	statb;
+
+    if (strlen (directory) + 1 + strlen (file) >= sizeof (path))
+	return FALSE;
+    strcpy (path, directory);
+    if (path[strlen (path) - 1] != '/')
+	strcat (path, "/");
+    strcat (path, file);
+    if (stat (path, &statb) == -1) {
+	*mtime = 0;
+	return errno == ENOENT;
+    }
+    *mtime = statb.st_mtime;
+    return TRUE;
+}
+
+static char *
+FontDirIndexString (char *data, FontDirIndexHeaderPtr header, CARD32 offset)
+{
+    if (offset >= header->size - header->strings)
+	return NULL;
+    return data + header->strings + offset;
+}
+
+static Bool
+FontDirIndexLoadTable (FontTablePtr table, char *data,
+		       FontDirIndexHeaderPtr header,
+		       FontDirIndexEntryPtr entries, int num)
+{
+    FontEntryPtr	entry;
+    char		*name, *string;
+    int			i;
+
+    if (!FontFileInitTable (table, num))
+	return FALSE;
+    for (i = 0; i < num; i++) {
+	name = FontDirIndexString (data, header, entries[i].name);
+	string = FontDirIndexString (data, header, entries[i].string);
+	if (!name || !string || entries[i].length != strlen (name))
+	    return FALSE;
+
+	entry = &table->entries[i];
+	memset (entry, 0, sizeof (*entry));
+	entry->type = entries[i].type;
+	entry->name.length = entries[i].length;
+	entry->name.ndashes = entries[i].ndashes;
+	switch (entry->type) {
+	case FONT_ENTRY_SCALABLE:
+	    /* FontFileFreeEntry () needs the extra */
+	    entry->u.scalable.extra = calloc (1, sizeof (FontScalableExtraRec));
+	    if (!entry->u.scalable.extra)
+		return FALSE;
+	    break;
+	case FONT_ENTRY_BITMAP:
+	case FONT_ENTRY_ALIAS:
+	    break;
+	default:
+	    return FALSE;
+	}
+	table->used++;
+
+	entry->name.name = strdup (name);
+	if (!entry->name.name)
+	    return FALSE;
+	switch (entry->type) {
+	case FONT_ENTRY_SCALABLE:
+	    entry->u.scalable.renderer = FontFileMatchRenderer (string);
+	    entry->u.scalable.fileName = strdup (string);
+	    if (!entry->u.scalable.renderer || !entry->u.scalable.fileName)
+		return FALSE;
+	    break;
+	case FONT_ENTRY_BITMAP:
+	    entry->u.bitmap.renderer = FontFileMatchRenderer (string);
+	    entry->u.bitmap.fileName = strdup (string);
+	    if (!entry->u.bitmap.renderer || !entry->u.bitmap.fileName)
+		return FALSE;
+	    break;
+	case FONT_ENTRY_ALIAS:
+	    entry->u.alias.resolved = strdup (string);
+	    if (!entry->u.alias.resolved)
+		return FALSE;
+	    break;
+	}
+    }
+    table->sorted = TRUE;
+    return TRUE;
+}
+
+static Bool
+FontDirIndexLoadScaled (FontDirectoryPtr dir, FontDirIndexHeaderPtr header,
+			FontDirIndexEntryPtr entries, FontDirIndexValsPtr vals)
+{
+    FontScalableExtraPtr    extra;
+    FontDirIndexValsPtr	    v;
+    int			    s, i;
+
+    for (s = 0; s < dir->scalable.used; s++) {
+	extra = dir->scalable.entries[s].u.scalable.extra;
+	if (entries[s].vals >= header->numVals ||
+	    entries[s].numScaled >= header->numVals - entries[s].vals)
+	    return FALSE;
+	v = &vals[entries[s].vals];
+	extra->defaults = v->vals;
+	extra->defaults.xlfdName = NULL;
+	extra->defaults.nranges = 0;
+	extra->defaults.ranges = NULL;
+	if (!entries[s].numScaled)
+	    continue;
+	extra->scaled = calloc (entries[s].numScaled, sizeof (FontScaledRec));
+	if (!extra->scaled)
+	    return FALSE;
+	extra->sizeScaled = entries[s].numScaled;
+	for (i = 0; i < entries[s].numScaled; i++) {
+	    v++;
+	    if (v->bitmap >= dir->nonScalable.used)
+		return FALSE;
+	    extra->scaled[i].vals = v->vals;
+	    extra->scaled[i].vals.xlfdName = NULL;
+	    extra->scaled[i].vals.nranges = 0;
+	    extra->scaled[i].vals.ranges = NULL;
+	    extra->scaled[i].bitmap = &dir->nonScalable.entries[v->bitmap];
+	    extra->scaled[i].pFont = NullFont;
+	    extra->numScaled++;
+	}
+    }
+    return TRUE;
+}
+
+/*
+ * Builds the directory from its index, when there is one and it is
+ * current.  Returns BadFontPath otherwise, and then the caller reads the
+ * text files.
+ */
+int
+FontFileReadDirectoryIndex (const char *directory, const char *dir_path,
+			    FontDirectoryPtr *pdir)
+{
+    char		    index_file[MAXFONTFILENAMELEN];
+    FontFilePtr		    file;
+    BufFileMapPtr	    map = NULL;
+    BufChar		    *mapData;
+    char		    *data = NULL, *attributes;
+    FontDirIndexHeaderRec   header;
+    FontDirIndexEntryPtr    entries;
+    CARD32		    dirMtime, aliasMtime;
+    CARD32		    pointSize, x, y;
+    FontDirectoryPtr	    dir = NULL;
+    int			    status = BadFontPath;
+
+    if (strlen (dir_path) + 1 + sizeof (FontDirIndexFile) > sizeof (index_file))
+	return BadFontPath;
+    strcpy (index_file, dir_path);
+    if (index_file[strlen (index_file) - 1] != '/')
+	strcat (index_file, "/");
+    strcat (index_file, FontDirIndexFile);
+
+    file = FontFileOpen (index_file);
+    if (!file)
+	return BadFontPath;
+    if (FontFileRead (file, (char *) &header, sizeof (header)) !=
+	    sizeof (header) ||
+	header.magic != FONT_DIR_INDEX_MAGIC ||
+	header.version != FONT_DIR_INDEX_VERSION ||
+	header.scalableSize != sizeof (FontScalableRec) ||
+	header.size < sizeof (header))
+	goto bail;
+
+    FontDirIndexDefaults (&pointSize, &x, &y);
+    if (!FontDirIndexMtime (dir_path, FontDirFile, &dirMtime) ||
+	!FontDirIndexMtime (dir_path, FontAliasFile, &aliasMtime) ||
+	header.dirMtime != dirMtime || header.aliasMtime != aliasMtime ||
+	header.pointSize != pointSize ||
+	header.xResolution != x || header.yResolution != y)
+	goto bail;
+
+    map = BufFileGetMap (file, &mapData);
+    if (map) {
+	if (!FontFileSkip (file, header.size - sizeof (header)))
+	    goto bail;
+	data = (char *) mapData;
+    }
+    else {
+	data = malloc (header.size);
+	if (!data)
+	    goto bail;
+	memcpy (data, &header, sizeof (header));
+	if (FontFileRead (file, data + sizeof (header),
+			  header.size - sizeof (header)) !=
+		header.size - sizeof (header))
+	    goto bail;
+    }
+
+    /* The tables must fit, and the string pool must end in a NUL */
+    if (header.entries % 8 || header.vals % 8 ||
+	header.entries > header.size || header.vals > header.size ||
+	header.strings >= header.size || data[header.size - 1] != '\0' ||
+	header.numScalable + (CARD64) header.numNonScalable >
+	    (header.size - header.entries) / sizeof (FontDirIndexEntryRec) ||
+	header.numVals >
+	    (header.size - header.vals) / sizeof (FontDirIndexValsRec))
+	goto bail;
+    entries = (FontDirIndexEntryPtr) (data + header.entries);
+
+    dir = FontFileMakeDir (directory, 0);
+    if (!dir)
+	goto bail;
+    attributes = header.attributes ?
+	FontDirIndexString (data, &header, header.attributes) : NULL;
+    if (dir->attributes ? !attributes || strcmp (dir->attributes, attributes)
+			: attributes != NULL)
+	goto bail;
+
+    if (!FontDirIndexLoadTable (&dir->nonScalable, data, &header,
+				entries + header.numScalable,
+				header.numNonScalable) ||
+	!FontDirIndexLoadTable (&dir->scalable, data, &header,
+				entries, header.numScalable) ||
+	!FontDirIndexLoadScaled (dir, &header, entries,
+				 (FontDirIndexValsPtr) (data + header.vals)))
+	goto bail;
+    dir->dir_mtime = dirMtime;
+    dir->alias_mtime = aliasMtime;
+
+    *pdir = dir;
+    dir = NULL;
+    status = Successful;
+
+bail:
+    if (dir)
+	FontFileFreeDir (dir);
+    if (map)
+	BufFileUnmap (map);
+    else
+	free (data);
+    FontFileClose (file);
+    return status;
+}
+
+typedef struct _FontDirIndexWriter {
+    char	*strings;
+    CARD32	used;
+    CARD32	size;
+} FontDirIndexWriterRec, *FontDirIndexWriterPtr;
+
+static CARD32
+FontDirIndexAddString (FontDirIndexWriterPtr w, const char *s)
+{
+    CARD32	len = strlen (s) + 1;
+    CARD32	offset = w->used;
+    char	*strings;
+
+    if (w->used + len > w->size) {
+	CARD32 size = w->size ? w->size * 2 : 16384;
+
+	while (size < w->used + len)
+	    size *= 2;
+	strings = realloc (w->strings, size);
+	if (!strings)
+	    return (CARD32) -1;
+	w->strings = strings;
+	w->size = size;
+    }
+    memcpy (w->strings + w->used, s, len);
+    w->used += len;
+    return offset;
+}
+
+static Bool
+FontDirIndexStoreVals (FontDirIndexValsPtr v, FontScalablePtr vals,
+		       CARD32 bitmap)
+{
+    if (vals->ranges)
+	return FALSE;
+    memset (v, 0, sizeof (*v));
+    v->vals = *vals;
+    v->vals.xlfdName = NULL;
+    v->vals.nranges = 0;
+    v->bitmap = bitmap;
+    return TRUE;
+}
+
+static Bool
+FontDirIndexStoreTable (FontDirIndexWriterPtr w, FontDirectoryPtr dir,
+			FontTablePtr table, FontDirIndexEntryPtr entries,
+			FontDirIndexValsPtr vals, CARD32 *numVals)
+{
+    FontEntryPtr	    entry;
+    FontScalableExtraPtr    extra;
+    const char		    *string;
+    CARD32		    bitmap;
+    int			    i, s;
+
+    for (i = 0; i < table->used; i++) {
+	entry = &table->entries[i];
+	switch (entry->type) {
+	case FONT_ENTRY_SCALABLE:
+	    string = entry->u.scalable.fileName;
+	    extra = entry->u.scalable.extra;
+	    entries[i].vals = *numVals;
+	    entries[i].numScaled = extra->numScaled;
+	    if (!FontDirIndexStoreVals (&vals[(*numVals)++],
+					&extra->defaults, ~0))
+		return FALSE;
+	    for (s = 0; s < extra->numScaled; s++) {
+		bitmap = extra->scaled[s].bitmap - dir->nonScalable.entries;
+		if (extra->scaled[s].pFont ||
+		    bitmap >= dir->nonScalable.used ||
+		    &dir->nonScalable.entries[bitmap] != extra->scaled[s].bitmap ||
+		    !FontDirIndexStoreVals (&vals[(*numVals)++],
+					    &extra->scaled[s].vals, bitmap))
+		    return FALSE;
+	    }
+	    break;
+	case FONT_ENTRY_BITMAP:
+	    string = entry->u.bitmap.fileName;
+	    break;
+	case FONT_ENTRY_ALIAS:
+	    string = entry->u.alias.resolved;
+	    break;
+	default:
+	    return FALSE;
+	}
+	entries[i].name = FontDirIndexAddString (w, entry->name.name);
+	entries[i].length = entry->name.length;
+	entries[i].ndashes = entry->name.ndashes;
+	entries[i].type = entry->type;
+	entries[i].string = FontDirIndexAddString (w, string);
+	if (entries[i].name == (CARD32) -1 || entries[i].string == (CARD32) -1)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Writes the index for a directory just read from the text files.  The
+ * index is written to a freshly created temporary file renamed into
+ * place, so readers see either the old index or the complete new one,
+ * and nothing already in the directory is written through.  Failing to
+ * write it is not an error; the directory is just read from the text
+ * files again next time.
+ */
+void
+FontFileWriteDirectoryIndex (const char *dir_path, FontDirectoryPtr dir)
+{
+    char		    index_file[MAXFONTFILENAMELEN];
+    char		    temp_file[MAXFONTFILENAMELEN];
+    FontDirIndexWriterRec   w;
+    FontDirIndexHeaderRec   header;
+    FontDirIndexEntryPtr    entries = NULL;
+    FontDirIndexValsPtr	    vals = NULL;
+    CARD32		    numEntries, numVals;
+    int			    i, fd = -1;
+    Bool		    ok = FALSE;
+
+    if (strlen (dir_path) + 1 + sizeof (FontDirIndexFile) + 16 >
+	    sizeof (index_file) ||
+	!dir->scalable.sorted || !dir->nonScalable.sorted)
+	return;
+    strcpy (index_file, dir_path);
+    if (index_file[strlen (index_file) - 1] != '/')
+	strcat (index_file, "/");
+    strcat (index_file, FontDirIndexFile);
+    temp_file[0] = '\0';
+
+    memset (&w, 0, sizeof (w));
+    memset (&header, 0, sizeof (header));
+    header.magic = FONT_DIR_INDEX_MAGIC;
+    header.version = FONT_DIR_INDEX_VERSION;
+    header.scalableSize = sizeof (FontScalableRec);
+    FontDirIndexDefaults (&header.pointSize, &header.xResolution,
+			  &header.yResolution);
+    header.dirMtime = dir->dir_mtime;
+    header.aliasMtime = dir->alias_mtime;
+    header.numScalable = dir->scalable.used;
+    header.numNonScalable = dir->nonScalable.used;
+
+    /* Offset 0 is the empty string, so that 0 can mean none */
+    if (FontDirIndexAddString (&w, "") == (CARD32) -1)
+	goto bail;
+    if (dir->attributes) {
+	header.attributes = FontDirIndexAddString (&w, dir->attributes);
+	if (header.attributes == (CARD32) -1)
+	    goto bail;
+    }
+
+    numEntries = dir->scalable.used + dir->nonScalable.used;
+    numVals = dir->scalable.used;
+    for (i = 0; i < dir->scalable.used; i++)
+	numVals += dir->scalable.entries[i].u.scalable.extra->numScaled;
+    entries = calloc (numEntries ? numEntries : 1, sizeof (*entries));
+    vals = calloc (numVals ? numVals : 1, sizeof (*vals));
+    if (!entries || !vals)
+	goto bail;
+
+    header.numVals = 0;
+    if (!FontDirIndexStoreTable (&w, dir, &dir->scalable, entries,
+				 vals, &header.numVals) ||
+	!FontDirIndexStoreTable (&w, dir, &dir->nonScalable,
+				 entries + dir->scalable.used,
+				 vals, &header.numVals))
+	goto bail;
+
+    header.entries = FontDirIndexAlign (sizeof (header));
+    header.vals = FontDirIndexAlign (header.entries +
+				     numEntries * sizeof (*entries));
+    header.strings = header.vals + numVals * sizeof (*vals);
+    header.size = header.strings + w.used;
+
+    sprintf (temp_file, "%s-XXXXXX", index_file);
+#ifdef WIN32
+    if (_mktemp_s (temp_file, strlen (temp_file) + 1) == 0)
+	fd = open (temp_file, O_WRONLY|O_CREAT|O_EXCL|O_BINARY, 0644);
+#else
+    fd = mkstemp (temp_file);
+#endif
+    if (fd < 0) {
+	temp_file[0] = '\0';
+	goto bail;
+    }
+#ifndef WIN32
+    fchmod (fd, 0644);
+#endif
+    if (write (fd, &header, sizeof (header)) != sizeof (header) ||
+	lseek (fd, header.entries, SEEK_SET) != header.entries ||
+	write (fd, entries, numEntries * sizeof (*entries)) !=
+	    numEntries * sizeof (*entries) ||
+	lseek (fd, header.vals, SEEK_SET) != header.vals ||
+	write (fd, vals, numVals * sizeof (*vals)) !=
+	    numVals * sizeof (*vals) ||
+	write (fd, w.strings, w.used) != w.used)
+	goto bail;
+    if (close (fd) == 0) {
+	fd = -1;
+#ifdef WIN32
+	unlink (index_file);
+#endif
+	ok = rename (temp_file, index_file) == 0;
+    }
+
+bail:
+    if (fd >= 0)
+	close (fd);
+    if (!ok && temp_file[0])
+	unlink (temp_file);
+    free (w.strings);
+    free (entries);
+    free (vals);
+}
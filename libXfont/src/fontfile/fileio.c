@@ -50,7 +50,9 @@ FontFileOpen (const char *name)
     fd = open (name, O_BINARY|O_CLOEXEC);
     if (fd < 0)
 	return 0;
-    raw = BufFileOpenRead (fd);
+    raw = BufFileOpenMapped (fd);
+    if (!raw)
+	raw = BufFileOpenRead (fd);
     if (!raw)
     {
 	close (fd);
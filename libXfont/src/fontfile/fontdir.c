@@ -42,6 +42,8 @@ in this Software without prior written authorization from The Open Group.
 #define INT32_MAX 0x7fffffff
 #endif
 
+static void FontFileFreeXLFDIndex (struct _FontXLFDIndex *index);
+
 Bool
 FontFileInitTable (FontTablePtr table, int size)
 {
@@ -58,6 +60,7 @@ FontFileInitTable (FontTablePtr table, int size)
     table->used = 0;
     table->size = size;
     table->sorted = FALSE;
+    table->xlfd = NULL;
     return TRUE;
 }
 
@@ -101,6 +104,7 @@ FontFileFreeTable (FontTablePtr table)
     for (i = 0; i < table->used; i++)
 	FontFileFreeEntry (&table->entries[i]);
     free (table->entries);
+    FontFileFreeXLFDIndex (table->xlfd);
 }
 
 FontDirectoryPtr
@@ -421,6 +425,322 @@ PatternMatch(char *pat, int patdashes, char *string, int stringdashes)
     }
 }
 
+/*
+ * The XLFD index of a sorted table: for each field of the XLFD names in
+ * the table and each value found in it, the entries with that value, in
+ * table order.  Wildcard searches look up the fields the pattern fixes
+ * and only try PatternMatch() on the entries found in all of them.
+ *
+ * Fields are only fixed in place while no wildcard has been seen:
+ * PatternMatch() lets '*' and '?' match dashes, as long as the name has
+ * more dashes than the pattern.  So in a name with 14 dashes, a field
+ * the pattern spells out is at its own position when there is no
+ * wildcard before it, or counted from the end when there is none after
+ * it, and anywhere in between otherwise.  Names that aren't XLFD names
+ * are always tried.
+ */
+
+#define XLFD_FIELDS		14
+#define XLFD_INDEX_MIN		64	/* entries worth indexing */
+
+typedef struct _FontXLFDKey {
+    char	*value;		/* in an entry name, not terminated */
+    int		length;
+    int		field;
+    int		next;		/* in the hash chain */
+    int		first;		/* in postings */
+    int		count;
+} FontXLFDKeyRec, *FontXLFDKeyPtr;
+
+typedef struct _FontXLFDIndex {
+    int		    *buckets;
+    int		    mask;
+    FontXLFDKeyPtr  keys;
+    int		    numKeys;
+    int		    sizeKeys;
+    int		    *postings;
+    int		    *rest;	/* entries that aren't XLFD names */
+    int		    numRest;
+} FontXLFDIndexRec, *FontXLFDIndexPtr;
+
+static void
+FontFileFreeXLFDIndex (FontXLFDIndexPtr index)
+{
+    if (index) {
+	free (index->buckets);
+	free (index->keys);
+	free (index->postings);
+	free (index->rest);
+	free (index);
+    }
+}
+
+static unsigned int
+FontXLFDHash (int field, const char *value, int length)
+{
+    unsigned int    h = field;
+
+    while (length--)
+	h = h * 31 + (unsigned char) *value++;
+    return h;
+}
+
+static FontXLFDKeyPtr
+FontXLFDLookup (FontXLFDIndexPtr index, int field, char *value, int length,
+		Bool add)
+{
+    unsigned int    h = FontXLFDHash (field, value, length) & index->mask;
+    FontXLFDKeyPtr  key;
+    int		    k;
+
+    for (k = index->buckets[h]; k >= 0; k = key->next) {
+	key = &index->keys[k];
+	if (key->field == field && key->length == length &&
+	    !memcmp (key->value, value, length))
+	    return key;
+    }
+    if (!add)
+	return NULL;
+    if (index->numKeys == index->sizeKeys) {
+	int size = index->sizeKeys * 2;
+
+	key = realloc (index->keys, size * sizeof (FontXLFDKeyRec));
+	if (!key)
+	    return NULL;
+	index->keys = key;
+	index->sizeKeys = size;
+    }
+    key = &index->keys[index->numKeys];
+    key->value = value;
+    key->length = length;
+    key->field = field;
+    key->first = 0;
+    key->count = 0;
+    key->next = index->buckets[h];
+    index->buckets[h] = index->numKeys++;
+    return key;
+}
+
+#define IsXLFDName(name)    ((name)->ndashes == XLFD_FIELDS && \
+			     (name)->name[0] == XK_minus)
+
+/*
+ * Counts the entries of each key in a first pass, and fills in their
+ * postings in a second one, once they are all allocated.
+ */
+static FontXLFDIndexPtr
+FontFileMakeXLFDIndex (FontTablePtr table)
+{
+    FontXLFDIndexPtr	index;
+    FontXLFDKeyPtr	key;
+    FontNamePtr		name;
+    char		*value, *end;
+    int			pass, i, field, k, total;
+
+    index = calloc (1, sizeof (FontXLFDIndexRec));
+    if (!index)
+	return NULL;
+    for (k = 64; k < table->used; k <<= 1)
+	;
+    index->mask = k - 1;
+    index->sizeKeys = k;
+    index->buckets = malloc (k * sizeof (int));
+    index->keys = malloc (k * sizeof (FontXLFDKeyRec));
+    index->rest = malloc (table->used * sizeof (int));
+    if (!index->buckets || !index->keys || !index->rest)
+	goto bail;
+    memset (index->buckets, 0xff, k * sizeof (int));
+
+    for (pass = 0; pass < 2; pass++) {
+	for (i = 0; i < table->used; i++) {
+	    name = &table->entries[i].name;
+	    if (!IsXLFDName (name)) {
+		if (pass)
+		    index->rest[index->numRest++] = i;
+		continue;
+	    }
+	    value = name->name + 1;
+	    for (field = 1; field <= XLFD_FIELDS; field++) {
+		end = strchr (value, XK_minus);
+		if (!end)
+		    end = value + strlen (value);
+		key = FontXLFDLookup (index, field, value, end - value, !pass);
+		if (!key)
+		    goto bail;
+		if (pass)
+		    index->postings[key->first + key->count] = i;
+		key->count++;
+		value = end + 1;
+	    }
+	}
+	if (pass)
+	    break;
+	for (k = 0, total = 0; k < index->numKeys; k++) {
+	    index->keys[k].first = total;
+	    total += index->keys[k].count;
+	    index->keys[k].count = 0;
+	}
+	index->postings = malloc ((total ? total : 1) * sizeof (int));
+	if (!index->postings)
+	    goto bail;
+    }
+    return index;
+
+bail:
+    FontFileFreeXLFDIndex (index);
+    return NULL;
+}
+
+/* Merges two ascending lists, into the first when intersecting */
+static int
+FontXLFDMerge (int *a, int na, int *b, int nb, int *out, Bool intersect)
+{
+    int	    n = 0;
+
+    while (na && nb) {
+	if (*a < *b) {
+	    if (!intersect)
+		out[n++] = *a;
+	    a++, na--;
+	} else if (*a > *b) {
+	    if (!intersect)
+		out[n++] = *b;
+	    b++, nb--;
+	} else {
+	    out[n++] = *a++;
+	    b++;
+	    na--, nb--;
+	}
+    }
+    if (!intersect) {
+	while (na--)
+	    out[n++] = *a++;
+	while (nb--)
+	    out[n++] = *b++;
+    }
+    return n;
+}
+
+/*
+ * The XLFD names in the table with the value of one pattern field
+ * somewhere in fields lo to hi, in *list.
+ */
+static int
+FontXLFDFieldEntries (FontXLFDIndexPtr index, char *value, int length,
+		      int lo, int hi, int **list, int *tmp)
+{
+    FontXLFDKeyPtr  key;
+    int		    *found = NULL, *merged;
+    int		    n = 0, field;
+
+    for (field = lo; field <= hi; field++) {
+	key = FontXLFDLookup (index, field, value, length, FALSE);
+	if (!key)
+	    continue;
+	if (!n) {
+	    found = index->postings + key->first;
+	    n = key->count;
+	    continue;
+	}
+	merged = found == tmp ? tmp + n : tmp;
+	n = FontXLFDMerge (found, n, index->postings + key->first,
+			   key->count, merged, FALSE);
+	if (merged != tmp) {
+	    memcpy (tmp, merged, n * sizeof (int));
+	    merged = tmp;
+	}
+	found = merged;
+    }
+    *list = found;
+    return n;
+}
+
+/*
+ * When the index can narrow it down, returns TRUE with the entries in
+ * [start, stop) which may match pat, in table order, in a list to free.
+ */
+static Bool
+FontFileXLFDCandidates (FontTablePtr table, FontNamePtr pat,
+			int start, int stop, int **candp, int *ncandp)
+{
+    FontXLFDIndexPtr	index;
+    char		*segment[MAXFONTNAMELEN / 2 + 1];
+    int			length[MAXFONTNAMELEN / 2 + 1];
+    Bool		wild[MAXFONTNAMELEN / 2 + 1];
+    int			*cand, *list, *tmp = NULL, *scratch;
+    int			ncand = -1, n, i, s, lo, hi, P;
+    Bool		before, after;
+    char		*p;
+
+    P = pat->ndashes;
+    if (!table->sorted || stop - start < XLFD_INDEX_MIN ||
+	P > MAXFONTNAMELEN / 2)
+	return FALSE;
+    if (!table->xlfd && !(table->xlfd = FontFileMakeXLFDIndex (table)))
+	return FALSE;
+    index = table->xlfd;
+
+    for (s = 0, p = pat->name; s <= P; s++) {
+	segment[s] = p;
+	wild[s] = FALSE;
+	for (; *p && *p != XK_minus; p++)
+	    if (isWild (*p))
+		wild[s] = TRUE;
+	length[s] = p - segment[s];
+	p++;
+    }
+
+    /* Room for the merges of FontXLFDFieldEntries and the results */
+    cand = malloc ((2 * table->used + 2 * (stop - start) + 1) * sizeof (int));
+    if (!cand)
+	return FALSE;
+    tmp = cand + (stop - start);
+    scratch = tmp + 2 * table->used;
+
+    /* Intersect the entries for each field the pattern spells out */
+    if (P > XLFD_FIELDS || (!wild[0] && length[0]))
+	ncand = 0;
+    for (s = 1; s <= P && ncand; s++) {
+	if (wild[s])
+	    continue;
+	for (i = 0, before = FALSE; i < s; i++)
+	    before |= wild[i];
+	for (i = s + 1, after = FALSE; i <= P; i++)
+	    after |= wild[i];
+	if (!before)
+	    lo = hi = s;
+	else if (!after)
+	    lo = hi = XLFD_FIELDS - P + s;
+	else {
+	    lo = s;
+	    hi = XLFD_FIELDS - P + s;
+	}
+	n = FontXLFDFieldEntries (index, segment[s], length[s], lo, hi,
+				  &list, tmp);
+	if (ncand < 0) {
+	    /* Only those in range are of interest */
+	    for (i = 0, ncand = 0; i < n; i++)
+		if (list[i] >= start && list[i] < stop)
+		    scratch[ncand++] = list[i];
+	} else
+	    ncand = FontXLFDMerge (scratch, ncand, list, n, scratch, TRUE);
+    }
+    if (ncand < 0) {
+	/* Nothing spelled out, nothing to look up */
+	free (cand);
+	return FALSE;
+    }
+
+    /* And add those that aren't XLFD names */
+    for (i = 0, n = 0; i < index->numRest; i++)
+	if (index->rest[i] >= start && index->rest[i] < stop &&
+	    table->entries[index->rest[i]].name.ndashes >= P)
+	    tmp[n++] = index->rest[i];
+    *ncandp = FontXLFDMerge (scratch, ncand, tmp, n, cand, FALSE);
+    *candp = cand;
+    return TRUE;
+}
+
 int
 FontFileCountDashes (char *name, int namelen)
 {
@@ -445,17 +765,22 @@ FontFileFindNameInScalableDir(FontTablePtr table, FontNamePtr pat,
 			      FontScalablePtr vals)
 {
     int         i,
+		k,
                 start,
                 stop,
                 res,
                 private;
+    int		*cand = NULL;
     FontNamePtr	name;
 
     if (!table->entries)
 	return NULL;
     if ((i = SetupWildMatch(table, pat, &start, &stop, &private)) >= 0)
 	return &table->entries[i];
-    for (i = start; i < stop; i++) {
+    if (FontFileXLFDCandidates(table, pat, start, stop, &cand, &stop))
+	start = 0;
+    for (k = start; k < stop; k++) {
+	i = cand ? cand[k] : k;
 	name = &table->entries[i].name;
 	res = PatternMatch(pat->name, private, name->name, name->ndashes);
 	if (res > 0)
@@ -479,11 +804,13 @@ FontFileFindNameInScalableDir(FontTablePtr table, FontNamePtr pat,
 		     !(cap & CAP_CHARSUBSETTING)))
 		    continue;
 	    }
+	    free(cand);
 	    return &table->entries[i];
 	}
 	if (res < 0)
 	    break;
     }
+    free(cand);
     return (FontEntryPtr)0;
 }
 
@@ -499,11 +826,13 @@ FontFileFindNamesInScalableDir(FontTablePtr table, FontNamePtr pat, int max,
 			       int alias_behavior, int *newmax)
 {
     int		    i,
+		    k,
 		    start,
 		    stop,
 		    res,
 		    private;
     int		    ret = Successful;
+    int		    *cand = NULL;
     FontEntryPtr    fname;
     FontNamePtr	    name;
 
@@ -519,8 +848,10 @@ FontFileFindNamesInScalableDir(FontTablePtr table, FontNamePtr pat, int max,
 	}
 	start = i;
 	stop = i + 1;
-    }
-    for (i = start, fname = &table->entries[start]; i < stop; i++, fname++) {
+    } else if (FontFileXLFDCandidates(table, pat, start, stop, &cand, &stop))
+	start = 0;
+    for (k = start; k < stop; k++) {
+	fname = &table->entries[cand ? cand[k] : k];
 	res = PatternMatch(pat->name, private, fname->name.name, fname->name.ndashes);
 	if (res > 0) {
 	    if (vals)
@@ -576,6 +907,7 @@ FontFileFindNamesInScalableDir(FontTablePtr table, FontNamePtr pat, int max,
 	    break;
     }
   bail: ;
+    free(cand);
     if (newmax) *newmax = max;
     return ret;
 }
@@ -600,6 +932,7 @@ FontFileMatchName(char *name, int length, FontNamePtr pat)
     table.used = 1;
     table.size = 1;
     table.sorted = TRUE;
+    table.xlfd = NULL;
     table.entries = entries;
     entries[0].name.name = name;
     entries[0].name.length = length;
@@ -317,6 +317,23 @@ xcb_generic_event_t *xcb_poll_for_event(xcb_connection_t *c);
  */
 xcb_generic_event_t *xcb_poll_for_queued_event(xcb_connection_t *c);
 
+/**
+ * @brief Returns the next events without blocking.
+ * @param c: The connection to the X server.
+ * @param events: Where to store the events.
+ * @param max: How many events @p events has room for.
+ * @return The number of events stored, 0 if none are available.
+ *
+ * Like xcb_poll_for_event, but stores up to @p max queued events in
+ * @p events at once, reading from the connection first if none are
+ * queued. The events belong to the connection: they must not be freed,
+ * and stay valid until the next call to xcb_poll_for_events_batch or
+ * xcb_disconnect. Events of 32 bytes come out of a slab kept by the
+ * connection, so an event flood read this way costs no allocation
+ * per event.
+ */
+int xcb_poll_for_events_batch(xcb_connection_t *c, xcb_generic_event_t **events, int max);
+
 typedef struct xcb_special_event xcb_special_event_t;
 
 /**
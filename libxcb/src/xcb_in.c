@@ -61,6 +61,23 @@ struct event_list {
     struct event_list *next;
 };
 
+/* Events that fit in an xcb_generic_event_t are read into cells, taken
+ * from slabs of them.  Longer ones are malloced with their event_list
+ * after them, so freeing the event frees both. */
+struct event_cell {
+    struct event_list list;
+    xcb_generic_event_t event;
+};
+
+#define XCB_EVENT_SLAB_CELLS 64
+
+struct event_slab {
+    struct event_slab *next;
+    struct event_cell cells[XCB_EVENT_SLAB_CELLS];
+};
+
+#define EVENT_LIST_OFFSET(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
 struct xcb_special_event {
 
     struct xcb_special_event *next;
@@ -162,6 +179,81 @@ static int event_special(xcb_connection_t *c,
     return 0;
 }
 
+static int is_cell(struct event_list *event)
+{
+    return event->event == &((struct event_cell *) event)->event;
+}
+
+static struct event_list *alloc_event(_xcb_in *in, size_t size)
+{
+    struct event_list *event;
+    if(size <= sizeof(xcb_generic_event_t))
+    {
+        if(!in->free_cells)
+        {
+            struct event_slab *slab = malloc(sizeof(struct event_slab));
+            int i;
+            if(!slab)
+                return 0;
+            slab->next = in->slabs;
+            in->slabs = slab;
+            for(i = 0; i < XCB_EVENT_SLAB_CELLS; ++i)
+            {
+                slab->cells[i].list.next = in->free_cells;
+                in->free_cells = &slab->cells[i].list;
+            }
+        }
+        event = in->free_cells;
+        in->free_cells = event->next;
+        event->event = &((struct event_cell *) event)->event;
+    }
+    else
+    {
+        char *buf = malloc(EVENT_LIST_OFFSET(size) + sizeof(struct event_list));
+        if(!buf)
+            return 0;
+        event = (struct event_list *) (buf + EVENT_LIST_OFFSET(size));
+        event->event = (xcb_generic_event_t *) buf;
+    }
+    event->next = 0;
+    return event;
+}
+
+static void free_event(_xcb_in *in, struct event_list *event)
+{
+    if(is_cell(event))
+    {
+        event->next = in->free_cells;
+        in->free_cells = event;
+    }
+    else
+        free(event->event);
+}
+
+/* Hands an event taken off its queue to the application, which frees it */
+static xcb_generic_event_t *return_event(xcb_connection_t *c, struct event_list *event)
+{
+    xcb_generic_event_t *ret = event->event;
+    if(is_cell(event))
+    {
+        ret = malloc(sizeof(xcb_generic_event_t));
+        if(ret)
+            *ret = *event->event;
+        else
+            _xcb_conn_shutdown(c, XCB_CONN_CLOSED_MEM_INSUFFICIENT);
+        free_event(&c->in, event);
+    }
+    return ret;
+}
+
+static void free_packet(xcb_connection_t *c, struct event_list *event, void *buf)
+{
+    if(event)
+        free_event(&c->in, event);
+    else
+        free(buf);
+}
+
 static int read_packet(xcb_connection_t *c)
 {
     xcb_generic_reply_t genrep;
@@ -171,14 +263,15 @@ static int read_packet(xcb_connection_t *c)
     uint64_t bufsize;
     void *buf;
     pending_reply *pend = 0;
-    struct event_list *event;
+    struct event_list *event = 0;
+    int is_reply;
 
     /* Wait for there to be enough data for us to read a whole packet */
     if(c->in.queue_len < length)
         return 0;
 
     /* Get the response type, length, and sequence number. */
-    memcpy(&genrep, c->in.queue, sizeof(genrep));
+    memcpy(&genrep, c->in.queue + c->in.queue_start, sizeof(genrep));
 
     /* Compute 32-bit sequence number of this packet. */
     if((genrep.response_type & 0x7f) != XCB_KEYMAP_NOTIFY)
@@ -233,7 +326,7 @@ static int read_packet(xcb_connection_t *c)
     {
         if(pend && pend->workaround == WORKAROUND_GLX_GET_FB_CONFIGS_BUG)
         {
-            uint32_t *p = (uint32_t *) c->in.queue;
+            uint32_t *p = (uint32_t *) (c->in.queue + c->in.queue_start);
             genrep.length = p[2] * p[3] * 2;
         }
         length += genrep.length * 4;
@@ -248,12 +341,21 @@ static int read_packet(xcb_connection_t *c)
     if ((genrep.response_type & 0x7f) == XCB_XGE_EVENT)
         eventlength = genrep.length * 4;
 
+    /* Replies and checked errors are handed to whoever waits for them;
+     * everything else goes on an event queue. */
+    is_reply = genrep.response_type == XCB_REPLY ||
+        (genrep.response_type == XCB_ERROR && pend && (pend->flags & XCB_REQUEST_CHECKED));
+
     bufsize = length + eventlength + nfd * sizeof(int)  +
         (genrep.response_type == XCB_REPLY ? 0 : sizeof(uint32_t));
+    buf = NULL;
     if (bufsize < INT32_MAX)
-        buf = malloc((size_t) bufsize);
-    else
-        buf = NULL;
+    {
+        if (is_reply)
+            buf = malloc((size_t) bufsize);
+        else if ((event = alloc_event(&c->in, (size_t) bufsize)))
+            buf = event->event;
+    }
     if(!buf)
     {
         _xcb_conn_shutdown(c, XCB_CONN_CLOSED_MEM_INSUFFICIENT);
@@ -262,7 +364,7 @@ static int read_packet(xcb_connection_t *c)
 
     if(_xcb_in_read_block(c, buf, length) <= 0)
     {
-        free(buf);
+        free_packet(c, event, buf);
         return 0;
     }
 
@@ -271,7 +373,7 @@ static int read_packet(xcb_connection_t *c)
     {
         if(_xcb_in_read_block(c, &((xcb_generic_event_t*)buf)[1], eventlength) <= 0)
         {
-            free(buf);
+            free_packet(c, event, buf);
             return 0;
         }
     }
@@ -281,7 +383,7 @@ static int read_packet(xcb_connection_t *c)
     {
         if (!read_fds(c, (int *) &((char *) buf)[length], nfd))
         {
-            free(buf);
+            free_packet(c, event, buf);
             return 0;
         }
     }
@@ -289,7 +391,7 @@ static int read_packet(xcb_connection_t *c)
 
     if(pend && (pend->flags & XCB_REQUEST_DISCARD_REPLY))
     {
-        free(buf);
+        free_packet(c, event, buf);
         return 1;
     }
 
@@ -297,8 +399,7 @@ static int read_packet(xcb_connection_t *c)
         ((xcb_generic_event_t *) buf)->full_sequence = c->in.request_read;
 
     /* reply, or checked error */
-    if( genrep.response_type == XCB_REPLY ||
-       (genrep.response_type == XCB_ERROR && pend && (pend->flags & XCB_REQUEST_CHECKED)))
+    if(is_reply)
     {
         struct reply_list *cur = malloc(sizeof(struct reply_list));
         if(!cur)
@@ -317,16 +418,6 @@ static int read_packet(xcb_connection_t *c)
     }
 
     /* event, or unchecked error */
-    event = malloc(sizeof(struct event_list));
-    if(!event)
-    {
-        _xcb_conn_shutdown(c, XCB_CONN_CLOSED_MEM_INSUFFICIENT);
-        free(buf);
-        return 0;
-    }
-    event->event = buf;
-    event->next = 0;
-
     if (!event_special(c, event)) {
         *c->in.events_tail = event;
         c->in.events_tail = &event->next;
@@ -338,15 +429,12 @@ static int read_packet(xcb_connection_t *c)
 static xcb_generic_event_t *get_event(xcb_connection_t *c)
 {
     struct event_list *cur = c->in.events;
-    xcb_generic_event_t *ret;
     if(!c->in.events)
         return 0;
-    ret = cur->event;
     c->in.events = cur->next;
     if(!cur->next)
         c->in.events_tail = &c->in.events;
-    free(cur);
-    return ret;
+    return return_event(c, cur);
 }
 
 static void free_reply_list(struct reply_list *head)
@@ -653,6 +741,33 @@ xcb_generic_event_t *xcb_poll_for_queued_event(xcb_connection_t *c)
     return poll_for_next_event(c, 1);
 }
 
+int xcb_poll_for_events_batch(xcb_connection_t *c, xcb_generic_event_t **events, int max)
+{
+    struct event_list *cur, **prev;
+    int n = 0;
+    if(c->has_error)
+        return 0;
+    pthread_mutex_lock(&c->iolock);
+    while((cur = c->in.batch))
+    {
+        c->in.batch = cur->next;
+        free_event(&c->in, cur);
+    }
+    if(!c->in.events && c->in.reading == 0)
+        _xcb_in_read(c); /* _xcb_in_read shuts down the connection on error */
+
+    /* The events handed out stay on the batch list until the next call */
+    c->in.batch = c->in.events;
+    for(prev = &c->in.batch; n < max && *prev; prev = &(*prev)->next)
+        events[n++] = (*prev)->event;
+    c->in.events = *prev;
+    *prev = 0;
+    if(!c->in.events)
+        c->in.events_tail = &c->in.events;
+    pthread_mutex_unlock(&c->iolock);
+    return n;
+}
+
 xcb_generic_error_t *xcb_request_check(xcb_connection_t *c, xcb_void_cookie_t cookie)
 {
     uint64_t request;
@@ -681,10 +796,9 @@ static xcb_generic_event_t *get_special_event(xcb_connection_t *c,
     struct event_list *events;
 
     if ((events = se->events) != NULL) {
-        event = events->event;
         if (!(se->events = events->next))
             se->events_tail = &se->events;
-        free (events);
+        event = return_event(c, events);
     }
     return event;
 }
@@ -783,8 +897,7 @@ xcb_unregister_for_special_event(xcb_connection_t *c,
             *prev = se->next;
             for (events = se->events; events; events = next) {
                 next = events->next;
-                free (events->event);
-                free (events);
+                free_event(&c->in, events);
             }
             pthread_cond_destroy(&se->special_event_cond);
             free (se);
@@ -802,6 +915,7 @@ int _xcb_in_init(_xcb_in *in)
         return 0;
     in->reading = 0;
 
+    in->queue_start = 0;
     in->queue_len = 0;
 
     in->request_read = 0;
@@ -827,8 +941,19 @@ void _xcb_in_destroy(_xcb_in *in)
     {
         struct event_list *e = in->events;
         in->events = e->next;
-        free(e->event);
-        free(e);
+        free_event(in, e);
+    }
+    while(in->batch)
+    {
+        struct event_list *e = in->batch;
+        in->batch = e->next;
+        free_event(in, e);
+    }
+    while(in->slabs)
+    {
+        struct event_slab *slab = in->slabs;
+        in->slabs = slab->next;
+        free(slab);
     }
     while(in->pending_replies)
     {
@@ -933,6 +1058,12 @@ int _xcb_in_read(xcb_connection_t *c)
     }
     while(read_packet(c))
         /* empty */;
+    /* Move what's left of a packet to the front, once per read */
+    if(c->in.queue_start)
+    {
+        memmove(c->in.queue, c->in.queue + c->in.queue_start, c->in.queue_len);
+        c->in.queue_start = 0;
+    }
 #if HAVE_SENDMSG
     if (c->in.in_fd.nfd) {
         c->in.in_fd.nfd -= c->in.in_fd.ifd;
@@ -970,9 +1101,11 @@ int _xcb_in_read_block(xcb_connection_t *c, void *buf, int len)
     if(len < done)
         done = len;
 
-    memcpy(buf, c->in.queue, done);
+    memcpy(buf, c->in.queue + c->in.queue_start, done);
+    c->in.queue_start += done;
     c->in.queue_len -= done;
-    memmove(c->in.queue, c->in.queue + done, c->in.queue_len);
+    if(!c->in.queue_len)
+        c->in.queue_start = 0;
 
     if(len > done)
     {
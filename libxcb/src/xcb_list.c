@@ -23,7 +23,13 @@
  * authorization from the authors.
  */
 
-/* A generic implementation of a list of void-pointers. */
+/* A map from sequence numbers to void-pointers.
+ *
+ * Keys are put in (almost always) increasing order, so live entries sit in
+ * a ring indexed by key, covering the keys first .. end - 1.  The ring
+ * grows to cover as many keys as are pipelined; keys left behind far below
+ * the others (replies nobody collected) move out of it to a plain list
+ * instead of stretching the ring over the whole gap. */
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -34,6 +40,17 @@
 #include "xcb.h"
 #include "xcbint.h"
 
+#define XCB_MAP_MIN_SIZE 16
+/* Sparser than this, old entries are moved out of the ring */
+#define XCB_MAP_SPARSE 4
+/* Once empty, rings bigger than this are given back */
+#define XCB_MAP_KEEP_SIZE 1024
+
+typedef struct slot {
+    unsigned int key;
+    void *data;
+} slot;
+
 typedef struct node {
     struct node *next;
     unsigned int key;
@@ -41,10 +58,78 @@ typedef struct node {
 } node;
 
 struct _xcb_map {
+    slot *slots;
+    unsigned int size;
+    unsigned int first;
+    unsigned int end;
+    unsigned int count;
     node *head;
-    node **tail;
 };
 
+static slot *map_slot(_xcb_map *list, unsigned int key)
+{
+    return &list->slots[key & (list->size - 1)];
+}
+
+static int map_in_ring(_xcb_map *list, unsigned int key)
+{
+    return key - list->first < list->end - list->first;
+}
+
+static int map_resize(_xcb_map *list, unsigned int span)
+{
+    slot *slots;
+    unsigned int size = XCB_MAP_MIN_SIZE, key;
+
+    while(size < span)
+        size <<= 1;
+    if(size == list->size)
+        return 1;
+    slots = calloc(size, sizeof(slot));
+    if(!slots)
+        return 0;
+    for(key = list->first; key != list->end; ++key)
+        if(list->slots[key & (list->size - 1)].data)
+            slots[key & (size - 1)] = list->slots[key & (list->size - 1)];
+    free(list->slots);
+    list->slots = slots;
+    list->size = size;
+    return 1;
+}
+
+static int list_put(_xcb_map *list, unsigned int key, void *data)
+{
+    node *cur = malloc(sizeof(node));
+    if(!cur)
+        return 0;
+    cur->key = key;
+    cur->data = data;
+    cur->next = list->head;
+    list->head = cur;
+    return 1;
+}
+
+/* Moves the entries below key out of the ring */
+static int map_spill(_xcb_map *list, unsigned int key)
+{
+    while(list->first != key && list->first != list->end)
+    {
+        slot *s = map_slot(list, list->first);
+        if(s->data)
+        {
+            if(!list_put(list, s->key, s->data))
+                return 0;
+            s->data = 0;
+            --list->count;
+        }
+        ++list->first;
+    }
+    list->first = key;
+    if(!list->count)
+        list->end = key;
+    return 1;
+}
+
 /* Private interface */
 
 _xcb_map *_xcb_map_new(void)
@@ -53,15 +138,26 @@ _xcb_map *_xcb_map_new(void)
     list = malloc(sizeof(_xcb_map));
     if(!list)
         return 0;
+    list->slots = 0;
+    list->size = 0;
+    list->first = list->end = 0;
+    list->count = 0;
     list->head = 0;
-    list->tail = &list->head;
     return list;
 }
 
 void _xcb_map_delete(_xcb_map *list, xcb_list_free_func_t do_free)
 {
+    unsigned int key;
     if(!list)
         return;
+    for(key = list->first; list->count && key != list->end; ++key)
+    {
+        slot *s = map_slot(list, key);
+        if(s->data && do_free)
+            do_free(s->data);
+    }
+    free(list->slots);
     while(list->head)
     {
         node *cur = list->head;
@@ -75,29 +171,83 @@ void _xcb_map_delete(_xcb_map *list, xcb_list_free_func_t do_free)
 
 int _xcb_map_put(_xcb_map *list, unsigned int key, void *data)
 {
-    node *cur = malloc(sizeof(node));
-    if(!cur)
-        return 0;
-    cur->key = key;
-    cur->data = data;
-    cur->next = 0;
-    *list->tail = cur;
-    list->tail = &cur->next;
+    /* At most this many keys for the entries we have, or it's sparse */
+    unsigned int limit = XCB_MAP_SPARSE * (list->count + 1);
+    slot *s;
+
+    if(!list->count)
+        list->first = list->end = key;
+
+    if(map_in_ring(list, key))
+        ;
+    /* Above the ring: the usual case */
+    else if(key - list->end < 0x80000000)
+    {
+        if(key + 1 - list->first > list->size)
+        {
+            if(key + 1 - list->first > limit &&
+               !map_spill(list, key + 1 - limit))
+                return 0;
+            if(!map_resize(list, key + 1 - list->first))
+                return 0;
+        }
+        list->end = key + 1;
+    }
+    /* Below it, far enough to make it sparse: keep it aside */
+    else if(list->end - key > limit)
+        return list_put(list, key, data);
+    else
+    {
+        if(list->end - key > list->size &&
+           !map_resize(list, list->end - key))
+            return 0;
+        list->first = key;
+    }
+
+    s = map_slot(list, key);
+    s->key = key;
+    s->data = data;
+    ++list->count;
     return 1;
 }
 
 void *_xcb_map_remove(_xcb_map *list, unsigned int key)
 {
     node **cur;
+    if(list->count && map_in_ring(list, key))
+    {
+        slot *s = map_slot(list, key);
+        void *ret = s->data;
+        if(ret)
+        {
+            s->data = 0;
+            if(!--list->count)
+            {
+                list->first = list->end;
+                if(list->size > XCB_MAP_KEEP_SIZE)
+                {
+                    free(list->slots);
+                    list->slots = 0;
+                    list->size = 0;
+                }
+            }
+            else
+            {
+                while(!map_slot(list, list->first)->data)
+                    ++list->first;
+                while(!map_slot(list, list->end - 1)->data)
+                    --list->end;
+            }
+            return ret;
+        }
+    }
+    /* Keys kept aside may have come back within the ring's range since */
     for(cur = &list->head; *cur; cur = &(*cur)->next)
         if((*cur)->key == key)
         {
             node *tmp = *cur;
             void *ret = (*cur)->data;
             *cur = (*cur)->next;
-            if(!*cur)
-                list->tail = cur;
-
             free(tmp);
             return ret;
         }
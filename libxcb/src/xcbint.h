@@ -129,7 +129,8 @@ typedef struct _xcb_in {
     pthread_cond_t event_cond;
     int reading;
 
-    char queue[4096];
+    char queue[XCB_QUEUE_BUFFER_SIZE];
+    int queue_start;
     int queue_len;
 
     uint64_t request_expected;
@@ -149,6 +150,12 @@ typedef struct _xcb_in {
     _xcb_fd in_fd;
 #endif
     struct xcb_special_event *special_events;
+
+    /* 32-byte events are kept in slabs of cells, not malloced one by one */
+    struct event_list *free_cells;
+    struct event_slab *slabs;
+    /* returned by the last xcb_poll_for_events_batch, freed by the next */
+    struct event_list *batch;
 } _xcb_in;
 
 int _xcb_in_init(_xcb_in *in);
@@ -0,0 +1,195 @@
+/*
+ * Floods the connection with events from a stand-in server on the other
+ * end of a socket pair, a few of them long GenericEvents, and reads them
+ * one by one with xcb_wait_for_event and many at once with
+ * xcb_poll_for_events_batch, checking every event and printing how long
+ * each way took.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "xcb.h"
+
+#define EVENTS 1000000
+#define BATCH 256
+/* Every this many events, one is a GenericEvent with data after it */
+#define LONG_EVERY 97
+#define LONG_WORDS 6
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while(len)
+	{
+		ssize_t n = write(fd, p, len);
+		if(n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	while(len)
+	{
+		ssize_t n = read(fd, p, len);
+		if(n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+typedef struct server_t {
+	int fd;
+	int events;
+} server_t;
+
+/* Events are 32 bytes on the wire, the long ones more */
+typedef union event_t {
+	xcb_motion_notify_event_t motion;
+	xcb_ge_event_t ge;
+	uint32_t words[8 + LONG_WORDS];
+} event_t;
+
+/* A setup with no screens, then the events and nothing else: the
+ * n-th has n as its time, or in the first word after the header */
+static void *server(void *closure)
+{
+	server_t *s = closure;
+	static char out[65536];
+	char setup_request[12];
+	xcb_setup_t setup;
+	int len = 0, i;
+
+	if(!read_all(s->fd, setup_request, sizeof(setup_request)))
+		return 0;
+	memset(&setup, 0, sizeof(setup));
+	setup.status = 1;
+	setup.protocol_major_version = 11;
+	setup.length = (sizeof(setup) - 8) / 4;
+	setup.resource_id_base = 0x200000;
+	setup.resource_id_mask = 0x1fffff;
+	setup.maximum_request_length = 0xffff;
+	setup.min_keycode = 8;
+	setup.max_keycode = 255;
+	if(!write_all(s->fd, &setup, sizeof(setup)))
+		return 0;
+
+	for(i = 0; i < s->events; ++i)
+	{
+		event_t event;
+		int size = 32;
+		memset(&event, 0, sizeof(event));
+		if(i % LONG_EVERY == LONG_EVERY - 1)
+		{
+			event.ge.response_type = XCB_GE_GENERIC;
+			event.ge.length = LONG_WORDS;
+			event.words[8] = i;
+			size += LONG_WORDS * 4;
+		}
+		else
+		{
+			event.motion.response_type = XCB_MOTION_NOTIFY;
+			event.motion.time = i;
+		}
+		if(len + size > sizeof(out))
+		{
+			if(!write_all(s->fd, out, len))
+				return 0;
+			len = 0;
+		}
+		memcpy(out + len, &event, size);
+		len += size;
+	}
+	write_all(s->fd, out, len);
+	return 0;
+}
+
+/* The n-th event or not; long events have their data after full_sequence */
+static int check(xcb_generic_event_t *event, int n)
+{
+	if(n % LONG_EVERY == LONG_EVERY - 1)
+		return event->response_type == XCB_GE_GENERIC &&
+			((xcb_ge_event_t *) event)->length == LONG_WORDS &&
+			*(uint32_t *) &event[1] == n;
+	return event->response_type == XCB_MOTION_NOTIFY &&
+		((xcb_motion_notify_event_t *) event)->time == n;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int run(int batch, int n)
+{
+	xcb_generic_event_t *events[BATCH];
+	xcb_connection_t *c;
+	pthread_t thread;
+	server_t s;
+	double start;
+	int fds[2], i = 0, bad = 0, got, j;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+		return 0;
+	s.fd = fds[1];
+	s.events = n;
+	if(pthread_create(&thread, 0, server, &s))
+		return 0;
+	c = xcb_connect_to_fd(fds[0], 0);
+	if(xcb_connection_has_error(c))
+		return 0;
+
+	start = now();
+	while(i < n && !xcb_connection_has_error(c))
+	{
+		if(batch)
+		{
+			struct pollfd pfd = { xcb_get_file_descriptor(c), POLLIN, 0 };
+			got = xcb_poll_for_events_batch(c, events, BATCH);
+			if(!got)
+				poll(&pfd, 1, -1);
+			for(j = 0; j < got; ++j)
+				bad += !check(events[j], i++);
+		}
+		else
+		{
+			xcb_generic_event_t *event = xcb_wait_for_event(c);
+			if(!event)
+				break;
+			bad += !check(event, i++);
+			free(event);
+		}
+	}
+	printf("  %-28s %8d events %10.1f ms%s\n",
+	       batch ? "xcb_poll_for_events_batch" : "xcb_wait_for_event", i,
+	       (now() - start) * 1000, bad || i != n ? "  BAD EVENTS" : "");
+
+	xcb_disconnect(c);
+	pthread_join(thread, 0);
+	close(fds[1]);
+	return !bad && i == n;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : EVENTS;
+	int ok = 1;
+
+	ok = run(0, n) && ok;
+	ok = run(1, n) && ok;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
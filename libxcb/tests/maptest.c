@@ -0,0 +1,113 @@
+/*
+ * Exercises the sequence number map behind the reply queue: keys in
+ * order, out of order, far apart, and keys that were kept aside below
+ * the ring while it was sparse and are looked up again once the ring
+ * has come back over them.  Exits non-zero on the first wrong answer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The map is private to libxcb, build it in */
+#include "xcb_list.c"
+
+static int failed;
+
+/* Never NULL for the keys used here */
+#define KEY(k) ((void *) (size_t) ((k) ^ 0x80000000u))
+
+static void check_put(_xcb_map *map, unsigned int key)
+{
+	if(!_xcb_map_put(map, key, KEY(key)))
+	{
+		fprintf(stderr, "put(%u) failed\n", key);
+		failed = 1;
+	}
+}
+
+static void check_remove(_xcb_map *map, unsigned int key, int present)
+{
+	void *data = _xcb_map_remove(map, key);
+	if(data != (present ? KEY(key) : 0))
+	{
+		fprintf(stderr, "remove(%u) returned %p, expected %p\n",
+			key, data, present ? KEY(key) : 0);
+		failed = 1;
+	}
+}
+
+/* A key left far behind goes to the list; once it's gone the ring can
+ * reach back over the keys still on the list */
+static void test_spilled(void)
+{
+	_xcb_map *map = _xcb_map_new();
+	unsigned int key;
+
+	check_put(map, 100);
+	check_put(map, 101);
+	for(key = 200; key < 260; ++key)
+		check_put(map, key);
+	check_remove(map, 100, 1);
+	check_put(map, 100);
+	check_remove(map, 101, 1);
+	check_remove(map, 100, 1);
+	for(key = 200; key < 260; ++key)
+		check_remove(map, key, 1);
+	check_remove(map, 101, 0);
+	_xcb_map_delete(map, 0);
+}
+
+/* Everything that goes in comes out once, in any order */
+static void test_orders(void)
+{
+	_xcb_map *map = _xcb_map_new();
+	unsigned int key;
+
+	for(key = 0; key < 5000; ++key)
+		check_put(map, key);
+	for(key = 5000; key-- > 0; )
+		if(key % 3 == 0)
+			check_remove(map, key, 1);
+	for(key = 0; key < 5000; ++key)
+		check_remove(map, key, key % 3 != 0);
+	check_remove(map, 17, 0);
+
+	/* wrapping around the top of the sequence space */
+	for(key = 0xfffffff0; key != 0x10; ++key)
+		check_put(map, key);
+	for(key = 0xfffffff0; key != 0x10; key += 2)
+		check_remove(map, key, 1);
+	for(key = 0xfffffff1; key != 0x11; key += 2)
+		check_remove(map, key, 1);
+	_xcb_map_delete(map, 0);
+}
+
+/* Stragglers far below the pipelined keys, removed last */
+static void test_stragglers(void)
+{
+	_xcb_map *map = _xcb_map_new();
+	unsigned int key;
+
+	for(key = 0; key < 100000; key += 1000)
+		check_put(map, key);
+	for(key = 100000; key < 110000; ++key)
+	{
+		check_put(map, key);
+		if(key >= 100010)
+			check_remove(map, key - 10, 1);
+	}
+	for(key = 109990; key < 110000; ++key)
+		check_remove(map, key, 1);
+	for(key = 0; key < 100000; key += 1000)
+		check_remove(map, key, 1);
+	check_remove(map, 0, 0);
+	_xcb_map_delete(map, 0);
+}
+
+int main(void)
+{
+	test_spilled();
+	test_orders();
+	test_stragglers();
+	return failed;
+}
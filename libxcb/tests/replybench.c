@@ -0,0 +1,192 @@
+/*
+ * Pipelines many GetInputFocus requests to a stand-in server on the other
+ * end of a socket pair, then collects the replies in a few different
+ * orders, checking each one and printing how long every order took.
+ * With replies kept by sequence number this should not depend on the
+ * order much; kept in a list, collecting them backwards was quadratic.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "xcb.h"
+
+#define REQUESTS 100000
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while(len)
+	{
+		ssize_t n = write(fd, p, len);
+		if(n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	while(len)
+	{
+		ssize_t n = read(fd, p, len);
+		if(n <= 0)
+			return 0;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/* Replies are at least 32 bytes on the wire */
+typedef union reply_t {
+	xcb_get_input_focus_reply_t focus;
+	uint8_t pad[32];
+} reply_t;
+
+/* Just enough of a server: a setup with no screens, and a reply to every
+ * GetInputFocus with the request's sequence number as the focus window */
+static void *server(void *closure)
+{
+	int fd = *(int *) closure;
+	static char in[65536];
+	static reply_t out[1024];
+	uint32_t sequence = 0;
+	int len = 0, nout = 0, n, i;
+	char setup_request[12];
+	xcb_setup_t setup;
+
+	if(!read_all(fd, setup_request, sizeof(setup_request)))
+		return 0;
+	memset(&setup, 0, sizeof(setup));
+	setup.status = 1;
+	setup.protocol_major_version = 11;
+	setup.length = (sizeof(setup) - 8) / 4;
+	setup.resource_id_base = 0x200000;
+	setup.resource_id_mask = 0x1fffff;
+	setup.maximum_request_length = 0xffff;
+	setup.min_keycode = 8;
+	setup.max_keycode = 255;
+	if(!write_all(fd, &setup, sizeof(setup)))
+		return 0;
+
+	while((n = read(fd, in + len, sizeof(in) - len)) > 0)
+	{
+		len += n;
+		for(i = 0; i + 4 <= len; )
+		{
+			int reqlen = ((uint16_t *) (in + i))[1] * 4;
+			if(i + reqlen > len)
+				break;
+			++sequence;
+			if(in[i] == XCB_GET_INPUT_FOCUS)
+			{
+				xcb_get_input_focus_reply_t *rep = &out[nout++].focus;
+				memset(rep, 0, sizeof(reply_t));
+				rep->response_type = 1; /* reply */
+				rep->sequence = sequence;
+				rep->focus = sequence;
+				if(nout == sizeof(out) / sizeof(out[0]))
+				{
+					if(!write_all(fd, out, nout * sizeof(out[0])))
+						return 0;
+					nout = 0;
+				}
+			}
+			i += reqlen;
+		}
+		memmove(in, in + i, len - i);
+		len -= i;
+		if(nout && !write_all(fd, out, nout * sizeof(out[0])))
+			return 0;
+		nout = 0;
+	}
+	return 0;
+}
+
+typedef enum order_t {
+	ORDER_FORWARD, ORDER_BACKWARD, ORDER_ODD_EVEN, ORDER_LAST_FIRST, ORDER_END
+} order_t;
+static const char *const order_name[] = {
+	"in order", "backwards", "odd, then even", "last, then in order"
+};
+
+static unsigned int pick(order_t order, int n, int i)
+{
+	switch(order)
+	{
+	case ORDER_BACKWARD:
+		return n - 1 - i;
+	case ORDER_ODD_EVEN:
+		return i < n / 2 ? 2 * i + 1 : 2 * (i - n / 2);
+	case ORDER_LAST_FIRST:
+		return i ? i - 1 : n - 1;
+	default:
+		return i;
+	}
+}
+
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int run(xcb_connection_t *c, order_t order, int n)
+{
+	xcb_get_input_focus_cookie_t *cookies = malloc(n * sizeof(*cookies));
+	double start;
+	int i, bad = 0;
+
+	if(!cookies)
+		return 0;
+	start = now();
+	for(i = 0; i < n; ++i)
+		cookies[i] = xcb_get_input_focus(c);
+	xcb_flush(c);
+	for(i = 0; i < n; ++i)
+	{
+		unsigned int j = pick(order, n, i);
+		xcb_get_input_focus_reply_t *reply =
+			xcb_get_input_focus_reply(c, cookies[j], 0);
+		if(!reply || reply->focus != cookies[j].sequence)
+			++bad;
+		free(reply);
+	}
+	printf("  %-20s %8d round-trips %10.1f ms%s\n", order_name[order], n,
+	       (now() - start) * 1000, bad ? "  BAD REPLIES" : "");
+	free(cookies);
+	return !bad;
+}
+
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : REQUESTS;
+	int fds[2], ok = 1;
+	order_t order;
+	pthread_t thread;
+	xcb_connection_t *c;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) ||
+	   pthread_create(&thread, 0, server, &fds[1]))
+		return EXIT_FAILURE;
+	c = xcb_connect_to_fd(fds[0], 0);
+	if(xcb_connection_has_error(c))
+		return EXIT_FAILURE;
+
+	for(order = ORDER_FORWARD; order != ORDER_END; order++)
+		ok = run(c, order, n) && ok;
+
+	xcb_disconnect(c);
+	pthread_join(thread, 0);
+	close(fds[1]);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
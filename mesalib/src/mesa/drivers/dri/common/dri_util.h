@@ -170,6 +170,7 @@ struct __DRIscreenRec {
     const __DRIextension **extensions;
 
     const __DRIswrastLoaderExtension *swrast_loader;
+    const __DRIswrastMapLoaderExtension *swrast_map_loader;
 
     struct {
 	/* Flag to indicate that this is a DRI2 screen.  Many of the above
@@ -472,6 +472,7 @@ swrast_map_renderbuffer(struct gl_context *ctx,
    if (rb->AllocStorage == swrast_alloc_front_storage) {
       __DRIdrawable *dPriv = xrb->dPriv;
       __DRIscreen *sPriv = dPriv->driScreenPriv;
+      const __DRIswrastMapLoaderExtension *map_loader = sPriv->swrast_map_loader;
 
       xrb->map_mode = mode;
       xrb->map_x = x;
@@ -479,6 +480,21 @@ swrast_map_renderbuffer(struct gl_context *ctx,
       xrb->map_w = w;
       xrb->map_h = h;
 
+      /* Render straight into the drawable if the loader lets us */
+      if (map_loader) {
+         map = (GLubyte *) map_loader->mapDrawable(dPriv, xrb->bpp,
+                                                   rb->Width, rb->Height,
+                                                   &stride,
+                                                   dPriv->loaderPrivate);
+         if (map) {
+            xrb->map_direct = GL_TRUE;
+            *out_map = map + (GLsizei)(rb->Height - y - 1) * stride
+                           + (GLsizei)x * cpp;
+            *out_stride = -stride;
+            return;
+         }
+      }
+
       stride = w * cpp;
       xrb->Base.Buffer = (GLubyte*)malloc(h * stride);
 
@@ -515,6 +531,18 @@ swrast_unmap_renderbuffer(struct gl_context *ctx,
       __DRIdrawable *dPriv = xrb->dPriv;
       __DRIscreen *sPriv = dPriv->driScreenPriv;
 
+      if (xrb->map_direct) {
+         if (xrb->map_mode & GL_MAP_WRITE_BIT) {
+            sPriv->swrast_map_loader->damageDrawable(dPriv, xrb->map_x,
+                                                     rb->Height - xrb->map_y -
+                                                     xrb->map_h,
+                                                     xrb->map_w, xrb->map_h,
+                                                     dPriv->loaderPrivate);
+         }
+         xrb->map_direct = GL_FALSE;
+         return;
+      }
+
       if (xrb->map_mode & GL_MAP_WRITE_BIT) {
 	 sPriv->swrast_loader->putImage(dPriv, __DRI_SWRAST_IMAGE_OP_DRAW,
 					xrb->map_x, xrb->map_y,
@@ -115,6 +115,8 @@ struct dri_swrast_renderbuffer {
     /* GL_MAP_*_BIT, used for mapping of front buffer. */
     GLbitfield map_mode;
    int map_x, map_y, map_w, map_h;
+    /* front buffer mapped in place by the loader's mapDrawable */
+    GLboolean map_direct;
 
     /* renderbuffer pitch (in bytes) */
     GLuint pitch;
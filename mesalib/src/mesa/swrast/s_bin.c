@@ -0,0 +1,608 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+/**
+ * \file s_bin.c
+ * Writing triangle spans on several threads.
+ *
+ * The triangle functions set each triangle up once and make its spans as
+ * before, but the interpolated spans of the flat, smooth and general
+ * triangles aren't written right away: _swrast_write_rgba_span() keeps
+ * them in bins, one per BIN_ROWS rows of the framebuffer, in the order
+ * they came.  When the drawing is done (_swrast_flush()) the bins are
+ * handed out to the span workers, the drawing thread being one of them,
+ * and each bin's spans are written in order by whichever thread took it.
+ * Any one pixel is only ever written from one bin, in primitive order, so
+ * the results are the same as writing the spans one by one.
+ *
+ * The bins are bands of whole rows rather than tiles: a span split at a
+ * tile edge would have the second part's interpolants start from another
+ * point, and round differently.
+ *
+ * Anything else written through _swrast_write_rgba_span() (points, lines,
+ * antialiased triangles, bitmaps, images, zoomed spans) first writes the
+ * binned spans and then goes ahead on the drawing thread, and so do all
+ * spans while an occlusion query is counting.  Other threads writing spans
+ * need their own span arrays, fragment program machine and so on; those
+ * are SWthread, see _swrast_get_thread().
+ *
+ * The number of threads, including the drawing thread, defaults to the
+ * number of CPUs but no more than DEFAULT_THREADS, as every worker has
+ * span arrays of its own (about 15 MiB) for each context.  It can be set
+ * up to MAX_THREADS with the SWRAST_NUM_THREADS environment variable; 1
+ * turns the binning off.  It is always off with OpenMP, which
+ * has the antialiased triangles share the span arrays out in its own way.
+ */
+
+
+#include "c11/threads.h"
+#include "main/glheader.h"
+#include "main/context.h"
+#include "main/imports.h"
+#include "main/macros.h"
+
+#include "s_bin.h"
+#include "s_context.h"
+#include "s_span.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+/** Framebuffer rows per bin */
+#define BIN_ROWS 16
+
+/** Most threads writing spans, the drawing thread included */
+#define MAX_THREADS 8
+
+/** Most threads writing spans unless SWRAST_NUM_THREADS asks for more */
+#define DEFAULT_THREADS 4
+
+/** Write the bins out before they hold more than this many bytes */
+#define MAX_BINNED_BYTES (4 * 1024 * 1024)
+
+/** With fewer fragments binned, waking the workers isn't worth it */
+#define MIN_PARALLEL_FRAGMENTS 4096
+
+
+/** Size of the fixed-point interpolants, SWspan::red to intTexStep */
+#define FIXED_BYTES (offsetof(SWspan, arrayMask) - offsetof(SWspan, red))
+
+
+/**
+ * A span in a bin: what the triangle functions set of a SWspan, with the
+ * interpolants of just the attributes in use following it.
+ */
+struct binned_span
+{
+   GLint x, y;
+   GLuint end;
+   GLuint facing;
+   GLbitfield interpMask;
+   GLuint numAttribs;
+   GLubyte fixed[FIXED_BYTES];
+};
+
+struct binned_attrib
+{
+   GLuint attr;
+   GLfloat start[4], stepX[4], stepY[4];
+};
+
+
+struct swrast_bin
+{
+   GLubyte *Data;
+   GLuint Used, Size;
+};
+
+
+struct swrast_worker
+{
+   SWthread Thread;
+   struct swrast_bins *Bins;
+   thrd_t Handle;
+};
+
+
+struct swrast_bins
+{
+   struct gl_context *ctx;
+
+   struct swrast_bin *Bin;
+   GLuint NumBins;
+   GLuint Bytes;          /**< binned so far, in all bins */
+   GLuint Fragments;      /**< same */
+
+   GLuint NumThreads;     /**< to run, the drawing thread included */
+   GLuint NumWorkers;     /**< running */
+   GLboolean Started;     /**< have we tried to start them? */
+   struct swrast_worker *Worker;
+
+   /** The workers wait on Work for Generation to change, or for Quit;
+    * the drawing thread waits on Done for Busy to drop to zero.
+    */
+   mtx_t Mutex;
+   cnd_t Work, Done;
+   GLuint Generation;
+   GLuint Busy;
+   GLuint NextBin;
+   GLboolean Quit;
+};
+
+
+/** Each worker's SWthread, for _swrast_get_thread() */
+static tss_t thread_key;
+static once_flag thread_key_once = ONCE_FLAG_INIT;
+
+static void
+create_thread_key(void)
+{
+   tss_create(&thread_key, NULL);
+}
+
+
+/**
+ * Return the scratch memory of the thread writing spans: a span worker's
+ * own, or the context's for the drawing thread.
+ */
+SWthread *
+_swrast_get_thread(SWcontext *swrast)
+{
+   if (swrast->Bins) {
+      SWthread *thread = tss_get(thread_key);
+      if (thread)
+         return thread;
+   }
+   return &swrast->Thread;
+}
+
+
+/**
+ * Allocate the scratch memory that isn't allocated on first use.
+ * The span arrays are the caller's business.
+ */
+GLboolean
+_swrast_init_thread(SWthread *thread)
+{
+   thread->stencil_temp.buf1 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
+   thread->stencil_temp.buf2 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
+   thread->stencil_temp.buf3 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
+   thread->stencil_temp.buf4 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
+
+   return thread->stencil_temp.buf1 &&
+          thread->stencil_temp.buf2 &&
+          thread->stencil_temp.buf3 &&
+          thread->stencil_temp.buf4;
+}
+
+
+void
+_swrast_free_thread(SWthread *thread)
+{
+   free(thread->TexelBuffer);
+   _mesa_align_free(thread->FragProgSoa);
+
+   free(thread->stencil_temp.buf1);
+   free(thread->stencil_temp.buf2);
+   free(thread->stencil_temp.buf3);
+   free(thread->stencil_temp.buf4);
+}
+
+
+/**
+ * How many threads should write spans?
+ */
+static GLuint
+num_threads(void)
+{
+   const char *env = getenv("SWRAST_NUM_THREADS");
+   GLint n;
+
+   if (env) {
+      n = atoi(env);
+   }
+   else {
+#if defined(_WIN32)
+      SYSTEM_INFO info;
+      GetSystemInfo(&info);
+      n = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+      n = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+      n = 1;
+#endif
+      n = MIN2(n, DEFAULT_THREADS);
+   }
+
+   return CLAMP(n, 1, MAX_THREADS);
+}
+
+
+/**
+ * Set up binning for a new context, or return NULL to write every span
+ * right away.  The workers are started on first use.
+ */
+struct swrast_bins *
+_swrast_create_bins(struct gl_context *ctx)
+{
+#ifdef _OPENMP
+   return NULL;
+#else
+   const GLuint n = num_threads();
+   struct swrast_bins *bins;
+
+   if (n < 2)
+      return NULL;
+
+   bins = calloc(1, sizeof(*bins));
+   if (!bins)
+      return NULL;
+
+   bins->ctx = ctx;
+   bins->NumThreads = n;
+   mtx_init(&bins->Mutex, mtx_plain);
+   cnd_init(&bins->Work);
+   cnd_init(&bins->Done);
+
+   call_once(&thread_key_once, create_thread_key);
+
+   return bins;
+#endif
+}
+
+
+void
+_swrast_destroy_bins(struct gl_context *ctx)
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_bins *bins = swrast->Bins;
+   GLuint i;
+
+   if (!bins)
+      return;
+
+   mtx_lock(&bins->Mutex);
+   bins->Quit = GL_TRUE;
+   cnd_broadcast(&bins->Work);
+   mtx_unlock(&bins->Mutex);
+
+   for (i = 0; i < bins->NumWorkers; i++) {
+      thrd_join(bins->Worker[i].Handle, NULL);
+      free(bins->Worker[i].Thread.SpanArrays);
+      _swrast_free_thread(&bins->Worker[i].Thread);
+   }
+   free(bins->Worker);
+
+   for (i = 0; i < bins->NumBins; i++)
+      free(bins->Bin[i].Data);
+   free(bins->Bin);
+
+   cnd_destroy(&bins->Work);
+   cnd_destroy(&bins->Done);
+   mtx_destroy(&bins->Mutex);
+
+   free(bins);
+   swrast->Bins = NULL;
+}
+
+
+/**
+ * Write out one bin's spans, in the order they were binned.
+ */
+static void
+write_bin(struct gl_context *ctx, struct swrast_bin *bin,
+          SWspanarrays *arrays)
+{
+   const GLubyte *p = bin->Data;
+   const GLubyte *end = bin->Data + bin->Used;
+   SWspan span;
+
+   span.primitive = GL_POLYGON;
+   span.array = arrays;
+
+   while (p < end) {
+      const struct binned_span *s = (const struct binned_span *) p;
+      const struct binned_attrib *a = (const struct binned_attrib *) (s + 1);
+      GLuint i;
+
+      span.x = s->x;
+      span.y = s->y;
+      span.end = s->end;
+      span.leftClip = 0;
+      span.facing = s->facing;
+      span.interpMask = s->interpMask;
+      span.arrayMask = 0x0;
+      span.arrayAttribs = 0x0;
+      memcpy(&span.red, s->fixed, FIXED_BYTES);
+
+      for (i = 0; i < s->numAttribs; i++, a++) {
+         COPY_4V(span.attrStart[a->attr], a->start);
+         COPY_4V(span.attrStepX[a->attr], a->stepX);
+         COPY_4V(span.attrStepY[a->attr], a->stepY);
+      }
+
+      _swrast_write_rgba_span_now(ctx, &span);
+
+      p = (const GLubyte *) a;
+   }
+
+   bin->Used = 0;
+}
+
+
+/**
+ * Take bins and write them until there are none left.
+ */
+static void
+write_bins(struct swrast_bins *bins, SWspanarrays *arrays)
+{
+   for (;;) {
+      GLuint b;
+
+      mtx_lock(&bins->Mutex);
+      b = bins->NextBin++;
+      mtx_unlock(&bins->Mutex);
+
+      if (b >= bins->NumBins)
+         break;
+      if (bins->Bin[b].Used)
+         write_bin(bins->ctx, &bins->Bin[b], arrays);
+   }
+}
+
+
+static int
+span_worker(void *data)
+{
+   struct swrast_worker *worker = (struct swrast_worker *) data;
+   struct swrast_bins *bins = worker->Bins;
+   GLuint generation = 0;
+
+   tss_set(thread_key, &worker->Thread);
+
+   mtx_lock(&bins->Mutex);
+   for (;;) {
+      while (!bins->Quit && bins->Generation == generation)
+         cnd_wait(&bins->Work, &bins->Mutex);
+      if (bins->Quit)
+         break;
+      generation = bins->Generation;
+      mtx_unlock(&bins->Mutex);
+
+      write_bins(bins, worker->Thread.SpanArrays);
+
+      mtx_lock(&bins->Mutex);
+      if (--bins->Busy == 0)
+         cnd_signal(&bins->Done);
+   }
+   mtx_unlock(&bins->Mutex);
+
+   return 0;
+}
+
+
+/**
+ * Start as many of the workers as we can.
+ */
+static void
+start_workers(struct swrast_bins *bins)
+{
+   GLuint i;
+
+   bins->Started = GL_TRUE;
+   bins->Worker = calloc(bins->NumThreads - 1, sizeof(struct swrast_worker));
+   if (!bins->Worker)
+      return;
+
+   for (i = 0; i < bins->NumThreads - 1; i++) {
+      struct swrast_worker *worker = &bins->Worker[i];
+      SWspanarrays *arrays = malloc(sizeof(SWspanarrays));
+
+      if (arrays) {
+         arrays->ChanType = CHAN_TYPE;
+#if CHAN_TYPE == GL_UNSIGNED_BYTE
+         arrays->rgba = arrays->rgba8;
+#elif CHAN_TYPE == GL_UNSIGNED_SHORT
+         arrays->rgba = arrays->rgba16;
+#else
+         arrays->rgba = arrays->attribs[VARYING_SLOT_COL0];
+#endif
+      }
+
+      worker->Bins = bins;
+      worker->Thread.SpanArrays = arrays;
+      if (!arrays || !_swrast_init_thread(&worker->Thread) ||
+          thrd_create(&worker->Handle, span_worker, worker) != thrd_success) {
+         free(arrays);
+         _swrast_free_thread(&worker->Thread);
+         break;
+      }
+
+      bins->NumWorkers++;
+   }
+}
+
+
+/**
+ * Write all the binned spans.
+ */
+void
+_swrast_flush_bins(struct gl_context *ctx)
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_bins *bins = swrast->Bins;
+   GLuint i;
+
+   if (!bins || !bins->Bytes)
+      return;
+
+   if (bins->Fragments >= MIN_PARALLEL_FRAGMENTS && !bins->Started)
+      start_workers(bins);
+
+   if (bins->Fragments >= MIN_PARALLEL_FRAGMENTS && bins->NumWorkers) {
+      mtx_lock(&bins->Mutex);
+      bins->NextBin = 0;
+      bins->Busy = bins->NumWorkers;
+      bins->Generation++;
+      cnd_broadcast(&bins->Work);
+      mtx_unlock(&bins->Mutex);
+
+      write_bins(bins, swrast->SpanArrays);
+
+      mtx_lock(&bins->Mutex);
+      while (bins->Busy)
+         cnd_wait(&bins->Done, &bins->Mutex);
+      mtx_unlock(&bins->Mutex);
+   }
+   else {
+      for (i = 0; i < bins->NumBins; i++) {
+         if (bins->Bin[i].Used)
+            write_bin(ctx, &bins->Bin[i], swrast->SpanArrays);
+      }
+   }
+
+   bins->Bytes = 0;
+   bins->Fragments = 0;
+}
+
+
+/**
+ * Make room for 'bytes' more in a bin.
+ */
+static GLboolean
+grow_bin(struct swrast_bin *bin, GLuint bytes)
+{
+   GLuint size = MAX2(bin->Size * 2, 4096);
+   GLubyte *data;
+
+   while (size < bin->Used + bytes)
+      size *= 2;
+   data = realloc(bin->Data, size);
+   if (!data)
+      return GL_FALSE;
+   bin->Data = data;
+   bin->Size = size;
+   return GL_TRUE;
+}
+
+
+/**
+ * Have at least 'n' bins.
+ */
+static GLboolean
+grow_bins(struct swrast_bins *bins, GLuint n)
+{
+   struct swrast_bin *bin = realloc(bins->Bin, n * sizeof(*bin));
+
+   if (!bin)
+      return GL_FALSE;
+   memset(bin + bins->NumBins, 0, (n - bins->NumBins) * sizeof(*bin));
+   bins->Bin = bin;
+   bins->NumBins = n;
+   return GL_TRUE;
+}
+
+
+static void
+bin_attrib(struct binned_attrib *a, const SWspan *span, GLuint attr)
+{
+   a->attr = attr;
+   COPY_4V(a->start, span->attrStart[attr]);
+   COPY_4V(a->stepX, span->attrStepX[attr]);
+   COPY_4V(a->stepY, span->attrStepY[attr]);
+}
+
+
+/**
+ * Put a triangle span in its bin, to be written by _swrast_flush_bins().
+ * \return GL_FALSE if it can't be binned, the binned spans then having
+ *         been written so that it can be written right away.
+ */
+GLboolean
+_swrast_bin_span(struct gl_context *ctx, const SWspan *span)
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   struct swrast_bins *bins = swrast->Bins;
+   const struct gl_framebuffer *fb = ctx->DrawBuffer;
+   const GLuint size = sizeof(struct binned_span) +
+      (swrast->_NumActiveAttribs + 1) * sizeof(struct binned_attrib);
+   struct binned_span *s;
+   struct binned_attrib *a;
+   struct swrast_bin *bin;
+   GLuint b, i;
+
+   if (span->primitive != GL_POLYGON ||
+       span->arrayMask ||
+       span->arrayAttribs ||
+       span->array != swrast->SpanArrays ||
+       ctx->Query.CurrentOcclusionObject) {
+      _swrast_flush_bins(ctx);
+      return GL_FALSE;
+   }
+
+   /* rows outside the buffer are clipped away whole */
+   if (span->end == 0 || span->y < fb->_Ymin || span->y >= fb->_Ymax)
+      return GL_TRUE;
+
+   b = span->y / BIN_ROWS;
+   if (b >= bins->NumBins && !grow_bins(bins, b + 1)) {
+      _swrast_flush_bins(ctx);
+      return GL_FALSE;
+   }
+   bin = &bins->Bin[b];
+   if (bin->Used + size > bin->Size && !grow_bin(bin, size)) {
+      _swrast_flush_bins(ctx);
+      return GL_FALSE;
+   }
+
+   s = (struct binned_span *) (bin->Data + bin->Used);
+   s->x = span->x;
+   s->y = span->y;
+   s->end = span->end;
+   s->facing = span->facing;
+   s->interpMask = span->interpMask;
+   memcpy(s->fixed, &span->red, FIXED_BYTES);
+
+   /* the window position is always interpolated, active or not */
+   a = (struct binned_attrib *) (s + 1);
+   bin_attrib(a++, span, VARYING_SLOT_POS);
+   for (i = 0; i < swrast->_NumActiveAttribs; i++) {
+      const GLuint attr = swrast->_ActiveAttribs[i];
+      if (attr != VARYING_SLOT_POS)
+         bin_attrib(a++, span, attr);
+   }
+   s->numAttribs = a - (struct binned_attrib *) (s + 1);
+
+   bin->Used += (GLubyte *) a - (GLubyte *) s;
+   bins->Bytes += (GLubyte *) a - (GLubyte *) s;
+   bins->Fragments += span->end;
+
+   if (bins->Bytes >= MAX_BINNED_BYTES)
+      _swrast_flush_bins(ctx);
+
+   return GL_TRUE;
+}
@@ -33,6 +33,7 @@
 #include "program/prog_parameter.h"
 #include "program/prog_statevars.h"
 #include "swrast.h"
+#include "s_bin.h"
 #include "s_blend.h"
 #include "s_context.h"
 #include "s_lines.h"
@@ -265,11 +266,18 @@ _swrast_update_fog_state( struct gl_context *ctx )
 static void
 _swrast_update_fragment_program(struct gl_context *ctx, GLbitfield newState)
 {
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+
+   swrast->_FragProgSoa = GL_FALSE;
+
    if (!_swrast_use_fragment_program(ctx))
       return;
 
    _mesa_load_state_parameters(ctx,
                                ctx->FragmentProgram._Current->Base.Parameters);
+
+   swrast->_FragProgSoa =
+      _swrast_fragment_program_soa_ok(ctx->FragmentProgram._Current);
 }
 
 
@@ -800,19 +808,14 @@ _swrast_CreateContext( struct gl_context *ctx )
 
    ctx->swrast_context = swrast;
 
-   swrast->stencil_temp.buf1 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
-   swrast->stencil_temp.buf2 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
-   swrast->stencil_temp.buf3 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
-   swrast->stencil_temp.buf4 = malloc(SWRAST_MAX_WIDTH * sizeof(GLubyte));
-
-   if (!swrast->stencil_temp.buf1 ||
-       !swrast->stencil_temp.buf2 ||
-       !swrast->stencil_temp.buf3 ||
-       !swrast->stencil_temp.buf4) {
+   swrast->Thread.SpanArrays = swrast->SpanArrays;
+   if (!_swrast_init_thread(&swrast->Thread)) {
       _swrast_DestroyContext(ctx);
       return GL_FALSE;
    }
 
+   swrast->Bins = _swrast_create_bins(ctx);
+
    return GL_TRUE;
 }
 
@@ -825,14 +828,11 @@ _swrast_DestroyContext( struct gl_context *ctx )
       _mesa_debug(ctx, "_swrast_DestroyContext\n");
    }
 
+   _swrast_destroy_bins(ctx);
+
    free( swrast->SpanArrays );
    free( swrast->ZoomedArrays );
-   free( swrast->TexelBuffer );
-
-   free(swrast->stencil_temp.buf1);
-   free(swrast->stencil_temp.buf2);
-   free(swrast->stencil_temp.buf3);
-   free(swrast->stencil_temp.buf4);
+   _swrast_free_thread(&swrast->Thread);
 
    free( swrast );
 
@@ -856,6 +856,8 @@ _swrast_flush( struct gl_context *ctx )
       _swrast_write_rgba_span(ctx, &(swrast->PointSpan));
       swrast->PointSpan.end = 0;
    }
+   /* and the spans of triangles waiting in bins */
+   _swrast_flush_bins(ctx);
 }
 
 void
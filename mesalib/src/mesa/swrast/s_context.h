@@ -209,6 +209,35 @@ swrast_renderbuffer(struct gl_renderbuffer *img)
 
 
 
+/**
+ * Scratch memory for writing spans.  Every thread that writes spans at the
+ * same time as others needs its own: the drawing thread has the context's,
+ * and each span worker (see s_bin.c) one of its own.
+ */
+typedef struct swrast_thread
+{
+   /** Fragment arrays for the spans this thread writes */
+   SWspanarrays *SpanArrays;
+
+   /** Buffer for saving the sampled texture colors.
+    * Needed for GL_ARB_texture_env_crossbar implementation.
+    */
+   GLfloat *TexelBuffer;
+
+   /** State used during execution of fragment programs */
+   struct gl_program_machine FragProgMachine;
+   /** Registers for running it SIMD-fashion, allocated on first use */
+   struct swrast_soa_machine *FragProgSoa;
+
+   /** Temporary arrays for stencil operations.  To avoid large stack
+    * allocations.
+    */
+   struct {
+      GLubyte *buf1, *buf2, *buf3, *buf4;
+   } stencil_temp;
+} SWthread;
+
+
 /**
  * \struct SWcontext
  * \brief  Per-context state that's private to the software rasterizer module.
@@ -235,6 +264,7 @@ typedef struct
    GLboolean _TextureCombinePrimary;
    GLboolean _FogEnabled;
    GLboolean _DeferredTexture;
+   GLboolean _FragProgSoa;     /**< Run the fragment program span-wide? */
 
    /** List/array of the fragment attributes to interpolate */
    GLuint _ActiveAttribs[VARYING_SLOT_MAX];
@@ -314,22 +344,13 @@ typedef struct
    blend_func BlendFunc;
    texture_sample_func TextureSample[MAX_COMBINED_TEXTURE_IMAGE_UNITS];
 
-   /** Buffer for saving the sampled texture colors.
-    * Needed for GL_ARB_texture_env_crossbar implementation.
-    */
-   GLfloat *TexelBuffer;
-
    validate_texture_image_func ValidateTextureImage;
 
-   /** State used during execution of fragment programs */
-   struct gl_program_machine FragProgMachine;
+   /** The drawing thread's scratch memory; see _swrast_get_thread() */
+   SWthread Thread;
 
-   /** Temporary arrays for stencil operations.  To avoid large stack
-    * allocations.
-    */
-   struct {
-      GLubyte *buf1, *buf2, *buf3, *buf4;
-   } stencil_temp;
+   /** Span workers and their bins of spans, or NULL (see s_bin.c) */
+   struct swrast_bins *Bins;
 
 } SWcontext;
 
@@ -337,6 +358,9 @@ typedef struct
 extern void
 _swrast_validate_derived( struct gl_context *ctx );
 
+extern SWthread *
+_swrast_get_thread(SWcontext *swrast);
+
 extern void
 _swrast_update_texture_samplers(struct gl_context *ctx);
 
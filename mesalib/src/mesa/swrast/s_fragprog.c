@@ -23,10 +23,12 @@
  */
 
 #include "main/glheader.h"
+#include "main/imports.h"
 #include "main/macros.h"
 #include "main/samplerobj.h"
 #include "main/teximage.h"
 #include "program/prog_instruction.h"
+#include "program/prog_parameter.h"
 
 #include "s_context.h"
 #include "s_fragprog.h"
@@ -209,10 +211,10 @@ init_machine(struct gl_context *ctx, struct gl_program_machine *machine,
 static void
 run_program(struct gl_context *ctx, SWspan *span, GLuint start, GLuint end)
 {
-   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   SWthread *thread = _swrast_get_thread(SWRAST_CONTEXT(ctx));
    const struct gl_fragment_program *program = ctx->FragmentProgram._Current;
    const GLbitfield64 outputsWritten = program->Base.OutputsWritten;
-   struct gl_program_machine *machine = &swrast->FragProgMachine;
+   struct gl_program_machine *machine = &thread->FragProgMachine;
    GLuint i;
 
    for (i = start; i < end; i++) {
@@ -262,6 +264,818 @@ run_program(struct gl_context *ctx, SWspan *span, GLuint start, GLuint end)
 }
 
 
+/*
+ * Span-wide interpreter.
+ *
+ * _mesa_execute_program() decodes every instruction again for every
+ * fragment.  For straight-line programs (everything the texenv program
+ * generator makes, and most ARB_fragment_programs) we instead run each
+ * instruction on SOA_WIDTH fragments at a time, with the registers kept
+ * one component after another so the inner loops are plain float array
+ * arithmetic the compiler turns into SSE/AVX.  The arithmetic is the same
+ * as prog_execute.c's, in the same order, so the results are too.
+ */
+
+/** Fragments run at once; the registers for that many stay in the cache */
+#define SOA_WIDTH 64
+
+/** A register for SOA_WIDTH fragments: all x's, then all y's, and so on */
+typedef GLfloat soa_reg[4][SOA_WIDTH];
+
+struct swrast_soa_machine
+{
+   soa_reg Temporaries[MAX_PROGRAM_TEMPS];
+   soa_reg Outputs[MAX_PROGRAM_OUTPUTS];
+   soa_reg Inputs[VARYING_SLOT_MAX];
+   soa_reg Src[3];      /**< operands that had to be copied to be modified */
+   soa_reg Result;
+
+   /** The fragments still running: not masked out and not killed */
+   GLuint Live[SOA_WIDTH];
+   GLuint NumLive;
+   GLboolean Killed[SOA_WIDTH];
+
+   /** For texture sampling, one live fragment after another */
+   GLfloat TexCoords[SOA_WIDTH][4];
+   GLfloat Lambda[SOA_WIDTH];
+   GLfloat Texels[SOA_WIDTH][4];
+};
+
+
+static GLboolean
+soa_src_ok(const struct gl_fragment_program *fp,
+           const struct prog_instruction *inst,
+           const struct prog_src_register *src)
+{
+   GLuint i;
+
+   if (src->RelAddr || src->Index < 0)
+      return GL_FALSE;
+
+   /* only SWZ can swizzle in zeros and ones */
+   for (i = 0; i < 4; i++) {
+      if (GET_SWZ(src->Swizzle, i) > SWIZZLE_W &&
+          inst->Opcode != OPCODE_SWZ)
+         return GL_FALSE;
+   }
+
+   switch (src->File) {
+   case PROGRAM_TEMPORARY:
+      return src->Index < MAX_PROGRAM_TEMPS;
+   case PROGRAM_INPUT:
+      return src->Index < VARYING_SLOT_MAX &&
+             (fp->Base.InputsRead & BITFIELD64_BIT(src->Index));
+   case PROGRAM_OUTPUT:
+      return src->Index < MAX_PROGRAM_OUTPUTS;
+   case PROGRAM_STATE_VAR:
+   case PROGRAM_CONSTANT:
+   case PROGRAM_UNIFORM:
+      return src->Index < (GLint) fp->Base.Parameters->NumParameters;
+   default:
+      return GL_FALSE;
+   }
+}
+
+
+/**
+ * Can the span-wide interpreter run the given program?  It has no flow
+ * control, condition codes, address registers or derivatives; programs
+ * using any of them go through _mesa_execute_program().
+ */
+GLboolean
+_swrast_fragment_program_soa_ok(const struct gl_fragment_program *fp)
+{
+   GLuint pc, i;
+
+   for (pc = 0; pc < fp->Base.NumInstructions; pc++) {
+      const struct prog_instruction *inst = fp->Base.Instructions + pc;
+
+      switch (inst->Opcode) {
+      case OPCODE_ABS:
+      case OPCODE_ADD:
+      case OPCODE_CMP:
+      case OPCODE_COS:
+      case OPCODE_DP2:
+      case OPCODE_DP3:
+      case OPCODE_DP4:
+      case OPCODE_DPH:
+      case OPCODE_DST:
+      case OPCODE_EX2:
+      case OPCODE_FLR:
+      case OPCODE_FRC:
+      case OPCODE_KIL:
+      case OPCODE_LG2:
+      case OPCODE_LIT:
+      case OPCODE_LRP:
+      case OPCODE_MAD:
+      case OPCODE_MAX:
+      case OPCODE_MIN:
+      case OPCODE_MOV:
+      case OPCODE_MUL:
+      case OPCODE_NOP:
+      case OPCODE_POW:
+      case OPCODE_RCP:
+      case OPCODE_RSQ:
+      case OPCODE_SCS:
+      case OPCODE_SEQ:
+      case OPCODE_SGE:
+      case OPCODE_SGT:
+      case OPCODE_SIN:
+      case OPCODE_SLE:
+      case OPCODE_SLT:
+      case OPCODE_SNE:
+      case OPCODE_SSG:
+      case OPCODE_SUB:
+      case OPCODE_SWZ:
+      case OPCODE_TEX:
+      case OPCODE_TXB:
+      case OPCODE_TXP:
+      case OPCODE_TRUNC:
+      case OPCODE_XPD:
+      case OPCODE_END:
+         break;
+      default:
+         return GL_FALSE;
+      }
+
+      if (inst->CondUpdate)
+         return GL_FALSE;
+
+      if (_mesa_num_inst_dst_regs(inst->Opcode)) {
+         const struct prog_dst_register *dst = &inst->DstReg;
+         if (dst->RelAddr || dst->Index < 0 || dst->CondMask != COND_TR)
+            return GL_FALSE;
+         if (!(dst->File == PROGRAM_TEMPORARY &&
+               dst->Index < MAX_PROGRAM_TEMPS) &&
+             !(dst->File == PROGRAM_OUTPUT &&
+               dst->Index < MAX_PROGRAM_OUTPUTS))
+            return GL_FALSE;
+      }
+
+      for (i = 0; i < _mesa_num_inst_src_regs(inst->Opcode); i++) {
+         if (!soa_src_ok(fp, inst, &inst->SrcReg[i]))
+            return GL_FALSE;
+      }
+   }
+
+   return GL_TRUE;
+}
+
+
+/**
+ * Point src[] at the first 'comps' components of a source operand for
+ * 'n' fragments, after swizzling, abs and negation, like fetch_vector4().
+ * Operands that need modifying are copied to 'tmp'.
+ */
+static void
+soa_fetch(struct swrast_soa_machine *m, const struct gl_program *prog,
+          const struct prog_src_register *source, GLuint comps, GLuint n,
+          soa_reg tmp, const GLfloat *src[4])
+{
+   soa_reg *reg;
+   GLuint c, i;
+
+   switch (source->File) {
+   case PROGRAM_TEMPORARY:
+      reg = &m->Temporaries[source->Index];
+      break;
+   case PROGRAM_INPUT:
+      reg = &m->Inputs[source->Index];
+      break;
+   case PROGRAM_OUTPUT:
+      reg = &m->Outputs[source->Index];
+      break;
+   default:
+      {
+         /* the same for every fragment */
+         const GLfloat *value =
+            (const GLfloat *) prog->Parameters->ParameterValues[source->Index];
+         for (c = 0; c < comps; c++) {
+            GLfloat v = value[GET_SWZ(source->Swizzle, c)];
+            if (source->Abs)
+               v = fabsf(v);
+            if (source->Negate)
+               v = -v;
+            for (i = 0; i < n; i++)
+               tmp[c][i] = v;
+            src[c] = tmp[c];
+         }
+      }
+      return;
+   }
+
+   for (c = 0; c < comps; c++) {
+      const GLfloat *s = (*reg)[GET_SWZ(source->Swizzle, c)];
+
+      if (source->Abs && source->Negate) {
+         for (i = 0; i < n; i++)
+            tmp[c][i] = -fabsf(s[i]);
+         s = tmp[c];
+      }
+      else if (source->Abs) {
+         for (i = 0; i < n; i++)
+            tmp[c][i] = fabsf(s[i]);
+         s = tmp[c];
+      }
+      else if (source->Negate) {
+         for (i = 0; i < n; i++)
+            tmp[c][i] = -s[i];
+         s = tmp[c];
+      }
+      src[c] = s;
+   }
+}
+
+
+/**
+ * Write m->Result to the instruction's destination register, like
+ * store_vector4() without condition codes.
+ */
+static void
+soa_store(struct swrast_soa_machine *m, const struct prog_instruction *inst,
+          GLuint n)
+{
+   const struct prog_dst_register *dstReg = &inst->DstReg;
+   soa_reg *dst = dstReg->File == PROGRAM_OUTPUT
+      ? &m->Outputs[dstReg->Index] : &m->Temporaries[dstReg->Index];
+   GLuint c, i;
+
+   for (c = 0; c < 4; c++) {
+      if (!(dstReg->WriteMask & (1 << c)))
+         continue;
+      if (inst->SaturateMode == SATURATE_ZERO_ONE) {
+         for (i = 0; i < n; i++)
+            (*dst)[c][i] = CLAMP(m->Result[c][i], 0.0F, 1.0F);
+      }
+      else {
+         memcpy((*dst)[c], m->Result[c], n * sizeof(GLfloat));
+      }
+   }
+}
+
+
+/** Copy component 0 of m->Result to the others, for the scalar opcodes */
+static void
+soa_replicate(struct swrast_soa_machine *m, GLuint n)
+{
+   memcpy(m->Result[1], m->Result[0], n * sizeof(GLfloat));
+   memcpy(m->Result[2], m->Result[0], n * sizeof(GLfloat));
+   memcpy(m->Result[3], m->Result[0], n * sizeof(GLfloat));
+}
+
+
+/**
+ * What the sampling functions decide once for all the fragments they
+ * are given, from the lambda of the first, or of the first and last:
+ * minification or magnification (compute_min_mag_ranges()), or a depth
+ * texture's mipmap level (choose_depth_texture_level()).  Fragments
+ * sampled together must agree on it to get what they would one by one.
+ */
+static GLint
+soa_lambda_class(const struct gl_sampler_object *samp, GLboolean depth,
+                 GLfloat lambda)
+{
+   if (depth) {
+      if (samp->MinFilter == GL_NEAREST || samp->MinFilter == GL_LINEAR)
+         return 0;
+      return (GLint) lambda;
+   }
+   if (samp->MinFilter == samp->MagFilter)
+      return 0;
+   if (samp->MagFilter == GL_LINEAR &&
+       (samp->MinFilter == GL_NEAREST_MIPMAP_NEAREST ||
+        samp->MinFilter == GL_NEAREST_MIPMAP_LINEAR))
+      return lambda > 0.5F;
+   return lambda > 0.0F;
+}
+
+
+/**
+ * TEX, TXB and TXP for the live fragments, into m->Result.  The texture
+ * coordinates and lambda are worked out per fragment exactly as
+ * fetch_texel_lod() and fetch_texel_deriv() do, then the sampling
+ * function is called once for each run of fragments in the same
+ * soa_lambda_class(): once for the span, unless TXB's bias or the
+ * coordinates take lambda across the min/mag threshold.
+ */
+static void
+soa_texture(struct gl_context *ctx, const SWspan *span,
+            struct swrast_soa_machine *m,
+            const struct gl_fragment_program *program,
+            const struct prog_instruction *inst, const GLfloat *a[4])
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   const GLuint unit = program->Base.SamplerUnits[inst->TexSrcUnit];
+   const struct gl_texture_unit *texUnit = &ctx->Texture.Unit[unit];
+   const struct gl_texture_object *texObj = texUnit->_Current;
+   const struct gl_sampler_object *samp;
+   const GLfloat *texdx = NULL, *texdy = NULL;
+   GLfloat texW = 0.0F, texH = 0.0F;
+   GLboolean depth;
+   GLuint k, c, end;
+
+   if (!texObj) {
+      for (k = 0; k < m->NumLive; k++) {
+         const GLuint i = m->Live[k];
+         m->Result[0][i] = 0.0F;
+         m->Result[1][i] = 0.0F;
+         m->Result[2][i] = 0.0F;
+         m->Result[3][i] = 1.0F;
+      }
+      return;
+   }
+
+   samp = _mesa_get_samplerobj(ctx, unit);
+
+   /* Note: we only have the right derivatives for fragment input attribs */
+   if (inst->SrcReg[0].File == PROGRAM_INPUT &&
+       inst->SrcReg[0].Index == VARYING_SLOT_TEX0 + inst->TexSrcUnit) {
+      const struct gl_texture_image *texImg = _mesa_base_tex_image(texObj);
+      const struct swrast_texture_image *swImg =
+         swrast_texture_image_const(texImg);
+      texW = (GLfloat) swImg->WidthScale;
+      texH = (GLfloat) swImg->HeightScale;
+      texdx = span->attrStepX[inst->SrcReg[0].Index];
+      texdy = span->attrStepY[inst->SrcReg[0].Index];
+   }
+
+   for (k = 0; k < m->NumLive; k++) {
+      const GLuint i = m->Live[k];
+      GLfloat *texcoord = m->TexCoords[k];
+      GLfloat lodBias = 0.0F, lambda;
+
+      texcoord[0] = a[0][i];
+      texcoord[1] = a[1][i];
+      texcoord[2] = a[2][i];
+      texcoord[3] = a[3][i];
+
+      if (inst->Opcode == OPCODE_TEX) {
+         texcoord[3] = 1.0f;
+      }
+      else if (inst->Opcode == OPCODE_TXB) {
+         lodBias = texcoord[3];
+      }
+      else if (texcoord[3] != 0.0) {
+         texcoord[0] /= texcoord[3];
+         texcoord[1] /= texcoord[3];
+         texcoord[2] /= texcoord[3];
+      }
+
+      if (texdx) {
+         lambda = _swrast_compute_lambda(texdx[0], texdy[0],
+                                         texdx[1], texdy[1],
+                                         texdx[3], texdy[3],
+                                         texW, texH,
+                                         texcoord[0], texcoord[1], texcoord[3],
+                                         1.0F / texcoord[3]);
+         lambda += lodBias + texUnit->LodBias + samp->LodBias;
+      }
+      else {
+         lambda = lodBias;
+      }
+
+      m->Lambda[k] = CLAMP(lambda, samp->MinLod, samp->MaxLod);
+   }
+
+   depth = _mesa_base_tex_image(texObj)->_BaseFormat == GL_DEPTH_COMPONENT ||
+           _mesa_base_tex_image(texObj)->_BaseFormat == GL_DEPTH_STENCIL_EXT;
+   for (k = 0; k < m->NumLive; k = end) {
+      const GLint class = soa_lambda_class(samp, depth, m->Lambda[k]);
+
+      for (end = k + 1; end < m->NumLive; end++) {
+         if (soa_lambda_class(samp, depth, m->Lambda[end]) != class)
+            break;
+      }
+      swrast->TextureSample[unit](ctx, samp, texObj, end - k,
+                                  (const GLfloat (*)[4]) (m->TexCoords + k),
+                                  m->Lambda + k, m->Texels + k);
+   }
+
+   for (k = 0; k < m->NumLive; k++) {
+      const GLuint i = m->Live[k];
+      GLfloat color[4];
+      swizzle_texel(m->Texels[k], color, texObj->_Swizzle);
+      for (c = 0; c < 4; c++)
+         m->Result[c][i] = color[c];
+   }
+}
+
+
+/**
+ * Run the program on the first 'n' fragments in the machine's registers.
+ */
+static void
+soa_execute(struct gl_context *ctx, const SWspan *span,
+            struct swrast_soa_machine *m,
+            const struct gl_fragment_program *program, GLuint n)
+{
+   const struct gl_program *prog = &program->Base;
+   GLuint pc, c, i;
+
+   for (pc = 0; pc < prog->NumInstructions; pc++) {
+      const struct prog_instruction *inst = prog->Instructions + pc;
+      GLfloat (*r)[SOA_WIDTH] = m->Result;
+      const GLfloat *a[4], *b[4], *d[4];
+      GLuint numSrc = _mesa_num_inst_src_regs(inst->Opcode);
+      /* the scalar opcodes only use the first component */
+      GLuint comps = 4;
+
+      switch (inst->Opcode) {
+      case OPCODE_COS:
+      case OPCODE_EX2:
+      case OPCODE_LG2:
+      case OPCODE_POW:
+      case OPCODE_RCP:
+      case OPCODE_RSQ:
+      case OPCODE_SCS:
+      case OPCODE_SIN:
+         comps = 1;
+         break;
+      case OPCODE_SWZ:
+         numSrc = 0;
+         break;
+      default:
+         break;
+      }
+
+      if (numSrc > 0)
+         soa_fetch(m, prog, &inst->SrcReg[0], comps, n, m->Src[0], a);
+      if (numSrc > 1)
+         soa_fetch(m, prog, &inst->SrcReg[1], comps, n, m->Src[1], b);
+      if (numSrc > 2)
+         soa_fetch(m, prog, &inst->SrcReg[2], comps, n, m->Src[2], d);
+
+      switch (inst->Opcode) {
+      case OPCODE_ABS:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = fabsf(a[c][i]);
+         break;
+      case OPCODE_ADD:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] + b[c][i];
+         break;
+      case OPCODE_CMP:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] < 0.0F ? b[c][i] : d[c][i];
+         break;
+      case OPCODE_COS:
+         for (i = 0; i < n; i++)
+            r[0][i] = (GLfloat) cos(a[0][i]);
+         soa_replicate(m, n);
+         break;
+      case OPCODE_DP2:
+         for (i = 0; i < n; i++)
+            r[0][i] = a[0][i] * b[0][i] + a[1][i] * b[1][i];
+         soa_replicate(m, n);
+         break;
+      case OPCODE_DP3:
+         for (i = 0; i < n; i++)
+            r[0][i] = a[0][i] * b[0][i] + a[1][i] * b[1][i] +
+                      a[2][i] * b[2][i];
+         soa_replicate(m, n);
+         break;
+      case OPCODE_DP4:
+         for (i = 0; i < n; i++)
+            r[0][i] = a[0][i] * b[0][i] + a[1][i] * b[1][i] +
+                      a[2][i] * b[2][i] + a[3][i] * b[3][i];
+         soa_replicate(m, n);
+         break;
+      case OPCODE_DPH:
+         for (i = 0; i < n; i++)
+            r[0][i] = a[0][i] * b[0][i] + a[1][i] * b[1][i] +
+                      a[2][i] * b[2][i] + b[3][i];
+         soa_replicate(m, n);
+         break;
+      case OPCODE_DST:
+         for (i = 0; i < n; i++) {
+            r[0][i] = 1.0F;
+            r[1][i] = a[1][i] * b[1][i];
+            r[2][i] = a[2][i];
+            r[3][i] = b[3][i];
+         }
+         break;
+      case OPCODE_EX2:
+         for (i = 0; i < n; i++)
+            r[0][i] = (GLfloat) pow(2.0, a[0][i]);
+         soa_replicate(m, n);
+         break;
+      case OPCODE_FLR:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = floorf(a[c][i]);
+         break;
+      case OPCODE_FRC:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] - floorf(a[c][i]);
+         break;
+      case OPCODE_KIL:
+         {
+            GLuint k, live = 0;
+            for (k = 0; k < m->NumLive; k++) {
+               i = m->Live[k];
+               if (a[0][i] < 0.0F || a[1][i] < 0.0F ||
+                   a[2][i] < 0.0F || a[3][i] < 0.0F)
+                  m->Killed[i] = GL_TRUE;
+               else
+                  m->Live[live++] = i;
+            }
+            m->NumLive = live;
+            if (!live)
+               return;
+         }
+         break;
+      case OPCODE_LG2:
+         /* The fast LOG2 macro doesn't meet the precision requirements. */
+         for (i = 0; i < n; i++)
+            r[0][i] = a[0][i] == 0.0F ? -FLT_MAX
+                                      : (float) (log(a[0][i]) * 1.442695F);
+         soa_replicate(m, n);
+         break;
+      case OPCODE_LIT:
+         for (i = 0; i < n; i++) {
+            const GLfloat epsilon = 1.0F / 256.0F;   /* from NV VP spec */
+            const GLfloat x = MAX2(a[0][i], 0.0F);
+            const GLfloat y = MAX2(a[1][i], 0.0F);
+            const GLfloat w = CLAMP(a[3][i], -(128.0F - epsilon),
+                                    (128.0F - epsilon));
+            r[0][i] = 1.0F;
+            r[1][i] = x;
+            if (x > 0.0F) {
+               if (y == 0.0 && w == 0.0)
+                  r[2][i] = 1.0F;
+               else
+                  r[2][i] = (GLfloat) pow(y, w);
+            }
+            else {
+               r[2][i] = 0.0F;
+            }
+            r[3][i] = 1.0F;
+         }
+         break;
+      case OPCODE_LRP:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] * b[c][i] + (1.0F - a[c][i]) * d[c][i];
+         break;
+      case OPCODE_MAD:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] * b[c][i] + d[c][i];
+         break;
+      case OPCODE_MAX:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = MAX2(a[c][i], b[c][i]);
+         break;
+      case OPCODE_MIN:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = MIN2(a[c][i], b[c][i]);
+         break;
+      case OPCODE_MOV:
+         for (c = 0; c < 4; c++)
+            memcpy(r[c], a[c], n * sizeof(GLfloat));
+         break;
+      case OPCODE_MUL:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] * b[c][i];
+         break;
+      case OPCODE_POW:
+         for (i = 0; i < n; i++)
+            r[0][i] = (GLfloat) pow(a[0][i], b[0][i]);
+         soa_replicate(m, n);
+         break;
+      case OPCODE_RCP:
+         for (i = 0; i < n; i++)
+            r[0][i] = 1.0F / a[0][i];
+         soa_replicate(m, n);
+         break;
+      case OPCODE_RSQ:
+         for (i = 0; i < n; i++)
+            r[0][i] = 1.0f / sqrtf(fabsf(a[0][i]));
+         soa_replicate(m, n);
+         break;
+      case OPCODE_SCS:
+         for (i = 0; i < n; i++) {
+            r[0][i] = (GLfloat) cos(a[0][i]);
+            r[1][i] = (GLfloat) sin(a[0][i]);
+            r[2][i] = 0.0;    /* undefined! */
+            r[3][i] = 0.0;    /* undefined! */
+         }
+         break;
+      case OPCODE_SEQ:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] == b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SGE:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] >= b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SGT:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] > b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SIN:
+         for (i = 0; i < n; i++)
+            r[0][i] = (GLfloat) sin(a[0][i]);
+         soa_replicate(m, n);
+         break;
+      case OPCODE_SLE:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] <= b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SLT:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] < b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SNE:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (a[c][i] != b[c][i]) ? 1.0F : 0.0F;
+         break;
+      case OPCODE_SSG:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (GLfloat) ((a[c][i] > 0.0F) - (a[c][i] < 0.0F));
+         break;
+      case OPCODE_SUB:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = a[c][i] - b[c][i];
+         break;
+      case OPCODE_SWZ:         /* extended swizzle */
+         {
+            const struct prog_src_register *source = &inst->SrcReg[0];
+            struct prog_src_register plain = *source;
+
+            /* fetch the x/y/z/w components, then fill in zeros and ones */
+            plain.Swizzle = SWIZZLE_NOOP;
+            plain.Abs = GL_FALSE;
+            plain.Negate = NEGATE_NONE;
+            soa_fetch(m, prog, &plain, 4, n, m->Src[0], a);
+            for (c = 0; c < 4; c++) {
+               const GLuint swz = GET_SWZ(source->Swizzle, c);
+               const GLfloat sign = (source->Negate & (1 << c)) ? -1.0F : 1.0F;
+               if (swz == SWIZZLE_ZERO || swz == SWIZZLE_ONE) {
+                  const GLfloat v = swz == SWIZZLE_ONE ? 1.0F : 0.0F;
+                  for (i = 0; i < n; i++)
+                     r[c][i] = sign < 0.0F ? -v : v;
+               }
+               else if (sign < 0.0F) {
+                  for (i = 0; i < n; i++)
+                     r[c][i] = -a[swz][i];
+               }
+               else {
+                  memcpy(r[c], a[swz], n * sizeof(GLfloat));
+               }
+            }
+         }
+         break;
+      case OPCODE_TEX:
+      case OPCODE_TXB:
+      case OPCODE_TXP:
+         soa_texture(ctx, span, m, program, inst, a);
+         break;
+      case OPCODE_TRUNC:
+         for (c = 0; c < 4; c++)
+            for (i = 0; i < n; i++)
+               r[c][i] = (GLfloat) (GLint) a[c][i];
+         break;
+      case OPCODE_XPD:
+         for (i = 0; i < n; i++) {
+            r[0][i] = a[1][i] * b[2][i] - a[2][i] * b[1][i];
+            r[1][i] = a[2][i] * b[0][i] - a[0][i] * b[2][i];
+            r[2][i] = a[0][i] * b[1][i] - a[1][i] * b[0][i];
+            r[3][i] = 1.0;
+         }
+         break;
+      case OPCODE_NOP:
+         continue;
+      case OPCODE_END:
+         return;
+      default:
+         _mesa_problem(ctx, "Bad opcode %d in soa_execute()", inst->Opcode);
+         return;
+      }
+
+      if (_mesa_num_inst_dst_regs(inst->Opcode))
+         soa_store(m, inst, n);
+   }
+}
+
+
+/**
+ * Run fragment program on the pixels in span from 'start' to 'end' - 1,
+ * SOA_WIDTH at a time.  Does what run_program() does, for programs
+ * _swrast_fragment_program_soa_ok() accepts.
+ */
+static void
+run_program_soa(struct gl_context *ctx, SWspan *span,
+                struct swrast_soa_machine *m, GLuint start, GLuint end)
+{
+   const struct gl_fragment_program *program = ctx->FragmentProgram._Current;
+   const GLbitfield64 inputsRead = program->Base.InputsRead;
+   const GLbitfield64 outputsWritten = program->Base.OutputsWritten;
+   const GLboolean glsl =
+      ctx->_Shader->CurrentProgram[MESA_SHADER_FRAGMENT] != NULL;
+   GLfloat (*attribs)[SWRAST_MAX_WIDTH][4] = span->array->attribs;
+   GLuint first, n, k, i, c, attr, buf;
+
+   for (first = start; first < end; first += n) {
+      n = MIN2(end - first, SOA_WIDTH);
+
+      m->NumLive = 0;
+      for (i = 0; i < n; i++) {
+         m->Killed[i] = GL_FALSE;
+         if (span->array->mask[first + i])
+            m->Live[m->NumLive++] = i;
+      }
+      if (!m->NumLive)
+         continue;
+
+      /* as init_machine() does */
+      for (k = 0; k < m->NumLive; k++) {
+         const GLuint col = first + m->Live[k];
+         GLfloat *wpos = attribs[VARYING_SLOT_POS][col];
+
+         /* ARB_fragment_coord_conventions */
+         if (program->OriginUpperLeft)
+            wpos[1] = ctx->DrawBuffer->Height - 1 - wpos[1];
+         if (!program->PixelCenterInteger) {
+            wpos[0] += 0.5F;
+            wpos[1] += 0.5F;
+         }
+
+         /* if running a GLSL program (not ARB_fragment_program) */
+         if (glsl)
+            attribs[VARYING_SLOT_FACE][col][0] = 1.0F - span->facing;
+      }
+
+      for (attr = 0; attr < VARYING_SLOT_MAX; attr++) {
+         if (inputsRead & BITFIELD64_BIT(attr)) {
+            for (c = 0; c < 4; c++)
+               for (i = 0; i < n; i++)
+                  m->Inputs[attr][c][i] = attribs[attr][first + i][c];
+         }
+      }
+
+      soa_execute(ctx, span, m, program, n);
+
+      for (i = 0; i < n; i++) {
+         if (m->Killed[i]) {
+            /* killed fragment */
+            span->array->mask[first + i] = GL_FALSE;
+            span->writeAll = GL_FALSE;
+         }
+      }
+
+      for (k = 0; k < m->NumLive; k++) {
+         const GLuint j = m->Live[k];
+         const GLuint col = first + j;
+
+         /* Store result color */
+         if (outputsWritten & BITFIELD64_BIT(FRAG_RESULT_COLOR)) {
+            const soa_reg *color = &m->Outputs[FRAG_RESULT_COLOR];
+            for (c = 0; c < 4; c++)
+               attribs[VARYING_SLOT_COL0][col][c] = (*color)[c][j];
+         }
+         else {
+            /* Multiple drawbuffers / render targets */
+            for (buf = 0; buf < ctx->DrawBuffer->_NumColorDrawBuffers; buf++) {
+               if (outputsWritten & BITFIELD64_BIT(FRAG_RESULT_DATA0 + buf)) {
+                  const soa_reg *color = &m->Outputs[FRAG_RESULT_DATA0 + buf];
+                  for (c = 0; c < 4; c++)
+                     attribs[VARYING_SLOT_COL0 + buf][col][c] = (*color)[c][j];
+               }
+            }
+         }
+
+         /* Store result depth/z */
+         if (outputsWritten & BITFIELD64_BIT(FRAG_RESULT_DEPTH)) {
+            const GLfloat depth = m->Outputs[FRAG_RESULT_DEPTH][2][j];
+            if (depth <= 0.0)
+               span->array->z[col] = 0;
+            else if (depth >= 1.0)
+               span->array->z[col] = ctx->DrawBuffer->_DepthMax;
+            else
+               span->array->z[col] =
+                  (GLuint) (depth * ctx->DrawBuffer->_DepthMaxF + 0.5F);
+         }
+      }
+   }
+}
+
+
 /**
  * Execute the current fragment program for all the fragments
  * in the given span.
@@ -269,6 +1083,8 @@ run_program(struct gl_context *ctx, SWspan *span, GLuint start, GLuint end)
 void
 _swrast_exec_fragment_program( struct gl_context *ctx, SWspan *span )
 {
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   SWthread *thread = _swrast_get_thread(swrast);
    const struct gl_fragment_program *program = ctx->FragmentProgram._Current;
 
    /* incoming colors should be floats */
@@ -276,7 +1092,15 @@ _swrast_exec_fragment_program( struct gl_context *ctx, SWspan *span )
       assert(span->array->ChanType == GL_FLOAT);
    }
 
-   run_program(ctx, span, 0, span->end);
+   if (swrast->_FragProgSoa && !thread->FragProgSoa) {
+      thread->FragProgSoa =
+         _mesa_align_calloc(sizeof(struct swrast_soa_machine), 32);
+   }
+
+   if (swrast->_FragProgSoa && thread->FragProgSoa)
+      run_program_soa(ctx, span, thread->FragProgSoa, 0, span->end);
+   else
+      run_program(ctx, span, 0, span->end);
 
    if (program->Base.OutputsWritten & BITFIELD64_BIT(FRAG_RESULT_COLOR)) {
       span->interpMask &= ~SPAN_RGBA;
@@ -30,10 +30,14 @@
 #include "s_span.h"
 
 struct gl_context;
+struct gl_fragment_program;
 
 GLboolean
 _swrast_use_fragment_program(struct gl_context *ctx);
 
+extern GLboolean
+_swrast_fragment_program_soa_ok(const struct gl_fragment_program *fp);
+
 extern void
 _swrast_exec_fragment_program(struct gl_context *ctx, SWspan *span);
 
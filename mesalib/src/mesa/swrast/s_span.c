@@ -43,6 +43,7 @@
 
 #include "s_atifragshader.h"
 #include "s_alpha.h"
+#include "s_bin.h"
 #include "s_blend.h"
 #include "s_context.h"
 #include "s_depth.h"
@@ -1126,9 +1127,23 @@ _swrast_put_row(struct gl_context *ctx, struct gl_renderbuffer *rb,
  * This function may modify any of the array values in the span.
  * span->interpMask and span->arrayMask may be changed but will be restored
  * to their original values before returning.
+ *
+ * Triangle spans may only be binned here, to be written later by one of
+ * the span workers; see s_bin.c.
  */
 void
 _swrast_write_rgba_span( struct gl_context *ctx, SWspan *span)
+{
+   if (!SWRAST_CONTEXT(ctx)->Bins || !_swrast_bin_span(ctx, span))
+      _swrast_write_rgba_span_now(ctx, span);
+}
+
+
+/**
+ * As _swrast_write_rgba_span(), but always right away.
+ */
+void
+_swrast_write_rgba_span_now( struct gl_context *ctx, SWspan *span)
 {
    const SWcontext *swrast = SWRAST_CONTEXT(ctx);
    const GLuint *colorMask = (GLuint *) ctx->Color.ColorMask;
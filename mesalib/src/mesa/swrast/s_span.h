@@ -199,6 +199,9 @@ _swrast_compute_lambda(GLfloat dsdx, GLfloat dsdy, GLfloat dtdx, GLfloat dtdy,
 extern void
 _swrast_write_rgba_span( struct gl_context *ctx, SWspan *span);
 
+extern void
+_swrast_write_rgba_span_now( struct gl_context *ctx, SWspan *span);
+
 
 extern void
 _swrast_read_rgba_span(struct gl_context *ctx, struct gl_renderbuffer *rb,
@@ -47,12 +47,12 @@ typedef float (*float4_array)[4];
  * Return array of texels for given unit.
  */
 static inline float4_array
-get_texel_array(SWcontext *swrast, GLuint unit)
+get_texel_array(const GLfloat *texelBuffer, GLuint unit)
 {
 #ifdef _OPENMP
-   return (float4_array) (swrast->TexelBuffer + unit * SWRAST_MAX_WIDTH * 4 * omp_get_num_threads() + (SWRAST_MAX_WIDTH * 4 * omp_get_thread_num()));
+   return (float4_array) (texelBuffer + unit * SWRAST_MAX_WIDTH * 4 * omp_get_num_threads() + (SWRAST_MAX_WIDTH * 4 * omp_get_thread_num()));
 #else
-   return (float4_array) (swrast->TexelBuffer + unit * SWRAST_MAX_WIDTH * 4);
+   return (float4_array) (texelBuffer + unit * SWRAST_MAX_WIDTH * 4);
 #endif
 }
 
@@ -83,7 +83,6 @@ texture_combine( struct gl_context *ctx, GLuint unit,
                  const GLfloat *texelBuffer,
                  SWspan *span )
 {
-   SWcontext *swrast = SWRAST_CONTEXT(ctx);
    const struct gl_texture_unit *textureUnit = &(ctx->Texture.Unit[unit]);
    const struct gl_tex_env_combine_state *combine = textureUnit->_CurrentCombine;
    float4_array argRGB[MAX_COMBINER_TERMS];
@@ -143,7 +142,7 @@ texture_combine( struct gl_context *ctx, GLuint unit,
 
       switch (srcRGB) {
          case GL_TEXTURE:
-            argRGB[term] = get_texel_array(swrast, unit);
+            argRGB[term] = get_texel_array(texelBuffer, unit);
             break;
          case GL_PRIMARY_COLOR:
             argRGB[term] = primary_rgba;
@@ -191,7 +190,7 @@ texture_combine( struct gl_context *ctx, GLuint unit,
                assert(srcUnit < ctx->Const.MaxTextureUnits);
                if (!ctx->Texture.Unit[srcUnit]._Current)
                   goto end;
-               argRGB[term] = get_texel_array(swrast, srcUnit);
+               argRGB[term] = get_texel_array(texelBuffer, srcUnit);
             }
       }
 
@@ -239,7 +238,7 @@ texture_combine( struct gl_context *ctx, GLuint unit,
 
       switch (srcA) {
          case GL_TEXTURE:
-            argA[term] = get_texel_array(swrast, unit);
+            argA[term] = get_texel_array(texelBuffer, unit);
             break;
          case GL_PRIMARY_COLOR:
             argA[term] = primary_rgba;
@@ -281,7 +280,7 @@ texture_combine( struct gl_context *ctx, GLuint unit,
                assert(srcUnit < ctx->Const.MaxTextureUnits);
                if (!ctx->Texture.Unit[srcUnit]._Current)
                   goto end;
-               argA[term] = get_texel_array(swrast, srcUnit);
+               argA[term] = get_texel_array(texelBuffer, srcUnit);
             }
       }
 
@@ -586,10 +585,12 @@ void
 _swrast_texture_span( struct gl_context *ctx, SWspan *span )
 {
    SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   SWthread *thread = _swrast_get_thread(swrast);
    float4_array primary_rgba;
+   GLfloat *texelBuffer;
    GLuint unit;
 
-   if (!swrast->TexelBuffer) {
+   if (!thread->TexelBuffer) {
 #ifdef _OPENMP
       const GLint maxThreads = omp_get_max_threads();
 
@@ -599,7 +600,7 @@ _swrast_texture_span( struct gl_context *ctx, SWspan *span )
        * initialized already by another thread while this thread was waiting.
        */
       #pragma omp critical
-      if (!swrast->TexelBuffer) {
+      if (!thread->TexelBuffer) {
 #else
       const GLint maxThreads = 1;
 #endif
@@ -608,18 +609,19 @@ _swrast_texture_span( struct gl_context *ctx, SWspan *span )
        * instances; when running with multiple threads, create one per
        * thread.
        */
-      swrast->TexelBuffer =
+      thread->TexelBuffer =
 	 malloc(ctx->Const.Program[MESA_SHADER_FRAGMENT].MaxTextureImageUnits * maxThreads *
 			    SWRAST_MAX_WIDTH * 4 * sizeof(GLfloat));
 #ifdef _OPENMP
       } /* critical section */
 #endif
 
-      if (!swrast->TexelBuffer) {
+      if (!thread->TexelBuffer) {
 	 _mesa_error(ctx, GL_OUT_OF_MEMORY, "texture_combine");
 	 return;
       }
    }
+   texelBuffer = thread->TexelBuffer;
 
    primary_rgba = malloc(span->end * 4 * sizeof(GLfloat));
 
@@ -655,7 +657,7 @@ _swrast_texture_span( struct gl_context *ctx, SWspan *span )
          const struct gl_texture_object *curObj = texUnit->_Current;
          const struct gl_sampler_object *samp = _mesa_get_samplerobj(ctx, unit);
          GLfloat *lambda = span->array->lambda[unit];
-         float4_array texels = get_texel_array(swrast, unit);
+         float4_array texels = get_texel_array(texelBuffer, unit);
 
          /* adjust texture lod (lambda) */
          if (span->arrayMask & SPAN_LAMBDA) {
@@ -713,7 +715,7 @@ _swrast_texture_span( struct gl_context *ctx, SWspan *span )
     */
    for (unit = 0; unit < ctx->Const.MaxTextureUnits; unit++) {
       if (ctx->Texture.Unit[unit]._Current)
-         texture_combine(ctx, unit, primary_rgba, swrast->TexelBuffer, span);
+         texture_combine(ctx, unit, primary_rgba, texelBuffer, span);
    }
 
    free(primary_rgba);
@@ -35,6 +35,12 @@
 #include "s_context.h"
 #include "s_texfilter.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXFILTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
 
 /*
  * Note, the FRAC macro has to work perfectly.  Otherwise you'll sometimes
@@ -1244,6 +1250,312 @@ sample_2d_linear_repeat(struct gl_context *ctx,
 }
 
 
+#ifdef TEXFILTER_SSE2
+
+/*
+ * SSE2 bilinear sampling of RGBA8 2D textures.
+ *
+ * sample_2d_linear() costs a wrap mode switch per coordinate and four
+ * FetchTexel calls, each unpacking one texel through
+ * _mesa_unpack_rgba_row(), for every pixel.  For the 8-bit RGBA formats
+ * without a border and with GL_REPEAT or GL_CLAMP_TO_EDGE wrapping, the
+ * functions below find the texel locations of four pixels at a time, read
+ * the four texels of a pixel straight from the image and filter all four
+ * channels at once.  They repeat the float arithmetic of the scalar code
+ * step by step, so the results are the same to the bit.
+ */
+
+
+/**
+ * Can img be sampled with sample_2d_linear_rgba8_4()?
+ */
+static inline GLboolean
+linear_rgba8_ok(const struct gl_sampler_object *samp,
+                const struct gl_texture_image *img)
+{
+   if (img->Border != 0 ||
+       (samp->WrapS != GL_REPEAT && samp->WrapS != GL_CLAMP_TO_EDGE) ||
+       (samp->WrapT != GL_REPEAT && samp->WrapT != GL_CLAMP_TO_EDGE))
+      return GL_FALSE;
+
+   switch (img->TexFormat) {
+   case MESA_FORMAT_R8G8B8A8_UNORM:
+   case MESA_FORMAT_B8G8R8A8_UNORM:
+   case MESA_FORMAT_A8B8G8R8_UNORM:
+      return GL_TRUE;
+   default:
+      return GL_FALSE;
+   }
+}
+
+
+/**
+ * IFLOOR() of four floats, the same way.
+ */
+static inline __m128i
+ifloor4(__m128 f)
+{
+   const __m128d bias = _mm_set1_pd((3 << 22) + 0.5);
+   const __m128d flo = _mm_cvtps_pd(f);
+   const __m128d fhi = _mm_cvtps_pd(_mm_movehl_ps(f, f));
+   const __m128 af = _mm_movelh_ps(_mm_cvtpd_ps(_mm_add_pd(bias, flo)),
+                                   _mm_cvtpd_ps(_mm_add_pd(bias, fhi)));
+   const __m128 bf = _mm_movelh_ps(_mm_cvtpd_ps(_mm_sub_pd(bias, flo)),
+                                   _mm_cvtpd_ps(_mm_sub_pd(bias, fhi)));
+   return _mm_srai_epi32(_mm_sub_epi32(_mm_castps_si128(af),
+                                       _mm_castps_si128(bf)), 1);
+}
+
+
+/**
+ * linear_texel_locations() for four pixels, GL_REPEAT and GL_CLAMP_TO_EDGE
+ * only.  size holds the width (or height) of the image of each pixel.
+ * With NPOT sizes, REMAINDER() can come out negative for coordinates far
+ * below zero, where sample_2d_linear() would use the border color; such
+ * pixels get their bit set in the returned mask.
+ */
+static inline GLuint
+linear_texel_locations4(GLenum wrapMode, GLboolean isPOT, __m128i size,
+                        __m128 s, __m128i *i0, __m128i *i1, __m128 *weight)
+{
+   const __m128 sizef = _mm_cvtepi32_ps(size);
+   const __m128i one = _mm_set1_epi32(1);
+   const __m128i max = _mm_sub_epi32(size, one);
+   GLuint outside = 0x0;
+   __m128i flr;
+   __m128 u;
+
+   if (wrapMode == GL_REPEAT) {
+      u = _mm_sub_ps(_mm_mul_ps(s, sizef), _mm_set1_ps(0.5F));
+      flr = ifloor4(u);
+      if (isPOT) {
+         *i0 = _mm_and_si128(flr, max);
+         *i1 = _mm_and_si128(_mm_add_epi32(*i0, one), max);
+      }
+      else {
+         GLint f[4], sz[4], r0[4], r1[4];
+         GLuint k;
+         _mm_storeu_si128((__m128i *) f, flr);
+         _mm_storeu_si128((__m128i *) sz, size);
+         for (k = 0; k < 4; k++) {
+            r0[k] = REMAINDER(f[k], sz[k]);
+            r1[k] = REMAINDER(r0[k] + 1, sz[k]);
+            if (r0[k] < 0 || r1[k] < 0) {
+               outside |= 1 << k;
+               r0[k] = r1[k] = 0;
+            }
+         }
+         *i0 = _mm_loadu_si128((const __m128i *) r0);
+         *i1 = _mm_loadu_si128((const __m128i *) r1);
+      }
+   }
+   else {
+      /* GL_CLAMP_TO_EDGE */
+      const __m128 lo = _mm_cmple_ps(s, _mm_setzero_ps());
+      const __m128 hi = _mm_cmpge_ps(s, _mm_set1_ps(1.0F));
+      __m128i m;
+
+      u = _mm_andnot_ps(_mm_or_ps(lo, hi), _mm_mul_ps(s, sizef));
+      u = _mm_or_ps(u, _mm_andnot_ps(lo, _mm_and_ps(hi, sizef)));
+      u = _mm_sub_ps(u, _mm_set1_ps(0.5F));
+      flr = ifloor4(u);
+
+      /* i0 can't be above size - 1 here, nor i1 below 0, so clamping both
+       * to the image is the same as what linear_texel_locations() does.
+       */
+      *i0 = _mm_andnot_si128(_mm_srai_epi32(flr, 31), flr);
+      *i1 = _mm_add_epi32(flr, one);
+      m = _mm_cmpgt_epi32(*i1, max);
+      *i1 = _mm_or_si128(_mm_and_si128(m, max), _mm_andnot_si128(m, *i1));
+   }
+
+   *weight = _mm_sub_ps(u, _mm_cvtepi32_ps(flr));
+   return outside;
+}
+
+
+/**
+ * lerp_rgba_2d() of four RGBA8 texels packed as in format, t00 in the
+ * lowest lane, then t10, t01 and t11.
+ */
+static inline __m128
+lerp_rgba8_2d(mesa_format format, __m128i texels, __m128 a, __m128 b)
+{
+   const __m128i zero = _mm_setzero_si128();
+   const __m128 scale = _mm_set1_ps(1.0F / 255.0F);
+   __m128i lo, hi;
+   __m128 t00, t10, t01, t11, temp0, temp1;
+
+   /* Put R in the low byte, then G, B and A */
+   if (format == MESA_FORMAT_B8G8R8A8_UNORM) {
+      const __m128i ga = _mm_set1_epi32((int) 0xff00ff00);
+      const __m128i br = _mm_andnot_si128(ga, texels);
+      texels = _mm_or_si128(_mm_and_si128(texels, ga),
+                            _mm_or_si128(_mm_srli_epi32(br, 16),
+                                         _mm_slli_epi32(br, 16)));
+   }
+   else if (format == MESA_FORMAT_A8B8G8R8_UNORM) {
+      texels = _mm_or_si128(_mm_slli_epi32(texels, 16),
+                            _mm_srli_epi32(texels, 16));
+      texels = _mm_or_si128(_mm_slli_epi16(texels, 8),
+                            _mm_srli_epi16(texels, 8));
+   }
+
+   /* Same as _mesa_unorm_to_float(x, 8) */
+   lo = _mm_unpacklo_epi8(texels, zero);
+   hi = _mm_unpackhi_epi8(texels, zero);
+   t00 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale);
+   t10 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale);
+   t01 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale);
+   t11 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale);
+
+   temp0 = _mm_add_ps(t00, _mm_mul_ps(a, _mm_sub_ps(t10, t00)));
+   temp1 = _mm_add_ps(t01, _mm_mul_ps(a, _mm_sub_ps(t11, t01)));
+   return _mm_add_ps(temp0, _mm_mul_ps(b, _mm_sub_ps(temp1, temp0)));
+}
+
+
+/**
+ * sample_2d_linear() of count (at most four) pixels, the k-th one from
+ * img[k].  All four img[] must be set, and pass linear_rgba8_ok().
+ */
+static inline void
+sample_2d_linear_rgba8_4(struct gl_context *ctx,
+                         const struct gl_sampler_object *samp,
+                         const struct gl_texture_image *img[4],
+                         GLuint count, const GLfloat texcoords[][4],
+                         __m128 result[4])
+{
+   const struct swrast_texture_image *swImg[4];
+   GLint i0[4], i1[4], j0[4], j1[4];
+   GLfloat s[4], t[4], a[4], b[4];
+   GLboolean isPOT = GL_TRUE;
+   GLuint outside, k;
+   __m128i vi0, vi1, vj0, vj1;
+   __m128 va, vb;
+
+   for (k = 0; k < 4; k++) {
+      const GLuint c = MIN2(k, count - 1);
+      swImg[k] = swrast_texture_image_const(img[k]);
+      isPOT = isPOT && swImg[k]->_IsPowerOfTwo;
+      s[k] = texcoords[c][0];
+      t[k] = texcoords[c][1];
+   }
+
+   outside = linear_texel_locations4(samp->WrapS, isPOT,
+                                     _mm_set_epi32(img[3]->Width2,
+                                                   img[2]->Width2,
+                                                   img[1]->Width2,
+                                                   img[0]->Width2),
+                                     _mm_loadu_ps(s), &vi0, &vi1, &va);
+   outside |= linear_texel_locations4(samp->WrapT, isPOT,
+                                      _mm_set_epi32(img[3]->Height2,
+                                                    img[2]->Height2,
+                                                    img[1]->Height2,
+                                                    img[0]->Height2),
+                                      _mm_loadu_ps(t), &vj0, &vj1, &vb);
+   _mm_storeu_si128((__m128i *) i0, vi0);
+   _mm_storeu_si128((__m128i *) i1, vi1);
+   _mm_storeu_si128((__m128i *) j0, vj0);
+   _mm_storeu_si128((__m128i *) j1, vj1);
+   _mm_storeu_ps(a, va);
+   _mm_storeu_ps(b, vb);
+
+   for (k = 0; k < count; k++) {
+      if (outside & (1 << k)) {
+         GLfloat texel[4];
+         sample_2d_linear(ctx, samp, img[k], texcoords[k], texel);
+         result[k] = _mm_loadu_ps(texel);
+      }
+      else {
+         const GLubyte *map = (const GLubyte *) swImg[k]->ImageSlices[0];
+         const GLuint *row0 = (const GLuint *)
+            (map + swImg[k]->RowStride * j0[k]);
+         const GLuint *row1 = (const GLuint *)
+            (map + swImg[k]->RowStride * j1[k]);
+         const __m128i texels = _mm_set_epi32(row1[i1[k]], row1[i0[k]],
+                                              row0[i1[k]], row0[i0[k]]);
+         result[k] = lerp_rgba8_2d(img[k]->TexFormat, texels,
+                                   _mm_set1_ps(a[k]), _mm_set1_ps(b[k]));
+      }
+   }
+}
+
+
+/**
+ * sample_linear_2d() for an image that passes linear_rgba8_ok().
+ */
+static void
+sample_linear_2d_rgba8(struct gl_context *ctx,
+                       const struct gl_sampler_object *samp,
+                       const struct gl_texture_image *image, GLuint n,
+                       const GLfloat texcoords[][4], GLfloat rgba[][4])
+{
+   const struct gl_texture_image *img[4] = { image, image, image, image };
+   __m128 result[4];
+   GLuint i, k;
+
+   for (i = 0; i < n; i += 4) {
+      const GLuint count = MIN2(n - i, 4);
+      sample_2d_linear_rgba8_4(ctx, samp, img, count, texcoords + i, result);
+      for (k = 0; k < count; k++)
+         _mm_storeu_ps(rgba[i + k], result[k]);
+   }
+}
+
+
+/**
+ * sample_2d_linear_mipmap_linear() for a texture whose images pass
+ * linear_rgba8_ok().
+ */
+static void
+sample_2d_linear_mipmap_linear_rgba8(struct gl_context *ctx,
+                                     const struct gl_sampler_object *samp,
+                                     const struct gl_texture_object *tObj,
+                                     GLuint n, const GLfloat texcoords[][4],
+                                     const GLfloat lambda[],
+                                     GLfloat rgba[][4])
+{
+   const struct gl_texture_image *img0[4], *img1[4];
+   GLfloat f[4];
+   __m128 t0[4], t1[4];
+   GLuint i, k;
+
+   for (i = 0; i < n; i += 4) {
+      const GLuint count = MIN2(n - i, 4);
+      for (k = 0; k < 4; k++) {
+         const GLuint c = i + MIN2(k, count - 1);
+         const GLint level = linear_mipmap_level(tObj, lambda[c]);
+         if (level >= tObj->_MaxLevel) {
+            img0[k] = img1[k] = tObj->Image[0][tObj->_MaxLevel];
+            f[k] = -1.0F;  /* no lerp */
+         }
+         else {
+            img0[k] = tObj->Image[0][level];
+            img1[k] = tObj->Image[0][level + 1];
+            f[k] = FRAC(lambda[c]);
+         }
+      }
+
+      sample_2d_linear_rgba8_4(ctx, samp, img0, count, texcoords + i, t0);
+      sample_2d_linear_rgba8_4(ctx, samp, img1, count, texcoords + i, t1);
+      for (k = 0; k < count; k++) {
+         if (f[k] < 0.0F) {
+            _mm_storeu_ps(rgba[i + k], t0[k]);
+         }
+         else {
+            const __m128 w = _mm_set1_ps(f[k]);
+            _mm_storeu_ps(rgba[i + k],
+                          _mm_add_ps(t0[k],
+                                     _mm_mul_ps(w, _mm_sub_ps(t1[k], t0[k]))));
+         }
+      }
+   }
+}
+
+#endif /* TEXFILTER_SSE2 */
+
+
 static void
 sample_2d_nearest_mipmap_nearest(struct gl_context *ctx,
                                  const struct gl_sampler_object *samp,
@@ -1310,6 +1622,13 @@ sample_2d_linear_mipmap_linear( struct gl_context *ctx,
 {
    GLuint i;
    assert(lambda != NULL);
+#ifdef TEXFILTER_SSE2
+   if (linear_rgba8_ok(samp, _mesa_base_tex_image(tObj))) {
+      sample_2d_linear_mipmap_linear_rgba8(ctx, samp, tObj, n, texcoord,
+                                           lambda, rgba);
+      return;
+   }
+#endif
    for (i = 0; i < n; i++) {
       GLint level = linear_mipmap_level(tObj, lambda[i]);
       if (level >= tObj->_MaxLevel) {
@@ -1338,6 +1657,13 @@ sample_2d_linear_mipmap_linear_repeat(struct gl_context *ctx,
    assert(lambda != NULL);
    assert(samp->WrapS == GL_REPEAT);
    assert(samp->WrapT == GL_REPEAT);
+#ifdef TEXFILTER_SSE2
+   if (linear_rgba8_ok(samp, _mesa_base_tex_image(tObj))) {
+      sample_2d_linear_mipmap_linear_rgba8(ctx, samp, tObj, n, texcoord,
+                                           lambda, rgba);
+      return;
+   }
+#endif
    for (i = 0; i < n; i++) {
       GLint level = linear_mipmap_level(tObj, lambda[i]);
       if (level >= tObj->_MaxLevel) {
@@ -1386,6 +1712,12 @@ sample_linear_2d(struct gl_context *ctx,
    const struct gl_texture_image *image = _mesa_base_tex_image(tObj);
    const struct swrast_texture_image *swImg = swrast_texture_image_const(image);
    (void) lambda;
+#ifdef TEXFILTER_SSE2
+   if (linear_rgba8_ok(samp, image)) {
+      sample_linear_2d_rgba8(ctx, samp, image, n, texcoords, rgba);
+      return;
+   }
+#endif
    if (samp->WrapS == GL_REPEAT &&
        samp->WrapT == GL_REPEAT &&
        swImg->_IsPowerOfTwo &&
@@ -1623,14 +1955,18 @@ create_filter_table(void)
 {
    GLuint i;
    if (!weightLut) {
-      weightLut = malloc(WEIGHT_LUT_SIZE * sizeof(GLfloat));
+      GLfloat *lut = malloc(WEIGHT_LUT_SIZE * sizeof(GLfloat));
+
+      if (!lut)
+         return;
 
       for (i = 0; i < WEIGHT_LUT_SIZE; ++i) {
          GLfloat alpha = 2;
          GLfloat r2 = (GLfloat) i / (GLfloat) (WEIGHT_LUT_SIZE - 1);
          GLfloat weight = (GLfloat) exp(-alpha * r2);
-         weightLut[i] = weight;
+         lut[i] = weight;
       }
+      weightLut = lut;
    }
 }
 
@@ -1905,10 +2241,14 @@ sample_lambda_2d_aniso(struct gl_context *ctx,
       || (samp->MinLod != -1000.0 || samp->MaxLod != 1000.0);
 
    GLuint i;
-   
-   /* on first access create the lookup table containing the filter weights. */
+
+   /* the lookup table containing the filter weights was made when this
+    * function was chosen, as the span workers may get here together.
+    * Without it, filter as if there were no anisotropy.
+    */
    if (!weightLut) {
-      create_filter_table();
+      sample_lambda_2d(ctx, samp, tObj, n, texcoords, lambda_iso, rgba);
+      return;
    }
 
    texW = swImg->WidthScale;
@@ -3742,7 +4082,9 @@ _swrast_choose_texture_sample_func( struct gl_context *ctx,
             /* Anisotropic filtering extension. Activated only if mipmaps are used */
             if (sampler->MaxAnisotropy > 1.0 &&
                 sampler->MinFilter == GL_LINEAR_MIPMAP_LINEAR) {
-               return &sample_lambda_2d_aniso;
+               create_filter_table();
+               if (weightLut)
+                  return &sample_lambda_2d_aniso;
             }
             return &sample_lambda_2d;
          }
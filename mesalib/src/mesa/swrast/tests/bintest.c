@@ -0,0 +1,369 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Draws the same random triangles in a context that writes every span
+ * right away (SWRAST_NUM_THREADS=1) and in one that bins them for span
+ * threads, and checks the color, depth and stencil buffers come out
+ * bit for bit the same.  The triangles are big enough to wake the
+ * workers and cross many bands, some of them with edges on band
+ * boundaries, and they are drawn flat, smooth, textured (with mipmaps
+ * and perspective), blended, through depth and stencil tests, and mixed
+ * with lines, which are written on the drawing thread between the bins.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main/glheader.h"
+#include "main/blend.h"
+#include "main/clear.h"
+#include "main/context.h"
+#include "main/depth.h"
+#include "main/enable.h"
+#include "main/extensions.h"
+#include "main/framebuffer.h"
+#include "main/hint.h"
+#include "main/light.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "main/renderbuffer.h"
+#include "main/state.h"
+#include "main/stencil.h"
+#include "main/texenv.h"
+#include "main/teximage.h"
+#include "main/texobj.h"
+#include "main/texparam.h"
+#include "main/version.h"
+#include "drivers/common/driverfuncs.h"
+#include "swrast/swrast.h"
+#include "swrast/s_context.h"
+#include "swrast/s_renderbuffer.h"
+
+#define WIDTH      256
+#define HEIGHT     200
+#define TRIANGLES  60
+#define TEX_SIZE   64
+#define THREADS    "4"
+
+/* bands of the bins are this many rows, see s_bin.c */
+#define BAND_ROWS  16
+
+enum scene {
+   SCENE_FLAT,
+   SCENE_SMOOTH,
+   SCENE_TEXTURED,
+   SCENE_BLENDED,
+   SCENE_DEPTH_STENCIL,
+   SCENE_LINES,
+   NUM_SCENES
+};
+
+static const char *scene_names[NUM_SCENES] = {
+   "flat", "smooth", "textured", "blended", "depth/stencil", "lines",
+};
+
+struct test_context
+{
+   struct gl_context *ctx;
+   struct gl_framebuffer *fb;
+};
+
+
+static GLfloat
+random_float(GLfloat lo, GLfloat hi)
+{
+   return lo + (hi - lo) * (GLfloat) rand() / (GLfloat) RAND_MAX;
+}
+
+
+static void
+update_state(struct gl_context *ctx, GLuint new_state)
+{
+   _swrast_InvalidateState(ctx, new_state);
+}
+
+
+static GLboolean
+create_context(struct test_context *tc, const struct gl_config *visual,
+               const char *threads)
+{
+   struct dd_function_table functions;
+   struct gl_renderbuffer *rb;
+
+   /* read by swrast when it sets the context up */
+   setenv("SWRAST_NUM_THREADS", threads, 1);
+
+   _mesa_init_driver_functions(&functions);
+   functions.UpdateState = update_state;
+
+   tc->ctx = calloc(1, sizeof(struct gl_context));
+   if (!tc->ctx ||
+       !_mesa_initialize_context(tc->ctx, API_OPENGL_COMPAT, visual, NULL,
+                                 &functions) ||
+       !_swrast_CreateContext(tc->ctx))
+      return GL_FALSE;
+   _mesa_enable_sw_extensions(tc->ctx);
+   _mesa_compute_version(tc->ctx);
+
+   tc->fb = _mesa_create_framebuffer(visual);
+   if (!tc->fb)
+      return GL_FALSE;
+   /* swrast only makes color buffers through a context's driver */
+   rb = _swrast_new_soft_renderbuffer(tc->ctx, 0);
+   if (!rb)
+      return GL_FALSE;
+   rb->InternalFormat = GL_RGBA;
+   _mesa_add_renderbuffer(tc->fb, BUFFER_FRONT_LEFT, rb);
+   _swrast_add_soft_renderbuffers(tc->fb, GL_FALSE, GL_TRUE, GL_TRUE,
+                                  GL_FALSE, GL_FALSE, GL_FALSE);
+   _mesa_resize_framebuffer(tc->ctx, tc->fb, WIDTH, HEIGHT);
+   return _mesa_make_current(tc->ctx, tc->fb, tc->fb);
+}
+
+
+static void
+destroy_context(struct test_context *tc)
+{
+   _mesa_make_current(tc->ctx, tc->fb, tc->fb);
+   _swrast_DestroyContext(tc->ctx);
+   _mesa_make_current(NULL, NULL, NULL);
+   _mesa_free_context_data(tc->ctx);
+   free(tc->ctx);
+   _mesa_reference_framebuffer(&tc->fb, NULL);
+}
+
+
+/**
+ * A mipmapped TEX_SIZE x TEX_SIZE texture of random texels, bound to
+ * unit 0 with minification and magnification filters that differ, which
+ * keeps the triangles on the general (binned) path.
+ */
+static GLuint
+make_texture(void)
+{
+   GLubyte *texels = malloc(TEX_SIZE * TEX_SIZE * 4);
+   GLint size, level = 0;
+   GLuint tex, i;
+
+   _mesa_GenTextures(1, &tex);
+   _mesa_BindTexture(GL_TEXTURE_2D, tex);
+   for (size = TEX_SIZE; size > 0; size /= 2, level++) {
+      for (i = 0; i < size * size * 4; i++)
+         texels[i] = rand() & 0xff;
+      _mesa_TexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size, size, 0,
+                       GL_RGBA, GL_UNSIGNED_BYTE, texels);
+   }
+   _mesa_TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                       GL_LINEAR_MIPMAP_LINEAR);
+   _mesa_TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   _mesa_TexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+   _mesa_Enable(GL_TEXTURE_2D);
+   free(texels);
+   return tex;
+}
+
+
+/** A window coordinate, on a band boundary every now and then */
+static GLfloat
+random_coord(GLint size, GLboolean band)
+{
+   if (band && rand() % 3 == 0)
+      return (GLfloat) (BAND_ROWS * (rand() % (size / BAND_ROWS + 1)));
+   return random_float(0.0F, (GLfloat) size);
+}
+
+
+static void
+random_vertex(SWvertex *v, const struct gl_framebuffer *fb)
+{
+   GLuint c;
+
+   memset(v, 0, sizeof(*v));
+   v->attrib[VARYING_SLOT_POS][0] = random_coord(WIDTH, GL_FALSE);
+   v->attrib[VARYING_SLOT_POS][1] = random_coord(HEIGHT, GL_TRUE);
+   v->attrib[VARYING_SLOT_POS][2] = random_float(0.0F, fb->_DepthMaxF);
+   /* 1/w, for perspective correct texture coordinates */
+   v->attrib[VARYING_SLOT_POS][3] = random_float(0.25F, 4.0F);
+   for (c = 0; c < 4; c++) {
+      v->color[c] = rand() & 0xff;
+      v->attrib[VARYING_SLOT_COL0][c] = v->color[c] / 255.0F;
+   }
+   v->attrib[VARYING_SLOT_TEX0][0] = random_float(-2.0F, 2.0F);
+   v->attrib[VARYING_SLOT_TEX0][1] = random_float(-2.0F, 2.0F);
+   v->attrib[VARYING_SLOT_TEX0][3] = 1.0F;
+   v->pointSize = 1.0F;
+}
+
+
+/**
+ * Clear, set the scene's state up and draw its triangles, the random
+ * numbers coming from seed.
+ */
+static void
+draw_scene(struct test_context *tc, enum scene scene, unsigned seed)
+{
+   struct gl_context *ctx = tc->ctx;
+   GLuint tex = 0, i;
+
+   _mesa_make_current(ctx, tc->fb, tc->fb);
+   srand(seed);
+
+   _mesa_ClearColor(0.25F, 0.5F, 0.75F, 1.0F);
+   _mesa_ClearDepth(1.0);
+   _mesa_ClearStencil(0);
+   _mesa_Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+               GL_STENCIL_BUFFER_BIT);
+
+   _mesa_ShadeModel(scene == SCENE_FLAT ? GL_FLAT : GL_SMOOTH);
+   switch (scene) {
+   case SCENE_TEXTURED:
+      tex = make_texture();
+      _mesa_Hint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
+      break;
+   case SCENE_BLENDED:
+      _mesa_Enable(GL_BLEND);
+      _mesa_BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      break;
+   case SCENE_DEPTH_STENCIL:
+      _mesa_Enable(GL_DEPTH_TEST);
+      _mesa_DepthFunc(GL_LESS);
+      _mesa_Enable(GL_STENCIL_TEST);
+      _mesa_StencilFunc(GL_GEQUAL, 4, 0xff);
+      _mesa_StencilOp(GL_INCR, GL_INVERT, GL_INCR);
+      break;
+   case SCENE_LINES:
+      _mesa_Enable(GL_DEPTH_TEST);
+      _mesa_DepthFunc(GL_LEQUAL);
+      break;
+   default:
+      break;
+   }
+
+   _mesa_update_state(ctx);
+   _swrast_render_start(ctx);
+   for (i = 0; i < TRIANGLES; i++) {
+      SWvertex v[3];
+
+      random_vertex(&v[0], tc->fb);
+      random_vertex(&v[1], tc->fb);
+      random_vertex(&v[2], tc->fb);
+      _swrast_Triangle(ctx, &v[0], &v[1], &v[2]);
+      if (scene == SCENE_LINES && i % 4 == 3) {
+         _swrast_Line(ctx, &v[0], &v[2]);
+         _swrast_Line(ctx, &v[1], &v[2]);
+      }
+   }
+   _swrast_render_finish(ctx);
+
+   _mesa_Disable(GL_BLEND);
+   _mesa_Disable(GL_DEPTH_TEST);
+   _mesa_Disable(GL_STENCIL_TEST);
+   if (tex) {
+      _mesa_Disable(GL_TEXTURE_2D);
+      _mesa_DeleteTextures(1, &tex);
+   }
+   _mesa_update_state(ctx);
+}
+
+
+/**
+ * Compare a renderbuffer of the two framebuffers, row by row.
+ */
+static GLboolean
+same_buffer(const struct test_context *serial,
+            const struct test_context *binned, gl_buffer_index index,
+            const char *scene, const char *buffer)
+{
+   struct gl_renderbuffer *a = serial->fb->Attachment[index].Renderbuffer;
+   struct gl_renderbuffer *b = binned->fb->Attachment[index].Renderbuffer;
+   const GLint bytes = _mesa_get_format_bytes(a->Format);
+   const GLint stride = _mesa_format_row_stride(a->Format, a->Width);
+   GLint x, y;
+
+   for (y = 0; y < a->Height; y++) {
+      const GLubyte *rowA = swrast_renderbuffer(a)->Buffer + y * stride;
+      const GLubyte *rowB = swrast_renderbuffer(b)->Buffer + y * stride;
+
+      if (memcmp(rowA, rowB, a->Width * bytes) == 0)
+         continue;
+      for (x = 0; memcmp(rowA + x * bytes, rowB + x * bytes, bytes); x++)
+         ;
+      printf("%s: %s differs first at %d, %d\n", scene, buffer, x, y);
+      return GL_FALSE;
+   }
+   return GL_TRUE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct gl_config *visual;
+   struct test_context serial, binned;
+   GLuint failures = 0, s, pass;
+
+   (void) argc;
+   (void) argv;
+
+   visual = _mesa_create_visual(GL_FALSE, GL_FALSE, 8, 8, 8, 8, 24, 8,
+                                0, 0, 0, 0, 0);
+   if (!visual ||
+       !create_context(&serial, visual, "1") ||
+       !create_context(&binned, visual, THREADS)) {
+      printf("couldn't create the contexts\n");
+      return EXIT_FAILURE;
+   }
+
+   if (!SWRAST_CONTEXT(binned.ctx)->Bins) {
+      printf("spans are never binned in this build, nothing to compare\n");
+      return 77;
+   }
+
+   /* twice over, the second time with the workers already running */
+   for (pass = 0; pass < 2; pass++) {
+      for (s = 0; s < NUM_SCENES; s++) {
+         const unsigned seed = pass * NUM_SCENES + s + 1;
+         GLboolean same;
+
+         draw_scene(&serial, s, seed);
+         draw_scene(&binned, s, seed);
+
+         same = same_buffer(&serial, &binned, BUFFER_FRONT_LEFT,
+                            scene_names[s], "color");
+         same = same_buffer(&serial, &binned, BUFFER_DEPTH,
+                            scene_names[s], "depth") && same;
+         same = same_buffer(&serial, &binned, BUFFER_STENCIL,
+                            scene_names[s], "stencil") && same;
+         if (!same)
+            failures++;
+      }
+   }
+
+   printf("%u scenes compared, %u differed\n", 2 * NUM_SCENES, failures);
+
+   destroy_context(&binned);
+   destroy_context(&serial);
+   _mesa_destroy_visual(visual);
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,538 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Runs fragment programs over spans both span-wide (run_program_soa())
+ * and one fragment at a time through the program interpreter, and checks
+ * they produce the same colors, depths and kills.  The programs are
+ * random straight-line ones over every opcode the span-wide path
+ * accepts, plus TXB with a bias that changes from fragment to fragment,
+ * which takes lambda back and forth across the min/mag threshold.  They
+ * sample a mipmapped RGBA8 texture with minification and magnification
+ * filters that differ, so a span sampled as one run would go wrong.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main/glheader.h"
+#include "main/imports.h"
+#include "main/macros.h"
+#include "main/mtypes.h"
+#include "program/prog_instruction.h"
+#include "program/prog_parameter.h"
+#include "swrast/s_context.h"
+#include "swrast/s_fragprog.h"
+#include "swrast/s_span.h"
+#include "swrast/s_texfetch.h"
+#include "swrast/s_texfilter.h"
+
+#define PROGRAMS 400
+#define TEMPS    8
+#define PARAMS   8
+#define SPAN     200
+
+static const gl_inst_opcode opcodes[] = {
+   OPCODE_ABS, OPCODE_ADD, OPCODE_CMP, OPCODE_COS, OPCODE_DP2, OPCODE_DP3,
+   OPCODE_DP4, OPCODE_DPH, OPCODE_DST, OPCODE_EX2, OPCODE_FLR, OPCODE_FRC,
+   OPCODE_KIL, OPCODE_LG2, OPCODE_LIT, OPCODE_LRP, OPCODE_MAD, OPCODE_MAX,
+   OPCODE_MIN, OPCODE_MOV, OPCODE_MUL, OPCODE_NOP, OPCODE_POW, OPCODE_RCP,
+   OPCODE_RSQ, OPCODE_SCS, OPCODE_SEQ, OPCODE_SGE, OPCODE_SGT, OPCODE_SIN,
+   OPCODE_SLE, OPCODE_SLT, OPCODE_SNE, OPCODE_SSG, OPCODE_SUB, OPCODE_SWZ,
+   OPCODE_TEX, OPCODE_TXB, OPCODE_TXP, OPCODE_TRUNC, OPCODE_XPD,
+};
+
+static const GLuint inputs[] = {
+   VARYING_SLOT_POS, VARYING_SLOT_COL0, VARYING_SLOT_TEX0, VARYING_SLOT_TEX1,
+   VARYING_SLOT_VAR0,
+};
+
+/* minification and magnification filters, never the same */
+static const GLenum filters[][2] = {
+   { GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR },
+   { GL_NEAREST_MIPMAP_NEAREST, GL_LINEAR },
+   { GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR },
+   { GL_LINEAR_MIPMAP_NEAREST, GL_NEAREST },
+   { GL_LINEAR, GL_NEAREST },
+};
+
+static struct gl_context *ctx;
+static struct gl_fragment_program *fp;
+static SWspanarrays *arrays, *scalar_arrays, *soa_arrays;
+
+
+static GLfloat
+random_float(GLfloat lo, GLfloat hi)
+{
+   return lo + (hi - lo) * (GLfloat) rand() / (GLfloat) RAND_MAX;
+}
+
+
+/**
+ * A complete mipmapped 64x64 texture of random texels on unit 0.
+ */
+static struct gl_texture_object *
+make_texture(void)
+{
+   struct gl_texture_object *tObj = calloc(1, sizeof(*tObj));
+   GLint size = 64, level = 0;
+
+   tObj->Target = GL_TEXTURE_2D;
+   tObj->Sampler.sRGBDecode = GL_DECODE_EXT;
+   tObj->Sampler.WrapS = tObj->Sampler.WrapT = GL_REPEAT;
+   tObj->Sampler.MinLod = -1000.0F;
+   tObj->Sampler.MaxLod = 1000.0F;
+   tObj->_BaseComplete = tObj->_MipmapComplete = GL_TRUE;
+   tObj->_Swizzle = SWIZZLE_NOOP;
+
+   for (;;) {
+      struct swrast_texture_image *swImg = calloc(1, sizeof(*swImg));
+      struct gl_texture_image *img = &swImg->Base;
+      GLint i;
+
+      img->TexObject = tObj;
+      img->Level = level;
+      img->TexFormat = MESA_FORMAT_R8G8B8A8_UNORM;
+      img->_BaseFormat = GL_RGBA;
+      img->InternalFormat = GL_RGBA8;
+      img->Width = img->Width2 = size;
+      img->Height = img->Height2 = size;
+      img->Depth = img->Depth2 = 1;
+      img->WidthLog2 = img->HeightLog2 = _mesa_logbase2(size);
+
+      swImg->_IsPowerOfTwo = GL_TRUE;
+      swImg->WidthScale = swImg->HeightScale = (GLfloat) size;
+      swImg->DepthScale = 1.0F;
+      swImg->RowStride = size * 4;
+      swImg->Buffer = malloc(size * size * 4);
+      for (i = 0; i < size * size * 4; i++)
+         swImg->Buffer[i] = rand() & 0xff;
+      swImg->ImageSlices = calloc(1, sizeof(void *));
+      swImg->ImageSlices[0] = swImg->Buffer;
+
+      tObj->Image[0][level] = img;
+      if (size == 1)
+         break;
+      size /= 2;
+      level++;
+   }
+
+   tObj->BaseLevel = 0;
+   tObj->_MaxLevel = level;
+   tObj->_MaxLambda = (GLfloat) level;
+
+   ctx->Texture.Unit[0]._Current = tObj;
+   _mesa_update_fetch_functions(ctx, 0);
+   return tObj;
+}
+
+
+static void
+free_texture(struct gl_texture_object *tObj)
+{
+   GLint level;
+
+   for (level = 0; level <= tObj->_MaxLevel; level++) {
+      struct swrast_texture_image *swImg =
+         swrast_texture_image(tObj->Image[0][level]);
+      free(swImg->ImageSlices);
+      free(swImg->Buffer);
+      free(swImg);
+   }
+   free(tObj);
+}
+
+
+static void
+random_src(struct prog_src_register *src, GLboolean swz)
+{
+   GLuint c;
+
+   switch (rand() % 4) {
+   case 0:
+      src->File = PROGRAM_TEMPORARY;
+      src->Index = rand() % TEMPS;
+      break;
+   case 1:
+      src->File = PROGRAM_INPUT;
+      src->Index = inputs[rand() % ARRAY_SIZE(inputs)];
+      break;
+   case 2:
+      src->File = PROGRAM_CONSTANT;
+      src->Index = rand() % PARAMS;
+      break;
+   default:
+      src->File = PROGRAM_OUTPUT;
+      src->Index = rand() % 2 ? FRAG_RESULT_COLOR : FRAG_RESULT_DEPTH;
+      break;
+   }
+
+   /* SWZ can also pick zero and one, and negate components one by one */
+   src->Swizzle = 0;
+   for (c = 0; c < 4; c++)
+      src->Swizzle |= (rand() % (swz ? 6 : 4)) << (3 * c);
+   if (rand() % 3 == 0)
+      src->Swizzle = SWIZZLE_NOOP;
+   src->Abs = !swz && rand() % 5 == 0;
+   src->Negate = swz ? rand() % 16 : (rand() % 4 ? NEGATE_NONE : NEGATE_XYZW);
+}
+
+
+/**
+ * A random straight-line program: every temporary and output written
+ * first, then n random instructions.
+ */
+static struct prog_instruction *
+random_program(GLuint n)
+{
+   const GLuint init = TEMPS + 2;
+   struct prog_instruction *insts = _mesa_alloc_instructions(init + n + 1);
+   GLuint pc, i;
+
+   _mesa_init_instructions(insts, init + n + 1);
+
+   for (pc = 0; pc < init; pc++) {
+      struct prog_instruction *inst = &insts[pc];
+
+      inst->Opcode = OPCODE_MOV;
+      if (pc < TEMPS) {
+         inst->DstReg.File = PROGRAM_TEMPORARY;
+         inst->DstReg.Index = pc;
+      }
+      else {
+         inst->DstReg.File = PROGRAM_OUTPUT;
+         inst->DstReg.Index =
+            pc == TEMPS ? FRAG_RESULT_COLOR : FRAG_RESULT_DEPTH;
+      }
+      if (rand() % 2) {
+         inst->SrcReg[0].File = PROGRAM_INPUT;
+         inst->SrcReg[0].Index = inputs[rand() % ARRAY_SIZE(inputs)];
+      }
+      else {
+         inst->SrcReg[0].File = PROGRAM_CONSTANT;
+         inst->SrcReg[0].Index = rand() % PARAMS;
+      }
+   }
+
+   for (; pc < init + n; pc++) {
+      struct prog_instruction *inst = &insts[pc];
+
+      inst->Opcode = opcodes[rand() % ARRAY_SIZE(opcodes)];
+      /* not so many kills that nothing is left */
+      if (inst->Opcode == OPCODE_KIL && rand() % 3)
+         inst->Opcode = OPCODE_MAD;
+      if (rand() % 4) {
+         inst->DstReg.File = PROGRAM_TEMPORARY;
+         inst->DstReg.Index = rand() % TEMPS;
+      }
+      else {
+         inst->DstReg.File = PROGRAM_OUTPUT;
+         inst->DstReg.Index =
+            rand() % 2 ? FRAG_RESULT_COLOR : FRAG_RESULT_DEPTH;
+      }
+      inst->DstReg.WriteMask = 1 + rand() % 15;
+      inst->SaturateMode = rand() % 3 ? SATURATE_OFF : SATURATE_ZERO_ONE;
+      for (i = 0; i < 3; i++)
+         random_src(&inst->SrcReg[i], inst->Opcode == OPCODE_SWZ);
+      if (_mesa_is_tex_instruction(inst->Opcode)) {
+         inst->TexSrcUnit = rand() % 2;
+         inst->TexSrcTarget = TEXTURE_2D_INDEX;
+         /* mostly with the derivatives of a texcoord varying */
+         if (rand() % 3) {
+            inst->SrcReg[0].File = PROGRAM_INPUT;
+            inst->SrcReg[0].Index = VARYING_SLOT_TEX0 + inst->TexSrcUnit;
+            inst->SrcReg[0].Swizzle = SWIZZLE_NOOP;
+            inst->SrcReg[0].Negate = NEGATE_NONE;
+            inst->SrcReg[0].Abs = GL_FALSE;
+         }
+      }
+   }
+
+   insts[pc].Opcode = OPCODE_END;
+   return insts;
+}
+
+
+/**
+ * TXB from texcoord[0], whose w, the bias, is random for each fragment.
+ */
+static struct prog_instruction *
+txb_program(void)
+{
+   struct prog_instruction *insts = _mesa_alloc_instructions(3);
+
+   _mesa_init_instructions(insts, 3);
+   insts[0].Opcode = OPCODE_TXB;
+   insts[0].DstReg.File = PROGRAM_OUTPUT;
+   insts[0].DstReg.Index = FRAG_RESULT_COLOR;
+   insts[0].SrcReg[0].File = PROGRAM_INPUT;
+   insts[0].SrcReg[0].Index = VARYING_SLOT_TEX0;
+   insts[0].TexSrcUnit = 0;
+   insts[0].TexSrcTarget = TEXTURE_2D_INDEX;
+   insts[1].Opcode = OPCODE_MOV;
+   insts[1].DstReg.File = PROGRAM_OUTPUT;
+   insts[1].DstReg.Index = FRAG_RESULT_DEPTH;
+   insts[1].SrcReg[0].File = PROGRAM_INPUT;
+   insts[1].SrcReg[0].Index = VARYING_SLOT_COL0;
+   insts[2].Opcode = OPCODE_END;
+   return insts;
+}
+
+
+/**
+ * A span of n fragments, a few of them masked off, with texcoords that
+ * step smoothly across it and random everything else.
+ */
+static void
+make_span(SWspan *span, GLuint n, GLboolean bias)
+{
+   GLuint i, attr, c;
+
+   memset(span, 0, sizeof(*span));
+   span->end = n;
+   span->facing = rand() % 2;
+   span->writeAll = GL_TRUE;
+   span->array = arrays;
+
+   for (attr = 0; attr < VARYING_SLOT_MAX; attr++) {
+      for (c = 0; c < 4; c++) {
+         span->attrStepX[attr][c] = random_float(-0.05F, 0.05F);
+         span->attrStepY[attr][c] = random_float(-0.05F, 0.05F);
+      }
+   }
+
+   arrays->ChanType = GL_FLOAT;
+   for (i = 0; i < n; i++) {
+      arrays->mask[i] = rand() % 8 != 0;
+      for (attr = 0; attr < VARYING_SLOT_MAX; attr++) {
+         for (c = 0; c < 4; c++)
+            arrays->attribs[attr][i][c] = random_float(-4.0F, 4.0F);
+      }
+      for (c = 0; c < 4; c++) {
+         arrays->attribs[VARYING_SLOT_TEX0][i][c] =
+            i * span->attrStepX[VARYING_SLOT_TEX0][c];
+      }
+      arrays->attribs[VARYING_SLOT_TEX0][i][3] =
+         bias ? random_float(-3.0F, 3.0F) : 1.0F;
+      arrays->attribs[VARYING_SLOT_POS][i][3] = 1.0F;
+      arrays->z[i] = 0;
+   }
+}
+
+
+static GLboolean
+same_float(GLfloat a, GLfloat b)
+{
+   if (a == b || (IS_INF_OR_NAN(a) && IS_INF_OR_NAN(b)))
+      return GL_TRUE;
+   return fabsf(a - b) <= 1e-5F * MAX3(1.0F, fabsf(a), fabsf(b));
+}
+
+
+/** Copy what a span of n fragments uses of the (large) span arrays */
+static void
+copy_arrays(SWspanarrays *dst, const SWspanarrays *src, GLuint n)
+{
+   GLuint attr;
+
+   dst->ChanType = src->ChanType;
+   for (attr = 0; attr < VARYING_SLOT_MAX; attr++)
+      memcpy(dst->attribs[attr], src->attribs[attr], n * 4 * sizeof(GLfloat));
+   memcpy(dst->mask, src->mask, n * sizeof(GLubyte));
+   memcpy(dst->z, src->z, n * sizeof(GLuint));
+}
+
+
+/**
+ * Run the program on the span both ways and compare.
+ */
+static GLboolean
+check_span(const SWspan *orig, const char *name)
+{
+   SWcontext *swrast = SWRAST_CONTEXT(ctx);
+   SWspan scalar = *orig, soa = *orig;
+   GLuint i, c;
+
+   copy_arrays(scalar_arrays, arrays, orig->end);
+   copy_arrays(soa_arrays, arrays, orig->end);
+
+   scalar.array = scalar_arrays;
+   swrast->_FragProgSoa = GL_FALSE;
+   _swrast_exec_fragment_program(ctx, &scalar);
+
+   soa.array = soa_arrays;
+   swrast->_FragProgSoa = GL_TRUE;
+   _swrast_exec_fragment_program(ctx, &soa);
+
+   if (scalar.writeAll != soa.writeAll) {
+      printf("%s: writeAll %d, span-wide %d\n", name,
+             scalar.writeAll, soa.writeAll);
+      return GL_FALSE;
+   }
+   for (i = 0; i < orig->end; i++) {
+      if (scalar_arrays->mask[i] != soa_arrays->mask[i]) {
+         printf("%s: fragment %u mask %d, span-wide %d\n", name, i,
+                scalar_arrays->mask[i], soa_arrays->mask[i]);
+         return GL_FALSE;
+      }
+      if (!scalar_arrays->mask[i])
+         continue;
+      for (c = 0; c < 4; c++) {
+         const GLfloat a = scalar_arrays->attribs[VARYING_SLOT_COL0][i][c];
+         const GLfloat b = soa_arrays->attribs[VARYING_SLOT_COL0][i][c];
+         if (!same_float(a, b)) {
+            printf("%s: fragment %u color[%u] %g, span-wide %g\n", name,
+                   i, c, a, b);
+            return GL_FALSE;
+         }
+      }
+      if (scalar_arrays->z[i] != soa_arrays->z[i] &&
+          scalar_arrays->z[i] + 1 != soa_arrays->z[i] &&
+          scalar_arrays->z[i] != soa_arrays->z[i] + 1) {
+         printf("%s: fragment %u z %u, span-wide %u\n", name, i,
+                scalar_arrays->z[i], soa_arrays->z[i]);
+         return GL_FALSE;
+      }
+   }
+   return GL_TRUE;
+}
+
+
+static void
+use_program(struct prog_instruction *insts)
+{
+   GLuint n = 0;
+
+   while (insts[n].Opcode != OPCODE_END)
+      n++;
+   fp->Base.Instructions = insts;
+   fp->Base.NumInstructions = n + 1;
+   fp->OriginUpperLeft = rand() % 2;
+   fp->PixelCenterInteger = rand() % 2;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct gl_framebuffer *fb = calloc(1, sizeof(*fb));
+   struct gl_pipeline_object *pipeline = calloc(1, sizeof(*pipeline));
+   struct gl_program_parameter_list *params = calloc(1, sizeof(*params));
+   struct gl_texture_object *tObj;
+   GLuint failures = 0, checked = 0, f, p, i, c;
+
+   (void) argc;
+   (void) argv;
+
+   ctx = calloc(1, sizeof(*ctx));
+   ctx->swrast_context = calloc(1, sizeof(SWcontext));
+   fp = calloc(1, sizeof(*fp));
+   arrays = malloc(sizeof(*arrays));
+   scalar_arrays = malloc(sizeof(*scalar_arrays));
+   soa_arrays = malloc(sizeof(*soa_arrays));
+
+   fb->Height = SPAN;
+   fb->_DepthMax = 0xffffff;
+   fb->_DepthMaxF = (GLfloat) 0xffffff;
+   fb->_NumColorDrawBuffers = 1;
+   ctx->DrawBuffer = fb;
+   ctx->_Shader = pipeline;
+   ctx->FragmentProgram._Current = fp;
+
+   params->NumParameters = PARAMS;
+   params->ParameterValues = calloc(PARAMS, sizeof(gl_constant_value[4]));
+   fp->Base.Parameters = params;
+   fp->Base.Target = GL_FRAGMENT_PROGRAM_ARB;
+   for (i = 0; i < ARRAY_SIZE(inputs); i++)
+      fp->Base.InputsRead |= BITFIELD64_BIT(inputs[i]);
+   fp->Base.OutputsWritten = BITFIELD64_BIT(FRAG_RESULT_COLOR) |
+                             BITFIELD64_BIT(FRAG_RESULT_DEPTH);
+   /* TEX0 and TEX1 both sample unit 0 */
+   fp->Base.SamplerUnits[0] = fp->Base.SamplerUnits[1] = 0;
+
+   tObj = make_texture();
+
+   for (f = 0; f < ARRAY_SIZE(filters); f++) {
+      struct gl_sampler_object *samp = &tObj->Sampler;
+      char name[64];
+
+      samp->MinFilter = filters[f][0];
+      samp->MagFilter = filters[f][1];
+      SWRAST_CONTEXT(ctx)->TextureSample[0] =
+         _swrast_choose_texture_sample_func(ctx, tObj, samp);
+
+      for (p = 0; p < PROGRAMS; p++) {
+         struct prog_instruction *insts;
+         SWspan span;
+
+         srand(f * PROGRAMS + p + 1);
+         for (i = 0; i < PARAMS; i++) {
+            for (c = 0; c < 4; c++)
+               params->ParameterValues[i][c].f = random_float(-4.0F, 4.0F);
+         }
+         ctx->Texture.Unit[0].LodBias = random_float(-1.0F, 1.0F);
+
+         /* every other one a TXB with a bias of its own per fragment */
+         if (p % 2) {
+            insts = txb_program();
+            snprintf(name, sizeof(name), "filters %u, TXB %u", f, p);
+         }
+         else {
+            insts = random_program(1 + rand() % 20);
+            snprintf(name, sizeof(name), "filters %u, program %u", f, p);
+         }
+         use_program(insts);
+         pipeline->CurrentProgram[MESA_SHADER_FRAGMENT] =
+            rand() % 2 ? (struct gl_shader_program *) pipeline : NULL;
+
+         if (!_swrast_fragment_program_soa_ok(fp)) {
+            printf("%s: not run span-wide\n", name);
+            failures++;
+         }
+         else {
+            make_span(&span, 1 + rand() % SPAN, p % 2);
+            if (!check_span(&span, name))
+               failures++;
+            checked++;
+         }
+         _mesa_free_instructions(insts, fp->Base.NumInstructions);
+      }
+   }
+
+   printf("%u programs checked, %u failed\n", checked, failures);
+
+   free_texture(tObj);
+   free(params->ParameterValues);
+   free(params);
+   free(soa_arrays);
+   free(scalar_arrays);
+   free(arrays);
+   _mesa_align_free(SWRAST_CONTEXT(ctx)->Thread.FragProgSoa);
+   free(ctx->swrast_context);
+   free(fp);
+   free(pipeline);
+   free(fb);
+   free(ctx);
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
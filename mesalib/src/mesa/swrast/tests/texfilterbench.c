@@ -0,0 +1,309 @@
+/*
+ * Mesa 3-D graphics library
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Samples RGBA8 2D textures with GL_LINEAR and GL_LINEAR_MIPMAP_LINEAR
+ * filtering, GL_REPEAT and GL_CLAMP_TO_EDGE wrapping, at power of two and
+ * NPOT sizes, through sample_linear_2d() and
+ * sample_2d_linear_mipmap_linear() and through the per-texel scalar code
+ * they use for other formats.  Checks both give the same bits and prints
+ * the texels per second of each, best of a few tries.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* The sampling functions are all static */
+#include "swrast/s_texfilter.c"
+#include "swrast/s_texfetch.h"
+
+#define TEXELS  (1 << 18)
+#define SPAN    64
+#define TRIES   5
+
+typedef void (*scalar_linear_func)(struct gl_context *ctx,
+                                   const struct gl_sampler_object *samp,
+                                   const struct gl_texture_image *img,
+                                   const GLfloat texcoord[4],
+                                   GLfloat rgba[]);
+
+static const struct {
+   mesa_format format;
+   const char *name;
+} formats[] = {
+   { MESA_FORMAT_R8G8B8A8_UNORM, "RGBA" },
+   { MESA_FORMAT_B8G8R8A8_UNORM, "BGRA" },
+   { MESA_FORMAT_A8B8G8R8_UNORM, "ABGR" },
+};
+
+static const GLint sizes[][2] = { { 256, 256 }, { 300, 200 } };
+
+static GLfloat texcoords[TEXELS][4];
+static GLfloat lambda[TEXELS];
+static GLfloat scalar_rgba[TEXELS][4];
+static GLfloat rgba[TEXELS][4];
+
+
+static double
+now(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+static GLfloat
+random_float(GLfloat lo, GLfloat hi)
+{
+   return lo + (hi - lo) * (GLfloat) rand() / (GLfloat) RAND_MAX;
+}
+
+
+/**
+ * A complete mipmapped texture of random texels, FetchTexel set up.
+ */
+static struct gl_texture_object *
+make_texture(struct gl_context *ctx, GLint width, GLint height,
+             mesa_format format)
+{
+   struct gl_texture_object *tObj = calloc(1, sizeof(*tObj));
+   GLint level = 0;
+
+   tObj->Target = GL_TEXTURE_2D;
+   tObj->Sampler.sRGBDecode = GL_DECODE_EXT;
+
+   for (;;) {
+      struct swrast_texture_image *swImg = calloc(1, sizeof(*swImg));
+      struct gl_texture_image *img = &swImg->Base;
+      GLint i;
+
+      img->TexObject = tObj;
+      img->Level = level;
+      img->TexFormat = format;
+      img->_BaseFormat = GL_RGBA;
+      img->InternalFormat = GL_RGBA8;
+      img->Width = img->Width2 = width;
+      img->Height = img->Height2 = height;
+      img->Depth = img->Depth2 = 1;
+      img->WidthLog2 = _mesa_logbase2(width);
+      img->HeightLog2 = _mesa_logbase2(height);
+
+      swImg->_IsPowerOfTwo = _mesa_is_pow_two(width) &&
+                             _mesa_is_pow_two(height);
+      swImg->RowStride = width * 4;
+      swImg->Buffer = malloc(width * height * 4);
+      for (i = 0; i < width * height * 4; i++)
+         swImg->Buffer[i] = rand() & 0xff;
+      swImg->ImageSlices = calloc(1, sizeof(void *));
+      swImg->ImageSlices[0] = swImg->Buffer;
+
+      tObj->Image[0][level] = img;
+      if (width == 1 && height == 1)
+         break;
+      width = MAX2(width / 2, 1);
+      height = MAX2(height / 2, 1);
+      level++;
+   }
+
+   tObj->BaseLevel = 0;
+   tObj->_MaxLevel = level;
+   tObj->_MaxLambda = (GLfloat) level;
+
+   ctx->Texture.Unit[0]._Current = tObj;
+   _mesa_update_fetch_functions(ctx, 0);
+   return tObj;
+}
+
+
+static void
+free_texture(struct gl_texture_object *tObj)
+{
+   GLint level;
+
+   for (level = 0; level <= tObj->_MaxLevel; level++) {
+      struct swrast_texture_image *swImg =
+         swrast_texture_image(tObj->Image[0][level]);
+      free(swImg->ImageSlices);
+      free(swImg->Buffer);
+      free(swImg);
+   }
+   free(tObj);
+}
+
+
+static scalar_linear_func
+scalar_func(const struct gl_sampler_object *samp,
+            const struct gl_texture_object *tObj)
+{
+   const struct gl_texture_image *img = _mesa_base_tex_image(tObj);
+
+   if (samp->WrapS == GL_REPEAT && samp->WrapT == GL_REPEAT &&
+       swrast_texture_image_const(img)->_IsPowerOfTwo)
+      return sample_2d_linear_repeat;
+   return sample_2d_linear;
+}
+
+
+/**
+ * sample_linear_2d() and sample_2d_linear_mipmap_linear() the way they
+ * sample any other format.
+ */
+static void
+scalar_sample(struct gl_context *ctx, const struct gl_sampler_object *samp,
+              const struct gl_texture_object *tObj, GLuint n,
+              const GLfloat texcoords[][4], const GLfloat lambda[],
+              GLfloat rgba[][4])
+{
+   const scalar_linear_func linear = scalar_func(samp, tObj);
+   GLuint i;
+
+   for (i = 0; i < n; i++) {
+      if (samp->MinFilter == GL_LINEAR) {
+         linear(ctx, samp, _mesa_base_tex_image(tObj), texcoords[i], rgba[i]);
+      }
+      else {
+         const GLint level = linear_mipmap_level(tObj, lambda[i]);
+         if (level >= tObj->_MaxLevel) {
+            linear(ctx, samp, tObj->Image[0][tObj->_MaxLevel],
+                   texcoords[i], rgba[i]);
+         }
+         else {
+            GLfloat t0[4], t1[4];
+            const GLfloat f = FRAC(lambda[i]);
+            linear(ctx, samp, tObj->Image[0][level], texcoords[i], t0);
+            linear(ctx, samp, tObj->Image[0][level + 1], texcoords[i], t1);
+            lerp_rgba(rgba[i], f, t0, t1);
+         }
+      }
+   }
+}
+
+
+static void
+sample(struct gl_context *ctx, const struct gl_sampler_object *samp,
+       const struct gl_texture_object *tObj, GLuint n,
+       const GLfloat texcoords[][4], const GLfloat lambda[],
+       GLfloat rgba[][4])
+{
+   if (samp->MinFilter == GL_LINEAR)
+      sample_linear_2d(ctx, samp, tObj, n, texcoords, NULL, rgba);
+   else
+      sample_2d_linear_mipmap_linear(ctx, samp, tObj, n, texcoords,
+                                     lambda, rgba);
+}
+
+
+static double
+texels_per_second(struct gl_context *ctx,
+                  const struct gl_sampler_object *samp,
+                  const struct gl_texture_object *tObj, GLboolean scalar,
+                  GLfloat out[][4])
+{
+   double best = 0.0;
+   int try, i;
+
+   for (try = 0; try < TRIES; try++) {
+      double start = now(), secs;
+      for (i = 0; i < TEXELS; i += SPAN) {
+         if (scalar)
+            scalar_sample(ctx, samp, tObj, SPAN, texcoords + i, lambda + i,
+                          out + i);
+         else
+            sample(ctx, samp, tObj, SPAN, texcoords + i, lambda + i,
+                   out + i);
+      }
+      secs = now() - start;
+      if (try == 0 || secs < best)
+         best = secs;
+   }
+   return TEXELS / best;
+}
+
+
+static GLboolean
+bench(struct gl_context *ctx, struct gl_texture_object *tObj,
+      const char *format, GLenum filter, GLenum wrap)
+{
+   struct gl_sampler_object *samp = &tObj->Sampler;
+   const struct gl_texture_image *img = _mesa_base_tex_image(tObj);
+   char name[64];
+   double scalar, simd;
+   GLboolean ok;
+
+   samp->MinFilter = filter;
+   samp->MagFilter = GL_LINEAR;
+   samp->WrapS = samp->WrapT = wrap;
+
+   scalar = texels_per_second(ctx, samp, tObj, GL_TRUE, scalar_rgba);
+   simd = texels_per_second(ctx, samp, tObj, GL_FALSE, rgba);
+   ok = memcmp(scalar_rgba, rgba, sizeof(rgba)) == 0;
+
+   snprintf(name, sizeof(name), "%s %dx%d %s %s", format,
+            img->Width, img->Height,
+            filter == GL_LINEAR ? "linear" : "linear_mipmap_linear",
+            wrap == GL_REPEAT ? "repeat" : "clamp_to_edge");
+   printf("  %-48s %8.1f Mtexel/s scalar %8.1f Mtexel/s%s\n", name,
+          scalar / 1e6, simd / 1e6, ok ? "" : "  MISMATCH");
+   return ok;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   struct gl_context *ctx = calloc(1, sizeof(*ctx));
+   GLboolean ok = GL_TRUE;
+   unsigned f, s;
+   int i;
+
+   (void) argc;
+   (void) argv;
+
+   /* Both sides of the edges, and exactly on them now and then */
+   for (i = 0; i < TEXELS; i++) {
+      texcoords[i][0] = i % 61 ? random_float(-2.0F, 3.0F) : (i & 1);
+      texcoords[i][1] = i % 67 ? random_float(-2.0F, 3.0F) : (i & 2) >> 1;
+      lambda[i] = random_float(-0.5F, 9.5F);
+   }
+
+   for (f = 0; f < ARRAY_SIZE(formats); f++) {
+      for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+         struct gl_texture_object *tObj =
+            make_texture(ctx, sizes[s][0], sizes[s][1], formats[f].format);
+         ok = bench(ctx, tObj, formats[f].name, GL_LINEAR,
+                    GL_REPEAT) && ok;
+         ok = bench(ctx, tObj, formats[f].name, GL_LINEAR,
+                    GL_CLAMP_TO_EDGE) && ok;
+         ok = bench(ctx, tObj, formats[f].name, GL_LINEAR_MIPMAP_LINEAR,
+                    GL_REPEAT) && ok;
+         ok = bench(ctx, tObj, formats[f].name, GL_LINEAR_MIPMAP_LINEAR,
+                    GL_CLAMP_TO_EDGE) && ok;
+         free_texture(tObj);
+      }
+   }
+
+   free(ctx);
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
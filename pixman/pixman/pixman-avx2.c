@@ -0,0 +1,1000 @@
+/*
+ * Copyright © 2008 Rodrigo Kumpera
+ * Copyright © 2008 André Tupinambá
+ * Copyright © 2013 Soren Sandmann Pedersen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Based on pixman-sse2.c and pixman-ssse3.c; the arithmetic is the same,
+ * eight pixels at a time, so the results are bit for bit identical to
+ * those of the SSE2 and C implementations.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+#include "pixman-private.h"
+#include "pixman-inlines.h"
+
+/* ---------------------------------------------------------------------
+ * Helpers
+ *
+ * All the 256 bit instructions used below operate on the two 128 bit
+ * lanes independently, so a register holding eight pixels unpacks into
+ * a "lo" register holding pixels 0, 1, 4, 5 and a "hi" register holding
+ * pixels 2, 3, 6, 7, and packing them again restores the original order.
+ */
+
+static force_inline __m256i
+load_256_unaligned (const __m256i* src)
+{
+    return _mm256_loadu_si256 (src);
+}
+
+static force_inline void
+save_256_unaligned (__m256i* dst, __m256i data)
+{
+    _mm256_storeu_si256 (dst, data);
+}
+
+static force_inline void
+unpack_256_2x256 (__m256i data, __m256i* data_lo, __m256i* data_hi)
+{
+    *data_lo = _mm256_unpacklo_epi8 (data, _mm256_setzero_si256 ());
+    *data_hi = _mm256_unpackhi_epi8 (data, _mm256_setzero_si256 ());
+}
+
+static force_inline __m256i
+pack_2x256_256 (__m256i lo, __m256i hi)
+{
+    return _mm256_packus_epi16 (lo, hi);
+}
+
+static force_inline __m256i
+pix_multiply_256 (__m256i data, __m256i alpha)
+{
+    __m256i t = _mm256_mullo_epi16 (data, alpha);
+
+    t = _mm256_adds_epu16 (t, _mm256_set1_epi16 (0x0080));
+    return _mm256_mulhi_epu16 (t, _mm256_set1_epi16 (0x0101));
+}
+
+static force_inline void
+pix_multiply_2x256 (__m256i* data_lo, __m256i* data_hi,
+		    __m256i* alpha_lo, __m256i* alpha_hi,
+		    __m256i* ret_lo, __m256i* ret_hi)
+{
+    *ret_lo = pix_multiply_256 (*data_lo, *alpha_lo);
+    *ret_hi = pix_multiply_256 (*data_hi, *alpha_hi);
+}
+
+/* s * a1 + d * a2, saturated */
+static force_inline __m256i
+pix_add_multiply_256 (__m256i s, __m256i a1, __m256i d, __m256i a2)
+{
+    return _mm256_adds_epu8 (pix_multiply_256 (s, a1),
+			     pix_multiply_256 (d, a2));
+}
+
+static force_inline __m256i
+expand_alpha_256 (__m256i data)
+{
+    data = _mm256_shufflelo_epi16 (data, _MM_SHUFFLE (3, 3, 3, 3));
+    return _mm256_shufflehi_epi16 (data, _MM_SHUFFLE (3, 3, 3, 3));
+}
+
+static force_inline void
+expand_alpha_2x256 (__m256i data_lo, __m256i data_hi,
+		    __m256i* alpha_lo, __m256i* alpha_hi)
+{
+    *alpha_lo = expand_alpha_256 (data_lo);
+    *alpha_hi = expand_alpha_256 (data_hi);
+}
+
+static force_inline __m256i
+negate_256 (__m256i data)
+{
+    return _mm256_xor_si256 (data, _mm256_set1_epi16 (0x00ff));
+}
+
+static force_inline void
+negate_2x256 (__m256i data_lo, __m256i data_hi,
+	      __m256i* neg_lo, __m256i* neg_hi)
+{
+    *neg_lo = negate_256 (data_lo);
+    *neg_hi = negate_256 (data_hi);
+}
+
+static force_inline void
+over_2x256 (__m256i* src_lo, __m256i* src_hi,
+	    __m256i* alpha_lo, __m256i* alpha_hi,
+	    __m256i* dst_lo, __m256i* dst_hi)
+{
+    __m256i t1, t2;
+
+    negate_2x256 (*alpha_lo, *alpha_hi, &t1, &t2);
+
+    pix_multiply_2x256 (dst_lo, dst_hi, &t1, &t2, dst_lo, dst_hi);
+
+    *dst_lo = _mm256_adds_epu8 (*src_lo, *dst_lo);
+    *dst_hi = _mm256_adds_epu8 (*src_hi, *dst_hi);
+}
+
+static force_inline void
+in_over_2x256 (__m256i* src_lo, __m256i* src_hi,
+	       __m256i* alpha_lo, __m256i* alpha_hi,
+	       __m256i* mask_lo, __m256i* mask_hi,
+	       __m256i* dst_lo, __m256i* dst_hi)
+{
+    __m256i s_lo, s_hi;
+    __m256i a_lo, a_hi;
+
+    pix_multiply_2x256 (src_lo, src_hi, mask_lo, mask_hi, &s_lo, &s_hi);
+    pix_multiply_2x256 (alpha_lo, alpha_hi, mask_lo, mask_hi, &a_lo, &a_hi);
+
+    over_2x256 (&s_lo, &s_hi, &a_lo, &a_hi, dst_lo, dst_hi);
+}
+
+static force_inline int
+is_opaque_256 (__m256i x)
+{
+    __m256i ffs = _mm256_cmpeq_epi8 (x, x);
+
+    return ((uint32_t)_mm256_movemask_epi8 (
+		_mm256_cmpeq_epi8 (x, ffs)) & 0x88888888) == 0x88888888;
+}
+
+static force_inline int
+is_zero_256 (__m256i x)
+{
+    return (uint32_t)_mm256_movemask_epi8 (
+	_mm256_cmpeq_epi8 (x, _mm256_setzero_si256 ())) == 0xffffffff;
+}
+
+static force_inline int
+is_transparent_256 (__m256i x)
+{
+    return ((uint32_t)_mm256_movemask_epi8 (
+		_mm256_cmpeq_epi8 (x, _mm256_setzero_si256 ())) & 0x88888888)
+	== 0x88888888;
+}
+
+/* Selects the first w (< 8) pixels for the masked loads and stores
+ * that finish off a scanline.
+ */
+static force_inline __m256i
+tail_mask_256 (int w)
+{
+    return _mm256_cmpgt_epi32 (_mm256_set1_epi32 (w),
+			       _mm256_set_epi32 (7, 6, 5, 4, 3, 2, 1, 0));
+}
+
+static force_inline __m256i
+load_256_masked (const uint32_t *src, __m256i lmask)
+{
+    return _mm256_maskload_epi32 ((int *)src, lmask);
+}
+
+static force_inline void
+save_256_masked (uint32_t *dst, __m256i lmask, __m256i data)
+{
+    _mm256_maskstore_epi32 ((int *)dst, lmask, data);
+}
+
+/* ---------------------------------------------------------------------
+ * Combiners
+ */
+
+static force_inline __m256i
+apply_mask_256 (__m256i s, __m256i m)
+{
+    __m256i s_lo, s_hi;
+    __m256i m_lo, m_hi;
+
+    if (is_transparent_256 (m))
+	return _mm256_setzero_si256 ();
+
+    unpack_256_2x256 (s, &s_lo, &s_hi);
+    unpack_256_2x256 (m, &m_lo, &m_hi);
+
+    expand_alpha_2x256 (m_lo, m_hi, &m_lo, &m_hi);
+
+    pix_multiply_2x256 (&s_lo, &s_hi, &m_lo, &m_hi, &s_lo, &s_hi);
+
+    return pack_2x256_256 (s_lo, s_hi);
+}
+
+static force_inline __m256i
+combine8 (const uint32_t *ps, const uint32_t *pm)
+{
+    __m256i s = load_256_unaligned ((__m256i*)ps);
+
+    if (pm)
+	s = apply_mask_256 (s, load_256_unaligned ((__m256i*)pm));
+
+    return s;
+}
+
+static force_inline __m256i
+combine_tail (const uint32_t *ps, const uint32_t *pm, __m256i lmask)
+{
+    __m256i s = load_256_masked (ps, lmask);
+
+    if (pm)
+	s = apply_mask_256 (s, load_256_masked (pm, lmask));
+
+    return s;
+}
+
+static force_inline __m256i
+over_256 (__m256i s, __m256i d)
+{
+    __m256i xmm_src_lo, xmm_src_hi;
+    __m256i xmm_dst_lo, xmm_dst_hi;
+    __m256i xmm_alpha_lo, xmm_alpha_hi;
+
+    unpack_256_2x256 (s, &xmm_src_lo, &xmm_src_hi);
+    unpack_256_2x256 (d, &xmm_dst_lo, &xmm_dst_hi);
+
+    expand_alpha_2x256 (
+	xmm_src_lo, xmm_src_hi, &xmm_alpha_lo, &xmm_alpha_hi);
+
+    over_2x256 (&xmm_src_lo, &xmm_src_hi,
+		&xmm_alpha_lo, &xmm_alpha_hi,
+		&xmm_dst_lo, &xmm_dst_hi);
+
+    return pack_2x256_256 (xmm_dst_lo, xmm_dst_hi);
+}
+
+static void
+avx2_combine_over_u (pixman_implementation_t *imp,
+                     pixman_op_t              op,
+                     uint32_t *               pd,
+                     const uint32_t *         ps,
+                     const uint32_t *         pm,
+                     int                      w)
+{
+    __m256i xmm_src, lmask;
+
+    while (w >= 8)
+    {
+	xmm_src = combine8 (ps, pm);
+
+	if (is_opaque_256 (xmm_src))
+	{
+	    save_256_unaligned ((__m256i*)pd, xmm_src);
+	}
+	else if (!is_zero_256 (xmm_src))
+	{
+	    save_256_unaligned (
+		(__m256i*)pd,
+		over_256 (xmm_src, load_256_unaligned ((__m256i*)pd)));
+	}
+
+	ps += 8;
+	pd += 8;
+	if (pm)
+	    pm += 8;
+	w -= 8;
+    }
+
+    if (w)
+    {
+	lmask = tail_mask_256 (w);
+	xmm_src = combine_tail (ps, pm, lmask);
+
+	if (!is_zero_256 (xmm_src))
+	{
+	    save_256_masked (
+		pd, lmask, over_256 (xmm_src, load_256_masked (pd, lmask)));
+	}
+    }
+}
+
+/* The remaining unified combiners all have the shape
+ *
+ *     dest = f (combine (src, mask), dest)
+ *
+ * so they are generated from a function working on the unpacked source
+ * and destination.
+ */
+
+static force_inline __m256i
+over_reverse_256 (__m256i s, __m256i d)
+{
+    return _mm256_adds_epu8 (
+	d, pix_multiply_256 (s, negate_256 (expand_alpha_256 (d))));
+}
+
+static force_inline __m256i
+in_256 (__m256i s, __m256i d)
+{
+    return pix_multiply_256 (s, expand_alpha_256 (d));
+}
+
+static force_inline __m256i
+in_reverse_256 (__m256i s, __m256i d)
+{
+    return pix_multiply_256 (d, expand_alpha_256 (s));
+}
+
+static force_inline __m256i
+out_256 (__m256i s, __m256i d)
+{
+    return pix_multiply_256 (s, negate_256 (expand_alpha_256 (d)));
+}
+
+static force_inline __m256i
+out_reverse_256 (__m256i s, __m256i d)
+{
+    return pix_multiply_256 (d, negate_256 (expand_alpha_256 (s)));
+}
+
+static force_inline __m256i
+atop_256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_256 (
+	s, expand_alpha_256 (d), d, negate_256 (expand_alpha_256 (s)));
+}
+
+static force_inline __m256i
+atop_reverse_256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_256 (
+	s, negate_256 (expand_alpha_256 (d)), d, expand_alpha_256 (s));
+}
+
+static force_inline __m256i
+xor_256 (__m256i s, __m256i d)
+{
+    return pix_add_multiply_256 (
+	s, negate_256 (expand_alpha_256 (d)),
+	d, negate_256 (expand_alpha_256 (s)));
+}
+
+#define AVX2_COMBINE_U(name)						\
+    static force_inline __m256i						\
+    name ## _8 (__m256i s, __m256i d)					\
+    {									\
+	__m256i xmm_src_lo, xmm_src_hi;					\
+	__m256i xmm_dst_lo, xmm_dst_hi;					\
+									\
+	unpack_256_2x256 (s, &xmm_src_lo, &xmm_src_hi);			\
+	unpack_256_2x256 (d, &xmm_dst_lo, &xmm_dst_hi);			\
+									\
+	return pack_2x256_256 (name ## _256 (xmm_src_lo, xmm_dst_lo),	\
+			       name ## _256 (xmm_src_hi, xmm_dst_hi));	\
+    }									\
+									\
+    static void								\
+    avx2_combine_ ## name ## _u (pixman_implementation_t *imp,		\
+				 pixman_op_t              op,		\
+				 uint32_t *               pd,		\
+				 const uint32_t *         ps,		\
+				 const uint32_t *         pm,		\
+				 int                      w)		\
+    {									\
+	__m256i lmask;							\
+									\
+	while (w >= 8)							\
+	{								\
+	    save_256_unaligned (						\
+		(__m256i*)pd,						\
+		name ## _8 (combine8 (ps, pm),				\
+			    load_256_unaligned ((__m256i*)pd)));	\
+									\
+	    ps += 8;							\
+	    pd += 8;							\
+	    if (pm)							\
+		pm += 8;						\
+	    w -= 8;							\
+	}								\
+									\
+	if (w)								\
+	{								\
+	    lmask = tail_mask_256 (w);					\
+	    save_256_masked (						\
+		pd, lmask,						\
+		name ## _8 (combine_tail (ps, pm, lmask),		\
+			    load_256_masked (pd, lmask)));		\
+	}								\
+    }
+
+AVX2_COMBINE_U (over_reverse)
+AVX2_COMBINE_U (in)
+AVX2_COMBINE_U (in_reverse)
+AVX2_COMBINE_U (out)
+AVX2_COMBINE_U (out_reverse)
+AVX2_COMBINE_U (atop)
+AVX2_COMBINE_U (atop_reverse)
+AVX2_COMBINE_U (xor)
+
+static void
+avx2_combine_add_u (pixman_implementation_t *imp,
+                    pixman_op_t              op,
+                    uint32_t *               pd,
+                    const uint32_t *         ps,
+                    const uint32_t *         pm,
+                    int                      w)
+{
+    __m256i lmask;
+
+    while (w >= 8)
+    {
+	save_256_unaligned (
+	    (__m256i*)pd,
+	    _mm256_adds_epu8 (combine8 (ps, pm),
+			      load_256_unaligned ((__m256i*)pd)));
+
+	ps += 8;
+	pd += 8;
+	if (pm)
+	    pm += 8;
+	w -= 8;
+    }
+
+    if (w)
+    {
+	lmask = tail_mask_256 (w);
+	save_256_masked (
+	    pd, lmask,
+	    _mm256_adds_epu8 (combine_tail (ps, pm, lmask),
+			      load_256_masked (pd, lmask)));
+    }
+}
+
+/* ---------------------------------------------------------------------
+ * Fast paths
+ */
+
+static void
+avx2_composite_over_8888_8888 (pixman_implementation_t *imp,
+                               pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    int dst_stride, src_stride;
+    uint32_t    *dst_line, *dst;
+    uint32_t    *src_line, *src;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+
+    dst = dst_line;
+    src = src_line;
+
+    while (height--)
+    {
+	avx2_combine_over_u (imp, op, dst, src, NULL, width);
+
+	dst += dst_stride;
+	src += src_stride;
+    }
+}
+
+static void
+avx2_composite_src_x888_8888 (pixman_implementation_t *imp,
+			      pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint32_t    *dst_line, *dst;
+    uint32_t    *src_line, *src;
+    int32_t w;
+    int dst_stride, src_stride;
+    __m256i mask_ff000000 = _mm256_set1_epi32 (0xff000000);
+    __m256i lmask;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	src_image, src_x, src_y, uint32_t, src_stride, src_line, 1);
+
+    while (height--)
+    {
+	dst = dst_line;
+	dst_line += dst_stride;
+	src = src_line;
+	src_line += src_stride;
+	w = width;
+
+	while (w >= 32)
+	{
+	    __m256i xmm_src1, xmm_src2, xmm_src3, xmm_src4;
+
+	    xmm_src1 = load_256_unaligned ((__m256i*)src + 0);
+	    xmm_src2 = load_256_unaligned ((__m256i*)src + 1);
+	    xmm_src3 = load_256_unaligned ((__m256i*)src + 2);
+	    xmm_src4 = load_256_unaligned ((__m256i*)src + 3);
+
+	    save_256_unaligned ((__m256i*)dst + 0, _mm256_or_si256 (xmm_src1, mask_ff000000));
+	    save_256_unaligned ((__m256i*)dst + 1, _mm256_or_si256 (xmm_src2, mask_ff000000));
+	    save_256_unaligned ((__m256i*)dst + 2, _mm256_or_si256 (xmm_src3, mask_ff000000));
+	    save_256_unaligned ((__m256i*)dst + 3, _mm256_or_si256 (xmm_src4, mask_ff000000));
+
+	    dst += 32;
+	    src += 32;
+	    w -= 32;
+	}
+
+	while (w >= 8)
+	{
+	    save_256_unaligned (
+		(__m256i*)dst,
+		_mm256_or_si256 (load_256_unaligned ((__m256i*)src),
+				 mask_ff000000));
+
+	    dst += 8;
+	    src += 8;
+	    w -= 8;
+	}
+
+	if (w)
+	{
+	    lmask = tail_mask_256 (w);
+	    save_256_masked (
+		dst, lmask,
+		_mm256_or_si256 (load_256_masked (src, lmask), mask_ff000000));
+	}
+    }
+}
+
+static void
+avx2_composite_over_n_8_8888 (pixman_implementation_t *imp,
+                              pixman_composite_info_t *info)
+{
+    PIXMAN_COMPOSITE_ARGS (info);
+    uint32_t src, srca;
+    uint32_t *dst_line, *dst;
+    uint8_t *mask_line, *mask;
+    int dst_stride, mask_stride;
+    int32_t w;
+    uint64_t m;
+
+    __m256i xmm_src, xmm_alpha, xmm_def, xmm_expand, lmask;
+    __m256i xmm_dst, xmm_dst_lo, xmm_dst_hi;
+    __m256i xmm_mask, xmm_mask_lo, xmm_mask_hi;
+
+    src = _pixman_image_get_solid (imp, src_image, dest_image->bits.format);
+
+    srca = src >> 24;
+    if (src == 0)
+	return;
+
+    PIXMAN_IMAGE_GET_LINE (
+	dest_image, dest_x, dest_y, uint32_t, dst_stride, dst_line, 1);
+    PIXMAN_IMAGE_GET_LINE (
+	mask_image, mask_x, mask_y, uint8_t, mask_stride, mask_line, 1);
+
+    xmm_def = _mm256_set1_epi32 (src);
+    unpack_256_2x256 (xmm_def, &xmm_src, &xmm_src);
+    xmm_alpha = expand_alpha_256 (xmm_src);
+
+    /* Spreads each mask byte over the four bytes of its pixel */
+    xmm_expand = _mm256_set_epi8 (
+	12, 12, 12, 12, 8, 8, 8, 8, 4, 4, 4, 4, 0, 0, 0, 0,
+	12, 12, 12, 12, 8, 8, 8, 8, 4, 4, 4, 4, 0, 0, 0, 0);
+
+    while (height--)
+    {
+	dst = dst_line;
+	dst_line += dst_stride;
+	mask = mask_line;
+	mask_line += mask_stride;
+	w = width;
+
+	while (w > 0)
+	{
+	    /* The last few pixels of a line go through the same code,
+	     * with the mask bytes past the end of the line zeroed.
+	     */
+	    if (w >= 8)
+	    {
+		memcpy (&m, mask, sizeof (m));
+		lmask = _mm256_set1_epi32 (-1);
+	    }
+	    else
+	    {
+		m = 0;
+		memcpy (&m, mask, w);
+		lmask = tail_mask_256 (w);
+	    }
+
+	    if (srca == 0xff && m == ~(uint64_t)0)
+	    {
+		save_256_unaligned ((__m256i*)dst, xmm_def);
+	    }
+	    else if (m)
+	    {
+		xmm_dst = load_256_masked (dst, lmask);
+		xmm_mask = _mm256_cvtepu8_epi32 (
+		    _mm_loadl_epi64 ((__m128i*)&m));
+		xmm_mask = _mm256_shuffle_epi8 (xmm_mask, xmm_expand);
+
+		unpack_256_2x256 (xmm_dst, &xmm_dst_lo, &xmm_dst_hi);
+		unpack_256_2x256 (xmm_mask, &xmm_mask_lo, &xmm_mask_hi);
+
+		in_over_2x256 (&xmm_src, &xmm_src,
+			       &xmm_alpha, &xmm_alpha,
+			       &xmm_mask_lo, &xmm_mask_hi,
+			       &xmm_dst_lo, &xmm_dst_hi);
+
+		save_256_masked (
+		    dst, lmask, pack_2x256_256 (xmm_dst_lo, xmm_dst_hi));
+	    }
+
+	    w -= 8;
+	    dst += 8;
+	    mask += 8;
+	}
+    }
+}
+
+static const pixman_fast_path_t avx2_fast_paths[] =
+{
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, a8r8g8b8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8r8g8b8, null, x8r8g8b8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, a8b8g8r8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, a8b8g8r8, null, x8b8g8r8, avx2_composite_over_8888_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8r8g8b8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8r8g8b8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, a8b8g8r8, avx2_composite_over_n_8_8888),
+    PIXMAN_STD_FAST_PATH (OVER, solid, a8, x8b8g8r8, avx2_composite_over_n_8_8888),
+
+    PIXMAN_STD_FAST_PATH (SRC, x8r8g8b8, null, a8r8g8b8, avx2_composite_src_x888_8888),
+    PIXMAN_STD_FAST_PATH (SRC, x8b8g8r8, null, a8b8g8r8, avx2_composite_src_x888_8888),
+
+    { PIXMAN_OP_NONE },
+};
+
+/* ---------------------------------------------------------------------
+ * Bilinear fetcher
+ *
+ * This is the SSSE3 cover fetcher with both passes widened: the
+ * horizontal pass interpolates four source pixels per iteration and the
+ * vertical pass eight.  The intermediate format of the line buffers is
+ * unchanged, so the tails use the SSSE3 code as is.
+ */
+
+typedef struct
+{
+    int		y;
+    uint64_t *	buffer;
+} line_t;
+
+typedef struct
+{
+    line_t		lines[2];
+    pixman_fixed_t	y;
+    pixman_fixed_t	x;
+    uint64_t		data[1];
+} bilinear_info_t;
+
+static void
+avx2_fetch_horizontal (bits_image_t *image, line_t *line,
+		       int y, pixman_fixed_t x, pixman_fixed_t ux, int n)
+{
+    uint32_t *bits = image->bits + y * image->rowstride;
+    pixman_fixed_t x1 = x + ux, x2 = x + 2 * ux, x3 = x + 3 * ux;
+    /* Each lane holds the weights of one SSSE3 iteration */
+    __m256i vx = _mm256_set_epi16 (
+	- (x2 + 1), x2, - (x2 + 1), x2, - (x3 + 1), x3, - (x3 + 1), x3,
+	- (x + 1), x, - (x + 1), x, - (x1 + 1), x1, - (x1 + 1), x1);
+    __m256i vux = _mm256_set_epi16 (
+	- 4 * ux, 4 * ux, - 4 * ux, 4 * ux, - 4 * ux, 4 * ux, - 4 * ux, 4 * ux,
+	- 4 * ux, 4 * ux, - 4 * ux, 4 * ux, - 4 * ux, 4 * ux, - 4 * ux, 4 * ux);
+    __m256i vaddc = _mm256_set_epi16 (
+	1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0);
+    __m256i *b = (__m256i *)line->buffer;
+    __m128i *b128;
+    __m128i vx128, vux128, vaddc128;
+    __m128i vrl0, vrl1;
+
+    while (n >= 4)
+    {
+	__m256i vw, vr, vl1, vl0, s;
+
+	vl1 = _mm256_inserti128_si256 (
+	    _mm256_castsi128_si256 (_mm_loadl_epi64 (
+		(__m128i *)(bits + pixman_fixed_to_int (x + ux)))),
+	    _mm_loadl_epi64 (
+		(__m128i *)(bits + pixman_fixed_to_int (x + 3 * ux))), 1);
+	vl0 = _mm256_inserti128_si256 (
+	    _mm256_castsi128_si256 (_mm_loadl_epi64 (
+		(__m128i *)(bits + pixman_fixed_to_int (x)))),
+	    _mm_loadl_epi64 (
+		(__m128i *)(bits + pixman_fixed_to_int (x + 2 * ux))), 1);
+
+	vw = _mm256_add_epi16 (
+	    vaddc, _mm256_srli_epi16 (vx, 16 - BILINEAR_INTERPOLATION_BITS));
+	vw = _mm256_packus_epi16 (vw, vw);
+	vx = _mm256_add_epi16 (vx, vux);
+
+	x += 4 * ux;
+
+	vr = _mm256_unpacklo_epi16 (vl1, vl0);
+	s = _mm256_shuffle_epi32 (vr, _MM_SHUFFLE (1, 0, 3, 2));
+	vr = _mm256_unpackhi_epi8 (vr, s);
+	vr = _mm256_maddubs_epi16 (vr, vw);
+	vr = _mm256_abs_epi16 (vr);
+
+	_mm256_store_si256 (b++, vr);
+	n -= 4;
+    }
+
+    b128 = (__m128i *)b;
+    vx128 = _mm_set_epi16 (
+	- (x + 1), x, - (x + 1), x,
+	- (x + ux + 1), x + ux,  - (x + ux + 1), x + ux);
+    vux128 = _mm_set_epi16 (
+	- 2 * ux, 2 * ux, - 2 * ux, 2 * ux,
+	- 2 * ux, 2 * ux, - 2 * ux, 2 * ux);
+    vaddc128 = _mm_set_epi16 (1, 0, 1, 0, 1, 0, 1, 0);
+
+    while ((n -= 2) >= 0)
+    {
+	__m128i vw, vr, s;
+
+	vrl1 = _mm_loadl_epi64 (
+	    (__m128i *)(bits + pixman_fixed_to_int (x + ux)));
+
+    final_pixel:
+	vrl0 = _mm_loadl_epi64 (
+	    (__m128i *)(bits + pixman_fixed_to_int (x)));
+
+	vw = _mm_add_epi16 (
+	    vaddc128, _mm_srli_epi16 (vx128, 16 - BILINEAR_INTERPOLATION_BITS));
+	vw = _mm_packus_epi16 (vw, vw);
+	vx128 = _mm_add_epi16 (vx128, vux128);
+
+	x += 2 * ux;
+
+	vr = _mm_unpacklo_epi16 (vrl1, vrl0);
+	s = _mm_shuffle_epi32 (vr, _MM_SHUFFLE (1, 0, 3, 2));
+	vr = _mm_unpackhi_epi8 (vr, s);
+	vr = _mm_maddubs_epi16 (vr, vw);
+	vr = _mm_abs_epi16 (vr);
+
+	_mm_store_si128 (b128++, vr);
+    }
+
+    if (n == -1)
+    {
+	vrl1 = _mm_setzero_si128();
+	goto final_pixel;
+    }
+
+    line->y = y;
+}
+
+static force_inline __m128i
+avx2_interpolate_vertical_128 (__m128i top, __m128i bot, __m128i vw)
+{
+    __m128i r, tmp;
+
+    r = _mm_mulhi_epu16 (_mm_sub_epi16 (bot, top), vw);
+    tmp = _mm_cmplt_epi16 (bot, top);
+    tmp = _mm_and_si128 (tmp, vw);
+    r = _mm_sub_epi16 (r, tmp);
+    r = _mm_add_epi16 (r, top);
+    r = _mm_srli_epi16 (r, BILINEAR_INTERPOLATION_BITS);
+    /* r:  A0 R0 A1 R1 G0 B0 G1 B1 */
+    return _mm_shuffle_epi32 (r, _MM_SHUFFLE (2, 0, 3, 1));
+    /* r:  A1 R1 G1 B1 A0 R0 G0 B0 */
+}
+
+static force_inline __m256i
+avx2_interpolate_vertical_256 (__m256i top, __m256i bot, __m256i vw)
+{
+    __m256i r, tmp;
+
+    r = _mm256_mulhi_epu16 (_mm256_sub_epi16 (bot, top), vw);
+    tmp = _mm256_cmpgt_epi16 (top, bot);
+    tmp = _mm256_and_si256 (tmp, vw);
+    r = _mm256_sub_epi16 (r, tmp);
+    r = _mm256_add_epi16 (r, top);
+    r = _mm256_srli_epi16 (r, BILINEAR_INTERPOLATION_BITS);
+    return _mm256_shuffle_epi32 (r, _MM_SHUFFLE (2, 0, 3, 1));
+}
+
+static uint32_t *
+avx2_fetch_bilinear_cover (pixman_iter_t *iter, const uint32_t *mask)
+{
+    pixman_fixed_t fx, ux;
+    bilinear_info_t *info = iter->data;
+    line_t *line0, *line1;
+    int y0, y1;
+    int32_t dist_y;
+    __m256i vw;
+    __m128i vw128;
+    int i;
+
+    fx = info->x;
+    ux = iter->image->common.transform->matrix[0][0];
+
+    y0 = pixman_fixed_to_int (info->y);
+    y1 = y0 + 1;
+
+    line0 = &info->lines[y0 & 0x01];
+    line1 = &info->lines[y1 & 0x01];
+
+    if (line0->y != y0)
+    {
+	avx2_fetch_horizontal (
+	    &iter->image->bits, line0, y0, fx, ux, iter->width);
+    }
+
+    if (line1->y != y1)
+    {
+	avx2_fetch_horizontal (
+	    &iter->image->bits, line1, y1, fx, ux, iter->width);
+    }
+
+    dist_y = pixman_fixed_to_bilinear_weight (info->y);
+    dist_y <<= (16 - BILINEAR_INTERPOLATION_BITS);
+
+    vw = _mm256_set1_epi16 (dist_y);
+    vw128 = _mm256_castsi256_si128 (vw);
+
+    for (i = 0; i + 7 < iter->width; i += 8)
+    {
+	__m256i top0 = _mm256_load_si256 ((__m256i *)(line0->buffer + i));
+	__m256i bot0 = _mm256_load_si256 ((__m256i *)(line1->buffer + i));
+	__m256i top1 = _mm256_load_si256 ((__m256i *)(line0->buffer + i + 4));
+	__m256i bot1 = _mm256_load_si256 ((__m256i *)(line1->buffer + i + 4));
+	__m256i r0, r1, p;
+
+	r0 = avx2_interpolate_vertical_256 (top0, bot0, vw);
+	r1 = avx2_interpolate_vertical_256 (top1, bot1, vw);
+
+	/* The packs are done per lane, so the quadwords come out as
+	 * pixels 0-1, 4-5, 2-3, 6-7.
+	 */
+	p = _mm256_packus_epi16 (r0, r1);
+	p = _mm256_permute4x64_epi64 (p, _MM_SHUFFLE (3, 1, 2, 0));
+
+	_mm256_storeu_si256 ((__m256i *)(iter->buffer + i), p);
+    }
+
+    while (i < iter->width)
+    {
+	__m128i top0 = _mm_load_si128 ((__m128i *)(line0->buffer + i));
+	__m128i bot0 = _mm_load_si128 ((__m128i *)(line1->buffer + i));
+	__m128i p;
+
+	p = avx2_interpolate_vertical_128 (top0, bot0, vw128);
+	p = _mm_packus_epi16 (p, p);
+
+	if (iter->width - i == 1)
+	{
+	    *(uint32_t *)(iter->buffer + i) = _mm_cvtsi128_si32 (p);
+	    i++;
+	}
+	else
+	{
+	    _mm_storel_epi64 ((__m128i *)(iter->buffer + i), p);
+	    i += 2;
+	}
+    }
+
+    info->y += iter->image->common.transform->matrix[1][1];
+
+    return iter->buffer;
+}
+
+static void
+avx2_bilinear_cover_iter_fini (pixman_iter_t *iter)
+{
+    free (iter->data);
+}
+
+static void
+avx2_bilinear_cover_iter_init (pixman_iter_t *iter, const pixman_iter_info_t *iter_info)
+{
+    int width = iter->width;
+    bilinear_info_t *info;
+    pixman_vector_t v;
+
+    /* Reference point is the center of the pixel */
+    v.vector[0] = pixman_int_to_fixed (iter->x) + pixman_fixed_1 / 2;
+    v.vector[1] = pixman_int_to_fixed (iter->y) + pixman_fixed_1 / 2;
+    v.vector[2] = pixman_fixed_1;
+
+    if (!pixman_transform_point_3d (iter->image->common.transform, &v))
+	goto fail;
+
+    /* Room for both lines, each padded to 32 bytes, plus the extra
+     * entry the horizontal pass writes for odd widths.
+     */
+    info = malloc (sizeof (*info) + (2 * width + 1) * sizeof (uint64_t) + 64);
+    if (!info)
+	goto fail;
+
+    info->x = v.vector[0] - pixman_fixed_1 / 2;
+    info->y = v.vector[1] - pixman_fixed_1 / 2;
+
+#define ALIGN(addr)							\
+    ((void *)((((uintptr_t)(addr)) + 31) & (~31)))
+
+    /* It is safe to set the y coordinates to -1 initially
+     * because COVER_CLIP_BILINEAR ensures that we will only
+     * be asked to fetch lines in the [0, height) interval
+     */
+    info->lines[0].y = -1;
+    info->lines[0].buffer = ALIGN (&(info->data[0]));
+    info->lines[1].y = -1;
+    info->lines[1].buffer = ALIGN (info->lines[0].buffer + width);
+
+    iter->get_scanline = avx2_fetch_bilinear_cover;
+    iter->fini = avx2_bilinear_cover_iter_fini;
+
+    iter->data = info;
+    return;
+
+fail:
+    /* Something went wrong, either a bad matrix or OOM; in such cases,
+     * we don't guarantee any particular rendering.
+     */
+    _pixman_log_error (
+	FUNC, "Allocation failure or bad matrix, skipping rendering\n");
+
+    iter->get_scanline = _pixman_iter_get_scanline_noop;
+    iter->fini = NULL;
+}
+
+static const pixman_iter_info_t avx2_iters[] =
+{
+    { PIXMAN_a8r8g8b8,
+      (FAST_PATH_STANDARD_FLAGS			|
+       FAST_PATH_SCALE_TRANSFORM		|
+       FAST_PATH_BILINEAR_FILTER		|
+       FAST_PATH_SAMPLES_COVER_CLIP_BILINEAR),
+      ITER_NARROW | ITER_SRC,
+      avx2_bilinear_cover_iter_init,
+      NULL, NULL
+    },
+
+    { PIXMAN_null },
+};
+
+pixman_implementation_t *
+_pixman_implementation_create_avx2 (pixman_implementation_t *fallback)
+{
+    pixman_implementation_t *imp =
+	_pixman_implementation_create (fallback, avx2_fast_paths);
+
+    imp->combine_32[PIXMAN_OP_OVER] = avx2_combine_over_u;
+    imp->combine_32[PIXMAN_OP_OVER_REVERSE] = avx2_combine_over_reverse_u;
+    imp->combine_32[PIXMAN_OP_IN] = avx2_combine_in_u;
+    imp->combine_32[PIXMAN_OP_IN_REVERSE] = avx2_combine_in_reverse_u;
+    imp->combine_32[PIXMAN_OP_OUT] = avx2_combine_out_u;
+    imp->combine_32[PIXMAN_OP_OUT_REVERSE] = avx2_combine_out_reverse_u;
+    imp->combine_32[PIXMAN_OP_ATOP] = avx2_combine_atop_u;
+    imp->combine_32[PIXMAN_OP_ATOP_REVERSE] = avx2_combine_atop_reverse_u;
+    imp->combine_32[PIXMAN_OP_XOR] = avx2_combine_xor_u;
+    imp->combine_32[PIXMAN_OP_ADD] = avx2_combine_add_u;
+
+    imp->iter_info = avx2_iters;
+
+    return imp;
+}
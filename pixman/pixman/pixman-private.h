@@ -598,6 +598,11 @@ pixman_implementation_t *
 _pixman_implementation_create_ssse3 (pixman_implementation_t *fallback);
 #endif
 
+#ifdef USE_AVX2
+pixman_implementation_t *
+_pixman_implementation_create_avx2 (pixman_implementation_t *fallback);
+#endif
+
 #ifdef USE_ARM_SIMD
 pixman_implementation_t *
 _pixman_implementation_create_arm_simd (pixman_implementation_t *fallback);
@@ -639,6 +644,20 @@ _pixman_choose_implementation (void);
 pixman_bool_t
 _pixman_disabled (const char *name);
 
+/*
+ * Threaded compositing
+ */
+pixman_bool_t
+_pixman_composite_threaded (pixman_implementation_t *       imp,
+			    pixman_composite_func_t         func,
+			    const pixman_composite_info_t * info,
+			    const pixman_box32_t *          boxes,
+			    int                             n_boxes,
+			    int32_t                         src_dx,
+			    int32_t                         src_dy,
+			    int32_t                         mask_dx,
+			    int32_t                         mask_dy);
+
 
 /*
  * Utilities
@@ -472,15 +472,19 @@ pixman_rect_alloc (region_type_t * region,
     else
     {
 	size_t data_size;
+	int size = region->data->size;
 
-	if (n == 1)
-	{
-	    n = region->data->numRects;
-	    if (n > 500) /* XXX pick numbers out of a hat */
-		n = 250;
-	}
+	/* Grow by at least half again, so that a region built up a
+	 * rectangle or a band at a time is only reallocated
+	 * O(log n) times.
+	 */
+	if (n > INT_MAX - region->data->numRects)
+	    return pixman_break (region);
 
 	n += region->data->numRects;
+	if (n < size + size / 2 && size < INT_MAX / 2)
+	    n = size + size / 2;
+
 	data_size = PIXREGION_SZOF (n);
 
 	if (!data_size)
@@ -707,6 +711,65 @@ pixman_region_append_non_o (region_type_t * region,
 	}								\
     } while (0)
 
+static box_type_t *
+find_box_for_y (box_type_t *begin, box_type_t *end, int y);
+
+/*-
+ *-----------------------------------------------------------------------
+ * pixman_region_skip_bands --
+ *	Skip the bands following the current one that lie entirely above
+ *	y, appending them unchanged to new_reg if append is set.  This lets
+ *	pixman_op get past the parts of a large region that don't meet the
+ *	other region with a binary search and a single copy, instead of
+ *	going through them a band at a time.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	*r and *r_band_end are set to the last skipped band, if any.
+ *	If boxes were appended, *prev_band is set to the index of the
+ *	last band in new_reg.
+ *
+ *-----------------------------------------------------------------------
+ */
+static pixman_bool_t
+pixman_region_skip_bands (region_type_t * new_reg,
+			  box_type_t **   r,
+			  box_type_t **   r_band_end,
+			  box_type_t *    r_end,
+			  int             y,
+			  int             append,
+			  int *           prev_band)
+{
+    box_type_t *next;
+    box_type_t *last;
+
+    next = find_box_for_y (*r_band_end, r_end, y);
+    if (next == *r_band_end)
+	return TRUE;
+
+    last = next - 1;
+    while (last != *r_band_end && (last - 1)->y1 == last->y1)
+	last--;
+
+    if (append)
+    {
+	int new_rects = next - *r_band_end;
+
+	RECTALLOC (new_reg, new_rects);
+	*prev_band = new_reg->data->numRects + (last - *r_band_end);
+	memcpy (PIXREGION_TOP (new_reg), *r_band_end,
+		new_rects * sizeof (box_type_t));
+	new_reg->data->numRects += new_rects;
+    }
+
+    *r = last;
+    *r_band_end = next;
+
+    return TRUE;
+}
+
 /*-
  *-----------------------------------------------------------------------
  * pixman_op --
@@ -812,11 +875,11 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
         new_reg->data = pixman_region_empty_data;
     }
 
-    /* guess at new size */
-    if (numRects > new_size)
-	new_size = numRects;
-
-    new_size <<= 1;
+    /* guess at new size: few results have more rectangles than the
+     * two operands together, and pixman_rect_alloc grows the array
+     * geometrically for those that do.
+     */
+    new_size += numRects;
 
     if (!new_reg->data)
 	new_reg->data = pixman_region_empty_data;
@@ -897,6 +960,13 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
 		}
 	    }
             ytop = r2y1;
+
+            if (r1->y2 <= r2y1 &&
+                !pixman_region_skip_bands (new_reg, &r1, &r1_band_end, r1_end,
+                                           r2y1, append_non1, &prev_band))
+            {
+                goto bail;
+	    }
 	}
         else if (r2y1 < r1y1)
         {
@@ -916,6 +986,13 @@ pixman_op (region_type_t *  new_reg,               /* Place to store result
 		}
 	    }
             ytop = r1y1;
+
+            if (r2->y2 <= r1y1 &&
+                !pixman_region_skip_bands (new_reg, &r2, &r2_band_end, r2_end,
+                                           r1y1, append_non2, &prev_band))
+            {
+                goto bail;
+	    }
 	}
         else
         {
@@ -1047,6 +1124,7 @@ static void
 pixman_set_extents (region_type_t *region)
 {
     box_type_t *box, *box_end;
+    int x1, x2;
 
     if (!region->data)
 	return;
@@ -1068,22 +1146,27 @@ pixman_set_extents (region_type_t *region)
      * x2 from  box and box_end, resp., as good things to initialize them
      * to...
      */
-    region->extents.x1 = box->x1;
+    x1 = box->x1;
+    x2 = box_end->x2;
     region->extents.y1 = box->y1;
-    region->extents.x2 = box_end->x2;
     region->extents.y2 = box_end->y2;
 
     critical_if_fail (region->extents.y1 < region->extents.y2);
 
+    /* Keep the running minimum and maximum in locals rather than in
+     * region->extents, which the compiler has to assume the boxes
+     * alias; that way this becomes a vectorizable reduction.
+     */
     while (box <= box_end)
     {
-        if (box->x1 < region->extents.x1)
-	    region->extents.x1 = box->x1;
-        if (box->x2 > region->extents.x2)
-	    region->extents.x2 = box->x2;
+	x1 = MIN (x1, box->x1);
+	x2 = MAX (x2, box->x2);
         box++;
     }
 
+    region->extents.x1 = x1;
+    region->extents.x2 = x2;
+
     critical_if_fail (region->extents.x1 < region->extents.x2);
 }
 
@@ -1153,6 +1236,98 @@ pixman_region_intersect_o (region_type_t *region,
     return TRUE;
 }
 
+/*-
+ *-----------------------------------------------------------------------
+ * pixman_region_intersect_box --
+ *	Intersect a region with a single box.  The bands of the region
+ *	that the box covers just have their boxes clipped, so there is
+ *	never more than one output box per input box and the operation
+ *	can be done in place.
+ *
+ * Results:
+ *	TRUE if successful.
+ *
+ * Side Effects:
+ *	new_reg is overwritten.
+ *
+ *-----------------------------------------------------------------------
+ */
+static pixman_bool_t
+pixman_region_intersect_box (region_type_t *new_reg,
+			     region_type_t *reg,
+			     box_type_t     box)
+{
+    box_type_t *r;
+    box_type_t *r_end;
+    box_type_t *r_band_end;
+    box_type_t *next_rect;
+    int prev_band;
+    int cur_band;
+    int numRects;
+    int ry1;
+
+    r = PIXREGION_RECTS (reg);
+    r_end = r + PIXREGION_NUMRECTS (reg);
+    r = find_box_for_y (r, r_end, box.y1);
+
+    /* When working in place the output never overtakes the input, so
+     * the RECTALLOCs below don't reallocate.
+     */
+    if (!new_reg->data)
+	new_reg->data = pixman_region_empty_data;
+    else if (new_reg->data->size)
+	new_reg->data->numRects = 0;
+
+    prev_band = 0;
+
+    while (r != r_end && r->y1 < box.y2)
+    {
+	int y1 = MAX (r->y1, box.y1);
+	int y2 = MIN (r->y2, box.y2);
+
+	FIND_BAND (r, r_band_end, r_end, ry1);
+
+	cur_band = new_reg->data->numRects;
+	RECTALLOC (new_reg, r_band_end - r);
+	next_rect = PIXREGION_TOP (new_reg);
+
+	do
+	{
+	    int x1 = MAX (r->x1, box.x1);
+	    int x2 = MIN (r->x2, box.x2);
+
+	    if (x1 < x2)
+	    {
+		ADDRECT (next_rect, x1, y1, x2, y2);
+		new_reg->data->numRects++;
+	    }
+	}
+	while (++r != r_band_end);
+
+	COALESCE (new_reg, prev_band, cur_band);
+    }
+
+    if (!(numRects = new_reg->data->numRects))
+    {
+	FREE_DATA (new_reg);
+	new_reg->data = pixman_region_empty_data;
+    }
+    else if (numRects == 1)
+    {
+	new_reg->extents = *PIXREGION_BOXPTR (new_reg);
+	FREE_DATA (new_reg);
+	new_reg->data = (region_data_type_t *)NULL;
+    }
+    else
+    {
+	DOWNSIZE (new_reg, numRects);
+    }
+
+    pixman_set_extents (new_reg);
+
+    return TRUE;
+}
+
 PIXMAN_EXPORT pixman_bool_t
 PREFIX (_intersect) (region_type_t *     new_reg,
                      region_type_t *        reg1,
@@ -1204,6 +1379,17 @@ PREFIX (_intersect) (region_type_t *     new_reg,
     {
         return PREFIX (_copy) (new_reg, reg1);
     }
+    else if (!reg2->data)
+    {
+        /* Clipping to a rectangle, the most common of the rest */
+        if (!pixman_region_intersect_box (new_reg, reg1, reg2->extents))
+	    return FALSE;
+    }
+    else if (!reg1->data)
+    {
+        if (!pixman_region_intersect_box (new_reg, reg2, reg1->extents))
+	    return FALSE;
+    }
     else
     {
         /* General purpose intersection */
@@ -1971,8 +2157,10 @@ PREFIX (_subtract) (region_type_t *reg_d,
 	
         return PREFIX (_copy) (reg_d, reg_m);
     }
-    else if (reg_m == reg_s)
+    else if (reg_m == reg_s ||
+             (!reg_s->data && SUBSUMES (&reg_s->extents, &reg_m->extents)))
     {
+        /* Nothing is left of the minuend */
         FREE_DATA (reg_d);
         reg_d->extents.x2 = reg_d->extents.x1;
         reg_d->extents.y2 = reg_d->extents.y1;
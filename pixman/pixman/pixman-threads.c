@@ -0,0 +1,414 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software without
+ * specific, written prior permission.  The copyright holders make no
+ * representations about the suitability of this software for any purpose.
+ * It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include "pixman-private.h"
+
+/*
+ * Threaded compositing
+ *
+ * Large composites are cut into bands of whole scanlines, each about
+ * TILE_PIXELS pixels, and the bands are handed out to a pool of worker
+ * threads with the calling thread working alongside them.  Each band is
+ * composited exactly as a rectangle of the clip region would be, so the
+ * result is the same as that of the serial path.
+ *
+ * This is off unless pixman_composite_set_threads() has been called with
+ * more than one thread, or the PIXMAN_THREADS environment variable is
+ * set.
+ */
+
+#define TILE_PIXELS		(16 * 1024)
+#define MIN_THREADED_PIXELS	(4 * TILE_PIXELS)
+#define MAX_THREADS		64
+
+#if defined (_WIN32) || defined (HAVE_PTHREADS)
+
+#ifdef _WIN32
+
+#   define _NO_W32_PSEUDO_MODIFIERS
+#   include <windows.h>
+#ifdef IN
+#undef IN
+#endif
+
+typedef SRWLOCK lock_t;
+typedef CONDITION_VARIABLE cond_t;
+
+#define LOCK_INITIALIZER		SRWLOCK_INIT
+#define COND_INITIALIZER		CONDITION_VARIABLE_INIT
+#define lock(l)				AcquireSRWLockExclusive (l)
+#define unlock(l)			ReleaseSRWLockExclusive (l)
+#define cond_wait(c, l)			SleepConditionVariableSRW (c, l, INFINITE, 0)
+#define cond_broadcast(c)		WakeAllConditionVariable (c)
+
+#else
+
+#include <pthread.h>
+#include <signal.h>
+
+typedef pthread_mutex_t lock_t;
+typedef pthread_cond_t cond_t;
+
+#define LOCK_INITIALIZER		PTHREAD_MUTEX_INITIALIZER
+#define COND_INITIALIZER		PTHREAD_COND_INITIALIZER
+#define lock(l)				pthread_mutex_lock (l)
+#define unlock(l)			pthread_mutex_unlock (l)
+#define cond_wait(c, l)			pthread_cond_wait (c, l)
+#define cond_broadcast(c)		pthread_cond_broadcast (c)
+
+#endif
+
+typedef struct
+{
+    pixman_implementation_t *		imp;
+    pixman_composite_func_t		func;
+    const pixman_composite_info_t *	info;
+    int32_t				src_dx, src_dy;
+    int32_t				mask_dx, mask_dy;
+
+    pixman_box32_t *			tiles;
+    int					n_tiles;
+    int					n_workers;
+
+    /* Protected by pool_lock */
+    int					next;
+    int					done;
+} tile_job_t;
+
+static lock_t pool_lock = LOCK_INITIALIZER;
+static cond_t work_cond = COND_INITIALIZER;
+static cond_t done_cond = COND_INITIALIZER;
+
+/* Protected by pool_lock */
+static int n_threads = -1;
+static int n_workers;
+static tile_job_t *current_job;
+
+static void
+composite_tile (tile_job_t *job, const pixman_box32_t *box)
+{
+    pixman_composite_info_t info = *job->info;
+
+    info.src_x = box->x1 + job->src_dx;
+    info.src_y = box->y1 + job->src_dy;
+    info.mask_x = box->x1 + job->mask_dx;
+    info.mask_y = box->y1 + job->mask_dy;
+    info.dest_x = box->x1;
+    info.dest_y = box->y1;
+    info.width = box->x2 - box->x1;
+    info.height = box->y2 - box->y1;
+
+    job->func (job->imp, &info);
+}
+
+/* Called and returns with pool_lock held */
+static void
+run_tiles (tile_job_t *job)
+{
+    while (job->next < job->n_tiles)
+    {
+	int i = job->next++;
+
+	unlock (&pool_lock);
+	composite_tile (job, &job->tiles[i]);
+	lock (&pool_lock);
+
+	if (++job->done == job->n_tiles)
+	    cond_broadcast (&done_cond);
+    }
+}
+
+static void
+worker_main (int id)
+{
+    lock (&pool_lock);
+
+    for (;;)
+    {
+	tile_job_t *job = current_job;
+
+	if (job && id < job->n_workers && job->next < job->n_tiles)
+	    run_tiles (job);
+	else
+	    cond_wait (&work_cond, &pool_lock);
+    }
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI
+worker_thread (LPVOID data)
+{
+    worker_main ((int)(intptr_t)data);
+    return 0;
+}
+
+static pixman_bool_t
+start_worker (int id)
+{
+    HANDLE thread = CreateThread (
+	NULL, 0, worker_thread, (LPVOID)(intptr_t)id, 0, NULL);
+
+    if (!thread)
+	return FALSE;
+
+    CloseHandle (thread);
+    return TRUE;
+}
+
+#else
+
+static void *
+worker_thread (void *data)
+{
+    worker_main ((int)(intptr_t)data);
+    return NULL;
+}
+
+static pixman_bool_t
+start_worker (int id)
+{
+    pthread_t thread;
+    sigset_t all, saved;
+    int ret;
+
+    /* Signals are for the application's threads, not ours */
+    sigfillset (&all);
+    pthread_sigmask (SIG_SETMASK, &all, &saved);
+    ret = pthread_create (&thread, NULL, worker_thread, (void *)(intptr_t)id);
+    pthread_sigmask (SIG_SETMASK, &saved, NULL);
+
+    if (ret != 0)
+	return FALSE;
+
+    pthread_detach (thread);
+    return TRUE;
+}
+
+#endif
+
+/* Called with pool_lock held; returns the number of threads to use */
+static int
+get_threads (void)
+{
+    if (n_threads < 0)
+    {
+	const char *env = getenv ("PIXMAN_THREADS");
+
+	n_threads = env ? atoi (env) : 0;
+    }
+
+    n_threads = CLIP (n_threads, 0, MAX_THREADS);
+
+    /* The pool only ever grows; pixman_composite_set_threads() with a
+     * smaller number just leaves the extra workers idle.
+     */
+    while (n_workers < n_threads - 1 && start_worker (n_workers))
+	n_workers++;
+
+    return MIN (n_threads, n_workers + 1);
+}
+
+static pixman_bool_t
+bits_overlap (pixman_image_t *image, pixman_image_t *dest)
+{
+    uint8_t *b0, *e0, *b1, *e1;
+    ptrdiff_t size;
+
+    if (!image || image->type != BITS)
+	return FALSE;
+
+    size = (ptrdiff_t)image->bits.rowstride * 4 * image->bits.height;
+    b0 = (uint8_t *)image->bits.bits;
+    e0 = b0 + size;
+    if (size < 0)
+	b0 = e0, e0 = (uint8_t *)image->bits.bits;
+
+    size = (ptrdiff_t)dest->bits.rowstride * 4 * dest->bits.height;
+    b1 = (uint8_t *)dest->bits.bits;
+    e1 = b1 + size;
+    if (size < 0)
+	b1 = e1, e1 = (uint8_t *)dest->bits.bits;
+
+    return b0 < e1 && b1 < e0;
+}
+
+/* Images whose pixels go through user callbacks, or which read from
+ * the destination, have to be composited in order on a single thread.
+ * dest is NULL when checking the destination itself.
+ */
+static pixman_bool_t
+image_is_threadable (pixman_image_t *image, pixman_image_t *dest)
+{
+    if (!image)
+	return TRUE;
+
+    if (!(image->common.flags & FAST_PATH_NO_ACCESSORS)	||
+	!(image->common.flags & FAST_PATH_NO_ALPHA_MAP)	||
+	(dest && bits_overlap (image, dest)))
+    {
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+pixman_bool_t
+_pixman_composite_threaded (pixman_implementation_t *       imp,
+			    pixman_composite_func_t         func,
+			    const pixman_composite_info_t * info,
+			    const pixman_box32_t *          boxes,
+			    int                             n_boxes,
+			    int32_t                         src_dx,
+			    int32_t                         src_dy,
+			    int32_t                         mask_dx,
+			    int32_t                         mask_dy)
+{
+    pixman_image_t *dest = info->dest_image;
+    tile_job_t job;
+    int64_t pixels = 0;
+    int threads, i, n;
+
+    /* Small composites, the common case, don't touch the lock */
+    for (i = 0; i < n_boxes; i++)
+    {
+	pixels += (int64_t)(boxes[i].x2 - boxes[i].x1) *
+	    (boxes[i].y2 - boxes[i].y1);
+    }
+
+    if (pixels < MIN_THREADED_PIXELS)
+	return FALSE;
+
+    if (!image_is_threadable (dest, NULL)			||
+	!image_is_threadable (info->src_image, dest)		||
+	!image_is_threadable (info->mask_image, dest))
+    {
+	return FALSE;
+    }
+
+    lock (&pool_lock);
+
+    threads = get_threads ();
+
+    /* A single pool serves everyone; if it is busy, whether with
+     * another application thread's composite or with a composite
+     * nested inside one of ours, composite serially.
+     */
+    if (threads <= 1 || current_job)
+    {
+	unlock (&pool_lock);
+	return FALSE;
+    }
+
+    /* Cut every box into bands of whole scanlines */
+    n = 0;
+    for (i = 0; i < n_boxes; i++)
+    {
+	int width = boxes[i].x2 - boxes[i].x1;
+	int rows = MAX (1, TILE_PIXELS / width);
+
+	n += (boxes[i].y2 - boxes[i].y1 + rows - 1) / rows;
+    }
+
+    job.tiles = pixman_malloc_ab (n, sizeof (pixman_box32_t));
+    if (!job.tiles)
+    {
+	unlock (&pool_lock);
+	return FALSE;
+    }
+
+    n = 0;
+    for (i = 0; i < n_boxes; i++)
+    {
+	int width = boxes[i].x2 - boxes[i].x1;
+	int rows = MAX (1, TILE_PIXELS / width);
+	int y;
+
+	for (y = boxes[i].y1; y < boxes[i].y2; y += rows)
+	{
+	    job.tiles[n].x1 = boxes[i].x1;
+	    job.tiles[n].y1 = y;
+	    job.tiles[n].x2 = boxes[i].x2;
+	    job.tiles[n].y2 = MIN (y + rows, boxes[i].y2);
+	    n++;
+	}
+    }
+
+    job.imp = imp;
+    job.func = func;
+    job.info = info;
+    job.src_dx = src_dx;
+    job.src_dy = src_dy;
+    job.mask_dx = mask_dx;
+    job.mask_dy = mask_dy;
+    job.n_tiles = n;
+    job.next = 0;
+    job.done = 0;
+    job.n_workers = threads - 1;
+    current_job = &job;
+    cond_broadcast (&work_cond);
+
+    run_tiles (&job);
+
+    while (job.done < job.n_tiles)
+	cond_wait (&done_cond, &pool_lock);
+
+    current_job = NULL;
+
+    unlock (&pool_lock);
+
+    free (job.tiles);
+    return TRUE;
+}
+
+PIXMAN_EXPORT void
+pixman_composite_set_threads (int threads)
+{
+    lock (&pool_lock);
+    n_threads = CLIP (threads, 0, MAX_THREADS);
+    unlock (&pool_lock);
+}
+
+#else
+
+pixman_bool_t
+_pixman_composite_threaded (pixman_implementation_t *       imp,
+			    pixman_composite_func_t         func,
+			    const pixman_composite_info_t * info,
+			    const pixman_box32_t *          boxes,
+			    int                             n_boxes,
+			    int32_t                         src_dx,
+			    int32_t                         src_dy,
+			    int32_t                         mask_dx,
+			    int32_t                         mask_dy)
+{
+    return FALSE;
+}
+
+PIXMAN_EXPORT void
+pixman_composite_set_threads (int threads)
+{
+}
+
+#endif
@@ -695,6 +695,13 @@ pixman_image_composite32 (pixman_op_t      op,
 
     pbox = pixman_region32_rectangles (&region, &n);
 
+    if (_pixman_composite_threaded (imp, func, &info, pbox, n,
+				    src_x - dest_x, src_y - dest_y,
+				    mask_x - dest_x, mask_y - dest_y))
+    {
+	goto out;
+    }
+
     while (n--)
     {
 	info.src_x = pbox->x1 + src_x - dest_x;
@@ -927,6 +927,13 @@ void          pixman_image_composite32        (pixman_op_t        op,
  */
 void pixman_disable_out_of_bounds_workaround (void);
 
+/* Lets pixman_image_composite32() spread large composites over up to
+ * n_threads threads, the calling thread included.  The output is the
+ * same as with a single thread.  0 or 1 turns threading off, which is
+ * the default unless the PIXMAN_THREADS environment variable is set.
+ */
+void pixman_composite_set_threads (int n_threads);
+
 /*
  * Glyphs
  */
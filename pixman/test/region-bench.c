@@ -0,0 +1,255 @@
+/*
+ * Times region operations on the kind of regions an X server works with:
+ * the clip lists of a stack of overlapping windows, damage accumulated
+ * from many small rectangles, and the clipping of both against window
+ * and drawable rectangles.  A checksum of every result is printed so
+ * that changes to pixman-region.c can be checked for identical output.
+ *
+ * Usage: region-bench [n-windows]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "utils.h"
+
+#define SCREEN_WIDTH 1920
+#define SCREEN_HEIGHT 1080
+#define N_DAMAGE 4000
+#define TEST_REPEATS 5
+
+static pixman_box32_t *windows;
+static int n_windows;
+
+static pixman_region32_t *clips;
+static pixman_region32_t damage;
+
+/* The checksums are only computed on an untimed run */
+static pixman_bool_t checking;
+
+static uint32_t
+region_crc (uint32_t crc, pixman_region32_t *region)
+{
+    pixman_box32_t *boxes;
+    int n;
+
+    if (!checking)
+	return crc;
+
+    boxes = pixman_region32_rectangles (region, &n);
+    crc = compute_crc32 (crc, &n, sizeof (n));
+    return compute_crc32 (crc, boxes, n * sizeof (pixman_box32_t));
+}
+
+/* Like miValidateTree: walk the stack from the top, each window getting
+ * whatever part of its rectangle the windows above it leave uncovered.
+ */
+static uint32_t
+bench_clip_lists (void)
+{
+    pixman_region32_t covered, rect;
+    uint32_t crc = 0;
+    int i;
+
+    pixman_region32_init (&covered);
+
+    for (i = 0; i < n_windows; i++)
+    {
+	pixman_box32_t *w = &windows[i];
+
+	pixman_region32_init_rect (&rect, w->x1, w->y1,
+				   w->x2 - w->x1, w->y2 - w->y1);
+	pixman_region32_subtract (&clips[i], &rect, &covered);
+	pixman_region32_union (&covered, &covered, &rect);
+	pixman_region32_fini (&rect);
+
+	crc = region_crc (crc, &clips[i]);
+    }
+
+    crc = region_crc (crc, &covered);
+    pixman_region32_fini (&covered);
+
+    return crc;
+}
+
+/* Text-like damage: runs of glyph-sized rectangles along lines, which
+ * arrive mostly in order, with some scattered updates mixed in.
+ */
+static uint32_t
+bench_damage (void)
+{
+    int x = 0, y = 0;
+    int i;
+
+    pixman_region32_fini (&damage);
+    pixman_region32_init (&damage);
+
+    for (i = 0; i < N_DAMAGE; i++)
+    {
+	if (i % 16 == 15)
+	{
+	    pixman_region32_union_rect (&damage, &damage,
+					prng_rand_n (SCREEN_WIDTH),
+					prng_rand_n (SCREEN_HEIGHT),
+					prng_rand_n (64) + 1,
+					prng_rand_n (64) + 1);
+	    continue;
+	}
+
+	pixman_region32_union_rect (&damage, &damage, x, y, 9, 18);
+
+	x += 9;
+	if (x + 9 > SCREEN_WIDTH || prng_rand_n (40) == 0)
+	{
+	    x = prng_rand_n (4) * 9;
+	    y = (y + 18) % SCREEN_HEIGHT;
+	}
+    }
+
+    return region_crc (0, &damage);
+}
+
+/* Damage reported to each window, and each clip list restricted to a
+ * drawable-sized rectangle, as when computing a composite clip.
+ */
+static uint32_t
+bench_clip (void)
+{
+    pixman_region32_t result;
+    uint32_t crc = 0;
+    int i;
+
+    pixman_region32_init (&result);
+
+    for (i = 0; i < n_windows; i++)
+    {
+	pixman_box32_t *w = &windows[i];
+
+	pixman_region32_intersect (&result, &damage, &clips[i]);
+	crc = region_crc (crc, &result);
+
+	pixman_region32_intersect_rect (&result, &damage, w->x1, w->y1,
+					w->x2 - w->x1, w->y2 - w->y1);
+	crc = region_crc (crc, &result);
+
+	pixman_region32_intersect_rect (&result, &clips[i],
+					w->x1 + 16, w->y1 + 16, 256, 256);
+	crc = region_crc (crc, &result);
+
+	pixman_region32_copy (&result, &clips[i]);
+	pixman_region32_intersect_rect (&result, &result,
+					0, 0, SCREEN_WIDTH, SCREEN_HEIGHT / 2);
+	crc = region_crc (crc, &result);
+    }
+
+    pixman_region32_fini (&result);
+
+    return crc;
+}
+
+/* Repainting: the damage minus each window's clip, then minus a
+ * rectangle, as when exposures are sent and then cleared.
+ */
+static uint32_t
+bench_subtract (void)
+{
+    pixman_region32_t result, rect;
+    uint32_t crc = 0;
+    int i;
+
+    pixman_region32_init (&result);
+
+    for (i = 0; i < n_windows; i++)
+    {
+	pixman_box32_t *w = &windows[i];
+
+	pixman_region32_subtract (&result, &damage, &clips[i]);
+	crc = region_crc (crc, &result);
+
+	pixman_region32_init_rect (&rect, w->x1, w->y1,
+				   w->x2 - w->x1, w->y2 - w->y1);
+	pixman_region32_subtract (&result, &result, &rect);
+	pixman_region32_fini (&rect);
+	crc = region_crc (crc, &result);
+    }
+
+    pixman_region32_fini (&result);
+
+    return crc;
+}
+
+static void
+run (const char *name, uint32_t (* func) (void))
+{
+    double t = -1;
+    uint32_t crc;
+    int i;
+
+    for (i = 0; i < TEST_REPEATS; i++)
+    {
+	double t1, t2;
+
+	prng_srand (0xdeadbeef);
+
+	t1 = gettime ();
+	crc = func ();
+	t2 = gettime ();
+
+	if (t < 0 || t2 - t1 < t)
+	    t = t2 - t1;
+    }
+
+    prng_srand (0xdeadbeef);
+
+    checking = TRUE;
+    crc = func ();
+    checking = FALSE;
+
+    printf ("  %-12s %12.3f     %08X\n", name, t * 1000, crc);
+}
+
+int
+main (int argc, char **argv)
+{
+    int i;
+
+    n_windows = argc > 1 ? atoi (argv[1]) : 300;
+    if (n_windows < 1)
+	n_windows = 1;
+
+    windows = malloc (n_windows * sizeof (pixman_box32_t));
+    clips = malloc (n_windows * sizeof (pixman_region32_t));
+
+    prng_srand (0x5eed);
+
+    for (i = 0; i < n_windows; i++)
+    {
+	int w = prng_rand_n (384) + 32;
+	int h = prng_rand_n (256) + 24;
+
+	windows[i].x1 = prng_rand_n (SCREEN_WIDTH) - w / 2;
+	windows[i].y1 = prng_rand_n (SCREEN_HEIGHT) - h / 2;
+	windows[i].x2 = windows[i].x1 + w;
+	windows[i].y2 = windows[i].y1 + h;
+
+	pixman_region32_init (&clips[i]);
+    }
+
+    pixman_region32_init (&damage);
+
+    printf ("# %d windows, %d damage rectangles, best of %d\n",
+	    n_windows, N_DAMAGE, TEST_REPEATS);
+    printf ("# %-12s %12s     %8s\n", "operation", "time / ms", "checksum");
+
+    run ("clip_lists", bench_clip_lists);
+    run ("damage", bench_damage);
+    run ("intersect", bench_clip);
+    run ("subtract", bench_subtract);
+
+    for (i = 0; i < n_windows; i++)
+	pixman_region32_fini (&clips[i]);
+    pixman_region32_fini (&damage);
+
+    free (clips);
+    free (windows);
+
+    return 0;
+}
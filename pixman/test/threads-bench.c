@@ -0,0 +1,174 @@
+/*
+ * Times large composites with pixman_composite_set_threads() at a range
+ * of thread counts, and checks that every thread count produces exactly
+ * the pixels of the serial path.
+ *
+ * Usage: threads-bench [max-threads]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "utils.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define TEST_REPEATS 5
+
+typedef struct
+{
+    const char *	name;
+    pixman_op_t		op;
+    pixman_image_t *	src;
+    pixman_image_t *	mask;
+} workload_t;
+
+static uint32_t *dest_init;
+static uint32_t *dest_bits;
+
+static pixman_image_t *
+make_bits (int width, int height)
+{
+    uint32_t *data = aligned_malloc (64, width * height * 4);
+
+    prng_randmemset (data, width * height * 4, 0);
+
+    return pixman_image_create_bits (
+	PIXMAN_a8r8g8b8, width, height, data, width * 4);
+}
+
+static pixman_image_t *
+make_scaled (double scale)
+{
+    pixman_image_t *image = make_bits (WIDTH / scale + 2, HEIGHT / scale + 2);
+    pixman_transform_t transform;
+    pixman_fixed_t s = pixman_double_to_fixed (1 / scale);
+
+    pixman_transform_init_scale (&transform, s, s);
+    pixman_image_set_transform (image, &transform);
+    pixman_image_set_filter (image, PIXMAN_FILTER_BILINEAR, NULL, 0);
+
+    return image;
+}
+
+static pixman_image_t *
+make_linear (void)
+{
+    static const pixman_gradient_stop_t stops[] = {
+	{ pixman_int_to_fixed (0), { 0xffff, 0x0000, 0x0000, 0xffff } },
+	{ pixman_double_to_fixed (0.5), { 0x0000, 0xffff, 0x0000, 0x8000 } },
+	{ pixman_int_to_fixed (1), { 0x0000, 0x0000, 0xffff, 0xffff } },
+    };
+    pixman_point_fixed_t p1 = { 0, 0 };
+    pixman_point_fixed_t p2 = {
+	pixman_int_to_fixed (WIDTH), pixman_int_to_fixed (HEIGHT / 3) };
+
+    return pixman_image_create_linear_gradient (&p1, &p2, stops, 3);
+}
+
+static pixman_image_t *
+make_radial (void)
+{
+    static const pixman_gradient_stop_t stops[] = {
+	{ pixman_int_to_fixed (0), { 0xffff, 0xffff, 0x0000, 0xffff } },
+	{ pixman_int_to_fixed (1), { 0x0000, 0x4000, 0xffff, 0x4000 } },
+    };
+    pixman_point_fixed_t c1 = {
+	pixman_int_to_fixed (WIDTH / 3), pixman_int_to_fixed (HEIGHT / 3) };
+    pixman_point_fixed_t c2 = {
+	pixman_int_to_fixed (WIDTH / 2), pixman_int_to_fixed (HEIGHT / 2) };
+    pixman_image_t *image = pixman_image_create_radial_gradient (
+	&c1, &c2, pixman_int_to_fixed (10), pixman_int_to_fixed (WIDTH / 2),
+	stops, 2);
+
+    pixman_image_set_repeat (image, PIXMAN_REPEAT_REFLECT);
+    return image;
+}
+
+static double
+run (workload_t *w, pixman_image_t *dest, uint32_t *crc)
+{
+    double t = -1;
+    int i;
+
+    for (i = 0; i < TEST_REPEATS; i++)
+    {
+	double t1, t2;
+
+	memcpy (dest_bits, dest_init, WIDTH * HEIGHT * 4);
+
+	t1 = gettime ();
+	pixman_image_composite32 (w->op, w->src, w->mask, dest,
+				  0, 0, 0, 0, 0, 0, WIDTH, HEIGHT);
+	t2 = gettime ();
+
+	if (t < 0 || t2 - t1 < t)
+	    t = t2 - t1;
+    }
+
+    *crc = compute_crc32_for_image (0, dest);
+    return t;
+}
+
+int
+main (int argc, char **argv)
+{
+    workload_t workloads[5];
+    pixman_image_t *dest;
+    int max_threads = argc > 1 ? atoi (argv[1]) : 8;
+    int n_workloads = 0;
+    int failed = 0;
+    int i;
+
+    prng_srand (0x5eed);
+
+    dest = make_bits (WIDTH, HEIGHT);
+    dest_bits = pixman_image_get_data (dest);
+    dest_init = malloc (WIDTH * HEIGHT * 4);
+    memcpy (dest_init, dest_bits, WIDTH * HEIGHT * 4);
+
+    workloads[n_workloads++] = (workload_t) {
+	"over_8888_8888", PIXMAN_OP_OVER, make_bits (WIDTH, HEIGHT), NULL };
+    workloads[n_workloads++] = (workload_t) {
+	"over_8888_8_8888", PIXMAN_OP_OVER, make_bits (WIDTH, HEIGHT),
+	pixman_image_create_bits (PIXMAN_a8, WIDTH, HEIGHT, NULL, 0) };
+    workloads[n_workloads++] = (workload_t) {
+	"bilinear_x1.5", PIXMAN_OP_OVER, make_scaled (1.5), NULL };
+    workloads[n_workloads++] = (workload_t) {
+	"linear_gradient", PIXMAN_OP_SRC, make_linear (), NULL };
+    workloads[n_workloads++] = (workload_t) {
+	"radial_gradient", PIXMAN_OP_OVER, make_radial (), NULL };
+
+    prng_randmemset (pixman_image_get_data (workloads[1].mask),
+		     pixman_image_get_stride (workloads[1].mask) * HEIGHT, 0);
+
+    printf ("# %dx%d, best of %d\n", WIDTH, HEIGHT, TEST_REPEATS);
+    printf ("# %-18s %7s %12s %8s\n",
+	    "workload", "threads", "time / ms", "speedup");
+
+    for (i = 0; i < n_workloads; i++)
+    {
+	uint32_t serial_crc, crc;
+	double serial, t;
+	int n;
+
+	pixman_composite_set_threads (1);
+	serial = run (&workloads[i], dest, &serial_crc);
+
+	printf ("  %-18s %7d %12.3f %8.2f\n",
+		workloads[i].name, 1, serial * 1000, 1.0);
+
+	for (n = 2; n <= max_threads; n *= 2)
+	{
+	    pixman_composite_set_threads (n);
+	    t = run (&workloads[i], dest, &crc);
+
+	    printf ("  %-18s %7d %12.3f %8.2f%s\n",
+		    workloads[i].name, n, t * 1000, serial / t,
+		    crc == serial_crc ? "" : "  MISMATCH");
+
+	    if (crc != serial_crc)
+		failed = 1;
+	}
+    }
+
+    return failed;
+}
@@ -815,6 +815,22 @@ XKBParseFile(FILE * file, XkbFile ** pRtrn)
     return 1;
 }
 
+int
+XKBParseString(const char *str, size_t len, XkbFile ** pRtrn)
+{
+    scan_set_string(str, len);
+    rtrnValue = NULL;
+    if (yyparse() == 0)
+    {
+        *pRtrn = rtrnValue;
+        CheckDefaultMap(rtrnValue);
+        rtrnValue = NULL;
+        return 1;
+    }
+    *pRtrn = NULL;
+    return 0;
+}
+
 XkbFile *
 CreateXKBFile(int type, char *name, ParseCommon * defs, unsigned flags)
 {
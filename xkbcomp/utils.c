@@ -149,6 +149,7 @@ static int outCount = 0;
 static char *preMsg = NULL;
 static char *postMsg = NULL;
 static char *prefix = NULL;
+static jmp_buf *fatalJump = NULL;
 
 Boolean
 uSetErrorFile(char *name)
@@ -253,6 +254,8 @@ uFatalError(const char *s, ...)
     fprintf(errorFile, "                  Exiting\n");
     fflush(errorFile);
     outCount++;
+    if (fatalJump != NULL)
+        longjmp(*fatalJump, 1);
     exit(1);
     /* NOTREACHED */
 }
@@ -306,6 +309,17 @@ uFinishUp(void)
     return;
 }
 
+/**
+ * Make fatal errors longjmp to jump instead of exiting, so that a program
+ * using the compiler as a library survives them.  NULL restores exiting.
+ */
+void
+uSetFatalJump(jmp_buf *jump)
+{
+    fatalJump = jump;
+    return;
+}
+
 /***====================================================================***/
 
 #ifndef HAVE_STRDUP
@@ -35,6 +35,7 @@
 #include	<X11/Xfuncs.h>
 
 #include <stddef.h>
+#include <setjmp.h>
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -190,6 +191,9 @@ uInformation(const char * /* s */ , ...
 
      extern void uFinishUp(void);
 
+     extern void uSetFatalJump(jmp_buf * /* jump */
+    );
+
 
 /***====================================================================***/
 
@@ -70,8 +70,6 @@
 #define	INPUT_XKB	1
 #define	INPUT_XKM	2
 
-unsigned int debugFlags;
-
 static const char *fileTypeExt[] = {
     "XXX",
     "xkm",
@@ -93,10 +91,6 @@ static Bool showImplicit = False;
 static Bool synch = False;
 static Bool computeDflts = False;
 static Bool xkblist = False;
-unsigned warningLevel = 5;
-unsigned verboseLevel = 0;
-unsigned dirsToStrip = 0;
-unsigned optionalParts = 0;
 static char *preErrorMsg = NULL;
 static char *postErrorMsg = NULL;
 static char *errorPrefix = NULL;
@@ -1026,38 +1020,7 @@ main(int argc, char *argv[])
                 WSGO("Cannot allocate keyboard description\n");
                 /* NOTREACHED */
             }
-            switch (mapToUse->type)
-            {
-            case XkmSemanticsFile:
-            case XkmLayoutFile:
-            case XkmKeymapFile:
-                ok = CompileKeymap(mapToUse, &result, MergeReplace);
-                break;
-            case XkmKeyNamesIndex:
-                ok = CompileKeycodes(mapToUse, &result, MergeReplace);
-                break;
-            case XkmTypesIndex:
-                ok = CompileKeyTypes(mapToUse, &result, MergeReplace);
-                break;
-            case XkmSymbolsIndex:
-                /* if it's just symbols, invent key names */
-                result.xkb->flags |= AutoKeyNames;
-                ok = False;
-                break;
-            case XkmCompatMapIndex:
-                ok = CompileCompatMap(mapToUse, &result, MergeReplace, NULL);
-                break;
-            case XkmGeometryFile:
-            case XkmGeometryIndex:
-                /* if it's just a geometry, invent key names */
-                result.xkb->flags |= AutoKeyNames;
-                ok = CompileGeometry(mapToUse, &result, MergeReplace);
-                break;
-            default:
-                WSGO1("Unknown file type %d\n", mapToUse->type);
-                ok = False;
-                break;
-            }
+            ok = CompileXkbFile(mapToUse, &result);
             result.xkb->device_spec = device_id;
         }
         else if (inputFormat == INPUT_XKM) /* parse xkm file */
@@ -339,6 +339,10 @@ typedef struct _XkbFile
     Bool compiled;
 } XkbFile;
 
+extern Bool CompileXkbFile(XkbFile * /* file */ ,
+                           XkbFileInfo *        /* result */
+    );
+
 extern Bool CompileKeymap(XkbFile * /* file */ ,
                           XkbFileInfo * /* result */ ,
                           unsigned      /* merge */
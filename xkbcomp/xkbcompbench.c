@@ -0,0 +1,170 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Compiles one keymap to an xkm over and over, the way the X server used
+ * to (xkbcomp run through popen with the source on its stdin, the xkm
+ * written to a file and read back) and with XkbCompCompileKeymap, checks
+ * both give the same bytes and prints the time per keymap each way.
+ *
+ * usage: xkbcompbench [xkbcomp program [keymap source file]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "xkbcomplib.h"
+
+#define TRIES   50
+
+static const char dfltKeymap[] =
+    "xkb_keymap {\n"
+    "    xkb_keycodes { include \"xfree86+aliases(qwerty)\" };\n"
+    "    xkb_types { include \"complete\" };\n"
+    "    xkb_compat { include \"complete\" };\n"
+    "    xkb_symbols { include \"pc+us+inet(pc105)\" };\n"
+    "    xkb_geometry { include \"pc(pc105)\" };\n"
+    "};\n";
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static char *
+ReadAll(FILE * file, size_t *lengthRtrn)
+{
+    char *buf = NULL;
+    size_t len = 0, n;
+
+    do
+    {
+        buf = realloc(buf, len + 65536);
+        if (!buf)
+            return NULL;
+        n = fread(buf + len, 1, 65536, file);
+        len += n;
+    }
+    while (n > 0);
+    *lengthRtrn = len;
+    return buf;
+}
+
+/**
+ * Compile with the program into xkmFile and read the result back.
+ */
+static char *
+RunProgram(const char *program, const char *keymap, size_t length,
+           const char *xkmFile, size_t *xkmLengthRtrn)
+{
+    char cmd[1024];
+    char *xkm;
+    FILE *file;
+
+    snprintf(cmd, sizeof(cmd), "\"%s\" -w 1 -xkm - \"%s\"", program,
+             xkmFile);
+    file = popen(cmd, "w");
+    if (!file)
+        return NULL;
+    fwrite(keymap, 1, length, file);
+    if (pclose(file) != 0)
+        return NULL;
+
+    file = fopen(xkmFile, "rb");
+    if (!file)
+        return NULL;
+    xkm = ReadAll(file, xkmLengthRtrn);
+    fclose(file);
+    unlink(xkmFile);
+    return xkm;
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *program = argc > 1 ? argv[1] : "./xkbcomp";
+    const char *keymap = dfltKeymap;
+    size_t length = strlen(dfltKeymap);
+    char xkmFile[64];
+    char *forked = NULL;
+    void *inProcess = NULL;
+    size_t forkedLength = 0, inProcessLength = 0;
+    double start, forkTime, libTime;
+    int i, ok;
+
+    if (argc > 2)
+    {
+        FILE *file = fopen(argv[2], "r");
+
+        if (!file || !(keymap = ReadAll(file, &length)))
+        {
+            fprintf(stderr, "Cannot read %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+        fclose(file);
+    }
+    snprintf(xkmFile, sizeof(xkmFile), "/tmp/xkbcompbench-%d.xkm",
+             (int) getpid());
+
+    start = now();
+    for (i = 0; i < TRIES; i++)
+    {
+        free(forked);
+        forked = RunProgram(program, keymap, length, xkmFile, &forkedLength);
+        if (!forked)
+        {
+            fprintf(stderr, "Running %s failed\n", program);
+            return EXIT_FAILURE;
+        }
+    }
+    forkTime = (now() - start) / TRIES;
+
+    start = now();
+    for (i = 0; i < TRIES; i++)
+    {
+        XkbCompFree(inProcess);
+        if (!XkbCompCompileKeymap(keymap, length, NULL, 1,
+                                  &inProcess, &inProcessLength))
+        {
+            fprintf(stderr, "XkbCompCompileKeymap failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+    libTime = (now() - start) / TRIES;
+
+    ok = forkedLength == inProcessLength &&
+        memcmp(forked, inProcess, forkedLength) == 0;
+    printf("  %-24s %8.2f ms/keymap %6zu bytes\n", "xkbcomp through popen",
+           forkTime * 1000, forkedLength);
+    printf("  %-24s %8.2f ms/keymap %6zu bytes%s\n", "XkbCompCompileKeymap",
+           libTime * 1000, inProcessLength, ok ? "" : "  MISMATCH");
+
+    free(forked);
+    XkbCompFree(inProcess);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,256 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The part of xkbcomp shared by the program and by libxkbcomp: the
+ * settings every compiler file looks at, compiling a parsed map, and
+ * the library's entry points.
+ *
+ * A compile in the library goes like one run of the program: parse the
+ * source from memory, compile the default map in it, write the xkm.  The
+ * include path and the cache of parsed include files are reset each
+ * time, since the compilers modify the included trees as they go.  The
+ * trees themselves are never freed, here or in the program, so every
+ * compile leaks the parsed source it read; a process that compiles
+ * keymaps now and then can live with that, but should not compile
+ * whatever its clients ask for this way.  Fatal errors longjmp back
+ * instead of exiting.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#ifdef _MSC_VER
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "xkbcomp.h"
+#include "xkbpath.h"
+#include "parseutils.h"
+#include "misc.h"
+#include "xkbcomplib.h"
+
+unsigned int debugFlags;
+unsigned warningLevel = 5;
+unsigned verboseLevel = 0;
+unsigned dirsToStrip = 0;
+unsigned optionalParts = 0;
+
+/***====================================================================***/
+
+/**
+ * Compile mapToUse into result, whose xkb must be allocated already.
+ */
+Bool
+CompileXkbFile(XkbFile * mapToUse, XkbFileInfo * result)
+{
+    Bool ok;
+
+    switch (mapToUse->type)
+    {
+    case XkmSemanticsFile:
+    case XkmLayoutFile:
+    case XkmKeymapFile:
+        ok = CompileKeymap(mapToUse, result, MergeReplace);
+        break;
+    case XkmKeyNamesIndex:
+        ok = CompileKeycodes(mapToUse, result, MergeReplace);
+        break;
+    case XkmTypesIndex:
+        ok = CompileKeyTypes(mapToUse, result, MergeReplace);
+        break;
+    case XkmSymbolsIndex:
+        /* if it's just symbols, invent key names */
+        result->xkb->flags |= AutoKeyNames;
+        ok = False;
+        break;
+    case XkmCompatMapIndex:
+        ok = CompileCompatMap(mapToUse, result, MergeReplace, NULL);
+        break;
+    case XkmGeometryFile:
+    case XkmGeometryIndex:
+        /* if it's just a geometry, invent key names */
+        result->xkb->flags |= AutoKeyNames;
+        ok = CompileGeometry(mapToUse, result, MergeReplace);
+        break;
+    default:
+        WSGO1("Unknown file type %d\n", mapToUse->type);
+        ok = False;
+        break;
+    }
+    return ok;
+}
+
+/***====================================================================***/
+
+static const char *preErrorMsg, *errorPrefix, *postErrorMsg;
+
+void
+XkbCompSetMessages(const char *pre, const char *prefix, const char *post)
+{
+    preErrorMsg = pre;
+    errorPrefix = prefix;
+    postErrorMsg = post;
+}
+
+/**
+ * Write result as an xkm into memory.
+ */
+static Bool
+WriteXKMBuffer(XkbFileInfo * result, void **xkmRtrn, size_t *lengthRtrn)
+{
+    FILE *out;
+    char *buf = NULL;
+    size_t size = 0;
+    Bool ok;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    out = open_memstream(&buf, &size);
+    if (out == NULL)
+        return False;
+    ok = XkbWriteXKMFile(out, result);
+    if (fclose(out) != 0)
+        ok = False;
+#else
+    /* Without open_memstream, a temporary file read back */
+    long end;
+#ifdef _MSC_VER
+    const char *dir = getenv("TEMP");
+    char name[_MAX_PATH];
+    int fd = -1;
+
+    /* Created exclusively, so nobody can have a file waiting under the
+       name; _O_TEMPORARY deletes it on close */
+    if (_snprintf_s(name, sizeof(name), _TRUNCATE, "%s\\xkm_XXXXXX",
+                    dir ? dir : ".") > 0 &&
+        _mktemp_s(name, strlen(name) + 1) == 0)
+        fd = _open(name, _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY |
+                   _O_SHORT_LIVED | _O_TEMPORARY, _S_IREAD | _S_IWRITE);
+    out = fd >= 0 ? _fdopen(fd, "w+b") : NULL;
+    if (out == NULL && fd >= 0)
+        _close(fd);
+#else
+    out = tmpfile();
+#endif
+    if (out == NULL)
+        return False;
+    ok = XkbWriteXKMFile(out, result) && fflush(out) == 0 &&
+        (end = ftell(out)) >= 0;
+    if (ok)
+    {
+        size = end;
+        buf = malloc(size ? size : 1);
+        rewind(out);
+        ok = buf && fread(buf, 1, size, out) == size;
+    }
+    fclose(out);
+#endif
+    if (!ok)
+    {
+        free(buf);
+        return False;
+    }
+    *xkmRtrn = buf;
+    *lengthRtrn = size;
+    return True;
+}
+
+int
+XkbCompCompileKeymap(const char *keymap, size_t length, const char *root,
+                     unsigned warnLevel, void **xkmRtrn,
+                     size_t *xkmLengthRtrn)
+{
+    static Bool initialized;
+    static char scanName[] = "(keymap)";
+    /* static or volatile: they change between setjmp and longjmp */
+    static XkbFileInfo result;
+    volatile Bool ok;
+    XkbFile *rtrn, *mapToUse;
+    jmp_buf jump;
+
+    *xkmRtrn = NULL;
+    *xkmLengthRtrn = 0;
+
+    if (!initialized)
+    {
+        uSetDebugFile(NullString);
+        uSetErrorFile(NullString);
+        if (!XkbInitIncludePath())
+            return 0;
+        XkbInitAtoms(NULL);
+        initialized = True;
+    }
+    warningLevel = warnLevel;
+    uSetPreErrorMessage((char *) preErrorMsg);
+    uSetErrorPrefix((char *) errorPrefix);
+    uSetPostErrorMessage((char *) postErrorMsg);
+
+    XkbClearIncludePath();
+    XkbClearFileCache();
+    if (!XkbAddDirectoryToPath(root ? root : DFLT_XKB_CONFIG_ROOT))
+        return 0;
+
+    bzero((char *) &result, sizeof(result));
+    ok = False;
+    if (setjmp(jump) == 0)
+    {
+        uSetFatalJump(&jump);
+        setScanState(scanName, 1);
+        if (XKBParseString(keymap, length, &rtrn) && rtrn)
+        {
+            /* the map flagged default, or the first one */
+            for (mapToUse = rtrn; mapToUse;
+                 mapToUse = (XkbFile *) mapToUse->common.next)
+            {
+                if (mapToUse->flags & XkbLC_Default)
+                    break;
+            }
+            if (!mapToUse)
+                mapToUse = rtrn;
+
+            result.type = mapToUse->type;
+            result.xkb = XkbAllocKeyboard();
+            if (result.xkb == NULL)
+                WSGO("Cannot allocate keyboard description\n");
+            else if (CompileXkbFile(mapToUse, &result))
+            {
+                result.xkb->device_spec = XkbUseCoreKbd;
+                ok = WriteXKMBuffer(&result, xkmRtrn, xkmLengthRtrn);
+            }
+        }
+        else
+            INFO("Errors encountered in keymap; not compiled.\n");
+    }
+    uSetFatalJump(NULL);
+
+    if (result.xkb)
+        XkbFreeKeyboard(result.xkb, XkbAllComponentsMask, True);
+    uFinishUp();
+    return ok;
+}
+
+void
+XkbCompFree(void *xkm)
+{
+    free(xkm);
+}
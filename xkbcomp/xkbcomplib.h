@@ -0,0 +1,63 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XKBCOMPLIB_H
+#define XKBCOMPLIB_H 1
+
+#include <stddef.h>
+
+/*
+ * libxkbcomp: the keymap compiler without the program around it, so that
+ * a process can compile keymap source to an xkm without running xkbcomp.
+ * It uses global state and is not thread safe.
+ */
+
+#define XKBCOMP_LIB_VERSION     1
+
+/**
+ * Messages printed before the first error, in front of every line and
+ * after the last error of a compile, as xkbcomp's -em1, -emp and -eml.
+ * Any of them may be NULL.  The strings are not copied.
+ */
+extern void XkbCompSetMessages(const char * /* pre */ ,
+                               const char * /* prefix */ ,
+                               const char *     /* post */
+    );
+
+/**
+ * Compile the keymap source in keymap, length bytes of it, like
+ * "xkbcomp -xkm -w warningLevel -Rroot" would, including files from
+ * root, or from the built in default if root is NULL.  Returns 1 and
+ * the xkm in *xkmRtrn and *xkmLengthRtrn on success, to be freed with
+ * XkbCompFree; returns 0 and prints the reasons to stderr on failure.
+ */
+extern int XkbCompCompileKeymap(const char * /* keymap */ ,
+                                size_t /* length */ ,
+                                const char * /* root */ ,
+                                unsigned /* warningLevel */ ,
+                                void ** /* xkmRtrn */ ,
+                                size_t *        /* xkmLengthRtrn */
+    );
+
+extern void XkbCompFree(void *  /* xkm */
+    );
+
+#endif /* XKBCOMPLIB_H */
@@ -366,6 +366,23 @@ XkbFindFileInCache(char *name, unsigned type, char **pathRtrn)
     return NULL;
 }
 
+/**
+ * Forget all files in the cache.  The entries only point at their names,
+ * paths and data, which are left alone.
+ */
+void
+XkbClearFileCache(void)
+{
+    FileCacheEntry *entry, *next;
+
+    for (entry = fileCache; entry != NULL; entry = next)
+    {
+        next = entry->next;
+        uFree(entry);
+    }
+    fileCache = NULL;
+}
+
 /***====================================================================***/
 
 /**
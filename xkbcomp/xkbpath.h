@@ -55,6 +55,8 @@ extern void *XkbFindFileInCache(char * /* name */ ,
                                 char ** /* pathRtrn */
     );
 
+extern void XkbClearFileCache(void);
+
 extern Bool XkbParseIncludeMap(char ** /* str_inout */ ,
                                char ** /* file_rtrn */ ,
                                char ** /* map_rtrn */ ,
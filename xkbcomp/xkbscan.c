@@ -39,6 +39,8 @@
 unsigned int scanDebug;
 
 static FILE *yyin;
+static const char *scanString;
+static size_t scanStringLen;
 
 static char scanFileBuf[1024] = {0};
 char *scanFile = scanFileBuf;
@@ -278,15 +280,32 @@ scan_set_file(FILE *file)
     yyin = file;
 }
 
+void
+scan_set_string(const char *str, size_t len)
+{
+    readBufLen = 0;
+    readBufPos = 0;
+    yyin = NULL;
+    scanString = str;
+    scanStringLen = len;
+}
+
 static int
 scanchar(void)
 {
     if (readBufPos >= readBufLen) {
-        readBufLen = fread(readBuf, 1, BUFSIZE, yyin);
+        if (yyin != NULL)
+            readBufLen = fread(readBuf, 1, BUFSIZE, yyin);
+        else {
+            readBufLen = scanStringLen < BUFSIZE ? scanStringLen : BUFSIZE;
+            memcpy(readBuf, scanString, readBufLen);
+            scanString += readBufLen;
+            scanStringLen -= readBufLen;
+        }
         readBufPos = 0;
         if (!readBufLen)
             return EOF;
-        if (feof(yyin))
+        if (yyin != NULL && feof(yyin))
             readBuf[readBufLen] = EOF;
     }
 
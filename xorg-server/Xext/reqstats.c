@@ -0,0 +1,256 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "extnsionst.h"
+#include "swaprep.h"
+#include "xace.h"
+#include "extinit.h"
+#include "protocol-versions.h"
+#include "reqstats.h"
+#include "reqstatsproto.h"
+
+#define ReqStatsSplit(v, hi, lo) do {           \
+    (hi) = (CARD32) ((v) >> 32);                \
+    (lo) = (CARD32) (v);                        \
+} while (0)
+
+static CARD32
+ReqStatsClamp(CARD64 v)
+{
+    return v > 0xffffffff ? 0xffffffff : (CARD32) v;
+}
+
+static int
+ProcReqStatsQueryVersion(ClientPtr client)
+{
+    xReqStatsQueryVersionReply rep = {
+        .type = X_Reply,
+        .enabled = ReqStatsEnabled,
+        .sequenceNumber = client->sequence,
+        .length = 0,
+        .server_major = SERVER_REQSTATS_MAJOR_VERSION,
+        .server_minor = SERVER_REQSTATS_MINOR_VERSION
+    };
+
+    REQUEST_SIZE_MATCH(xReqStatsQueryVersionReq);
+
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swaps(&rep.server_major);
+        swaps(&rep.server_minor);
+    }
+    WriteToClient(client, sizeof(xReqStatsQueryVersionReply), &rep);
+    return Success;
+}
+
+static int
+ProcReqStatsQueryClients(ClientPtr client)
+{
+    xReqStatsQueryClientsReply rep;
+    xReqStatsClientInfo *infos;
+    int i, num_clients = 0;
+
+    REQUEST_SIZE_MATCH(xReqStatsQueryClientsReq);
+
+    infos = calloc(currentMaxClients, sizeof(xReqStatsClientInfo));
+    if (!infos)
+        return BadAlloc;
+
+    for (i = 0; i < currentMaxClients; i++) {
+        ReqStatsClientPtr stats = ReqStatsGetClient(i);
+        xReqStatsClientInfo *info = &infos[num_clients];
+
+        if (!clients[i])
+            continue;
+        info->resource_base = clients[i]->clientAsMask;
+        ReqStatsSplit(stats->requests, info->requests_hi, info->requests_lo);
+        ReqStatsSplit(stats->time, info->time_hi, info->time_lo);
+        ReqStatsSplit(stats->bytesIn, info->bytes_in_hi, info->bytes_in_lo);
+        ReqStatsSplit(stats->bytesOut, info->bytes_out_hi, info->bytes_out_lo);
+        info->max_time = ReqStatsClamp(stats->max);
+        info->max_major = stats->maxMajor;
+        info->max_minor = stats->maxMinor;
+        if (client->swapped) {
+            /* every field but the last word is a CARD32 */
+            SwapLongs((CARD32 *) info, 10);
+            swaps(&info->max_minor);
+        }
+        num_clients++;
+    }
+
+    rep = (xReqStatsQueryClientsReply) {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = bytes_to_int32(num_clients * sz_xReqStatsClientInfo),
+        .num_clients = num_clients
+    };
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swapl(&rep.num_clients);
+    }
+    WriteToClient(client, sizeof(xReqStatsQueryClientsReply), &rep);
+    WriteToClient(client, num_clients * sz_xReqStatsClientInfo, infos);
+    free(infos);
+    return Success;
+}
+
+static int
+ProcReqStatsQueryOpcodes(ClientPtr client)
+{
+    const int entry = sz_xReqStatsOpcodeInfo + REQSTATS_BUCKETS * 4;
+    xReqStatsQueryOpcodesReply rep;
+    char *buf, *p;
+    int major, minor, num_opcodes = 0;
+
+    REQUEST_SIZE_MATCH(xReqStatsQueryOpcodesReq);
+
+    for (major = 0; major < 256; major++)
+        for (minor = 0; minor < REQSTATS_MAX_MINOR; minor++) {
+            ReqStatsOpPtr op = ReqStatsGetOp(major, minor);
+
+            if (!op)
+                break;
+            if (op->count)
+                num_opcodes++;
+            if (major < EXTENSION_BASE)
+                break;
+        }
+
+    p = buf = calloc(num_opcodes ? num_opcodes : 1, entry);
+    if (!buf)
+        return BadAlloc;
+
+    for (major = 0; major < 256; major++)
+        for (minor = 0; minor < REQSTATS_MAX_MINOR; minor++) {
+            ReqStatsOpPtr op = ReqStatsGetOp(major, minor);
+            xReqStatsOpcodeInfo *info = (xReqStatsOpcodeInfo *) p;
+            CARD32 *hist = (CARD32 *) (p + sz_xReqStatsOpcodeInfo);
+
+            if (!op)
+                break;
+            if (op->count && p < buf + num_opcodes * entry) {
+                info->major = major;
+                info->minor = minor;
+                ReqStatsSplit(op->count, info->count_hi, info->count_lo);
+                ReqStatsSplit(op->time, info->time_hi, info->time_lo);
+                info->max_time = ReqStatsClamp(op->max);
+                memcpy(hist, op->hist, REQSTATS_BUCKETS * 4);
+                if (client->swapped) {
+                    swaps(&info->minor);
+                    SwapLongs(&info->count_hi, 5);
+                    SwapLongs(hist, REQSTATS_BUCKETS);
+                }
+                p += entry;
+            }
+            if (major < EXTENSION_BASE)
+                break;
+        }
+
+    rep = (xReqStatsQueryOpcodesReply) {
+        .type = X_Reply,
+        .sequenceNumber = client->sequence,
+        .length = bytes_to_int32(num_opcodes * entry),
+        .num_opcodes = num_opcodes,
+        .num_buckets = REQSTATS_BUCKETS
+    };
+    if (client->swapped) {
+        swaps(&rep.sequenceNumber);
+        swapl(&rep.length);
+        swapl(&rep.num_opcodes);
+        swapl(&rep.num_buckets);
+    }
+    WriteToClient(client, sizeof(xReqStatsQueryOpcodesReply), &rep);
+    WriteToClient(client, num_opcodes * entry, buf);
+    free(buf);
+    return Success;
+}
+
+static int
+ProcReqStatsControl(ClientPtr client)
+{
+    REQUEST(xReqStatsControlReq);
+    int rc;
+
+    REQUEST_SIZE_MATCH(xReqStatsControlReq);
+
+    if (stuff->enable > ReqStatsControlLeave) {
+        client->errorValue = stuff->enable;
+        return BadValue;
+    }
+    rc = XaceHook(XACE_SERVER_ACCESS, client, DixManageAccess);
+    if (rc != Success)
+        return rc;
+
+    if (stuff->reset)
+        ReqStatsReset();
+    if (stuff->enable != ReqStatsControlLeave)
+        ReqStatsSetEnabled(stuff->enable == ReqStatsControlEnable);
+    return Success;
+}
+
+static int
+ProcReqStatsDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    switch (stuff->data) {
+    case X_ReqStatsQueryVersion:
+        return ProcReqStatsQueryVersion(client);
+    case X_ReqStatsQueryClients:
+        return ProcReqStatsQueryClients(client);
+    case X_ReqStatsQueryOpcodes:
+        return ProcReqStatsQueryOpcodes(client);
+    case X_ReqStatsControl:
+        return ProcReqStatsControl(client);
+    default: break;
+    }
+
+    return BadRequest;
+}
+
+static int
+SProcReqStatsDispatch(ClientPtr client)
+{
+    REQUEST(xReq);
+    swaps(&stuff->length);
+
+    /* nothing else to swap in any of the requests */
+    return ProcReqStatsDispatch(client);
+}
+
+void
+ReqStatsExtensionInit(void)
+{
+    (void) AddExtension(REQSTATS_NAME, 0, 0,
+                        ProcReqStatsDispatch, SProcReqStatsDispatch,
+                        NULL, StandardMinorOpcode);
+}
@@ -0,0 +1,149 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _REQSTATSPROTO_H_
+#define _REQSTATSPROTO_H_
+
+/*
+ * X-Request-Stats: read the request statistics kept by the server, in
+ * the spirit of X-Resource.  64 bit counters are sent as two CARD32s,
+ * most significant first; times are in nanoseconds.
+ */
+
+#define REQSTATS_NAME                   "X-Request-Stats"
+
+#define X_ReqStatsQueryVersion          0
+#define X_ReqStatsQueryClients          1
+#define X_ReqStatsQueryOpcodes          2
+#define X_ReqStatsControl               3
+
+#define ReqStatsControlDisable          0
+#define ReqStatsControlEnable           1
+#define ReqStatsControlLeave            2
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+    CARD8 client_major;
+    CARD8 client_minor;
+    CARD16 pad;
+} xReqStatsQueryVersionReq;
+#define sz_xReqStatsQueryVersionReq 8
+
+typedef struct {
+    CARD8 type;
+    CARD8 enabled;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD16 server_major;
+    CARD16 server_minor;
+    CARD32 pad2;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+    CARD32 pad6;
+} xReqStatsQueryVersionReply;
+#define sz_xReqStatsQueryVersionReply 32
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+} xReqStatsQueryClientsReq;
+#define sz_xReqStatsQueryClientsReq 4
+
+typedef struct {
+    CARD8 type;
+    CARD8 pad1;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD32 num_clients;
+    CARD32 pad3;
+    CARD32 pad4;
+    CARD32 pad5;
+    CARD32 pad6;
+    CARD32 pad7;
+} xReqStatsQueryClientsReply;
+#define sz_xReqStatsQueryClientsReply 32
+
+typedef struct {
+    CARD32 resource_base;
+    CARD32 requests_hi;
+    CARD32 requests_lo;
+    CARD32 time_hi;
+    CARD32 time_lo;
+    CARD32 bytes_in_hi;
+    CARD32 bytes_in_lo;
+    CARD32 bytes_out_hi;
+    CARD32 bytes_out_lo;
+    CARD32 max_time;            /* saturates at 2^32 - 1 */
+    CARD8 max_major;
+    CARD8 pad;
+    CARD16 max_minor;
+} xReqStatsClientInfo;
+#define sz_xReqStatsClientInfo 44
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+} xReqStatsQueryOpcodesReq;
+#define sz_xReqStatsQueryOpcodesReq 4
+
+typedef struct {
+    CARD8 type;
+    CARD8 pad1;
+    CARD16 sequenceNumber;
+    CARD32 length;
+    CARD32 num_opcodes;
+    CARD32 num_buckets;
+    CARD32 pad4;
+    CARD32 pad5;
+    CARD32 pad6;
+    CARD32 pad7;
+} xReqStatsQueryOpcodesReply;
+#define sz_xReqStatsQueryOpcodesReply 32
+
+/* followed by num_buckets CARD32 histogram counts, bucket n holding
+   requests that took [2^n, 2^(n+1)) ns */
+typedef struct {
+    CARD8 major;
+    CARD8 pad;
+    CARD16 minor;
+    CARD32 count_hi;
+    CARD32 count_lo;
+    CARD32 time_hi;
+    CARD32 time_lo;
+    CARD32 max_time;            /* saturates at 2^32 - 1 */
+} xReqStatsOpcodeInfo;
+#define sz_xReqStatsOpcodeInfo 24
+
+typedef struct {
+    CARD8 reqType;
+    CARD8 reqStatsReqType;
+    CARD16 length;
+    CARD8 enable;               /* ReqStatsControl* */
+    BOOL reset;
+    CARD16 pad;
+} xReqStatsControlReq;
+#define sz_xReqStatsControlReq 8
+
+#endif /* _REQSTATSPROTO_H_ */
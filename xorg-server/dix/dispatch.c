@@ -132,6 +132,7 @@ int ProcInitialConnection();
 #include "xkbsrv.h"
 #include "site.h"
 #include "client.h"
+#include "reqstats.h"
 
 #ifdef XSERVER_DTRACE
 #include "registry.h"
@@ -235,8 +236,20 @@ long SmartScheduleInterval = SMART_SCHEDULE_DEFAULT_INTERVAL;
 long SmartScheduleMaxSlice = SMART_SCHEDULE_MAX_SLICE;
 long SmartScheduleTime;
 int SmartScheduleLatencyLimited = 0;
+Bool SmartScheduleFair = FALSE;
 static ClientPtr SmartLastClient;
 static int SmartLastIndex[SMART_MAX_PRIORITY - SMART_MIN_PRIORITY + 1];
+static int SmartLastFairIndex;
+
+/* Client classes for fair scheduling, picked by command name */
+typedef struct _SmartClass {
+    char *name;
+    int weight;
+} SmartClassRec;
+
+static SmartClassRec *SmartClasses;
+static int SmartNumClasses;
+static int SmartDefaultWeight = 1;
 
 #ifdef SMART_DEBUG
 long SmartLastPrint;
@@ -244,6 +257,160 @@ long SmartLastPrint;
 
 void Dispatch(void);
 
+#define SMART_MAX_WEIGHT    1000
+
+/*
+ * Parse a -schedClass argument, "weight:name[,name...]".  Clients whose
+ * command name is one of the names get that weight, a name of "*" sets
+ * the weight of every other client.  The command name is only known for
+ * local clients on systems where GetClientCmdName works (not on Windows),
+ * all others get the default weight.
+ */
+Bool
+SmartScheduleAddClass(const char *spec)
+{
+    char *end, *names, *name, *next;
+    long weight;
+
+    weight = strtol(spec, &end, 10);
+    if (end == spec || *end != ':' || weight < 1 || weight > SMART_MAX_WEIGHT)
+        return FALSE;
+    names = strdup(end + 1);
+    if (!names)
+        return FALSE;
+
+    for (name = names; name; name = next) {
+        next = strchr(name, ',');
+        if (next)
+            *next++ = '\0';
+        if (!*name)
+            continue;
+        if (strcmp(name, "*") == 0)
+            SmartDefaultWeight = weight;
+        else {
+            SmartClassRec *classes;
+
+            classes = realloc(SmartClasses,
+                              (SmartNumClasses + 1) * sizeof(SmartClassRec));
+            if (!classes)
+                break;
+            SmartClasses = classes;
+            SmartClasses[SmartNumClasses].name = strdup(name);
+            SmartClasses[SmartNumClasses].weight = weight;
+            if (SmartClasses[SmartNumClasses].name)
+                SmartNumClasses++;
+        }
+    }
+    free(names);
+    return TRUE;
+}
+
+static int
+SmartScheduleClientWeight(ClientPtr pClient)
+{
+    const char *cmd = GetClientCmdName(pClient);
+    const char *base;
+    int i;
+
+    if (cmd) {
+        base = strrchr(cmd, '/');
+        base = base ? base + 1 : cmd;
+        for (i = 0; i < SmartNumClasses; i++)
+            if (strcmp(base, SmartClasses[i].name) == 0)
+                return SmartClasses[i].weight;
+    }
+    return SmartDefaultWeight;
+}
+
+/*
+ * Weighted fair scheduling, deficit round robin style.  Every round a
+ * client earns SmartScheduleInterval msec of credit times its weight,
+ * and it pays for the time its requests really took.  The next client
+ * is the first ready one with credit left, going round from the last
+ * one served; when none has any, enough rounds are credited at once for
+ * at least one to have some.  A client that runs out of requests drops
+ * its unused credit, so idle clients can't save up time, but the debt
+ * left by an expensive request stays until it is paid off.  Among the
+ * clients with credit, those boosted by input events (smart_priority)
+ * still go first, as in the priority scheme.
+ */
+static ClientPtr
+SmartScheduleFairPick(int *clientReady, int nready)
+{
+    ClientPtr pClient, best = NULL;
+    int bestPrio = SMART_MIN_PRIORITY - 1;
+    int bestRobin = MAXCLIENTS;
+    int i, robin;
+
+    for (i = 0; i < nready; i++) {
+        pClient = clients[clientReady[i]];
+        if (pClient->smart_deficit <= 0)
+            continue;
+        robin = (pClient->index - SmartLastFairIndex + MAXCLIENTS) % MAXCLIENTS;
+        if (pClient->smart_priority > bestPrio ||
+            (pClient->smart_priority == bestPrio && robin < bestRobin)) {
+            bestPrio = pClient->smart_priority;
+            bestRobin = robin;
+            best = pClient;
+        }
+    }
+    return best;
+}
+
+static int
+SmartScheduleFairClient(int *clientReady, int nready)
+{
+    long quantum = SmartScheduleInterval * 1000;
+    long rounds = 0;
+    ClientPtr pClient, best;
+    int i;
+
+    for (i = 0; i < nready; i++) {
+        pClient = clients[clientReady[i]];
+        if (!pClient->smart_weight)
+            pClient->smart_weight = SmartScheduleClientWeight(pClient);
+    }
+
+    best = SmartScheduleFairPick(clientReady, nready);
+    if (!best) {
+        for (i = 0; i < nready; i++) {
+            long credit;
+
+            pClient = clients[clientReady[i]];
+            credit = quantum * pClient->smart_weight;
+            if (!rounds || -pClient->smart_deficit / credit + 1 < rounds)
+                rounds = -pClient->smart_deficit / credit + 1;
+        }
+        for (i = 0; i < nready; i++) {
+            pClient = clients[clientReady[i]];
+            pClient->smart_deficit += rounds * quantum * pClient->smart_weight;
+        }
+        best = SmartScheduleFairPick(clientReady, nready);
+    }
+
+    SmartLastFairIndex = best->index;
+    if (SmartLastClient != best) {
+        best->smart_start_tick = SmartScheduleTime;
+        SmartLastClient = best;
+    }
+    if (nready == 1 && SmartScheduleLatencyLimited == 0)
+        SmartScheduleSlice = SmartScheduleMaxSlice;
+    else
+        SmartScheduleSlice = min(max(best->smart_deficit / 1000, 1),
+                                 SmartScheduleLatencyLimited ?
+                                 SmartScheduleInterval : SmartScheduleMaxSlice);
+    return best->index;
+}
+
+/* Charge pClient for a turn that started at start usec */
+static void
+SmartScheduleCharge(ClientPtr pClient, CARD64 start, Bool drained)
+{
+    pClient->smart_deficit -= (long) (GetTimeInMicros() - start);
+    if (drained && pClient->smart_deficit > 0)
+        pClient->smart_deficit = 0;
+}
+
 static int
 SmartScheduleClient(int *clientReady, int nready)
 {
@@ -255,6 +422,9 @@ SmartScheduleClient(int *clientReady, int nready)
     long now = SmartScheduleTime;
     long idle;
 
+    if (SmartScheduleFair)
+        return SmartScheduleFairClient(clientReady, nready);
+
     bestPrio = -0x7fffffff;
     bestRobin = 0;
     idle = 2 * SmartScheduleSlice;
@@ -344,6 +514,8 @@ Dispatch(void)
     int nready;
     HWEventQueuePtr *icheck = checkForInput;
     long start_tick;
+    CARD64 turn_start;
+    Bool drained;
 
     nextFreeClientID = 1;
     nClients = 0;
@@ -384,10 +556,15 @@ Dispatch(void)
             isItTimeToYield = FALSE;
 
             start_tick = SmartScheduleTime;
+            turn_start = SmartScheduleFair && !SmartScheduleDisable ?
+                GetTimeInMicros() : 0;
+            drained = FALSE;
             while (!isItTimeToYield) {
 #ifdef XSERVER_DTRACE
                 CARD8 StartMajorOp;
 #endif
+                CARD64 reqStart = 0;
+                int reqMajor = 0, reqMinor = 0, reqBytes = 0;
                 if (*icheck[0] != *icheck[1])
                     ProcessInputEvents();
 
@@ -408,6 +585,7 @@ Dispatch(void)
                 if (result <= 0) {
                     if (result < 0)
                         CloseDownClient(client);
+                    drained = TRUE;
                     break;
                 }
 
@@ -420,6 +598,12 @@ Dispatch(void)
                     if (ext)
                         client->minorOp = ext->MinorOpcode(client);
                 }
+                if (ReqStatsEnabled) {
+                    reqMajor = client->majorOp;
+                    reqMinor = client->minorOp;
+                    reqBytes = result;
+                    reqStart = ReqStatsNow();
+                }
 #ifdef XSERVER_DTRACE
                 if (XSERVER_REQUEST_START_ENABLED())
                 {
@@ -440,6 +624,9 @@ Dispatch(void)
                             (*client->requestVector[client->majorOp]) (client);
                     XaceHookAuditEnd(client, result);
                 }
+                if (reqStart)
+                    ReqStatsRecord(client, reqMajor, reqMinor, reqBytes,
+                                   reqStart);
 #ifdef XSERVER_DTRACE
                 if (XSERVER_REQUEST_DONE_ENABLED())
                 {
@@ -484,8 +671,11 @@ Dispatch(void)
             }
             FlushAllOutput();
             client = clients[clientReady[nready]];
-            if (client)
+            if (client) {
                 client->smart_stop_tick = SmartScheduleTime;
+                if (turn_start)
+                    SmartScheduleCharge(client, turn_start, drained);
+            }
         }
         dispatchException &= ~DE_PRIORITYCHANGE;
     }
@@ -2061,6 +2251,49 @@ ProcPutImage(ClientPtr client)
     return Success;
 }
 
+/*
+ * Send one stripe of a GetImage reply.  The stripe buffer is handed to
+ * the output layer, which only keeps it if the client can't take it right
+ * away.  When it comes straight back it is reused for the next stripe;
+ * only a kept buffer needs a fresh one.  Returns the buffer for the next
+ * stripe, or NULL after the last one.  If a fresh buffer can't be had the
+ * reply can't be finished, so the client is dropped and NULL returned.
+ */
+static char *ImageStripeWriting;
+static Bool ImageStripeReturned;
+
+static void
+ReleaseImageStripe(void *data)
+{
+    if (data == ImageStripeWriting)
+        ImageStripeReturned = TRUE;
+    else
+        free(data);
+}
+
+static char *
+WriteImageStripe(ClientPtr client, char *pBuf, int count, int length,
+                 Bool more)
+{
+    char *pNext;
+
+    ImageStripeWriting = pBuf;
+    ImageStripeReturned = FALSE;
+    WriteToClientNoCopy(client, count, pBuf, ReleaseImageStripe, pBuf);
+    ImageStripeWriting = NULL;
+    if (ImageStripeReturned) {
+        if (more)
+            return pBuf;
+        free(pBuf);
+        return NULL;
+    }
+    if (!more)
+        return NULL;
+    if (!(pNext = calloc(1, length)))
+        MarkClientException(client);
+    return pNext;
+}
+
 static int
 DoGetImage(ClientPtr client, int format, Drawable drawable,
            int x, int y, int width, int height,
@@ -2203,7 +2436,7 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
     }
     else if (format == ZPixmap) {
         linesDone = 0;
-        while (height - linesDone > 0) {
+        while (pBuf && height - linesDone > 0) {
             nlines = min(linesPerBuf, height - linesDone);
             (*pDraw->pScreen->GetImage) (pDraw,
                                          x,
@@ -2221,16 +2454,17 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
             ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                           BitsPerPixel(pDraw->depth), ClientOrder(client));
 
-            WriteToClient(client, (int) (nlines * widthBytesLine), pBuf);
+            pBuf = WriteImageStripe(client, pBuf, nlines * widthBytesLine,
+                                    length, linesDone + nlines < height);
             linesDone += nlines;
         }
     }
     else {                      /* XYPixmap */
 
-        for (; plane; plane >>= 1) {
+        for (; plane && pBuf; plane >>= 1) {
             if (planemask & plane) {
                 linesDone = 0;
-                while (height - linesDone > 0) {
+                while (pBuf && height - linesDone > 0) {
                     nlines = min(linesPerBuf, height - linesDone);
                     (*pDraw->pScreen->GetImage) (pDraw,
                                                  x,
@@ -2249,7 +2483,10 @@ DoGetImage(ClientPtr client, int format, Drawable drawable,
                     ReformatImage(pBuf, (int) (nlines * widthBytesLine),
                                   1, ClientOrder(client));
 
-                    WriteToClient(client, (int)(nlines * widthBytesLine), pBuf);
+                    pBuf = WriteImageStripe(client, pBuf,
+                                            nlines * widthBytesLine, length,
+                                            linesDone + nlines < height ||
+                                            (planemask & (plane - 1)));
                     linesDone += nlines;
                 }
             }
@@ -3509,6 +3746,7 @@ InitClient(ClientPtr client, int i, void *ospriv)
     client->smart_start_tick = SmartScheduleTime;
     client->smart_stop_tick = SmartScheduleTime;
     client->clientIds = NULL;
+    ReqStatsClientInit(client);
 }
 
 /************************
@@ -1633,6 +1633,7 @@ SetFontPathElements(int npaths, unsigned char *paths, int *bad, Bool persist)
     unsigned int len;
     unsigned char *cp = paths;
     FontPathElementPtr fpe = NULL, *fplist;
+    CARD64 start = GetTimeInMicros(), elementStart;
 
     fplist = malloc(sizeof(FontPathElementPtr) * npaths);
     if (!fplist) {
@@ -1645,6 +1646,7 @@ SetFontPathElements(int npaths, unsigned char *paths, int *bad, Bool persist)
     }
     for (i = 0; i < npaths; i++) {
         len = (unsigned int) (*cp++);
+        elementStart = GetTimeInMicros();
 
         if (len == 0) {
             if (persist)
@@ -1703,6 +1705,10 @@ SetFontPathElements(int npaths, unsigned char *paths, int *bad, Bool persist)
                     free(fpe);
                 }
             }
+            LogMessageVerb(X_INFO, 4, "Font path element %.*s: %s in %.1f ms\n",
+                           (int) len, cp,
+                           err == Successful ? "set up" : "failed",
+                           (GetTimeInMicros() - elementStart) / 1000.0);
         }
         if (err != Successful) {
             if (!persist)
@@ -1720,6 +1726,9 @@ SetFontPathElements(int npaths, unsigned char *paths, int *bad, Bool persist)
         EmptyFontPatternCache(patternCache);
     num_fpes = valid_paths;
 
+    LogMessageVerb(X_INFO, 3, "Font path of %d elements set up in %.1f ms\n",
+                   valid_paths, (GetTimeInMicros() - start) / 1000.0);
+
     return Success;
  bail:
     *bad = i;
@@ -105,6 +105,7 @@ Equipment Corporation.
 #include "registry.h"
 #include "client.h"
 #include "exevents.h"
+#include "reqstats.h"
 #ifdef PANORAMIX
 #include "panoramiXsrv.h"
 #else
@@ -244,6 +245,7 @@ dix_main(int argc, char *argv[], char *envp[])
         dixResetRegistry();
         ResetFontPrivateIndex();
         InitCallbackManager();
+        ReqStatsInit();
         InitOutput(&screenInfo, argc, argv);
 
         if (screenInfo.numScreens < 1)
@@ -345,8 +347,12 @@ dix_main(int argc, char *argv[], char *envp[])
         winInitializeModeKeyStates ();
         #endif
 
+        InputThreadInit();
+
         Dispatch();
 
+        InputThreadFini();
+
 #ifdef XQUARTZ
         /* Let the other threads know the server is no longer running */
         pthread_mutex_lock(&serverRunningMutex);
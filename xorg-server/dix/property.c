@@ -535,7 +535,15 @@ ProcGetProperty(ClientPtr client)
             client->pSwapReplyFunc = (ReplySwapPtr) WriteToClient;
             break;
         }
-        WriteSwappedDataToClient(client, len, (char *) pProp->data + ind);
+        if (stuff->delete && reply.bytesAfter == 0 && !client->swapped) {
+            /* The data goes away with the property, so let the output
+               layer have it rather than copying it for a slow client */
+            WriteToClientNoCopy(client, len, (char *) pProp->data + ind,
+                                free, pProp->data);
+            pProp->data = NULL;
+        }
+        else
+            WriteSwappedDataToClient(client, len, (char *) pProp->data + ind);
     }
 
     if (stuff->delete && (reply.bytesAfter == 0)) {
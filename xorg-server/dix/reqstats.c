@@ -0,0 +1,341 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "registry.h"
+#include "client.h"
+#include "reqstats.h"
+
+Bool ReqStatsEnabled = FALSE;
+
+static ReqStatsOpRec coreOps[EXTENSION_BASE];
+static ReqStatsOpPtr extOps[256 - EXTENSION_BASE];
+static ReqStatsClientRec clientStats[MAXCLIENTS];
+
+#ifdef SIGUSR2
+static volatile sig_atomic_t dumpPending;
+#endif
+
+CARD64
+ReqStatsNow(void)
+{
+#if defined(MONOTONIC_CLOCK) && !defined(WIN32)
+    struct timespec tp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0)
+        return (CARD64) tp.tv_sec * 1000000000 + tp.tv_nsec;
+#endif
+    return GetTimeInMicros() * 1000;
+}
+
+/* floor(log2(ns)), with 0 and 1 both in the first bucket */
+static int
+ReqStatsBucket(CARD64 ns)
+{
+    int b = 0;
+
+    if (ns >> 32) {
+        ns >>= 32;
+        b += 32;
+    }
+    if (ns >> 16) {
+        ns >>= 16;
+        b += 16;
+    }
+    if (ns >> 8) {
+        ns >>= 8;
+        b += 8;
+    }
+    if (ns >> 4) {
+        ns >>= 4;
+        b += 4;
+    }
+    if (ns >> 2) {
+        ns >>= 2;
+        b += 2;
+    }
+    if (ns >> 1)
+        b += 1;
+    return min(b, REQSTATS_BUCKETS - 1);
+}
+
+ReqStatsOpPtr
+ReqStatsGetOp(int major, int minor)
+{
+    if (major < EXTENSION_BASE)
+        return &coreOps[major];
+    if (!extOps[major - EXTENSION_BASE])
+        return NULL;
+    return &extOps[major - EXTENSION_BASE][min(minor, REQSTATS_MAX_MINOR - 1)];
+}
+
+ReqStatsClientPtr
+ReqStatsGetClient(int index)
+{
+    return &clientStats[index];
+}
+
+void
+ReqStatsRecord(ClientPtr client, int major, int minor, int bytes,
+               CARD64 start)
+{
+    CARD64 elapsed = ReqStatsNow() - start;
+    ReqStatsClientPtr stats = &clientStats[client->index];
+    ReqStatsOpPtr op;
+
+    if (major >= EXTENSION_BASE && !extOps[major - EXTENSION_BASE])
+        extOps[major - EXTENSION_BASE] = calloc(REQSTATS_MAX_MINOR,
+                                                sizeof(ReqStatsOpRec));
+    op = ReqStatsGetOp(major, minor);
+    if (op) {
+        op->count++;
+        op->time += elapsed;
+        if (elapsed > op->max)
+            op->max = elapsed;
+        op->hist[ReqStatsBucket(elapsed)]++;
+    }
+
+    stats->requests++;
+    stats->time += elapsed;
+    stats->bytesIn += bytes;
+    if (elapsed > stats->max) {
+        stats->max = elapsed;
+        stats->maxMajor = major;
+        stats->maxMinor = minor;
+    }
+}
+
+void
+ReqStatsClientInit(ClientPtr client)
+{
+    memset(&clientStats[client->index], 0, sizeof(ReqStatsClientRec));
+}
+
+void
+ReqStatsReset(void)
+{
+    int i;
+
+    memset(coreOps, 0, sizeof(coreOps));
+    for (i = 0; i < ARRAY_SIZE(extOps); i++)
+        if (extOps[i])
+            memset(extOps[i], 0, REQSTATS_MAX_MINOR * sizeof(ReqStatsOpRec));
+    memset(clientStats, 0, sizeof(clientStats));
+}
+
+void
+ReqStatsSetEnabled(Bool enable)
+{
+    ReqStatsEnabled = enable;
+}
+
+static const char *
+ReqStatsFormatTime(char *buf, size_t size, CARD64 ns)
+{
+    if (ns < 10000)
+        snprintf(buf, size, "%uns", (unsigned) ns);
+    else if (ns < 10000000)
+        snprintf(buf, size, "%uus", (unsigned) (ns / 1000));
+    else if (ns < (CARD64) 10000000000ULL)
+        snprintf(buf, size, "%ums", (unsigned) (ns / 1000000));
+    else
+        snprintf(buf, size, "%us", (unsigned) (ns / 1000000000));
+    return buf;
+}
+
+static const char *
+ReqStatsRequestName(char *buf, size_t size, int major, int minor)
+{
+#ifdef X_REGISTRY_REQUEST
+    return LookupRequestName(major, minor);
+#else
+    if (major < EXTENSION_BASE)
+        snprintf(buf, size, "%d", major);
+    else
+        snprintf(buf, size, "%d.%d", major, minor);
+    return buf;
+#endif
+}
+
+typedef struct {
+    int major, minor;
+    ReqStatsOpPtr op;
+} ReqStatsOpRef;
+
+static int
+ReqStatsCompareOps(const void *a, const void *b)
+{
+    const ReqStatsOpRef *ra = a, *rb = b;
+
+    if (ra->op->time != rb->op->time)
+        return ra->op->time < rb->op->time ? 1 : -1;
+    return 0;
+}
+
+static int
+ReqStatsCompareClients(const void *a, const void *b)
+{
+    const ReqStatsClientRec *ca = &clientStats[*(const int *) a];
+    const ReqStatsClientRec *cb = &clientStats[*(const int *) b];
+
+    if (ca->time != cb->time)
+        return ca->time < cb->time ? 1 : -1;
+    return 0;
+}
+
+#define REQSTATS_DUMP_OPS       32
+#define REQSTATS_DUMP_CLIENTS   16
+
+static void
+ReqStatsDumpOp(ReqStatsOpRef *ref)
+{
+    ReqStatsOpPtr op = ref->op;
+    char hist[REQSTATS_BUCKETS * 24];
+    char name[16], t1[16], t2[16], t3[16];
+    int b, len = 0;
+
+    for (b = 0; b < REQSTATS_BUCKETS; b++)
+        if (op->hist[b] && len < sizeof(hist))
+            len += snprintf(hist + len, sizeof(hist) - len, " %s:%u",
+                            ReqStatsFormatTime(t1, sizeof(t1),
+                                               (CARD64) 1 << b),
+                            (unsigned) op->hist[b]);
+    hist[min(len, sizeof(hist) - 1)] = '\0';
+
+    LogMessageVerb(X_INFO, 0, "  %-32s %10llu %8s %8s %8s |%s\n",
+                   ReqStatsRequestName(name, sizeof(name),
+                                       ref->major, ref->minor),
+                   (unsigned long long) op->count,
+                   ReqStatsFormatTime(t1, sizeof(t1), op->time),
+                   ReqStatsFormatTime(t2, sizeof(t2), op->time / op->count),
+                   ReqStatsFormatTime(t3, sizeof(t3), op->max), hist);
+}
+
+/* Writes the busiest requests and clients to the log */
+void
+ReqStatsDump(void)
+{
+    ReqStatsOpRef *refs;
+    int order[MAXCLIENTS];
+    int nrefs = 0, nclients = 0;
+    int i, j;
+
+    if (!ReqStatsEnabled) {
+        LogMessage(X_INFO, "Request statistics are disabled\n");
+        return;
+    }
+
+    refs = calloc(EXTENSION_BASE + ARRAY_SIZE(extOps) * REQSTATS_MAX_MINOR,
+                  sizeof(ReqStatsOpRef));
+    if (!refs)
+        return;
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < (i < EXTENSION_BASE ? 1 : REQSTATS_MAX_MINOR); j++) {
+            ReqStatsOpPtr op = ReqStatsGetOp(i, j);
+
+            if (!op)
+                break;
+            if (op->count) {
+                refs[nrefs].major = i;
+                refs[nrefs].minor = j;
+                refs[nrefs].op = op;
+                nrefs++;
+            }
+        }
+    }
+    qsort(refs, nrefs, sizeof(ReqStatsOpRef), ReqStatsCompareOps);
+
+    LogMessage(X_INFO, "Request statistics, by total time:\n");
+    LogMessageVerb(X_INFO, 0, "  %-32s %10s %8s %8s %8s | histogram\n",
+                   "request", "count", "total", "mean", "max");
+    for (i = 0; i < nrefs && i < REQSTATS_DUMP_OPS; i++)
+        ReqStatsDumpOp(&refs[i]);
+    free(refs);
+
+    for (i = 0; i < currentMaxClients; i++)
+        if (clients[i] && clientStats[i].requests)
+            order[nclients++] = i;
+    qsort(order, nclients, sizeof(int), ReqStatsCompareClients);
+
+    LogMessage(X_INFO, "Clients, by time spent in their requests:\n");
+    for (i = 0; i < nclients && i < REQSTATS_DUMP_CLIENTS; i++) {
+        ClientPtr client = clients[order[i]];
+        ReqStatsClientPtr stats = &clientStats[order[i]];
+        const char *cmd = GetClientCmdName(client);
+        char name[16], t1[16], t2[16];
+
+        LogMessageVerb(X_INFO, 0,
+                       "  %3d %-20s pid %-6ld %10llu reqs %8s, "
+                       "%llu bytes in (%llu copied), %llu out, slowest %s %s\n",
+                       client->index, cmd ? cmd : "?",
+                       (long) GetClientPid(client),
+                       (unsigned long long) stats->requests,
+                       ReqStatsFormatTime(t1, sizeof(t1), stats->time),
+                       (unsigned long long) stats->bytesIn,
+                       (unsigned long long) stats->bytesMoved,
+                       (unsigned long long) stats->bytesOut,
+                       ReqStatsRequestName(name, sizeof(name),
+                                           stats->maxMajor, stats->maxMinor),
+                       ReqStatsFormatTime(t2, sizeof(t2), stats->max));
+    }
+}
+
+#ifdef SIGUSR2
+static void
+ReqStatsSignal(int sig)
+{
+    int olderrno = errno;
+
+    dumpPending = TRUE;
+    errno = olderrno;
+}
+
+static void
+ReqStatsWakeupHandler(void *data, int result, void *pReadmask)
+{
+    if (dumpPending) {
+        dumpPending = FALSE;
+        ReqStatsDump();
+    }
+}
+#endif
+
+/* Called once per server generation */
+void
+ReqStatsInit(void)
+{
+#ifdef SIGUSR2
+    OsSignal(SIGUSR2, ReqStatsSignal);
+    RegisterBlockAndWakeupHandlers((BlockHandlerProcPtr) NoopDDA,
+                                   ReqStatsWakeupHandler, NULL);
+#endif
+}
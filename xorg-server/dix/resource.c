@@ -149,31 +149,54 @@ Equipment Corporation.
 #define TypeNameString(t) LookupResourceName(t)
 #endif
 
-static void RebuildTable(int    /*client */
-    );
-
 #define SERVER_MINID 32
 
-#define INITBUCKETS 64
 #define INITHASHSIZE 6
-#define MAXHASHSIZE 11
+#define MAXHASHSIZE 30
+#define MIGRATE_STEP 16         /* old slots moved per update while growing */
+
+/*
+ * Each client's resources live in an open addressing table with Robin
+ * Hood probing: entries are kept ordered by home slot, so a lookup stops
+ * as soon as it meets an entry that is closer to its own home than the
+ * key would be, and deletion shifts the following entries back instead
+ * of leaving tombstones.  A type of RT_NONE marks an empty slot.
+ *
+ * Several resources may share an id (with different types).  They always
+ * sit in the same cluster in the order they were added, and FreeResource
+ * frees them newest first as the old hash chains did.
+ *
+ * When a table gets 3/4 full a table twice the size is allocated and
+ * the old one is drained into it MIGRATE_STEP slots at a time on later
+ * updates, so growing never stalls a request for long.  All resources
+ * with one id are moved together, so they are never split between the
+ * two tables.
+ */
 
 typedef struct _Resource {
-    struct _Resource *next;
     XID id;
     RESTYPE type;
     void *value;
 } ResourceRec, *ResourcePtr;
 
+typedef struct _ResourceTable {
+    ResourcePtr slots;
+    int hashsize;               /* log(2)(slots) */
+    int elements;
+} ResourceTableRec, *ResourceTablePtr;
+
 typedef struct _ClientResource {
-    ResourcePtr *resources;
+    ResourceTableRec table;     /* new resources go here */
+    ResourceTableRec old;       /* being drained into table */
+    int migrate;                /* next slot of old to drain */
     int elements;
-    int buckets;
-    int hashsize;               /* log(2)(buckets) */
     XID fakeID;
     XID endFakeID;
 } ClientResourceRec;
 
+/* Return TRUE to stop walking */
+typedef Bool (*ResourceWalkProc) (ResourcePtr res, void *closure);
+
 RESTYPE lastResourceType;
 static RESTYPE lastResourceClass;
 RESTYPE TypeMask;
@@ -600,6 +623,278 @@ CreateNewResourceClass(void)
 
 static ClientResourceRec clientTable[MAXCLIENTS];
 
+#define ClientInUse(cid) (clientTable[cid].table.slots != NULL)
+
+static inline int
+TableSize(ResourceTablePtr t)
+{
+    return t->slots ? 1 << t->hashsize : 0;
+}
+
+/* Fibonacci hashing, so runs of sequential ids spread over the table */
+static inline unsigned
+ResourceSlot(XID id, int hashsize)
+{
+    return ((CARD32) (id & RESOURCE_ID_MASK) * 0x9E3779B1U) >> (32 - hashsize);
+}
+
+/* How far the resource in slot i is from its home slot */
+static inline unsigned
+ResourceDistance(ResourceTablePtr t, unsigned i)
+{
+    return (i - ResourceSlot(t->slots[i].id, t->hashsize)) &
+        ((1U << t->hashsize) - 1);
+}
+
+static Bool
+ResourceMatches(ResourcePtr res, RESTYPE type, RESTYPE rclass)
+{
+    return type ? res->type == type : (res->type & rclass) != 0;
+}
+
+/*
+ * Find a resource with id in t that has the given type, or any type in
+ * rclass if type is RT_NONE.  With first set the oldest match is
+ * returned, otherwise the newest.
+ */
+static ResourcePtr
+TableLookup(ResourceTablePtr t, XID id, RESTYPE type, RESTYPE rclass,
+            Bool first)
+{
+    ResourcePtr found = NULL;
+    unsigned mask, i, d;
+
+    if (!t->elements)
+        return NULL;
+    mask = (1U << t->hashsize) - 1;
+    for (i = ResourceSlot(id, t->hashsize), d = 0;; i = (i + 1) & mask, d++) {
+        ResourcePtr res = &t->slots[i];
+
+        if (res->type == RT_NONE || ResourceDistance(t, i) < d)
+            break;
+        if (res->id == id && ResourceMatches(res, type, rclass)) {
+            found = res;
+            if (first)
+                break;
+        }
+    }
+    return found;
+}
+
+/*
+ * Caller makes sure there is room.  The entry goes in front of the first
+ * one that is closer to its home, and the rest of the cluster moves up a
+ * slot, which keeps the order of everything already in it.
+ */
+static ResourcePtr
+TableInsert(ResourceTablePtr t, XID id, RESTYPE type, void *value)
+{
+    unsigned mask = (1U << t->hashsize) - 1;
+    unsigned i, j, d;
+
+    for (i = ResourceSlot(id, t->hashsize), d = 0;; i = (i + 1) & mask, d++)
+        if (t->slots[i].type == RT_NONE || ResourceDistance(t, i) < d)
+            break;
+    for (j = i; t->slots[j].type != RT_NONE; j = (j + 1) & mask);
+    for (; j != i; j = (j - 1) & mask)
+        t->slots[j] = t->slots[(j - 1) & mask];
+    t->slots[i].id = id;
+    t->slots[i].type = type;
+    t->slots[i].value = value;
+    t->elements++;
+    return &t->slots[i];
+}
+
+static void
+TableRemove(ResourceTablePtr t, unsigned i)
+{
+    unsigned mask = (1U << t->hashsize) - 1;
+    unsigned next;
+
+    for (next = (i + 1) & mask;
+         t->slots[next].type != RT_NONE && ResourceDistance(t, next) != 0;
+         i = next, next = (i + 1) & mask)
+        t->slots[i] = t->slots[next];
+    t->slots[i].id = 0;
+    t->slots[i].type = RT_NONE;
+    t->slots[i].value = NULL;
+    t->elements--;
+}
+
+/* Newest resource with id matching type or rclass, from either table */
+static ResourcePtr
+LookupResource(ClientResourceRec * rrec, XID id, RESTYPE type, RESTYPE rclass)
+{
+    ResourcePtr res = TableLookup(&rrec->table, id, type, rclass, FALSE);
+
+    if (!res && rrec->old.elements)
+        res = TableLookup(&rrec->old, id, type, rclass, FALSE);
+    return res;
+}
+
+/* Move every resource with id from the old table, oldest first */
+static void
+MigrateID(ClientResourceRec * rrec, XID id)
+{
+    ResourcePtr res;
+
+    while ((res = TableLookup(&rrec->old, id, RT_NONE, RC_ANY, TRUE))) {
+        ResourceRec moved = *res;
+
+        TableRemove(&rrec->old, res - rrec->old.slots);
+        TableInsert(&rrec->table, moved.id, moved.type, moved.value);
+    }
+}
+
+static void
+MigrateResources(ClientResourceRec * rrec, int count)
+{
+    ResourceTablePtr old = &rrec->old;
+    int size = TableSize(old);
+
+    if (!size)
+        return;
+    while (count-- > 0 && old->elements) {
+        /* removals never move anything back past the cursor */
+        if (rrec->migrate >= size)
+            rrec->migrate = 0;
+        if (old->slots[rrec->migrate].type == RT_NONE)
+            rrec->migrate++;
+        else
+            MigrateID(rrec, old->slots[rrec->migrate].id);
+    }
+    if (!old->elements) {
+        free(old->slots);
+        old->slots = NULL;
+        old->hashsize = 0;
+    }
+}
+
+/* Make sure the current table can take one more resource */
+static Bool
+ResourceRoom(ClientResourceRec * rrec)
+{
+    ResourceTableRec grown;
+
+    MigrateResources(rrec, MIGRATE_STEP);
+    if ((rrec->table.elements + 1) * 4 <= 3 * TableSize(&rrec->table))
+        return TRUE;
+
+    /* the previous growth is long done by now, but be sure */
+    MigrateResources(rrec, INT_MAX);
+    if (rrec->table.hashsize < MAXHASHSIZE &&
+        (grown.slots = calloc(2 * TableSize(&rrec->table),
+                              sizeof(ResourceRec)))) {
+        grown.hashsize = rrec->table.hashsize + 1;
+        grown.elements = 0;
+        rrec->old = rrec->table;
+        rrec->table = grown;
+        rrec->migrate = 0;
+        MigrateResources(rrec, MIGRATE_STEP);
+        return TRUE;
+    }
+    /* keep an empty slot so probing terminates */
+    return rrec->table.elements + 1 < TableSize(&rrec->table);
+}
+
+/* Take res out of its table, returning a copy for the free callbacks */
+static ResourceRec
+UnlinkResource(ClientResourceRec * rrec, ResourcePtr res)
+{
+    ResourceRec gone = *res;
+    ResourceTablePtr t = &rrec->table;
+
+    if (res < t->slots || res >= t->slots + TableSize(t))
+        t = &rrec->old;
+    TableRemove(t, res - t->slots);
+    rrec->elements--;
+    return gone;
+}
+
+/*
+ * Call proc on the resources of rrec matching type (RT_NONE for all)
+ * until it returns TRUE.  If proc changes the tables the walk goes on
+ * from the same slot, so some resources may be seen twice or missed.
+ */
+static void
+WalkResourcesInPlace(ClientResourceRec * rrec, RESTYPE type,
+                     ResourceWalkProc proc, void *closure)
+{
+    int t, i;
+
+    for (t = 0; t < 2; t++) {
+        ResourceTablePtr tab = t ? &rrec->old : &rrec->table;
+
+        for (i = 0; i < TableSize(tab); i++) {
+            ResourceRec seen = tab->slots[i];
+
+            if (seen.type == RT_NONE || (type && seen.type != type))
+                continue;
+            if ((*proc) (&tab->slots[i], closure))
+                return;
+            /* something else may have been shifted into this slot */
+            if (i < TableSize(tab) && tab->slots[i].type != RT_NONE &&
+                (tab->slots[i].id != seen.id ||
+                 tab->slots[i].type != seen.type ||
+                 tab->slots[i].value != seen.value))
+                i--;
+        }
+    }
+}
+
+/*
+ * Like WalkResourcesInPlace, but over a copy of the matching resources
+ * so proc may add or free resources: each resource present at the start
+ * is visited once unless it was freed in the meantime, resources added
+ * during the walk are not visited.
+ */
+static void
+WalkResources(ClientResourceRec * rrec, RESTYPE type,
+              ResourceWalkProc proc, void *closure)
+{
+    ResourceRec stackSnap[64];
+    ResourcePtr snap = stackSnap;
+    int count, n, t, i;
+
+    if (type) {
+        for (count = 0, t = 0; t < 2; t++) {
+            ResourceTablePtr tab = t ? &rrec->old : &rrec->table;
+
+            for (i = 0; i < TableSize(tab); i++)
+                if (tab->slots[i].type == type)
+                    count++;
+        }
+    }
+    else
+        count = rrec->elements;
+    if (count > ARRAY_SIZE(stackSnap) &&
+        !(snap = malloc(count * sizeof(ResourceRec)))) {
+        WalkResourcesInPlace(rrec, type, proc, closure);
+        return;
+    }
+
+    for (n = 0, t = 0; t < 2; t++) {
+        ResourceTablePtr tab = t ? &rrec->old : &rrec->table;
+
+        for (i = 0; i < TableSize(tab) && n < count; i++)
+            if (tab->slots[i].type != RT_NONE &&
+                (!type || tab->slots[i].type == type))
+                snap[n++] = tab->slots[i];
+    }
+
+    for (i = 0; i < n; i++) {
+        ResourcePtr res = LookupResource(rrec, snap[i].id, snap[i].type, 0);
+
+        /* skip what an earlier call freed */
+        if (!res || res->value != snap[i].value)
+            continue;
+        if ((*proc) (res, closure))
+            break;
+    }
+    if (snap != stackSnap)
+        free(snap);
+}
+
 /*****************
  * InitClientResources
  *    When a new client is created, call this to allocate space
@@ -609,7 +904,7 @@ static ClientResourceRec clientTable[MAXCLIENTS];
 Bool
 InitClientResources(ClientPtr client)
 {
-    int i, j;
+    ClientResourceRec *rrec;
 
     if (client == serverClient) {
         lastResourceType = RT_LASTPREDEF;
@@ -621,24 +916,20 @@ InitClientResources(ClientPtr client)
             return FALSE;
         memcpy(resourceTypes, predefTypes, sizeof(predefTypes));
     }
-    clientTable[i = client->index].resources =
-        malloc(INITBUCKETS * sizeof(ResourcePtr));
-    if (!clientTable[i].resources)
+    rrec = &clientTable[client->index];
+    memset(rrec, 0, sizeof(*rrec));
+    rrec->table.slots = calloc(1 << INITHASHSIZE, sizeof(ResourceRec));
+    if (!rrec->table.slots)
         return FALSE;
-    clientTable[i].buckets = INITBUCKETS;
-    clientTable[i].elements = 0;
-    clientTable[i].hashsize = INITHASHSIZE;
+    rrec->table.hashsize = INITHASHSIZE;
     /* Many IDs allocated from the server client are visible to clients,
      * so we don't use the SERVER_BIT for them, but we have to start
      * past the magic value constants used in the protocol.  For normal
      * clients, we can start from zero, with SERVER_BIT set.
      */
-    clientTable[i].fakeID = client->clientAsMask |
+    rrec->fakeID = client->clientAsMask |
         (client->index ? SERVER_BIT : SERVER_MINID);
-    clientTable[i].endFakeID = (clientTable[i].fakeID | RESOURCE_ID_MASK) + 1;
-    for (j = 0; j < INITBUCKETS; j++) {
-        clientTable[i].resources[j] = NULL;
-    }
+    rrec->endFakeID = (rrec->fakeID | RESOURCE_ID_MASK) + 1;
     return TRUE;
 }
 
@@ -673,15 +964,10 @@ HashResourceID(XID id, int numBits)
 static XID
 AvailableID(int client, XID id, XID maxid, XID goodid)
 {
-    ResourcePtr res;
-
     if ((goodid >= id) && (goodid <= maxid))
         return goodid;
     for (; id <= maxid; id++) {
-        res = clientTable[client].resources[HashResourceID(id, clientTable[client].hashsize)];
-        while (res && (res->id != id))
-            res = res->next;
-        if (!res)
+        if (!LookupResource(&clientTable[client], id, RT_NONE, RC_ANY))
             return id;
     }
     return 0;
@@ -690,10 +976,10 @@ AvailableID(int client, XID id, XID maxid, XID goodid)
 void
 GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
 {
+    ClientResourceRec *rrec = &clientTable[client];
     XID id, maxid;
-    ResourcePtr *resp;
     ResourcePtr res;
-    int i;
+    int t, i;
     XID goodid;
 
     id = (Mask) client << CLIENTOFFSET;
@@ -701,9 +987,13 @@ GetXIDRange(int client, Bool server, XID *minp, XID *maxp)
         id |= client ? SERVER_BIT : SERVER_MINID;
     maxid = id | RESOURCE_ID_MASK;
     goodid = 0;
-    for (resp = clientTable[client].resources, i = clientTable[client].buckets;
-         --i >= 0;) {
-        for (res = *resp++; res; res = res->next) {
+    for (t = 0; t < 2; t++) {
+        ResourceTablePtr tab = t ? &rrec->old : &rrec->table;
+
+        for (i = 0; i < TableSize(tab); i++) {
+            res = &tab->slots[i];
+            if (res->type == RT_NONE)
+                continue;
             if ((res->id < id) || (res->id > maxid))
                 continue;
             if (((res->id - id) >= (maxid - res->id)) ?
@@ -790,79 +1080,31 @@ AddResource(XID id, RESTYPE type, void *value)
 {
     int client;
     ClientResourceRec *rrec;
-    ResourcePtr res, *head;
+    ResourcePtr res;
 
 #ifdef XSERVER_DTRACE
     XSERVER_RESOURCE_ALLOC(id, type, value, TypeNameString(type));
 #endif
     client = CLIENT_ID(id);
     rrec = &clientTable[client];
-    if (!rrec->buckets) {
+    if (!ClientInUse(client)) {
         ErrorF("[dix] AddResource(%lx, %x, %lx), client=%d \n",
                (unsigned long) id, type, (unsigned long) value, client);
         FatalError("client not in use\n");
     }
-    if ((rrec->elements >= 4 * rrec->buckets) && (rrec->hashsize < MAXHASHSIZE))
-        RebuildTable(client);
-    head = &rrec->resources[HashResourceID(id, clientTable[client].hashsize)];
-    res = malloc(sizeof(ResourceRec));
-    if (!res) {
+    if (!ResourceRoom(rrec)) {
         (*resourceTypes[type & TypeMask].deleteFunc) (value, id);
         return FALSE;
     }
-    res->next = *head;
-    res->id = id;
-    res->type = type;
-    res->value = value;
-    *head = res;
+    /* resources sharing an id stay together, in order */
+    if (rrec->old.elements)
+        MigrateID(rrec, id);
+    res = TableInsert(&rrec->table, id, type, value);
     rrec->elements++;
     CallResourceStateCallback(ResourceStateAdding, res);
     return TRUE;
 }
 
-static void
-RebuildTable(int client)
-{
-    int j;
-    ResourcePtr res, next;
-    ResourcePtr **tails, *resources;
-    ResourcePtr **tptr, *rptr;
-
-    /*
-     * For now, preserve insertion order, since some ddx layers depend
-     * on resources being free in the opposite order they are added.
-     */
-
-    j = 2 * clientTable[client].buckets;
-    tails = malloc(j * sizeof(ResourcePtr *));
-    if (!tails)
-        return;
-    resources = malloc(j * sizeof(ResourcePtr));
-    if (!resources) {
-        free(tails);
-        return;
-    }
-    for (rptr = resources, tptr = tails; --j >= 0; rptr++, tptr++) {
-        *rptr = NULL;
-        *tptr = rptr;
-    }
-    clientTable[client].hashsize++;
-    for (j = clientTable[client].buckets,
-         rptr = clientTable[client].resources; --j >= 0; rptr++) {
-        for (res = *rptr; res; res = next) {
-            next = res->next;
-            res->next = NULL;
-            tptr = &tails[HashResourceID(res->id, clientTable[client].hashsize)];
-            **tptr = res;
-            *tptr = &res->next;
-        }
-    }
-    free(tails);
-    clientTable[client].buckets *= 2;
-    free(clientTable[client].resources);
-    clientTable[client].resources = resources;
-}
-
 static void
 doFreeResource(ResourcePtr res, Bool skip)
 {
@@ -870,42 +1112,29 @@ doFreeResource(ResourcePtr res, Bool skip)
 
     if (!skip)
         resourceTypes[res->type & TypeMask].deleteFunc(res->value, res->id);
-
-    free(res);
 }
 
 void
 FreeResource(XID id, RESTYPE skipDeleteFuncType)
 {
     int cid;
+    ClientResourceRec *rrec;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
-    int *eltptr;
-    int elements;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-        eltptr = &clientTable[cid].elements;
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && ClientInUse(cid)) {
+        rrec = &clientTable[cid];
+        MigrateResources(rrec, MIGRATE_STEP);
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id) {
-                RESTYPE rtype = res->type;
+        /* Newest first.  Look it up again every time around, the delete
+           functions may add or free resources. */
+        while ((res = LookupResource(rrec, id, RT_NONE, RC_ANY))) {
+            ResourceRec gone = UnlinkResource(rrec, res);
 
 #ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
+            XSERVER_RESOURCE_FREE(gone.id, gone.type,
+                                  gone.value, TypeNameString(gone.type));
 #endif
-                *prev = res->next;
-                elements = --*eltptr;
-
-                doFreeResource(res, rtype == skipDeleteFuncType);
-
-                if (*eltptr != elements)
-                    prev = head;        /* prev may no longer be valid */
-            }
-            else
-                prev = &res->next;
+            doFreeResource(&gone, gone.type == skipDeleteFuncType);
         }
     }
 }
@@ -915,27 +1144,17 @@ FreeResourceByType(XID id, RESTYPE type, Bool skipFree)
 {
     int cid;
     ResourcePtr res;
-    ResourcePtr *prev, *head;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets) {
-        head = &clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && ClientInUse(cid)) {
+        res = LookupResource(&clientTable[cid], id, type, 0);
+        if (res) {
+            ResourceRec gone = UnlinkResource(&clientTable[cid], res);
 
-        prev = head;
-        while ((res = *prev)) {
-            if (res->id == id && res->type == type) {
 #ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(res->id, res->type,
-                                      res->value, TypeNameString(res->type));
+            XSERVER_RESOURCE_FREE(gone.id, gone.type,
+                                  gone.value, TypeNameString(gone.type));
 #endif
-                *prev = res->next;
-                clientTable[cid].elements--;
-
-                doFreeResource(res, skipFree);
-
-                break;
-            }
-            else
-                prev = &res->next;
+            doFreeResource(&gone, skipFree);
         }
     }
 }
@@ -952,18 +1171,30 @@ ChangeResourceValue(XID id, RESTYPE rtype, void *value)
     int cid;
     ResourcePtr res;
 
-    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if ((res->id == id) && (res->type == rtype)) {
-                res->value = value;
-                return TRUE;
-            }
+    if (((cid = CLIENT_ID(id)) < MAXCLIENTS) && ClientInUse(cid)) {
+        res = LookupResource(&clientTable[cid], id, rtype, 0);
+        if (res) {
+            res->value = value;
+            return TRUE;
+        }
     }
     return FALSE;
 }
 
+typedef struct {
+    FindResType func;
+    void *cdata;
+} FindByTypeRec;
+
+static Bool
+FindByTypeWalk(ResourcePtr res, void *closure)
+{
+    FindByTypeRec *find = closure;
+
+    (*find->func) (res->value, res->id, find->cdata);
+    return FALSE;
+}
+
 /* Note: if func adds or deletes resources, then func can get called
  * more than once for some resources.  If func adds new resources,
  * func might or might not get called for them.  func cannot both
@@ -974,27 +1205,12 @@ void
 FindClientResourcesByType(ClientPtr client,
                           RESTYPE type, FindResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    FindByTypeRec find = { func, cdata };
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            if (!type || this->type == type) {
-                elements = *eltptr;
-                (*func) (this->value, this->id, cdata);
-                if (*eltptr != elements)
-                    next = resources[i];        /* start over */
-            }
-        }
-    }
+    WalkResources(&clientTable[client->index], type, FindByTypeWalk, &find);
 }
 
 void FindSubResources(void *resource,
@@ -1006,28 +1222,49 @@ void FindSubResources(void *resource,
     rtype.findSubResFunc(resource, func, cdata);
 }
 
+typedef struct {
+    FindAllRes func;
+    void *cdata;
+} FindAllRec;
+
+static Bool
+FindAllWalk(ResourcePtr res, void *closure)
+{
+    FindAllRec *find = closure;
+
+    (*find->func) (res->value, res->id, res->type, find->cdata);
+    return FALSE;
+}
+
 void
 FindAllClientResources(ClientPtr client, FindAllRes func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    int i, elements;
-    int *eltptr;
+    FindAllRec find = { func, cdata };
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            elements = *eltptr;
-            (*func) (this->value, this->id, this->type, cdata);
-            if (*eltptr != elements)
-                next = resources[i];    /* start over */
-        }
+    WalkResources(&clientTable[client->index], RT_NONE, FindAllWalk, &find);
+}
+
+typedef struct {
+    FindComplexResType func;
+    void *cdata;
+    void *found;
+} FindComplexRec;
+
+static Bool
+FindComplexWalk(ResourcePtr res, void *closure)
+{
+    FindComplexRec *find = closure;
+    /* workaround func freeing the type as DRI1 does */
+    void *value = res->value;
+
+    if ((*find->func) (value, res->id, find->cdata)) {
+        find->found = value;
+        return TRUE;
     }
+    return FALSE;
 }
 
 void *
@@ -1035,74 +1272,71 @@ LookupClientResourceComplex(ClientPtr client,
                             RESTYPE type,
                             FindComplexResType func, void *cdata)
 {
-    ResourcePtr *resources;
-    ResourcePtr this, next;
-    void *value;
-    int i;
+    FindComplexRec find = { func, cdata, NULL };
 
     if (!client)
         client = serverClient;
 
-    resources = clientTable[client->index].resources;
-    for (i = 0; i < clientTable[client->index].buckets; i++) {
-        for (this = resources[i]; this; this = next) {
-            next = this->next;
-            if (!type || this->type == type) {
-                /* workaround func freeing the type as DRI1 does */
-                value = this->value;
-                if ((*func) (value, this->id, cdata))
-                    return value;
-            }
-        }
+    /* this one is on lookup paths, don't copy the table */
+    WalkResourcesInPlace(&clientTable[client->index], type,
+                         FindComplexWalk, &find);
+    return find.found;
+}
+
+static Bool
+FreeNeverRetainWalk(ResourcePtr res, void *closure)
+{
+    ClientResourceRec *rrec = closure;
+
+    if (res->type & RC_NEVERRETAIN) {
+        ResourceRec gone = UnlinkResource(rrec, res);
+
+#ifdef XSERVER_DTRACE
+        XSERVER_RESOURCE_FREE(gone.id, gone.type,
+                              gone.value, TypeNameString(gone.type));
+#endif
+        doFreeResource(&gone, FALSE);
     }
-    return NULL;
+    return FALSE;
 }
 
 void
 FreeClientNeverRetainResources(ClientPtr client)
 {
-    ResourcePtr *resources;
-    ResourcePtr this;
-    ResourcePtr *prev;
-    int j, elements;
-    int *eltptr;
+    ClientResourceRec *rrec;
 
     if (!client)
         return;
 
-    resources = clientTable[client->index].resources;
-    eltptr = &clientTable[client->index].elements;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        prev = &resources[j];
-        while ((this = *prev)) {
-            RESTYPE rtype = this->type;
-
-            if (rtype & RC_NEVERRETAIN) {
-#ifdef XSERVER_DTRACE
-                XSERVER_RESOURCE_FREE(this->id, this->type,
-                                      this->value, TypeNameString(this->type));
-#endif
-                *prev = this->next;
-                clientTable[client->index].elements--;
-                elements = *eltptr;
+    rrec = &clientTable[client->index];
+    WalkResources(rrec, RT_NONE, FreeNeverRetainWalk, rrec);
+}
 
-                doFreeResource(this, FALSE);
+/* Some resource of rrec, looking from where the last one was found */
+static ResourcePtr
+AnyResource(ClientResourceRec * rrec, int *hint)
+{
+    int size = TableSize(&rrec->table);
+    int i;
 
-                if (*eltptr != elements)
-                    prev = &resources[j];       /* prev may no longer be valid */
-            }
-            else
-                prev = &this->next;
-        }
-    }
+    for (i = *hint; i < size; i++)
+        if (rrec->table.slots[i].type != RT_NONE)
+            return &rrec->table.slots[*hint = i];
+    for (i = 0; i < TableSize(&rrec->old); i++)
+        if (rrec->old.slots[i].type != RT_NONE)
+            return &rrec->old.slots[i];
+    for (i = 0; i < size && i < *hint; i++)
+        if (rrec->table.slots[i].type != RT_NONE)
+            return &rrec->table.slots[*hint = i];
+    return NULL;
 }
 
 void
 FreeClientResources(ClientPtr client)
 {
-    ResourcePtr *resources;
-    ResourcePtr this;
-    int j;
+    ClientResourceRec *rrec;
+    ResourcePtr res;
+    int hint = 0;
 
     /* This routine shouldn't be called with a null client, but just in
        case ... */
@@ -1112,35 +1346,28 @@ FreeClientResources(ClientPtr client)
 
     HandleSaveSet(client);
 
-    resources = clientTable[client->index].resources;
-    for (j = 0; j < clientTable[client->index].buckets; j++) {
-        /* It may seem silly to update the head of this resource list as
-           we delete the members, since the entire list will be deleted any way,
-           but there are some resource deletion functions "FreeClientPixels" for
-           one which do a LookupID on another resource id (a Colormap id in this
-           case), so the resource list must be kept valid up to the point that
-           it is deleted, so every time we delete a resource, we must update the
-           head, just like in FreeResource. I hope that this doesn't slow down
-           mass deletion appreciably. PRH */
-
-        ResourcePtr *head;
+    rrec = &clientTable[client->index];
 
-        head = &resources[j];
+    /* The tables must stay valid until the very end, since some
+       deletion functions ("FreeClientPixels" for one) look up other
+       resources of the client.  Resources sharing an id go newest
+       first, just like in FreeResource. */
+    while (rrec->elements > 0 && (res = AnyResource(rrec, &hint))) {
+        ResourceRec gone;
 
-        for (this = *head; this; this = *head) {
+        res = LookupResource(rrec, res->id, RT_NONE, RC_ANY);
+        gone = UnlinkResource(rrec, res);
 #ifdef XSERVER_DTRACE
-            XSERVER_RESOURCE_FREE(this->id, this->type,
-                                  this->value, TypeNameString(this->type));
+        XSERVER_RESOURCE_FREE(gone.id, gone.type,
+                              gone.value, TypeNameString(gone.type));
 #endif
-            *head = this->next;
-            clientTable[client->index].elements--;
-
-            doFreeResource(this, FALSE);
-        }
+        doFreeResource(&gone, FALSE);
     }
-    free(clientTable[client->index].resources);
-    clientTable[client->index].resources = NULL;
-    clientTable[client->index].buckets = 0;
+    free(rrec->table.slots);
+    free(rrec->old.slots);
+    memset(&rrec->table, 0, sizeof(rrec->table));
+    memset(&rrec->old, 0, sizeof(rrec->old));
+    rrec->elements = 0;
 }
 
 void
@@ -1149,7 +1376,7 @@ FreeAllResources(void)
     int i;
 
     for (i = currentMaxClients; --i >= 0;) {
-        if (clientTable[i].buckets)
+        if (ClientInUse(i))
             FreeClientResources(clients[i]);
     }
 }
@@ -1190,13 +1417,8 @@ dixLookupResourceByType(void **result, XID id, RESTYPE rtype,
     if ((rtype & TypeMask) > lastResourceType)
         return BadImplementation;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && res->type == rtype)
-                break;
-    }
+    if ((cid < MAXCLIENTS) && ClientInUse(cid))
+        res = LookupResource(&clientTable[cid], id, rtype, 0);
     if (!res)
         return resourceTypes[rtype & TypeMask].errorValue;
 
@@ -1223,13 +1445,8 @@ dixLookupResourceByClass(void **result, XID id, RESTYPE rclass,
 
     *result = NULL;
 
-    if ((cid < MAXCLIENTS) && clientTable[cid].buckets) {
-        res = clientTable[cid].resources[HashResourceID(id, clientTable[cid].hashsize)];
-
-        for (; res; res = res->next)
-            if (res->id == id && (res->type & rclass))
-                break;
-    }
+    if ((cid < MAXCLIENTS) && ClientInUse(cid))
+        res = LookupResource(&clientTable[cid], id, RT_NONE, rclass);
     if (!res)
         return BadValue;
 
@@ -441,6 +441,7 @@ typedef struct {
 #endif
     DevPrivateKeyRec    gcPrivateKeyRec;
     DevPrivateKeyRec    winPrivateKeyRec;
+    struct _FbGlyphAtlas *glyphAtlas;   /* fbpict.c, created on first use */
 } FbScreenPrivRec, *FbScreenPrivPtr;
 
 #define fbGetScreenPrivate(pScreen) ((FbScreenPrivPtr) \
@@ -1119,6 +1120,9 @@ extern _X_EXPORT Bool
 extern _X_EXPORT void
 fbDestroyGlyphCache(void);
 
+extern _X_EXPORT void
+fbDestroyGlyphAtlas(ScreenPtr pScreen);
+
 /*
  * fbpixmap.c
  */
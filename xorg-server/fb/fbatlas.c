@@ -0,0 +1,603 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software without
+ * specific, written prior permission.  The copyright holders make no
+ * representations about the suitability of this software for any purpose.
+ * It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <string.h>
+
+#include "fb.h"
+#include "picturestr.h"
+#include "fbpict.h"
+
+/*
+ * Glyph atlas
+ *
+ * Glyph images are packed into a few large pages, alpha-only glyphs of
+ * any depth into a8 pages, converted once when they are loaded, and
+ * a8r8g8b8 glyphs into pages of their own.  Glyphs are found by the
+ * SHA1 of their contents, like in the global glyph hash, so a glyph that
+ * is freed and uploaded again, possibly by another client, is still
+ * there.
+ *
+ * Pages are filled in shelves and single glyphs are never removed; when
+ * a kind runs out of room, the least recently used page that the
+ * current run doesn't need is emptied.
+ *
+ * A run is copied straight into its mask, without going through pixman
+ * for every glyph, and composited with a single call.  Runs without a
+ * mask format are left to pixman_composite_glyphs_no_mask(), which is
+ * already as fast as compositing from the atlas one glyph at a time.
+ */
+
+#define ATLAS_A8		0
+#define ATLAS_ARGB		1
+#define ATLAS_KINDS		2
+
+#define ATLAS_MAX_PAGES		4
+#define ATLAS_MIN_BUCKETS	256
+
+static const struct {
+    pixman_format_code_t format;
+    int width, height;
+} atlasKinds[ATLAS_KINDS] = {
+    { PIXMAN_a8, 1024, 512 },
+    { PIXMAN_a8r8g8b8, 512, 512 },
+};
+
+typedef struct {
+    int y, height;
+    int x;                      /* first free column */
+} FbAtlasShelfRec, *FbAtlasShelfPtr;
+
+typedef struct {
+    pixman_image_t *image;
+    CARD8 *bits;
+    int stride;
+    int kind;
+    CARD32 serial;              /* last run that used the page */
+    FbAtlasGlyphPtr glyphs;     /* every glyph in the page */
+    FbAtlasShelfPtr shelves;
+    int nShelves, sizeShelves;
+    int top;                    /* first row below the shelves */
+} FbAtlasPageRec, *FbAtlasPagePtr;
+
+struct _FbAtlasGlyph {
+    FbAtlasGlyphPtr next;       /* hash chain */
+    FbAtlasGlyphPtr pageNext;
+    FbAtlasPagePtr page;
+    unsigned char sha1[20];
+    CARD32 format;
+    int x, y;                   /* position in the page */
+    int width, height;
+    int xorigin, yorigin;
+};
+
+struct _FbGlyphAtlas {
+    FbAtlasGlyphPtr *buckets;
+    CARD32 nBuckets;            /* a power of two */
+    CARD32 nGlyphs;
+    CARD32 serial;
+    FbAtlasPagePtr pages[ATLAS_KINDS][ATLAS_MAX_PAGES];
+    int nPages[ATLAS_KINDS];
+};
+
+static CARD32
+fbAtlasHash(FbGlyphAtlasPtr atlas, const unsigned char *sha1, CARD32 format)
+{
+    CARD32 h;
+
+    /* The digest is as well mixed as anything we could compute */
+    memcpy(&h, sha1, sizeof(h));
+    return (h ^ format ^ (format >> 16)) & (atlas->nBuckets - 1);
+}
+
+static int
+fbAtlasKind(CARD32 format)
+{
+    switch (format) {
+    case PICT_a1:
+    case PICT_a4:
+    case PICT_a8:
+        return ATLAS_A8;
+    case PICT_a8r8g8b8:
+        return ATLAS_ARGB;
+    default:
+        return -1;
+    }
+}
+
+static Bool
+fbAtlasRehash(FbGlyphAtlasPtr atlas, CARD32 nBuckets)
+{
+    FbAtlasGlyphPtr *old = atlas->buckets;
+    CARD32 nOld = atlas->nBuckets;
+    CARD32 i;
+
+    atlas->buckets = calloc(nBuckets, sizeof(FbAtlasGlyphPtr));
+    if (!atlas->buckets) {
+        atlas->buckets = old;
+        return FALSE;
+    }
+    atlas->nBuckets = nBuckets;
+
+    for (i = 0; i < nOld; i++) {
+        FbAtlasGlyphPtr glyph, next;
+
+        for (glyph = old[i]; glyph; glyph = next) {
+            CARD32 h = fbAtlasHash(atlas, glyph->sha1, glyph->format);
+
+            next = glyph->next;
+            glyph->next = atlas->buckets[h];
+            atlas->buckets[h] = glyph;
+        }
+    }
+    free(old);
+    return TRUE;
+}
+
+FbGlyphAtlasPtr
+fbGlyphAtlasCreate(void)
+{
+    FbGlyphAtlasPtr atlas = calloc(1, sizeof(*atlas));
+
+    if (!atlas)
+        return NULL;
+    if (!fbAtlasRehash(atlas, ATLAS_MIN_BUCKETS)) {
+        free(atlas);
+        return NULL;
+    }
+    return atlas;
+}
+
+static void
+fbAtlasPageEmpty(FbGlyphAtlasPtr atlas, FbAtlasPagePtr page)
+{
+    FbAtlasGlyphPtr glyph, next;
+
+    for (glyph = page->glyphs; glyph; glyph = next) {
+        FbAtlasGlyphPtr *prev;
+
+        prev = &atlas->buckets[fbAtlasHash(atlas, glyph->sha1, glyph->format)];
+        while (*prev != glyph)
+            prev = &(*prev)->next;
+        *prev = glyph->next;
+
+        next = glyph->pageNext;
+        free(glyph);
+        atlas->nGlyphs--;
+    }
+    page->glyphs = NULL;
+    page->nShelves = 0;
+    page->top = 0;
+}
+
+void
+fbGlyphAtlasDestroy(FbGlyphAtlasPtr atlas)
+{
+    int kind, i;
+
+    for (kind = 0; kind < ATLAS_KINDS; kind++) {
+        for (i = 0; i < atlas->nPages[kind]; i++) {
+            FbAtlasPagePtr page = atlas->pages[kind][i];
+
+            fbAtlasPageEmpty(atlas, page);
+            pixman_image_unref(page->image);
+            free(page->bits);
+            free(page->shelves);
+            free(page);
+        }
+    }
+    free(atlas->buckets);
+    free(atlas);
+}
+
+void
+fbGlyphAtlasBeginRun(FbGlyphAtlasPtr atlas)
+{
+    atlas->serial++;
+}
+
+FbAtlasGlyphPtr
+fbGlyphAtlasLookup(FbGlyphAtlasPtr atlas,
+                   const unsigned char *sha1, CARD32 format)
+{
+    FbAtlasGlyphPtr glyph;
+
+    for (glyph = atlas->buckets[fbAtlasHash(atlas, sha1, format)];
+         glyph; glyph = glyph->next) {
+        if (glyph->format == format && !memcmp(glyph->sha1, sha1, 20)) {
+            glyph->page->serial = atlas->serial;
+            return glyph;
+        }
+    }
+    return NULL;
+}
+
+static FbAtlasPagePtr
+fbAtlasPageCreate(int kind)
+{
+    FbAtlasPagePtr page = calloc(1, sizeof(*page));
+    int bpp = PIXMAN_FORMAT_BPP(atlasKinds[kind].format) / 8;
+
+    if (!page)
+        return NULL;
+
+    /*
+     * With a power of two stride, the rows of a glyph would all land in
+     * the same few cache sets; one more cache line per row spreads them.
+     */
+    page->stride = atlasKinds[kind].width * bpp + 64;
+    page->bits = malloc(page->stride * atlasKinds[kind].height);
+    if (!page->bits) {
+        free(page);
+        return NULL;
+    }
+    page->image = pixman_image_create_bits(atlasKinds[kind].format,
+                                           atlasKinds[kind].width,
+                                           atlasKinds[kind].height,
+                                           (uint32_t *) page->bits,
+                                           page->stride);
+    if (!page->image) {
+        free(page->bits);
+        free(page);
+        return NULL;
+    }
+    page->kind = kind;
+    return page;
+}
+
+/*
+ * Finds room for a glyph on the best fitting shelf, opening a new shelf
+ * when the glyph would waste too much of the existing ones.
+ */
+static Bool
+fbAtlasPagePack(FbAtlasPagePtr page, int width, int height, int *x, int *y)
+{
+    int pageWidth = atlasKinds[page->kind].width;
+    int pageHeight = atlasKinds[page->kind].height;
+    FbAtlasShelfPtr shelf = NULL;
+    int i;
+
+    for (i = 0; i < page->nShelves; i++) {
+        FbAtlasShelfPtr s = &page->shelves[i];
+
+        if (s->height >= height && s->x + width <= pageWidth &&
+            (!shelf || s->height < shelf->height))
+            shelf = s;
+    }
+
+    if ((!shelf || shelf->height - height > max(4, height / 2)) &&
+        page->top + height <= pageHeight) {
+        if (page->nShelves == page->sizeShelves) {
+            int size = page->sizeShelves ? page->sizeShelves * 2 : 16;
+            FbAtlasShelfPtr shelves;
+
+            shelves = realloc(page->shelves, size * sizeof(FbAtlasShelfRec));
+            if (!shelves)
+                return FALSE;
+            page->shelves = shelves;
+            page->sizeShelves = size;
+        }
+        shelf = &page->shelves[page->nShelves++];
+        shelf->y = page->top;
+        shelf->height = min((height + 3) & ~3, pageHeight - page->top);
+        shelf->x = 0;
+        page->top += shelf->height;
+    }
+
+    if (!shelf)
+        return FALSE;
+
+    *x = shelf->x;
+    *y = shelf->y;
+    shelf->x += width;
+    return TRUE;
+}
+
+static FbAtlasPagePtr
+fbAtlasAllocate(FbGlyphAtlasPtr atlas, int kind, int width, int height,
+                int *x, int *y)
+{
+    FbAtlasPagePtr page, victim = NULL;
+    int i;
+
+    for (i = 0; i < atlas->nPages[kind]; i++) {
+        page = atlas->pages[kind][i];
+        if (fbAtlasPagePack(page, width, height, x, y))
+            return page;
+    }
+
+    if (atlas->nPages[kind] < ATLAS_MAX_PAGES) {
+        page = fbAtlasPageCreate(kind);
+        if (!page)
+            return NULL;
+        atlas->pages[kind][atlas->nPages[kind]++] = page;
+    }
+    else {
+        /* Glyphs already looked up for this run must stay where they are */
+        for (i = 0; i < ATLAS_MAX_PAGES; i++) {
+            page = atlas->pages[kind][i];
+            if (page->serial != atlas->serial &&
+                (!victim ||
+                 atlas->serial - page->serial > atlas->serial - victim->serial))
+                victim = page;
+        }
+        if (!victim)
+            return NULL;
+        page = victim;
+        fbAtlasPageEmpty(atlas, page);
+    }
+
+    if (!fbAtlasPagePack(page, width, height, x, y))
+        return NULL;
+    return page;
+}
+
+FbAtlasGlyphPtr
+fbGlyphAtlasInsert(FbGlyphAtlasPtr atlas,
+                   const unsigned char *sha1, CARD32 format,
+                   pixman_image_t *image, int xorigin, int yorigin)
+{
+    int kind = fbAtlasKind(format);
+    int width = pixman_image_get_width(image);
+    int height = pixman_image_get_height(image);
+    FbAtlasGlyphPtr glyph;
+    FbAtlasPagePtr page;
+    CARD32 h;
+    int x, y;
+
+    if (kind < 0 || width <= 0 || height <= 0 ||
+        width > atlasKinds[kind].width || height > atlasKinds[kind].height)
+        return NULL;
+
+    if (atlas->nGlyphs >= atlas->nBuckets &&
+        !fbAtlasRehash(atlas, atlas->nBuckets * 2))
+        return NULL;
+
+    glyph = malloc(sizeof(*glyph));
+    if (!glyph)
+        return NULL;
+
+    page = fbAtlasAllocate(atlas, kind, width, height, &x, &y);
+    if (!page) {
+        free(glyph);
+        return NULL;
+    }
+
+    pixman_image_composite32(PIXMAN_OP_SRC, image, NULL, page->image,
+                             0, 0, 0, 0, x, y, width, height);
+
+    memcpy(glyph->sha1, sha1, sizeof(glyph->sha1));
+    glyph->format = format;
+    glyph->page = page;
+    glyph->x = x;
+    glyph->y = y;
+    glyph->width = width;
+    glyph->height = height;
+    glyph->xorigin = xorigin;
+    glyph->yorigin = yorigin;
+
+    h = fbAtlasHash(atlas, sha1, format);
+    glyph->next = atlas->buckets[h];
+    atlas->buckets[h] = glyph;
+    glyph->pageNext = page->glyphs;
+    page->glyphs = glyph;
+    atlas->nGlyphs++;
+
+    page->serial = atlas->serial;
+    return glyph;
+}
+
+/*
+ * Computes the bounds of a run in pen coordinates.  Returns whether any
+ * two glyphs might overlap; glyphs that are each entirely below or to
+ * the right of the ones before them, as in lines of text, don't.
+ */
+static Bool
+fbAtlasExtents(int n, FbAtlasGlyphPosPtr glyphs, pixman_box32_t *extents)
+{
+    Bool overlap = FALSE;
+    int bandBottom = MININT, bandRight = MININT;
+    int i;
+
+    extents->x1 = extents->y1 = MAXINT;
+    extents->x2 = extents->y2 = MININT;
+
+    for (i = 0; i < n; i++) {
+        FbAtlasGlyphPtr g = glyphs[i].glyph;
+        int x1 = glyphs[i].x - g->xorigin;
+        int y1 = glyphs[i].y - g->yorigin;
+        int x2 = x1 + g->width;
+        int y2 = y1 + g->height;
+
+        /* bandBottom is the bottom of everything before the current line */
+        if (y1 >= extents->y2) {
+            bandBottom = extents->y2;
+            bandRight = x2;
+        }
+        else if (y1 >= bandBottom && x1 >= bandRight)
+            bandRight = x2;
+        else
+            overlap = TRUE;
+
+        extents->x1 = min(extents->x1, x1);
+        extents->y1 = min(extents->y1, y1);
+        extents->x2 = max(extents->x2, x2);
+        extents->y2 = max(extents->y2, y2);
+    }
+    return overlap;
+}
+
+static inline CARD32
+fbAtlasAdd8888(CARD32 a, CARD32 b)
+{
+    CARD32 rb = (a & 0x00ff00ff) + (b & 0x00ff00ff);
+    CARD32 ag = ((a >> 8) & 0x00ff00ff) + ((b >> 8) & 0x00ff00ff);
+
+    rb |= 0x10000100 - ((rb >> 8) & 0x00ff00ff);
+    ag |= 0x10000100 - ((ag >> 8) & 0x00ff00ff);
+    return (rb & 0x00ff00ff) | ((ag & 0x00ff00ff) << 8);
+}
+
+/* Glyph rows are short enough that calling memcpy() costs more than the copy */
+static inline void
+fbAtlasCopyRow(CARD8 *dst, const CARD8 *src, int n)
+{
+    if (n > 64) {
+        memcpy(dst, src, n);
+        return;
+    }
+    for (; n >= 16; n -= 16, dst += 16, src += 16)
+        memcpy(dst, src, 16);
+    if (n >= 8) {
+        memcpy(dst, src, 8);
+        n -= 8, dst += 8, src += 8;
+    }
+    if (n >= 4) {
+        memcpy(dst, src, 4);
+        n -= 4, dst += 4, src += 4;
+    }
+    while (n--)
+        *dst++ = *src++;
+}
+
+/*
+ * Adds a glyph into the mask the way pixman_composite_glyphs() does, as
+ * white IN glyph.  When the glyphs don't overlap there is nothing under
+ * them yet and they can be stored instead.
+ */
+static void
+fbAtlasRasterize(CARD8 *maskBits, int maskStride, int maskBpp,
+                 FbAtlasGlyphPtr glyph, int dx, int dy, Bool store)
+{
+    FbAtlasPagePtr page = glyph->page;
+    int width = glyph->width, height = glyph->height;
+    int pageBpp = glyph->page->kind == ATLAS_A8 ? 1 : 4;
+    CARD8 *src = page->bits + glyph->y * page->stride + glyph->x * pageBpp;
+    CARD8 *dst = maskBits + dy * maskStride + dx * maskBpp;
+    int x;
+
+    if (store && pageBpp == maskBpp) {
+        for (; height--; src += page->stride, dst += maskStride)
+            fbAtlasCopyRow(dst, src, width * pageBpp);
+        return;
+    }
+
+    /* Where glyphs overlap, most of each glyph still lands on zeros */
+    for (; height--; src += page->stride, dst += maskStride) {
+        if (pageBpp == maskBpp) {
+            if (pageBpp == 1) {
+                for (x = 0; x + 4 <= width; x += 4) {
+                    CARD32 s, d;
+
+                    memcpy(&s, src + x, 4);
+                    memcpy(&d, dst + x, 4);
+                    d = fbAtlasAdd8888(d, s);
+                    memcpy(dst + x, &d, 4);
+                }
+                for (; x < width; x++) {
+                    unsigned int v = dst[x] + src[x];
+
+                    dst[x] = v > 0xff ? 0xff : v;
+                }
+            }
+            else {
+                CARD32 *s = (CARD32 *) src, *d = (CARD32 *) dst;
+
+                for (x = 0; x < width; x++)
+                    d[x] = d[x] ? fbAtlasAdd8888(d[x], s[x]) : s[x];
+            }
+        }
+        else if (pageBpp == 1) {
+            CARD32 *d = (CARD32 *) dst;
+
+            for (x = 0; x < width; x++) {
+                CARD32 v = src[x] * 0x01010101;
+
+                d[x] = store || !d[x] ? v : fbAtlasAdd8888(d[x], v);
+            }
+        }
+        else {
+            CARD32 *s = (CARD32 *) src;
+
+            for (x = 0; x < width; x++) {
+                unsigned int v = s[x] >> 24;
+
+                if (!store)
+                    v += dst[x];
+                dst[x] = v > 0xff ? 0xff : v;
+            }
+        }
+    }
+}
+
+Bool
+fbGlyphAtlasComposite(FbGlyphAtlasPtr atlas,
+                      pixman_op_t op,
+                      pixman_image_t *src,
+                      pixman_image_t *dst,
+                      pixman_format_code_t maskFormat,
+                      int xSrc, int ySrc, int xDst, int yDst,
+                      int n, FbAtlasGlyphPosPtr glyphs)
+{
+    pixman_box32_t extents;
+    pixman_image_t *mask;
+    CARD8 *maskBits;
+    int maskStride, maskBpp;
+    Bool overlap;
+    int i;
+
+    if (maskFormat != PIXMAN_a8 && maskFormat != PIXMAN_a8r8g8b8)
+        return FALSE;
+
+    if (n == 0)
+        return TRUE;
+
+    overlap = fbAtlasExtents(n, glyphs, &extents);
+
+    mask = pixman_image_create_bits(maskFormat,
+                                    extents.x2 - extents.x1,
+                                    extents.y2 - extents.y1, NULL, 0);
+    if (!mask)
+        return FALSE;
+    pixman_image_set_component_alpha(mask, maskFormat == PIXMAN_a8r8g8b8);
+
+    maskBits = (CARD8 *) pixman_image_get_data(mask);
+    maskStride = pixman_image_get_stride(mask);
+    maskBpp = maskFormat == PIXMAN_a8 ? 1 : 4;
+
+    for (i = 0; i < n; i++) {
+        FbAtlasGlyphPtr g = glyphs[i].glyph;
+
+        fbAtlasRasterize(maskBits, maskStride, maskBpp, g,
+                         glyphs[i].x - g->xorigin - extents.x1,
+                         glyphs[i].y - g->yorigin - extents.y1, !overlap);
+    }
+
+    pixman_image_composite32(op, src, mask, dst,
+                             xSrc + extents.x1, ySrc + extents.y1, 0, 0,
+                             xDst + extents.x1, yDst + extents.y1,
+                             extents.x2 - extents.x1,
+                             extents.y2 - extents.y1);
+    pixman_image_unref(mask);
+    return TRUE;
+}
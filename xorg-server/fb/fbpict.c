@@ -82,6 +82,21 @@ fbDestroyGlyphCache(void)
     }
 }
 
+void
+fbDestroyGlyphAtlas(ScreenPtr pScreen)
+{
+    FbScreenPrivPtr pScrPriv = fbGetScreenPrivate(pScreen);
+
+    if (pScrPriv->glyphAtlas) {
+        fbGlyphAtlasDestroy(pScrPriv->glyphAtlas);
+        pScrPriv->glyphAtlas = NULL;
+    }
+}
+
+/*
+ * The atlas is keyed on glyph contents rather than on GlyphPtrs, so its
+ * entries stay valid after the glyph goes away and are simply aged out.
+ */
 static void
 fbUnrealizeGlyph(ScreenPtr pScreen,
 		 GlyphPtr pGlyph)
@@ -90,6 +105,128 @@ fbUnrealizeGlyph(ScreenPtr pScreen,
 	pixman_glyph_cache_remove (glyphCache, pGlyph, NULL);
 }
 
+#define N_STACK_GLYPHS 512
+
+/*
+ * Draws the glyphs through a mask from the screen's glyph atlas.  Returns
+ * FALSE, having drawn nothing, when there is no mask or when some glyph
+ * or the mask format can't be handled there, and the glyphs have to go
+ * through the pixman glyph cache.
+ */
+static Bool
+fbGlyphsAtlas(CARD8 op,
+	      PicturePtr pSrc,
+	      PicturePtr pDst,
+	      PictFormatPtr maskFormat,
+	      INT16 xSrc,
+	      INT16 ySrc, int nlist,
+	      GlyphListPtr list,
+	      GlyphPtr *glyphs,
+	      int n_glyphs)
+{
+    ScreenPtr pScreen = pDst->pDrawable->pScreen;
+    FbScreenPrivPtr pScrPriv = fbGetScreenPrivate(pScreen);
+    FbAtlasGlyphPosRec stack_pos[N_STACK_GLYPHS];
+    FbAtlasGlyphPosPtr pos = stack_pos;
+    pixman_image_t *srcImage, *dstImage;
+    int srcXoff, srcYoff, dstXoff, dstYoff;
+    FbGlyphAtlasPtr atlas;
+    GlyphPtr glyph;
+    Bool ret = FALSE;
+    int x, y;
+    int i, n;
+    int xDst = list->xOff, yDst = list->yOff;
+
+    if (!maskFormat ||
+	(maskFormat->format != PICT_a8 && maskFormat->format != PICT_a8r8g8b8))
+	return FALSE;
+
+    if (!pScrPriv->glyphAtlas &&
+	!(pScrPriv->glyphAtlas = fbGlyphAtlasCreate()))
+	return FALSE;
+    atlas = pScrPriv->glyphAtlas;
+
+    if (n_glyphs > N_STACK_GLYPHS) {
+	if (!(pos = malloc (n_glyphs * sizeof (FbAtlasGlyphPosRec))))
+	    return FALSE;
+    }
+
+    fbGlyphAtlasBeginRun(atlas);
+
+    i = 0;
+    x = y = 0;
+    while (nlist--) {
+	CARD32 format = list->format->format;
+
+        x += list->xOff;
+        y += list->yOff;
+        n = list->len;
+        while (n--) {
+	    FbAtlasGlyphPtr g;
+
+            glyph = *glyphs++;
+
+	    if (!glyph->info.width || !glyph->info.height)
+		goto next;
+
+	    if (!(g = fbGlyphAtlasLookup(atlas, glyph->sha1, format))) {
+		pixman_image_t *glyphImage;
+		PicturePtr pPicture;
+		int xoff, yoff;
+
+		pPicture = GetGlyphPicture(glyph, pScreen);
+		if (!pPicture)
+		    goto next;
+
+		if (!(glyphImage = image_from_pict(pPicture, FALSE, &xoff, &yoff)))
+		    goto out;
+
+		g = fbGlyphAtlasInsert(atlas, glyph->sha1, format, glyphImage,
+				       glyph->info.x, glyph->info.y);
+
+		free_pixman_pict(pPicture, glyphImage);
+
+		if (!g)
+		    goto out;
+	    }
+
+	    pos[i].x = x;
+	    pos[i].y = y;
+	    pos[i].glyph = g;
+	    i++;
+
+	next:
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+	}
+	list++;
+    }
+
+    /* From here on there is nothing the fallback could do better */
+    ret = TRUE;
+
+    if (!(srcImage = image_from_pict(pSrc, FALSE, &srcXoff, &srcYoff)))
+	goto out;
+
+    if (!(dstImage = image_from_pict(pDst, TRUE, &dstXoff, &dstYoff)))
+	goto out_free_src;
+
+    ret = fbGlyphAtlasComposite(atlas, op, srcImage, dstImage,
+				maskFormat->format,
+				xSrc + srcXoff - xDst, ySrc + srcYoff - yDst,
+				dstXoff, dstYoff, i, pos);
+
+    free_pixman_pict(pDst, dstImage);
+
+out_free_src:
+    free_pixman_pict(pSrc, srcImage);
+
+out:
+    if (pos != stack_pos)
+	free(pos);
+    return ret;
+}
+
 void
 fbGlyphs(CARD8 op,
 	 PicturePtr pSrc,
@@ -100,7 +237,6 @@ fbGlyphs(CARD8 op,
 	 GlyphListPtr list,
 	 GlyphPtr *glyphs)
 {
-#define N_STACK_GLYPHS 512
     ScreenPtr pScreen = pDst->pDrawable->pScreen;
     pixman_glyph_t stack_glyphs[N_STACK_GLYPHS];
     pixman_glyph_t *pglyphs = stack_glyphs;
@@ -118,6 +254,10 @@ fbGlyphs(CARD8 op,
     for (i = 0; i < nlist; ++i)
 	n_glyphs += list[i].len;
 
+    if (fbGlyphsAtlas(op, pSrc, pDst, maskFormat, xSrc, ySrc,
+		      nlist, list, glyphs, n_glyphs))
+	return;
+
     if (!glyphCache)
 	glyphCache = pixman_glyph_cache_create();
 
@@ -81,4 +81,48 @@ fbGlyphs(CARD8 op,
 	 GlyphListPtr list,
 	 GlyphPtr *glyphs);
 
+/* fbatlas.c */
+
+typedef struct _FbGlyphAtlas *FbGlyphAtlasPtr;
+typedef struct _FbAtlasGlyph *FbAtlasGlyphPtr;
+
+/* A glyph of a run and its pen position */
+typedef struct {
+    FbAtlasGlyphPtr glyph;
+    int x, y;
+} FbAtlasGlyphPosRec, *FbAtlasGlyphPosPtr;
+
+extern _X_EXPORT FbGlyphAtlasPtr
+fbGlyphAtlasCreate(void);
+
+extern _X_EXPORT void
+fbGlyphAtlasDestroy(FbGlyphAtlasPtr atlas);
+
+/* Glyphs looked up or inserted after this stay in place until the next run */
+extern _X_EXPORT void
+fbGlyphAtlasBeginRun(FbGlyphAtlasPtr atlas);
+
+extern _X_EXPORT FbAtlasGlyphPtr
+fbGlyphAtlasLookup(FbGlyphAtlasPtr atlas,
+                   const unsigned char *sha1, CARD32 format);
+
+/* Returns NULL for formats the atlas can't hold and when it is full */
+extern _X_EXPORT FbAtlasGlyphPtr
+fbGlyphAtlasInsert(FbGlyphAtlasPtr atlas,
+                   const unsigned char *sha1, CARD32 format,
+                   pixman_image_t *image, int xorigin, int yorigin);
+
+/* Like pixman_composite_glyphs(); returns FALSE, having drawn nothing,
+ * for mask formats other than a8 and a8r8g8b8 and when there is no
+ * memory for the mask.
+ */
+extern _X_EXPORT Bool
+fbGlyphAtlasComposite(FbGlyphAtlasPtr atlas,
+                      pixman_op_t op,
+                      pixman_image_t *src,
+                      pixman_image_t *dst,
+                      pixman_format_code_t maskFormat,
+                      int xSrc, int ySrc, int xDst, int yDst,
+                      int n, FbAtlasGlyphPosPtr glyphs);
+
 #endif                          /* _FBPICT_H_ */
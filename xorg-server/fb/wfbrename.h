@@ -48,6 +48,7 @@
 #define fbCreatePixmap wfbCreatePixmap
 #define fbCreatePixmapBpp wfbCreatePixmapBpp
 #define fbCreateWindow wfbCreateWindow
+#define fbDestroyGlyphAtlas wfbDestroyGlyphAtlas
 #define fbDestroyGlyphCache wfbDestroyGlyphCache
 #define fbDestroyPixmap wfbDestroyPixmap
 #define fbDestroyWindow wfbDestroyWindow
@@ -72,6 +73,12 @@
 #define fbGlyph24 wfbGlyph24
 #define fbGlyph32 wfbGlyph32
 #define fbGlyph8 wfbGlyph8
+#define fbGlyphAtlasBeginRun wfbGlyphAtlasBeginRun
+#define fbGlyphAtlasComposite wfbGlyphAtlasComposite
+#define fbGlyphAtlasCreate wfbGlyphAtlasCreate
+#define fbGlyphAtlasDestroy wfbGlyphAtlasDestroy
+#define fbGlyphAtlasInsert wfbGlyphAtlasInsert
+#define fbGlyphAtlasLookup wfbGlyphAtlasLookup
 #define fbHasVisualTypes wfbHasVisualTypes
 #define fbImageGlyphBlt wfbImageGlyphBlt
 #define fbIn wfbIn
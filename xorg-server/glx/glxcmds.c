@@ -2027,6 +2027,7 @@ __glXDisp_Render(__GLXclientState * cl, GLbyte * pc)
     CARD16 opcode;
     __GLXrenderHeader *hdr;
     __GLXcontext *glxc;
+    Bool queued;
 
     __GLX_DECLARE_SWAP_VARIABLES;
 
@@ -2038,10 +2039,11 @@ __glXDisp_Render(__GLXclientState * cl, GLbyte * pc)
         __GLX_SWAP_INT(&req->contextTag);
     }
 
-    glxc = __glXForceCurrent(cl, req->contextTag, &error);
+    glxc = __glXRenderContext(cl, req->contextTag, &error);
     if (!glxc) {
         return error;
     }
+    queued = __glXQueueWanted(glxc);
 
     commandsDone = 0;
     pc += sz_xGLXRenderReq;
@@ -2106,9 +2108,13 @@ __glXDisp_Render(__GLXclientState * cl, GLbyte * pc)
          ** caller to trash the command memory.  This is useful especially
          ** for things that require double alignment - they can just shift
          ** the data towards lower memory (trashing the header) by 4 bytes
-         ** and achieve the required alignment.
+         ** and achieve the required alignment.  Queued commands are copied
+         ** header and all, so that still holds when they run.
          */
-        (*proc) (pc + __GLX_RENDER_HDR_SIZE);
+        if (queued)
+            __glXQueueCommand(glxc, proc, pc, cmdlen, __GLX_RENDER_HDR_SIZE);
+        else
+            (*proc) (pc + __GLX_RENDER_HDR_SIZE);
         pc += cmdlen;
         left -= cmdlen;
         commandsDone++;
@@ -2144,7 +2150,7 @@ __glXDisp_RenderLarge(__GLXclientState * cl, GLbyte * pc)
         __GLX_SWAP_SHORT(&req->requestTotal);
     }
 
-    glxc = __glXForceCurrent(cl, req->contextTag, &error);
+    glxc = __glXRenderContext(cl, req->contextTag, &error);
     if (!glxc) {
         /* Reset in case this isn't 1st request. */
         __glXResetLargeCommandStatus(cl);
@@ -2323,7 +2329,12 @@ __glXDisp_RenderLarge(__GLXclientState * cl, GLbyte * pc)
             /*
              ** Skip over the header and execute the command.
              */
-            (*proc) (cl->largeCmdBuf + __GLX_RENDER_LARGE_HDR_SIZE);
+            if (__glXQueueWanted(glxc))
+                __glXQueueCommand(glxc, proc, cl->largeCmdBuf,
+                                  cl->largeCmdBytesSoFar,
+                                  __GLX_RENDER_LARGE_HDR_SIZE);
+            else
+                (*proc) (cl->largeCmdBuf + __GLX_RENDER_LARGE_HDR_SIZE);
             glxc->hasUnflushedCommands = GL_TRUE;
 
             /*
@@ -93,6 +93,12 @@ struct __GLXcontext {
      */
     GLboolean isDirect;
 
+    /*
+     ** Whether the provider can run this context's rendering commands on a
+     ** thread of their own (-glxthreads).
+     */
+    GLboolean threadedRendering;
+
     /*
      ** This flag keeps track of whether there are unflushed GL commands.
      */
@@ -121,6 +127,12 @@ struct __GLXcontext {
      */
     __GLXdrawable *drawPriv;
     __GLXdrawable *readPriv;
+
+    /*
+     ** Rendering commands waiting for this context's render thread, with
+     ** -glxthreads; NULL until the first one is queued.
+     */
+    __GLXrenderQueue *renderQueue;
 };
 
 void __glXContextDestroy(__GLXcontext * context);
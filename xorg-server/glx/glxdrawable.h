@@ -72,6 +72,12 @@ struct __GLXdrawable {
      ** Event mask
      */
     unsigned long eventMask;
+
+    /*
+     ** Reports X drawing to this drawable, so that rendering queued for it
+     ** runs first (-glxthreads).
+     */
+    DamagePtr renderDamage;
 };
 
 #endif                          /* !__GLX_drawable_h__ */
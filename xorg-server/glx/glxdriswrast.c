@@ -42,11 +42,16 @@
 
 #include "scrnintstr.h"
 #include "pixmapstr.h"
+#include "windowstr.h"
 #include "gcstruct.h"
+#include "regionstr.h"
+#include "servermd.h"
+#include "damage.h"
 #include "os.h"
 
 #include "glxserver.h"
 #include "glxutil.h"
+#include "glxext.h"
 #include "glxdricommon.h"
 
 #include "extension_string.h"
@@ -270,6 +275,7 @@ __glXDRIscreenCreateContext(__GLXscreen * baseScreen,
     context->base.makeCurrent = __glXDRIcontextMakeCurrent;
     context->base.loseCurrent = __glXDRIcontextLoseCurrent;
     context->base.copy = __glXDRIcontextCopy;
+    context->base.threadedRendering = GL_TRUE;
     context->base.textureFromPixmap = &__glXDRItextureFromPixmap;
 
     context->driContext =
@@ -329,6 +335,10 @@ __glXDRIscreenCreateDrawable(ClientPtr client,
     return &private->base;
 }
 
+/*
+ * Render threads call this too, without going through the main thread:
+ * the drawable stays around while they have rendering queued for it.
+ */
 static void
 swrastGetDrawableInfo(__DRIdrawable * draw,
                       int *x, int *y, int *w, int *h, void *loaderPrivate)
@@ -342,16 +352,129 @@ swrastGetDrawableInfo(__DRIdrawable * draw,
     *h = pDraw->height;
 }
 
+/*
+ * Where the drawable's pixels are, if the screen keeps them in plain
+ * memory as fb does: the address of its top-left pixel and the distance
+ * between rows.  Pixmaps without devPrivate.ptr (in video memory) have
+ * none.
+ */
+static Bool
+swrastDrawableBits(DrawablePtr pDraw, unsigned char **bits, int *stride)
+{
+    ScreenPtr pScreen = pDraw->pScreen;
+    PixmapPtr pPixmap;
+    int x = 0, y = 0;
+
+    if (pDraw->type == DRAWABLE_WINDOW) {
+        pPixmap = (*pScreen->GetWindowPixmap) ((WindowPtr) pDraw);
+        x = pDraw->x;
+        y = pDraw->y;
+#ifdef COMPOSITE
+        x -= pPixmap->screen_x;
+        y -= pPixmap->screen_y;
+#endif
+    }
+    else
+        pPixmap = (PixmapPtr) pDraw;
+
+    if (!pPixmap || !pPixmap->devPrivate.ptr ||
+        pPixmap->drawable.bitsPerPixel != pDraw->bitsPerPixel ||
+        pDraw->bitsPerPixel < 8)
+        return FALSE;
+
+    *stride = pPixmap->devKind;
+    *bits = (unsigned char *) pPixmap->devPrivate.ptr + y * *stride +
+        x * (pDraw->bitsPerPixel / 8);
+    return TRUE;
+}
+
+/*
+ * Report damage done behind the GC's back.  While the main thread waits
+ * for a render thread from inside another op's damage report, the
+ * report-after listeners are left to that op's epilogue, which then
+ * reports both once both are drawn.
+ */
 static void
-swrastPutImage(__DRIdrawable * draw, int op,
-               int x, int y, int w, int h, char *data, void *loaderPrivate)
+swrastDamage(DrawablePtr pDraw, RegionPtr pRegion)
 {
-    __GLXDRIdrawable *drawable = loaderPrivate;
+    DamageRegionAppend(pDraw, pRegion);
+    if (!__glXQueueInDamage())
+        DamageRegionProcessPending(pDraw);
+}
+
+/*
+ * A GXcopy PutImage of a ZPixmap done by copying the rows into the
+ * drawable's pixels, clipped as the GC would, then reported as damage.
+ * Spares validating the GC and fb's per-request setup, and calling back
+ * into GL to make the context current again.
+ */
+static Bool
+swrastPutImageDirect(DrawablePtr pDraw, int x, int y, int w, int h,
+                     int stride, const char *data)
+{
+    const int cpp = pDraw->bitsPerPixel / 8;
+    unsigned char *bits;
+    int pitch, nbox;
+    RegionRec region;
+    BoxRec box;
+    BoxPtr pbox;
+
+    if (!swrastDrawableBits(pDraw, &bits, &pitch))
+        return FALSE;
+
+    box.x1 = pDraw->x + max(x, 0);
+    box.y1 = pDraw->y + max(y, 0);
+    box.x2 = pDraw->x + min(x + w, (int) pDraw->width);
+    box.y2 = pDraw->y + min(y + h, (int) pDraw->height);
+    if (box.x1 >= box.x2 || box.y1 >= box.y2)
+        return TRUE;
+
+    RegionInit(&region, &box, 1);
+    if (pDraw->type == DRAWABLE_WINDOW)
+        RegionIntersect(&region, &region, &((WindowPtr) pDraw)->clipList);
+
+    pbox = RegionRects(&region);
+    for (nbox = RegionNumRects(&region); nbox--; pbox++) {
+        const char *src = data + (pbox->y1 - pDraw->y - y) * stride +
+            (pbox->x1 - pDraw->x - x) * cpp;
+        unsigned char *dst = bits + (pbox->y1 - pDraw->y) * pitch +
+            (pbox->x1 - pDraw->x) * cpp;
+        int row;
+
+        for (row = pbox->y1; row < pbox->y2; row++) {
+            memcpy(dst, src, (pbox->x2 - pbox->x1) * cpp);
+            src += stride;
+            dst += pitch;
+        }
+    }
+
+    swrastDamage(pDraw, &region);
+    RegionUninit(&region);
+    return TRUE;
+}
+
+/*
+ * The image transfers, which render threads (-glxthreads) leave to the
+ * main thread.
+ */
+typedef struct {
+    __GLXDRIdrawable *drawable;
+    int op;
+    int x, y, w, h;
+    int stride;
+    char *data;
+} swrastImageRec;
+
+static void
+swrastDoPutImage(void *closure)
+{
+    swrastImageRec *image = closure;
+    __GLXDRIdrawable *drawable = image->drawable;
     DrawablePtr pDraw = drawable->base.pDraw;
     GCPtr gc;
-    __GLXcontext *cx = lastGLContext;
+    int row;
 
-    switch (op) {
+    switch (image->op) {
     case __DRI_SWRAST_IMAGE_OP_DRAW:
         gc = drawable->gc;
         break;
@@ -362,9 +485,35 @@ swrastPutImage(__DRIdrawable * draw, int op,
         return;
     }
 
+    if (swrastPutImageDirect(pDraw, image->x, image->y, image->w, image->h,
+                             image->stride, image->data))
+        return;
+
+    /* Only for pixels the CPU cannot reach, which fb always can: the GC
+     * ops process pending damage themselves */
     ValidateGC(pDraw, gc);
 
-    gc->ops->PutImage(pDraw, gc, pDraw->depth, x, y, w, h, 0, ZPixmap, data);
+    if (image->stride == PixmapBytePad(image->w, pDraw->depth))
+        gc->ops->PutImage(pDraw, gc, pDraw->depth, image->x, image->y,
+                          image->w, image->h, 0, ZPixmap, image->data);
+    else
+        for (row = 0; row < image->h; row++)
+            gc->ops->PutImage(pDraw, gc, pDraw->depth, image->x,
+                              image->y + row, image->w, 1, 0, ZPixmap,
+                              image->data + row * image->stride);
+}
+
+static void
+swrastPutImage2(__DRIdrawable * draw, int op,
+                int x, int y, int w, int h, int stride,
+                char *data, void *loaderPrivate)
+{
+    swrastImageRec image = { loaderPrivate, op, x, y, w, h, stride, data };
+    __GLXcontext *cx = lastGLContext;
+
+    if (!__glXQueueCallMain(swrastDoPutImage, &image))
+        swrastDoPutImage(&image);
+
     if (cx != lastGLContext) {
         lastGLContext = cx;
         cx->makeCurrent(cx);
@@ -372,31 +521,115 @@ swrastPutImage(__DRIdrawable * draw, int op,
 }
 
 static void
-swrastGetImage(__DRIdrawable * draw,
+swrastPutImage(__DRIdrawable * draw, int op,
                int x, int y, int w, int h, char *data, void *loaderPrivate)
 {
     __GLXDRIdrawable *drawable = loaderPrivate;
-    DrawablePtr pDraw = drawable->base.pDraw;
+
+    swrastPutImage2(draw, op, x, y, w, h,
+                    PixmapBytePad(w, drawable->base.pDraw->depth), data,
+                    loaderPrivate);
+}
+
+static void
+swrastDoGetImage(void *closure)
+{
+    swrastImageRec *image = closure;
+    DrawablePtr pDraw = image->drawable->base.pDraw;
     ScreenPtr pScreen = pDraw->pScreen;
+
+    pScreen->GetImage(pDraw, image->x, image->y, image->w, image->h,
+                      ZPixmap, ~0L, image->data);
+}
+
+static void
+swrastGetImage(__DRIdrawable * draw,
+               int x, int y, int w, int h, char *data, void *loaderPrivate)
+{
+    swrastImageRec image = { loaderPrivate, 0, x, y, w, h, 0, data };
     __GLXcontext *cx = lastGLContext;
 
-    pScreen->GetImage(pDraw, x, y, w, h, ZPixmap, ~0L, data);
+    if (!__glXQueueCallMain(swrastDoGetImage, &image))
+        swrastDoGetImage(&image);
     if (cx != lastGLContext) {
         lastGLContext = cx;
         cx->makeCurrent(cx);
     }
 }
 
+/*
+ * Lets the driver render into the drawable in place, when nothing could
+ * clip what it draws: a pixmap, or a window with nothing over it and no
+ * children showing.  Not from a render thread, which would be writing
+ * the pixels behind the main thread's back.
+ */
+static void *
+swrastMapDrawable(__DRIdrawable * draw, int bpp, int width, int height,
+                  int *stride, void *loaderPrivate)
+{
+    __GLXDRIdrawable *drawable = loaderPrivate;
+    DrawablePtr pDraw = drawable->base.pDraw;
+    unsigned char *bits;
+
+    if (__glXQueueThreadSelf())
+        return NULL;
+
+    if (pDraw->bitsPerPixel != bpp ||
+        pDraw->width != width || pDraw->height != height)
+        return NULL;
+
+    if (pDraw->type == DRAWABLE_WINDOW) {
+        RegionPtr pClip = &((WindowPtr) pDraw)->clipList;
+        BoxPtr pExtents = RegionExtents(pClip);
+
+        if (RegionNumRects(pClip) != 1 ||
+            pExtents->x1 != pDraw->x || pExtents->y1 != pDraw->y ||
+            pExtents->x2 != pDraw->x + width ||
+            pExtents->y2 != pDraw->y + height)
+            return NULL;
+    }
+
+    if (!swrastDrawableBits(pDraw, &bits, stride))
+        return NULL;
+    return bits;
+}
+
+static void
+swrastDamageDrawable(__DRIdrawable * draw, int x, int y, int w, int h,
+                     void *loaderPrivate)
+{
+    __GLXDRIdrawable *drawable = loaderPrivate;
+    DrawablePtr pDraw = drawable->base.pDraw;
+    RegionRec region;
+    BoxRec box;
+
+    box.x1 = pDraw->x + x;
+    box.y1 = pDraw->y + y;
+    box.x2 = box.x1 + w;
+    box.y2 = box.y1 + h;
+    RegionInit(&region, &box, 1);
+    swrastDamage(pDraw, &region);
+    RegionUninit(&region);
+}
+
 static const __DRIswrastLoaderExtension swrastLoaderExtension = {
     {__DRI_SWRAST_LOADER, __DRI_SWRAST_LOADER_VERSION},
     swrastGetDrawableInfo,
     swrastPutImage,
-    swrastGetImage
+    swrastGetImage,
+    swrastPutImage2
+};
+
+static const __DRIswrastMapLoaderExtension swrastMapLoaderExtension = {
+    {__DRI_SWRAST_MAP_LOADER, __DRI_SWRAST_MAP_LOADER_VERSION},
+    swrastMapDrawable,
+    swrastDamageDrawable
 };
 
 static const __DRIextension *loader_extensions[] = {
     &systemTimeExtension.base,
     &swrastLoaderExtension.base,
+    &swrastMapLoaderExtension.base,
     NULL
 };
 
@@ -48,6 +48,7 @@
 #include "unpack.h"
 #include "glxutil.h"
 #include "glxext.h"
+#include "opaque.h"
 #include "indirect_table.h"
 #include "indirect_util.h"
 #include "glapi.h"
@@ -124,6 +125,9 @@ DrawableGone(__GLXdrawable * glxPriv, XID xid)
 {
     __GLXcontext *c, *next;
 
+    __glXQueueDrawableGone(glxPriv);
+    __glXLockGL();
+
     if (glxPriv->type == GLX_DRAWABLE_WINDOW) {
         /* If this was created by glXCreateWindow, free the matching resource */
         if (glxPriv->drawId != glxPriv->pDraw->id) {
@@ -158,6 +162,7 @@ DrawableGone(__GLXdrawable * glxPriv, XID xid)
 
     glxPriv->destroy(glxPriv);
 
+    __glXUnlockGL();
     return True;
 }
 
@@ -201,6 +206,7 @@ __glXFreeContext(__GLXcontext * cx)
     if (cx->idExists || cx->currentClient)
         return GL_FALSE;
 
+    __glXQueueDestroy(cx);
     __glXRemoveFromContextList(cx);
 
     free(cx->feedbackBuf);
@@ -215,7 +221,9 @@ __glXFreeContext(__GLXcontext * cx)
 
     if (!glxBlockClients) {
         __glXleaveServer(GL_FALSE);
+        __glXLockGL();
         cx->destroy(cx);
+        __glXUnlockGL();
         __glXenterServer(GL_FALSE);
     }
     else {
@@ -294,6 +302,8 @@ glxClientCallback(CallbackListPtr *list, void *closure, void *data)
 
     case ClientStateGone:
         /* detach from all current contexts */
+        __glXQueueSyncAll();
+        __glXLockGL();
         for (c = glxAllContexts; c; c = next) {
             next = c->next;
             if (c->currentClient == pClient) {
@@ -303,6 +313,7 @@ glxClientCallback(CallbackListPtr *list, void *closure, void *data)
                 FreeResourceByType(c->id, __glXContextRes, FALSE);
             }
         }
+        __glXUnlockGL();
 
         free(cl->returnBuf);
         free(cl->largeCmdBuf);
@@ -423,6 +434,7 @@ GlxExtensionInit(void)
 
     __glXErrorBase = extEntry->errorBase;
     __glXEventBase = extEntry->eventBase;
+    __glXQueueInit();
 #if PRESENT
     __glXregisterPresentCompleteNotify();
 #endif
@@ -436,8 +448,8 @@ GlxExtensionInit(void)
 ** switching it between different contexts).  While we are at it, look up
 ** a context by its tag and return its (__GLXcontext *).
 */
-__GLXcontext *
-__glXForceCurrent(__GLXclientState * cl, GLXContextTag tag, int *error)
+static __GLXcontext *
+LookupCurrentContext(__GLXclientState * cl, GLXContextTag tag, int *error)
 {
     __GLXcontext *cx;
 
@@ -464,6 +476,18 @@ __glXForceCurrent(__GLXclientState * cl, GLXContextTag tag, int *error)
         }
     }
 
+    return cx;
+}
+
+__GLXcontext *
+__glXForceCurrent(__GLXclientState * cl, GLXContextTag tag, int *error)
+{
+    __GLXcontext *cx;
+
+    cx = LookupCurrentContext(cl, tag, error);
+    if (!cx)
+        return 0;
+
     if (cx->wait && (*cx->wait) (cx, cl, error))
         return NULL;
 
@@ -486,6 +510,22 @@ __glXForceCurrent(__GLXclientState * cl, GLXContextTag tag, int *error)
     return cx;
 }
 
+/*
+** Look up the context of a Render or RenderLarge request.  If its
+** commands are queued for its render thread (-glxthreads) it is left
+** alone, otherwise it is made current as by __glXForceCurrent.
+*/
+__GLXcontext *
+__glXRenderContext(__GLXclientState * cl, GLXContextTag tag, int *error)
+{
+    __GLXcontext *cx;
+
+    cx = LookupCurrentContext(cl, tag, error);
+    if (!cx || !__glXQueueWanted(cx))
+        return __glXForceCurrent(cl, tag, error);
+    return cx;
+}
+
 /************************************************************************/
 
 void
@@ -499,6 +539,7 @@ glxSuspendClients(void)
     }
 
     glxBlockClients = TRUE;
+    __glXQueueSyncAll();
 }
 
 void
@@ -515,12 +556,14 @@ glxResumeClients(void)
     }
 
     __glXleaveServer(GL_FALSE);
+    __glXLockGL();
     for (cx = glxPendingDestroyContexts; cx != NULL; cx = next) {
         next = cx->next;
 
         cx->destroy(cx);
     }
     glxPendingDestroyContexts = NULL;
+    __glXUnlockGL();
     __glXenterServer(GL_FALSE);
 }
 
@@ -578,6 +621,48 @@ void *__glGetProcAddress(const char *proc)
     return ret ? ret : (void *) NoopDDA;
 }
 
+/*
+** With render threads, get ready for a request to run GL here: wait for
+** what was queued before it that it depends on and take the GL lock.  A
+** single depends on its own context, Render and RenderLarge on nothing,
+** anything else on all contexts.  Render and RenderLarge for a context
+** whose commands are queued need not run GL here at all.  Returns whether
+** the lock was taken.
+*/
+static Bool
+__glXSyncForRequest(ClientPtr client, __GLXclientState * cl, CARD8 opcode)
+{
+    REQUEST(xGLXSingleReq);
+    GLXContextTag tag;
+    __GLXcontext *cx = NULL;
+
+    if (!enableGLXThreads)
+        return FALSE;
+
+    if (opcode <= X_GLXRenderLarge || opcode >= X_GLsop_NewList) {
+        if (client->req_len < bytes_to_int32(sz_xGLXSingleReq))
+            return FALSE;
+        tag = stuff->contextTag;
+        if (client->swapped)
+            swapl(&tag);
+        cx = __glXLookupContextByTag(cl, tag);
+    }
+
+    if (opcode <= X_GLXRenderLarge) {
+        if (cx && __glXQueueWanted(cx))
+            return FALSE;
+    }
+    else if (opcode >= X_GLsop_NewList) {
+        if (cx)
+            __glXQueueSync(cx);
+    }
+    else
+        __glXQueueSyncAll();
+
+    __glXLockGL();
+    return TRUE;
+}
+
 /*
 ** Top level dispatcher; all commands are executed from here down.
 */
@@ -619,11 +704,15 @@ __glXDispatch(ClientPtr client)
                                           client->swapped);
     if (proc != NULL) {
         GLboolean rendering = opcode <= X_GLXRenderLarge;
+        Bool locked;
 
         __glXleaveServer(rendering);
+        locked = __glXSyncForRequest(client, cl, opcode);
 
         retval = (*proc) (cl, (GLbyte *) stuff);
 
+        if (locked)
+            __glXUnlockGL();
         __glXenterServer(rendering);
     }
     else {
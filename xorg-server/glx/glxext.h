@@ -65,6 +65,25 @@ extern void __glXClearErrorOccured(void);
 extern GLboolean __glXErrorOccured(void);
 extern void __glXResetLargeCommandStatus(__GLXclientState *);
 
+extern __GLXcontext *__glXRenderContext(__GLXclientState * cl,
+                                        GLXContextTag tag, int *error);
+
+/* Render threads, glxqueue.c */
+extern void __glXQueueInit(void);
+extern Bool __glXQueueWanted(__GLXcontext * cx);
+extern void __glXQueueCommand(__GLXcontext * cx,
+                              __GLXdispatchRenderProcPtr proc,
+                              GLbyte * cmd, int cmdlen, int hdrlen);
+extern void __glXQueueSync(__GLXcontext * cx);
+extern void __glXQueueSyncAll(void);
+extern void __glXQueueDrawableGone(__GLXdrawable * drawable);
+extern void __glXQueueDestroy(__GLXcontext * cx);
+extern Bool __glXQueueThreadSelf(void);
+extern Bool __glXQueueInDamage(void);
+extern Bool __glXQueueCallMain(void (*func) (void *), void *data);
+extern void __glXLockGL(void);
+extern void __glXUnlockGL(void);
+
 extern const char GLServerVersion[];
 extern int DoGetString(__GLXclientState * cl, GLbyte * pc, GLboolean need_swap);
 
@@ -0,0 +1,719 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "glxserver.h"
+#include "glxutil.h"
+#include "glxext.h"
+#include "opaque.h"
+
+/*
+ * Render threads (-glxthreads).
+ *
+ * Render and RenderLarge commands for a context that allows it are
+ * checked as usual, then copied into the context's queue instead of being
+ * run.  A thread per context runs them: it takes the GL lock, makes the
+ * context current, runs everything queued so far and releases it again.
+ * The server's GL dispatch is not made for several threads at once, so
+ * only one thread runs GL at a time; what this buys is that the main
+ * thread goes on with other clients meanwhile.
+ *
+ * The main thread takes the GL lock around any other GLX request, after
+ * waiting for the queues that request depends on: a single waits for its
+ * own context's queue, everything else for all of them.  X drawing to a
+ * drawable with queued rendering waits for it too, through a damage
+ * report.
+ *
+ * Render threads never touch X state themselves.  Loader callbacks that
+ * need to, the swrast getImage and putImage, are handed to the main
+ * thread with __glXQueueCallMain, which runs them while it waits for GL
+ * or, failing that, from its wakeup handler; the block handler keeps the
+ * main loop from sleeping for long while a render thread is busy.
+ */
+
+#ifdef GLX_RENDER_THREADS
+
+#include <pthread.h>
+#include <signal.h>
+
+/* Enough for anything but a RenderLarge command, which gets its own */
+#define GLX_QUEUE_CHUNK_SIZE    (64 * 1024)
+/* Stop queueing and wait once this much is waiting */
+#define GLX_QUEUE_MAX_BYTES     (8 * 1024 * 1024)
+
+typedef struct __GLXqueueChunk __GLXqueueChunk;
+struct __GLXqueueChunk {
+    __GLXqueueChunk *next;
+    size_t used;
+    size_t size;
+};
+
+/* Followed by the command, header included */
+typedef struct {
+    __GLXdispatchRenderProcPtr proc;
+    int size;                   /* of the whole entry */
+    int hdrlen;                 /* bytes of header before what proc gets */
+} __GLXqueueEntry;
+
+#define GLX_QUEUE_ALIGN(n)      (((n) + 7) & ~7)
+#define GLX_QUEUE_ENTRY_SIZE    GLX_QUEUE_ALIGN(sizeof(__GLXqueueEntry))
+#define GLX_QUEUE_CHUNK_HEADER  GLX_QUEUE_ALIGN(sizeof(__GLXqueueChunk))
+
+struct __GLXrenderQueue {
+    __GLXrenderQueue *next;
+    __GLXcontext *context;
+    pthread_t thread;
+    pthread_cond_t cond;        /* commands queued, or exit set */
+    __GLXqueueChunk *head, *tail;
+    __GLXqueueChunk *spare;
+    size_t bytes;               /* in head..tail */
+    Bool busy;                  /* thread is running commands */
+    Bool exit;
+};
+
+typedef struct __GLXmainCall __GLXmainCall;
+struct __GLXmainCall {
+    __GLXmainCall *next;
+    void (*func) (void *);
+    void *data;
+    Bool done;
+};
+
+/* Everything below, and all queues, are protected by glxQueueMutex */
+static pthread_mutex_t glxQueueMutex = PTHREAD_MUTEX_INITIALIZER;
+/* Broadcast on any change the main thread or a waiting queue could
+ * be waiting for: GL released, a queue gone idle, a call posted or done */
+static pthread_cond_t glxQueueCond = PTHREAD_COND_INITIALIZER;
+static __GLXrenderQueue *glxQueues;
+static __GLXmainCall *glxMainCalls;
+
+/* Which queue's thread holds the GL lock, or &glxMainOwner */
+static void *glxGLOwner;
+static char glxMainOwner;
+
+/* Main thread only */
+static int glxMainDepth;
+static Bool glxServicing;
+static Bool glxDamageWaiting;
+
+/* Set on render threads, created before the first one */
+static pthread_key_t glxQueueKey;
+static pthread_once_t glxQueueKeyOnce = PTHREAD_ONCE_INIT;
+static Bool glxQueueKeyValid;
+
+static void
+glxQueueKeyInit(void)
+{
+    glxQueueKeyValid = pthread_key_create(&glxQueueKey, NULL) == 0;
+}
+
+Bool
+__glXQueueThreadSelf(void)
+{
+    return glxQueueKeyValid && pthread_getspecific(glxQueueKey) != NULL;
+}
+
+/*
+ * Whether the main thread is waiting for render threads from inside a
+ * damage report, that is, in the middle of another op's damage
+ * prologue.  Loader calls run meanwhile must not process that
+ * drawable's pending damage, which would report the op's damage to
+ * report-after listeners before it is drawn.
+ */
+Bool
+__glXQueueInDamage(void)
+{
+    return glxDamageWaiting;
+}
+
+static Bool
+glxQueueIdle(__GLXrenderQueue * q)
+{
+    return !q->head && !q->busy;
+}
+
+/*
+ * Run the loader calls render threads are waiting on.  Main thread,
+ * glxQueueMutex held; it is dropped while each call runs.
+ */
+static void
+glxServiceCalls(void)
+{
+    while (glxMainCalls) {
+        __GLXmainCall *call = glxMainCalls;
+
+        glxMainCalls = call->next;
+        pthread_mutex_unlock(&glxQueueMutex);
+        glxServicing = TRUE;
+        (*call->func) (call->data);
+        glxServicing = FALSE;
+        pthread_mutex_lock(&glxQueueMutex);
+        call->done = TRUE;
+    }
+    pthread_cond_broadcast(&glxQueueCond);
+}
+
+/* Main thread, glxQueueMutex held */
+static void
+glxMainWait(void)
+{
+    if (glxMainCalls)
+        glxServiceCalls();
+    else
+        pthread_cond_wait(&glxQueueCond, &glxQueueMutex);
+}
+
+/*
+ * Wait until q has run everything queued on it.  Main thread,
+ * glxQueueMutex held.  If the main thread holds the GL lock it lends it
+ * to the render threads meanwhile, then gets the context it had current
+ * back, like the loader callbacks do.
+ */
+static void
+glxQueueWait(__GLXrenderQueue * q)
+{
+    __GLXcontext *cx = NULL;
+    Bool owned = glxMainDepth > 0;
+
+    if (glxQueueIdle(q))
+        return;
+
+    if (owned) {
+        cx = lastGLContext;
+        glxGLOwner = NULL;
+        pthread_cond_broadcast(&glxQueueCond);
+    }
+    while (!glxQueueIdle(q))
+        glxMainWait();
+    if (owned) {
+        while (glxGLOwner)
+            glxMainWait();
+        glxGLOwner = &glxMainOwner;
+        if (cx != lastGLContext) {
+            lastGLContext = cx;
+            pthread_mutex_unlock(&glxQueueMutex);
+            if (cx)
+                cx->makeCurrent(cx);
+            pthread_mutex_lock(&glxQueueMutex);
+        }
+    }
+}
+
+void
+__glXLockGL(void)
+{
+    if (!enableGLXThreads)
+        return;
+
+    if (glxMainDepth++ == 0) {
+        pthread_mutex_lock(&glxQueueMutex);
+        while (glxGLOwner)
+            glxMainWait();
+        glxGLOwner = &glxMainOwner;
+        pthread_mutex_unlock(&glxQueueMutex);
+    }
+}
+
+void
+__glXUnlockGL(void)
+{
+    if (!enableGLXThreads)
+        return;
+
+    if (--glxMainDepth == 0) {
+        pthread_mutex_lock(&glxQueueMutex);
+        glxGLOwner = NULL;
+        pthread_cond_broadcast(&glxQueueCond);
+        pthread_mutex_unlock(&glxQueueMutex);
+    }
+}
+
+/*
+ * Have the main thread run func(data) and wait for it.  Returns FALSE,
+ * without calling func, unless the caller is a render thread.
+ */
+Bool
+__glXQueueCallMain(void (*func) (void *), void *data)
+{
+    __GLXmainCall call, **tail;
+
+    if (!__glXQueueThreadSelf())
+        return FALSE;
+
+    call.next = NULL;
+    call.func = func;
+    call.data = data;
+    call.done = FALSE;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    for (tail = &glxMainCalls; *tail; tail = &(*tail)->next)
+        ;
+    *tail = &call;
+    pthread_cond_broadcast(&glxQueueCond);
+    while (!call.done)
+        pthread_cond_wait(&glxQueueCond, &glxQueueMutex);
+    pthread_mutex_unlock(&glxQueueMutex);
+    return TRUE;
+}
+
+static void
+glxQueueRun(__GLXcontext * cx, __GLXqueueChunk * chunks)
+{
+    __GLXqueueChunk *chunk;
+
+    lastGLContext = cx;
+    if (cx->makeCurrent(cx)) {
+        for (chunk = chunks; chunk; chunk = chunk->next) {
+            GLbyte *p = (GLbyte *) chunk + GLX_QUEUE_CHUNK_HEADER;
+            GLbyte *end = p + chunk->used;
+
+            while (p < end) {
+                __GLXqueueEntry *entry = (__GLXqueueEntry *) p;
+                GLbyte *cmd = p + GLX_QUEUE_ENTRY_SIZE;
+
+                (*entry->proc) (cmd + entry->hdrlen);
+                p += entry->size;
+            }
+        }
+        cx->loseCurrent(cx);
+    }
+    lastGLContext = NULL;
+}
+
+static void *
+glxQueueThread(void *arg)
+{
+    __GLXrenderQueue *q = arg;
+
+    pthread_setspecific(glxQueueKey, q);
+
+    pthread_mutex_lock(&glxQueueMutex);
+    for (;;) {
+        __GLXqueueChunk *chunks, *next;
+
+        while (!q->head && !q->exit)
+            pthread_cond_wait(&q->cond, &glxQueueMutex);
+        if (!q->head)
+            break;
+
+        chunks = q->head;
+        q->head = q->tail = NULL;
+        q->bytes = 0;
+        q->busy = TRUE;
+        while (glxGLOwner)
+            pthread_cond_wait(&glxQueueCond, &glxQueueMutex);
+        glxGLOwner = q;
+        pthread_mutex_unlock(&glxQueueMutex);
+
+        glxQueueRun(q->context, chunks);
+
+        pthread_mutex_lock(&glxQueueMutex);
+        glxGLOwner = NULL;
+        q->busy = FALSE;
+        for (; chunks; chunks = next) {
+            next = chunks->next;
+            if (!q->spare && chunks->size == GLX_QUEUE_CHUNK_SIZE) {
+                chunks->next = NULL;
+                q->spare = chunks;
+            }
+            else
+                free(chunks);
+        }
+        pthread_cond_broadcast(&glxQueueCond);
+    }
+    pthread_mutex_unlock(&glxQueueMutex);
+    return NULL;
+}
+
+static __GLXrenderQueue *
+glxQueueCreate(__GLXcontext * cx)
+{
+    __GLXrenderQueue *q;
+    int ret;
+#ifndef WIN32
+    sigset_t set, old;
+#endif
+
+    pthread_once(&glxQueueKeyOnce, glxQueueKeyInit);
+    if (!glxQueueKeyValid)
+        return NULL;
+
+    q = calloc(1, sizeof(*q));
+    if (!q)
+        return NULL;
+    q->context = cx;
+    pthread_cond_init(&q->cond, NULL);
+
+#ifndef WIN32
+    /* signals are for the main thread, the new thread inherits this mask */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+#endif
+    ret = pthread_create(&q->thread, NULL, glxQueueThread, q);
+#ifndef WIN32
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+    if (ret != 0) {
+        LogMessage(X_WARNING, "GLX: cannot create render thread: %s\n",
+                   strerror(ret));
+        pthread_cond_destroy(&q->cond);
+        free(q);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&glxQueueMutex);
+    q->next = glxQueues;
+    glxQueues = q;
+    pthread_mutex_unlock(&glxQueueMutex);
+
+    cx->renderQueue = q;
+    return q;
+}
+
+/*
+ * Whether Render commands for cx should be queued rather than run.
+ */
+Bool
+__glXQueueWanted(__GLXcontext * cx)
+{
+    return enableGLXThreads && cx->threadedRendering &&
+        !cx->isDirect && cx->drawPriv != NULL;
+}
+
+static void
+glxQueueDamage(DamagePtr pDamage, RegionPtr pRegion, void *closure)
+{
+    __GLXdrawable *drawable = closure;
+    __GLXrenderQueue *q;
+
+    /* X drawing done for GL, on the main thread or on behalf of a render
+     * thread, is in order already */
+    if (glxMainDepth || glxServicing)
+        return;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    glxDamageWaiting = TRUE;
+    for (q = glxQueues; q; q = q->next) {
+        if (q->context->drawPriv == drawable ||
+            q->context->readPriv == drawable)
+            glxQueueWait(q);
+    }
+    glxDamageWaiting = FALSE;
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+static void
+glxQueueDamageDestroy(DamagePtr pDamage, void *closure)
+{
+    __GLXdrawable *drawable = closure;
+
+    drawable->renderDamage = NULL;
+}
+
+static void
+glxQueueWatchDrawable(__GLXdrawable * drawable)
+{
+    DrawablePtr pDraw;
+
+    if (!drawable || drawable->renderDamage)
+        return;
+
+    pDraw = drawable->pDraw;
+    drawable->renderDamage = DamageCreate(glxQueueDamage,
+                                          glxQueueDamageDestroy,
+                                          DamageReportRawRegion, TRUE,
+                                          pDraw->pScreen, drawable);
+    if (drawable->renderDamage)
+        DamageRegister(pDraw, drawable->renderDamage);
+}
+
+/* Run a command right away, when it cannot be queued */
+static void
+glxQueueRunNow(__GLXcontext * cx, __GLXdispatchRenderProcPtr proc,
+               GLbyte * cmd, int hdrlen)
+{
+    __glXQueueSync(cx);
+    __glXLockGL();
+    if (cx != lastGLContext) {
+        lastGLContext = cx;
+        cx->makeCurrent(cx);
+    }
+    (*proc) (cmd + hdrlen);
+    __glXUnlockGL();
+}
+
+/*
+ * Queue a checked rendering command of cmdlen bytes at cmd for cx's
+ * render thread, which runs proc(cmd + hdrlen).
+ */
+void
+__glXQueueCommand(__GLXcontext * cx, __GLXdispatchRenderProcPtr proc,
+                  GLbyte * cmd, int cmdlen, int hdrlen)
+{
+    __GLXrenderQueue *q = cx->renderQueue;
+    const size_t size = GLX_QUEUE_ENTRY_SIZE + GLX_QUEUE_ALIGN(cmdlen);
+    __GLXqueueChunk *chunk;
+    __GLXqueueEntry *entry;
+    Bool wake;
+
+    if (!q && !(q = glxQueueCreate(cx))) {
+        glxQueueRunNow(cx, proc, cmd, hdrlen);
+        return;
+    }
+
+    glxQueueWatchDrawable(cx->drawPriv);
+    if (cx->readPriv != cx->drawPriv)
+        glxQueueWatchDrawable(cx->readPriv);
+
+    pthread_mutex_lock(&glxQueueMutex);
+    if (q->bytes + size > GLX_QUEUE_MAX_BYTES)
+        glxQueueWait(q);
+
+    chunk = q->tail;
+    if (!chunk || chunk->used + size > chunk->size) {
+        size_t chunkSize = max(size, GLX_QUEUE_CHUNK_SIZE);
+
+        if (q->spare && chunkSize == GLX_QUEUE_CHUNK_SIZE) {
+            chunk = q->spare;
+            q->spare = NULL;
+        }
+        else {
+            chunk = malloc(GLX_QUEUE_CHUNK_HEADER + chunkSize);
+            if (!chunk) {
+                pthread_mutex_unlock(&glxQueueMutex);
+                glxQueueRunNow(cx, proc, cmd, hdrlen);
+                return;
+            }
+            chunk->size = chunkSize;
+        }
+        chunk->next = NULL;
+        chunk->used = 0;
+        if (q->tail)
+            q->tail->next = chunk;
+        else
+            q->head = chunk;
+        q->tail = chunk;
+    }
+
+    entry = (__GLXqueueEntry *) ((GLbyte *) chunk + GLX_QUEUE_CHUNK_HEADER +
+                                 chunk->used);
+    entry->proc = proc;
+    entry->size = size;
+    entry->hdrlen = hdrlen;
+    memcpy((GLbyte *) entry + GLX_QUEUE_ENTRY_SIZE, cmd, cmdlen);
+    wake = q->bytes == 0 && !q->busy;
+    chunk->used += size;
+    q->bytes += size;
+    if (wake)
+        pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+/*
+ * Wait for cx's render thread to run everything queued for it.
+ */
+void
+__glXQueueSync(__GLXcontext * cx)
+{
+    if (!cx->renderQueue)
+        return;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    glxQueueWait(cx->renderQueue);
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+void
+__glXQueueSyncAll(void)
+{
+    __GLXrenderQueue *q;
+
+    if (!enableGLXThreads)
+        return;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    for (q = glxQueues; q; q = q->next)
+        glxQueueWait(q);
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+/*
+ * Before a drawable goes away: let rendering queued for it finish and
+ * stop watching it.
+ */
+void
+__glXQueueDrawableGone(__GLXdrawable * drawable)
+{
+    __GLXrenderQueue *q;
+
+    if (!enableGLXThreads)
+        return;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    for (q = glxQueues; q; q = q->next) {
+        if (q->context->drawPriv == drawable ||
+            q->context->readPriv == drawable)
+            glxQueueWait(q);
+    }
+    pthread_mutex_unlock(&glxQueueMutex);
+
+    if (drawable->renderDamage)
+        DamageDestroy(drawable->renderDamage);
+}
+
+/*
+ * Finish what is queued for cx and stop its render thread.
+ */
+void
+__glXQueueDestroy(__GLXcontext * cx)
+{
+    __GLXrenderQueue *q = cx->renderQueue, **prev;
+    __GLXqueueChunk *spare;
+
+    if (!q)
+        return;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    glxQueueWait(q);
+    q->exit = TRUE;
+    pthread_cond_signal(&q->cond);
+    for (prev = &glxQueues; *prev != q; prev = &(*prev)->next)
+        ;
+    *prev = q->next;
+    spare = q->spare;
+    pthread_mutex_unlock(&glxQueueMutex);
+
+    pthread_join(q->thread, NULL);
+    pthread_cond_destroy(&q->cond);
+    free(spare);
+    free(q);
+    cx->renderQueue = NULL;
+}
+
+/*
+ * Keep the main loop from sleeping while a render thread could hand it a
+ * call, and run any that came in.
+ */
+static void
+glxQueueBlockHandler(void *data, OSTimePtr pTimeout, void *pReadmask)
+{
+    __GLXrenderQueue *q;
+
+    pthread_mutex_lock(&glxQueueMutex);
+    for (q = glxQueues; q; q = q->next) {
+        if (!glxQueueIdle(q)) {
+            AdjustWaitForDelay(pTimeout, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+static void
+glxQueueWakeupHandler(void *data, int result, void *pReadmask)
+{
+    pthread_mutex_lock(&glxQueueMutex);
+    if (glxMainCalls)
+        glxServiceCalls();
+    pthread_mutex_unlock(&glxQueueMutex);
+}
+
+/* Called once per server generation */
+void
+__glXQueueInit(void)
+{
+    if (!enableGLXThreads)
+        return;
+
+    RegisterBlockAndWakeupHandlers(glxQueueBlockHandler,
+                                   glxQueueWakeupHandler, NULL);
+    LogMessage(X_INFO, "GLX: running indirect rendering on render threads\n");
+}
+
+#else                           /* GLX_RENDER_THREADS */
+
+Bool
+__glXQueueThreadSelf(void)
+{
+    return FALSE;
+}
+
+void
+__glXLockGL(void)
+{
+}
+
+void
+__glXUnlockGL(void)
+{
+}
+
+Bool
+__glXQueueCallMain(void (*func) (void *), void *data)
+{
+    return FALSE;
+}
+
+Bool
+__glXQueueWanted(__GLXcontext * cx)
+{
+    return FALSE;
+}
+
+void
+__glXQueueCommand(__GLXcontext * cx, __GLXdispatchRenderProcPtr proc,
+                  GLbyte * cmd, int cmdlen, int hdrlen)
+{
+    (*proc) (cmd + hdrlen);
+}
+
+void
+__glXQueueSync(__GLXcontext * cx)
+{
+}
+
+void
+__glXQueueSyncAll(void)
+{
+}
+
+void
+__glXQueueDrawableGone(__GLXdrawable * drawable)
+{
+}
+
+void
+__glXQueueDestroy(__GLXcontext * cx)
+{
+}
+
+void
+__glXQueueInit(void)
+{
+}
+
+#endif                          /* GLX_RENDER_THREADS */
@@ -45,6 +45,7 @@
 #include <extnsionst.h>
 #include <resource.h>
 #include <scrnintstr.h>
+#include <damage.h>
 
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -60,6 +61,7 @@ typedef XID GLXDrawable;
 typedef struct __GLXclientStateRec __GLXclientState;
 typedef struct __GLXdrawable __GLXdrawable;
 typedef struct __GLXcontext __GLXcontext;
+typedef struct __GLXrenderQueue __GLXrenderQueue;
 
 #include "glxscreens.h"
 #include "glxdrawable.h"
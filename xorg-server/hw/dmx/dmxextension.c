@@ -1174,10 +1174,11 @@ dmxBERestoreRenderGlyph(void *value, XID id, void *n)
     }
 
     /* Now for the complex part, restore the glyph data */
+    FlushGlyphHash(&glyphSet->hash);
     table = glyphSet->hash.table;
 
     /* We need to know how much memory to allocate for this part */
-    for (i = 0; i < glyphSet->hash.hashSet->size; i++) {
+    for (i = 0; i < glyphSet->hash.size; i++) {
         GlyphRefPtr gr = &table[i];
         GlyphPtr gl = gr->glyph;
 
@@ -1195,7 +1196,7 @@ dmxBERestoreRenderGlyph(void *value, XID id, void *n)
     ctr = 0;
 
     /* Fill the allocated memory with the proper data */
-    for (i = 0; i < glyphSet->hash.hashSet->size; i++) {
+    for (i = 0; i < glyphSet->hash.size; i++) {
         GlyphRefPtr gr = &table[i];
         GlyphPtr gl = gr->glyph;
 
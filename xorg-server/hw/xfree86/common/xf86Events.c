@@ -312,6 +312,8 @@ xf86SigioReadInput(int fd, void *closure)
 void
 xf86AddEnabledDevice(InputInfoPtr pInfo)
 {
+    if (InputThreadRegisterDev(pInfo->fd, xf86SigioReadInput, pInfo))
+        return;
     if (!xf86InstallSIGIOHandler(pInfo->fd, xf86SigioReadInput, pInfo)) {
         AddEnabledDevice(pInfo->fd);
     }
@@ -324,6 +326,8 @@ xf86AddEnabledDevice(InputInfoPtr pInfo)
 void
 xf86RemoveEnabledDevice(InputInfoPtr pInfo)
 {
+    if (InputThreadUnregisterDev(pInfo->fd))
+        return;
     if (!xf86RemoveSIGIOHandler(pInfo->fd)) {
         RemoveEnabledDevice(pInfo->fd);
     }
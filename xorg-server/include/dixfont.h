@@ -138,6 +138,9 @@ extern _X_EXPORT Bool QueryTextExtents(FontPtr /*pFont */ ,
 
 extern _X_EXPORT Bool ParseGlyphCachingMode(char * /*str */ );
 
+/* write fonts.idx into font directories (libXfont) */
+extern _X_EXPORT Bool FontFileWriteIndexes;
+
 extern _X_EXPORT void InitGlyphCaching(void);
 
 extern _X_EXPORT void SetGlyphCachingMode(int /*newmode */ );
@@ -112,6 +112,8 @@ typedef struct _Client {
 #if XTRANS_SEND_FDS
     int req_fds;
 #endif
+    int smart_weight;           /* share under fair scheduling, 0 if unset */
+    long smart_deficit;         /* fair scheduling credit in usec */
 } ClientRec;
 
 #if XTRANS_SEND_FDS
@@ -131,6 +133,7 @@ extern _X_EXPORT long SmartScheduleInterval;
 extern _X_EXPORT long SmartScheduleSlice;
 extern _X_EXPORT long SmartScheduleMaxSlice;
 extern _X_EXPORT Bool SmartScheduleDisable;
+extern _X_EXPORT Bool SmartScheduleFair;
 extern _X_EXPORT void
 SmartScheduleStartTimer(void);
 extern _X_EXPORT void
@@ -142,6 +145,9 @@ SmartScheduleStopTimer(void);
 extern _X_EXPORT void
 SmartScheduleInit(void);
 
+extern _X_EXPORT Bool
+SmartScheduleAddClass(const char *spec);
+
 /* This prototype is used pervasively in Xext, dix */
 #define DISPATCH_PROC(func) int func(ClientPtr /* client */)
 
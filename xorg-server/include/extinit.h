@@ -103,6 +103,8 @@ extern void RenderExtensionInit(void);
 #include <X11/extensions/XResproto.h>
 extern _X_EXPORT Bool noResExtension;
 extern void ResExtensionInit(void);
+extern _X_EXPORT Bool noReqStatsExtension;
+extern void ReqStatsExtensionInit(void);
 #endif
 
 #if defined(SCREENSAVER)
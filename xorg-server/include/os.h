@@ -115,6 +115,13 @@ extern _X_EXPORT void SetCriticalOutputPending(void);
 extern _X_EXPORT int WriteToClient(ClientPtr /*who */ , int /*count */ ,
                                    const void * /*buf */ );
 
+typedef void (*OsReleaseProcPtr) (void * /*data */ );
+
+extern _X_EXPORT int WriteToClientNoCopy(ClientPtr /*who */ , int /*count */ ,
+                                         const void * /*buf */ ,
+                                         OsReleaseProcPtr /*release */ ,
+                                         void * /*data */ );
+
 extern _X_EXPORT void ResetOsBuffers(void);
 
 extern _X_EXPORT int TransIsListening(char *protocol);
@@ -323,6 +330,42 @@ extern _X_EXPORT void
 OsAbort(void)
     _X_NORETURN;
 
+/*
+ * Input thread (-inputthread).  Devices registered here are read from a
+ * separate thread that feeds the mi event queue and wakes the main loop,
+ * so input keeps flowing while clients are being dispatched.  Code that
+ * would block SIGIO against device readers takes the input lock instead;
+ * OsBlockSIGIO and OsBlockSignals do so already.
+ */
+typedef void (*InputReadProcPtr) (int /*fd */ , void * /*data */ );
+
+extern _X_EXPORT Bool InputThreadEnable;
+
+extern _X_EXPORT Bool
+InputThreadRegisterDev(int /*fd */ , InputReadProcPtr /*readInputProc */ ,
+                       void * /*readInputArgs */ );
+
+extern _X_EXPORT Bool
+InputThreadUnregisterDev(int /*fd */ );
+
+extern _X_EXPORT Bool
+InputThreadSelf(void);
+
+extern _X_EXPORT void
+InputThreadLock(void);
+
+extern _X_EXPORT void
+InputThreadUnlock(void);
+
+extern void
+InputThreadForceUnlock(void);
+
+extern void
+InputThreadInit(void);
+
+extern void
+InputThreadFini(void);
+
 #if !defined(WIN32)
 extern _X_EXPORT int
 System(const char *);
@@ -0,0 +1,74 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _OSPOLL_H_
+#define _OSPOLL_H_
+
+#include <dix-config.h>
+
+/*
+ * Event backend for WaitForSomething.  File descriptors are registered
+ * once with a per-fd callback and then switched on and off with
+ * ospoll_listen/ospoll_mute, so the cost of a wakeup is proportional
+ * to the number of ready descriptors rather than the highest one.
+ *
+ * epoll is used where available, with a poll() fallback.  Windows keeps
+ * using select() directly from WaitForSomething.
+ */
+
+#ifndef WIN32
+
+#define X_NOTIFY_NONE   0x0
+#define X_NOTIFY_READ   0x1
+#define X_NOTIFY_WRITE  0x2
+#define X_NOTIFY_ERROR  0x4     /* only reported, never listened for */
+
+struct ospoll;
+
+typedef void (*ospoll_callback_ptr) (int fd, int xevents, void *data);
+
+struct ospoll *
+ospoll_create(void);
+
+void
+ospoll_destroy(struct ospoll *ospoll);
+
+Bool
+ospoll_add(struct ospoll *ospoll, int fd,
+           ospoll_callback_ptr callback, void *data);
+
+void
+ospoll_remove(struct ospoll *ospoll, int fd);
+
+Bool
+ospoll_contains(struct ospoll *ospoll, int fd);
+
+void
+ospoll_listen(struct ospoll *ospoll, int fd, int xevents);
+
+void
+ospoll_mute(struct ospoll *ospoll, int fd, int xevents);
+
+int
+ospoll_wait(struct ospoll *ospoll, int timeout);
+
+#endif
+
+#endif /* _OSPOLL_H_ */
@@ -145,6 +145,10 @@
 #define SERVER_XKB_MAJOR_VERSION		1
 #define SERVER_XKB_MINOR_VERSION		0
 
+/* Request statistics */
+#define SERVER_REQSTATS_MAJOR_VERSION		1
+#define SERVER_REQSTATS_MINOR_VERSION		0
+
 /* Resource */
 #define SERVER_XRES_MAJOR_VERSION		1
 #define SERVER_XRES_MINOR_VERSION		2
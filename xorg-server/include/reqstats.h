@@ -0,0 +1,99 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _REQSTATS_H_
+#define _REQSTATS_H_
+
+#include "misc.h"
+#include "dixstruct.h"
+
+/*
+ * Request statistics, collected by Dispatch when the server runs with
+ * -reqstats (or once a client turns them on through X-Request-Stats).
+ *
+ * For every core request and every extension minor opcode the number of
+ * requests, the time spent in them and a histogram of their latencies is
+ * kept; bucket n counts requests that took [2^n, 2^(n+1)) nanoseconds.
+ * For every client the requests, time and bytes in both directions are
+ * kept, along with its slowest request, which is usually enough to tell
+ * which client holds everyone else up, and the input bytes the server
+ * had to copy again after reading them.
+ */
+
+#define REQSTATS_BUCKETS        32
+#define REQSTATS_MAX_MINOR      256     /* higher minors share the last */
+
+typedef struct _ReqStatsOp {
+    CARD64 count;
+    CARD64 time;                /* ns */
+    CARD64 max;                 /* ns */
+    CARD32 hist[REQSTATS_BUCKETS];
+} ReqStatsOpRec, *ReqStatsOpPtr;
+
+typedef struct _ReqStatsClient {
+    CARD64 requests;
+    CARD64 time;                /* ns spent in this client's requests */
+    CARD64 bytesIn;
+    CARD64 bytesOut;
+    CARD64 bytesMoved;          /* input copied around after reading */
+    CARD64 max;                 /* slowest request, ns */
+    CARD8 maxMajor;
+    CARD16 maxMinor;
+} ReqStatsClientRec, *ReqStatsClientPtr;
+
+extern Bool ReqStatsEnabled;
+
+extern CARD64 ReqStatsNow(void);
+
+extern void ReqStatsRecord(ClientPtr client, int major, int minor,
+                           int bytes, CARD64 start);
+
+extern void ReqStatsClientInit(ClientPtr client);
+
+extern void ReqStatsReset(void);
+
+extern void ReqStatsSetEnabled(Bool enable);
+
+/* NULL if no request with that opcode was seen */
+extern ReqStatsOpPtr ReqStatsGetOp(int major, int minor);
+
+extern ReqStatsClientPtr ReqStatsGetClient(int index);
+
+extern void ReqStatsDump(void);
+
+extern void ReqStatsInit(void);
+
+/* Called from WriteToClient, must stay cheap */
+static inline void
+ReqStatsBytesOut(ClientPtr client, int count)
+{
+    if (ReqStatsEnabled && count > 0)
+        ReqStatsGetClient(client->index)->bytesOut += count;
+}
+
+/* Called when ReadRequestFromClient copies input it has read already */
+static inline void
+ReqStatsInputMoved(ClientPtr client, unsigned long count)
+{
+    if (ReqStatsEnabled)
+        ReqStatsGetClient(client->index)->bytesMoved += count;
+}
+
+#endif /* _REQSTATS_H_ */
@@ -272,5 +272,16 @@ extern _X_EXPORT unsigned XkmReadFile(FILE * /* file */ ,
                                       XkbDescPtr *      /* result */
     );
 
+extern _X_EXPORT unsigned XkmReadBuffer(const void * /* data */ ,
+                                        size_t /* size */ ,
+                                        unsigned /* need */ ,
+                                        unsigned /* want */ ,
+                                        XkbDescPtr *    /* result */
+    );
+
+extern _X_EXPORT void *XkmSlurpFile(FILE * /* file */ ,
+                                    size_t *    /* sizeRtrn */
+    );
+
 _XFUNCPROTOEND
 #endif                          /* _XKBFILE_H_ */
@@ -87,6 +87,22 @@ typedef struct _EventQueue {
 
 static EventQueueRec miEventQueue;
 
+/*
+ * With the input thread, head is only written by the main thread and
+ * tail only by whoever holds the input lock, so the queue is handed
+ * between them without a lock: an event slot is filled before tail is
+ * published and copied out before head moves past it.
+ */
+#ifdef INPUTTHREAD
+#define QueueLoad(field) \
+    __atomic_load_n(&miEventQueue.field, __ATOMIC_ACQUIRE)
+#define QueueStore(field, value) \
+    __atomic_store_n(&miEventQueue.field, (value), __ATOMIC_RELEASE)
+#else
+#define QueueLoad(field) (miEventQueue.field)
+#define QueueStore(field, value) (miEventQueue.field = (value))
+#endif
+
 #ifdef XQUARTZ
 #include  <pthread.h>
 static pthread_mutex_t miEventQueueMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -143,13 +159,13 @@ mieqGrowQueue(EventQueuePtr eventQueue, size_t new_nevents)
         return FALSE;
     }
 
-    n_enqueued = mieqNumEnqueued(eventQueue);
-
     /* We block signals, so an mieqEnqueue triggered by SIGIO does not
      * write to our queue as we are modifying it.
      */
     OsBlockSignals();
 
+    n_enqueued = mieqNumEnqueued(eventQueue);
+
     /* First copy the existing events */
     first_hunk = eventQueue->nevents - eventQueue->head;
     memcpy(new_events,
@@ -243,7 +259,8 @@ mieqReservedCandidate(InternalEvent *e)
 void
 mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
 {
-    unsigned int oldtail = miEventQueue.tail;
+    unsigned int oldtail;
+    unsigned int head;
     InternalEvent *evt;
     int isMotion = 0;
     int evlen;
@@ -254,17 +271,28 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
     wait_for_server_init();
     pthread_mutex_lock(&miEventQueueMutex);
 #endif
+#ifdef INPUTTHREAD
+    /* keeps this the only producer, the input thread holds it already */
+    if (InputThreadEnable)
+        InputThreadLock();
+#endif
 
     verify_internal_event(e);
 
-    n_enqueued = mieqNumEnqueued(&miEventQueue);
+    oldtail = miEventQueue.tail;
+    head = QueueLoad(head);
+    n_enqueued = oldtail - head + miEventQueue.nevents;
+    if (n_enqueued >= miEventQueue.nevents)
+        n_enqueued -= miEventQueue.nevents;
 
     /* avoid merging events from different devices */
     if (e->any.type == ET_Motion)
         isMotion = pDev->id;
 
+    /* The main thread may be reading the last event at any moment when
+     * the input thread is running, so it can't be rewritten in place. */
     if (isMotion && isMotion == miEventQueue.lastMotion &&
-        oldtail != miEventQueue.head) {
+        oldtail != head && !InputThreadEnable) {
         oldtail = (oldtail - 1) % miEventQueue.nevents;
     }
     else if ((n_enqueued + 1 == miEventQueue.nevents) ||
@@ -296,6 +324,10 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
             xorg_backtrace();
         }
 
+#ifdef INPUTTHREAD
+        if (InputThreadEnable)
+            InputThreadUnlock();
+#endif
 #ifdef XQUARTZ
         pthread_mutex_unlock(&miEventQueueMutex);
 #endif
@@ -318,7 +350,11 @@ mieqEnqueue(DeviceIntPtr pDev, InternalEvent *e)
     miEventQueue.events[oldtail].pDev = pDev;
 
     miEventQueue.lastMotion = isMotion;
-    miEventQueue.tail = (oldtail + 1) % miEventQueue.nevents;
+    QueueStore(tail, (oldtail + 1) % miEventQueue.nevents);
+#ifdef INPUTTHREAD
+    if (InputThreadEnable)
+        InputThreadUnlock();
+#endif
 #ifdef XQUARTZ
     pthread_mutex_unlock(&miEventQueueMutex);
 #endif
@@ -579,6 +615,7 @@ mieqProcessInputEvents(void)
     InternalEvent event;
     DeviceIntPtr dev = NULL, master = NULL;
     size_t n_enqueued;
+    size_t dropped;
 
 #ifdef XQUARTZ
     pthread_mutex_lock(&miEventQueueMutex);
@@ -595,22 +632,27 @@ mieqProcessInputEvents(void)
         }
     }
 
-    if (miEventQueue.dropped) {
+    /* mieqEnqueue counts the drops on the input thread or from SIGIO */
+    OsBlockSignals();
+    dropped = miEventQueue.dropped;
+    miEventQueue.dropped = 0;
+    OsReleaseSignals();
+
+    if (dropped) {
         ErrorF("[mi] EQ processing has resumed after %lu dropped events.\n",
-               (unsigned long) miEventQueue.dropped);
+               (unsigned long) dropped);
         ErrorF
             ("[mi] This may be caused my a misbehaving driver monopolizing the server's resources.\n");
-        miEventQueue.dropped = 0;
     }
 
-    while (miEventQueue.head != miEventQueue.tail) {
+    while (miEventQueue.head != QueueLoad(tail)) {
         e = &miEventQueue.events[miEventQueue.head];
 
         event = *e->events;
         dev = e->pDev;
         screen = e->pScreen;
 
-        miEventQueue.head = (miEventQueue.head + 1) % miEventQueue.nevents;
+        QueueStore(head, (miEventQueue.head + 1) % miEventQueue.nevents);
 
 #ifdef XQUARTZ
         pthread_mutex_unlock(&miEventQueueMutex);
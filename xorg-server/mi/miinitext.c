@@ -154,6 +154,7 @@ static ExtensionToggle ExtensionToggleList[] = {
     {"SECURITY", &noSecurityExtension},
 #endif
 #ifdef RES
+    {"X-Request-Stats", &noReqStatsExtension},
     {"X-Resource", &noResExtension},
 #endif
 #ifdef XF86BIGFONT
@@ -298,6 +299,7 @@ static const ExtensionModule staticExtensions[] = {
 #endif
 #ifdef RES
     {ResExtensionInit, XRES_NAME, &noResExtension},
+    {ReqStatsExtensionInit, "X-Request-Stats", &noReqStatsExtension},
 #endif
 #ifdef XV
     {XvExtensionInit, XvName, &noXvExtension},
@@ -24,7 +24,9 @@
 #include <dix-config.h>
 #endif
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include    <X11/X.h>
 #include    "scrnintstr.h"
@@ -119,6 +121,181 @@ getDrawableDamageRef(DrawablePtr pDrawable)
     DamagePtr	*pPrev = (DamagePtr *) \
 	dixLookupPrivateAddr(&(pWindow)->devPrivates, damageWinPrivateKey)
 
+/*
+ * A listener can limit the number of boxes its damage is kept in with
+ * DamageSetMaxRects.  When the region grows past that, it is coalesced
+ * row by row: a row is a band of the region, boxes with the same y1 and
+ * y2.  Neighbouring rows are merged into one spanning both, and the boxes
+ * in a row into their bounding box, cheapest first: a merge costs the
+ * area it draws over that was not damaged, per box it saves.  Each pass
+ * over the rows allows twice the cost of the one before until few enough
+ * boxes are left.  Rows never overlap, so the region made of them has
+ * just those boxes.  If the extents would draw over no more than the
+ * damage itself covers, they are used right away.
+ */
+static int64_t
+damageRowArea(const BoxRec * pRow, int n)
+{
+    int64_t width = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        width += pRow[i].x2 - pRow[i].x1;
+    return width * (pRow->y2 - pRow->y1);
+}
+
+/*
+ * Merge the boxes of rows a and b into pOut, spanning both rows
+ */
+static int
+damageMergeRows(const BoxRec * pA, int nA, const BoxRec * pB, int nB,
+                BoxPtr pOut)
+{
+    short y1 = pA->y1, y2 = pB->y2;
+    const BoxRec *pNext;
+    int n = 0;
+
+    while (nA || nB) {
+        if (!nB || (nA && pA->x1 <= pB->x1)) {
+            pNext = pA++;
+            nA--;
+        }
+        else {
+            pNext = pB++;
+            nB--;
+        }
+        if (n && pNext->x1 <= pOut[n - 1].x2) {
+            if (pNext->x2 > pOut[n - 1].x2)
+                pOut[n - 1].x2 = pNext->x2;
+        }
+        else {
+            pOut[n].x1 = pNext->x1;
+            pOut[n].x2 = pNext->x2;
+            pOut[n].y1 = y1;
+            pOut[n].y2 = y2;
+            n++;
+        }
+    }
+    return n;
+}
+
+/*
+ * Merge neighbouring boxes of a row costing at most threshold
+ */
+static int
+damageMergeSpans(BoxPtr pRow, int n, int64_t threshold, int *pCount,
+                 int target)
+{
+    int64_t height = pRow->y2 - pRow->y1;
+    int i, last = 0;
+
+    for (i = 1; i < n; i++) {
+        if (*pCount > target &&
+            (pRow[i].x1 - pRow[last].x2) * height <= threshold) {
+            pRow[last].x2 = pRow[i].x2;
+            (*pCount)--;
+        }
+        else
+            pRow[++last] = pRow[i];
+    }
+    return last + 1;
+}
+
+/*
+ * One pass over the rows in pIn, writing them to pOut merged where that
+ * costs at most threshold.  Returns the number of boxes in pOut.
+ */
+static int
+damageCoalescePass(const BoxRec * pIn, int nIn, BoxPtr pOut, BoxPtr pTmp,
+                   int64_t threshold, int *pCount, int target)
+{
+    BoxPtr pCur = pOut;
+    int64_t cost;
+    int nCur = 0, nOut = 0, nMerged, saved, i, n;
+
+    for (i = 0; i < nIn; i += n) {
+        for (n = 1; i + n < nIn && pIn[i + n].y1 == pIn[i].y1; n++);
+        if (nCur) {
+            nMerged = damageMergeRows(pCur, nCur, pIn + i, n, pTmp);
+            saved = nCur + n - nMerged;
+            cost = damageRowArea(pTmp, nMerged) - damageRowArea(pCur, nCur) -
+                damageRowArea(pIn + i, n);
+            /* merging rows may save no boxes by itself, but let the
+             * boxes of the new row be merged */
+            if (*pCount > target && cost <= threshold * max(saved, 1)) {
+                memcpy(pCur, pTmp, nMerged * sizeof(BoxRec));
+                nCur = nMerged;
+                *pCount -= saved;
+                continue;
+            }
+            nOut += damageMergeSpans(pCur, nCur, threshold, pCount, target);
+            pCur = pOut + nOut;
+        }
+        memcpy(pCur, pIn + i, n * sizeof(BoxRec));
+        nCur = n;
+    }
+    return nOut + damageMergeSpans(pCur, nCur, threshold, pCount, target);
+}
+
+static void
+damageCoalesce(DamagePtr pDamage)
+{
+    damageScrPriv(pDamage->pScreen);
+    RegionPtr pRegion = &pDamage->damage;
+    int nBoxes = RegionNumRects(pRegion);
+    BoxRec extents = *RegionExtents(pRegion);
+    BoxPtr pBoxes, pIn, pOut, pTmp;
+    int64_t area, threshold;
+    int i, n, count;
+
+    pScrPriv->coalesces++;
+    area = 0;
+    for (i = 0; i < nBoxes; i++)
+        area += damageRowArea(RegionRects(pRegion) + i, 1);
+
+    if (pDamage->maxRects == 1 || damageRowArea(&extents, 1) - area <= area ||
+        !(pBoxes = malloc(3 * nBoxes * sizeof(BoxRec)))) {
+        RegionReset(pRegion, &extents);
+        pScrPriv->coalescedRects += nBoxes - 1;
+        return;
+    }
+
+    pIn = pBoxes;
+    pOut = pBoxes + nBoxes;
+    pTmp = pBoxes + 2 * nBoxes;
+    memcpy(pIn, RegionRects(pRegion), nBoxes * sizeof(BoxRec));
+    /* start at the average box, the overdraw that doubles the damage if
+     * every box is merged once */
+    threshold = max(area / nBoxes, 1);
+    n = count = nBoxes;
+    while (count > pDamage->maxRects) {
+        BoxPtr pSwap = pIn;
+
+        n = damageCoalescePass(pIn, n, pOut, pTmp, threshold, &count,
+                               pDamage->maxRects);
+        pIn = pOut;
+        pOut = pSwap;
+        threshold *= 2;
+    }
+    RegionUninit(pRegion);
+    if (!RegionInitBoxes(pRegion, pIn, n))
+        RegionReset(pRegion, &extents);
+    free(pBoxes);
+    pScrPriv->coalescedRects += nBoxes - RegionNumRects(pRegion);
+}
+
+/*
+ * Add pRegion to the damage accumulated in pDamage
+ */
+static void
+damageAccumulate(DamagePtr pDamage, RegionPtr pRegion)
+{
+    RegionUnion(&pDamage->damage, &pDamage->damage, pRegion);
+    if (pDamage->maxRects &&
+        RegionNumRects(&pDamage->damage) > pDamage->maxRects)
+        damageCoalesce(pDamage);
+}
+
 #if DAMAGE_DEBUG_ENABLE
 static void
 _damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
@@ -139,6 +316,7 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
     RegionPtr pDamageRegion;
     RegionRec pixClip;
     int draw_x, draw_y;
+    CARD64 start;
 
 #ifdef COMPOSITE
     int screen_x = 0, screen_y = 0;
@@ -148,6 +326,8 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
     if (!RegionNotEmpty(pRegion))
         return;
 
+    start = GetTimeInMicros();
+
 #ifdef COMPOSITE
     /*
      * When drawing to a pixmap which is storing window contents,
@@ -253,6 +433,9 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
         if (draw_x || draw_y)
             RegionTranslate(pDamageRegion, -draw_x, -draw_y);
 
+        pScrPriv->appends++;
+        pScrPriv->appendRects += RegionNumRects(pDamageRegion);
+
         /* Store damage region if needed after submission. */
         if (pDamage->reportAfter)
             RegionUnion(&pDamage->pendingDamage,
@@ -263,7 +446,7 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, pDamageRegion);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+                damageAccumulate(pDamage, pDamageRegion);
         }
 
         /*
@@ -278,12 +461,20 @@ damageRegionAppend(DrawablePtr pDrawable, RegionPtr pRegion, Bool clip,
 #endif
 
     RegionUninit(&clippedRec);
+    pScrPriv->appendMicros += GetTimeInMicros() - start;
 }
 
 static void
 damageRegionProcessPending(DrawablePtr pDrawable)
 {
     drawableDamage(pDrawable);
+    DamageScrPrivPtr pScrPriv;
+    CARD64 start;
+
+    if (!pDamage)
+        return;
+    pScrPriv = damageGetScrPriv(pDrawable->pScreen);
+    start = GetTimeInMicros();
 
     for (; pDamage != NULL; pDamage = pDamage->pNext) {
         if (pDamage->reportAfter) {
@@ -291,14 +482,14 @@ damageRegionProcessPending(DrawablePtr pDrawable)
             if (pDamage->damageReport)
                 DamageReportDamage(pDamage, &pDamage->pendingDamage);
             else
-                RegionUnion(&pDamage->damage, &pDamage->damage,
-                            &pDamage->pendingDamage);
+                damageAccumulate(pDamage, &pDamage->pendingDamage);
         }
 
         if (pDamage->reportAfter)
             RegionEmpty(&pDamage->pendingDamage);
     }
 
+    pScrPriv->appendMicros += GetTimeInMicros() - start;
 }
 
 #if DAMAGE_DEBUG_ENABLE
@@ -1566,6 +1757,14 @@ damageCloseScreen(ScreenPtr pScreen)
 {
     damageScrPriv(pScreen);
 
+    if (pScrPriv->appends)
+        LogMessageVerb(X_INFO, 3, "Damage: screen %d: %lu regions (%lu "
+                       "boxes) appended in %llu ms, %lu coalesces removed "
+                       "%lu boxes\n", pScreen->myNum, pScrPriv->appends,
+                       pScrPriv->appendRects,
+                       (unsigned long long) pScrPriv->appendMicros / 1000,
+                       pScrPriv->coalesces, pScrPriv->coalescedRects);
+
     unwrap(pScrPriv, pScreen, DestroyPixmap);
     unwrap(pScrPriv, pScreen, CreateGC);
     unwrap(pScrPriv, pScreen, CopyWindow);
@@ -1657,6 +1856,11 @@ DamageSetup(ScreenPtr pScreen)
 
     pScrPriv->internalLevel = 0;
     pScrPriv->pScreenDamage = 0;
+    pScrPriv->appends = 0;
+    pScrPriv->appendRects = 0;
+    pScrPriv->coalesces = 0;
+    pScrPriv->coalescedRects = 0;
+    pScrPriv->appendMicros = 0;
 
     wrap(pScrPriv, pScreen, DestroyPixmap, damageDestroyPixmap);
     wrap(pScrPriv, pScreen, CreateGC, damageCreateGC);
@@ -1699,6 +1903,7 @@ DamageCreate(DamageReportFunc damageReport,
     pDamage->isWindow = FALSE;
     pDamage->pDrawable = 0;
     pDamage->reportAfter = FALSE;
+    pDamage->maxRects = 0;
 
     pDamage->damageReport = damageReport;
     pDamage->damageDestroy = damageDestroy;
@@ -1892,6 +2097,15 @@ DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter)
     pDamage->reportAfter = reportAfter;
 }
 
+void
+DamageSetMaxRects(DamagePtr pDamage, int maxRects)
+{
+    pDamage->maxRects = maxRects > 0 ? maxRects : 0;
+    if (pDamage->maxRects &&
+        RegionNumRects(&pDamage->damage) > pDamage->maxRects)
+        damageCoalesce(pDamage);
+}
+
 DamageScreenFuncsPtr
 DamageGetScreenFuncs(ScreenPtr pScreen)
 {
@@ -1908,21 +2122,33 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
 
     switch (pDamage->damageLevel) {
     case DamageReportRawRegion:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         (*pDamage->damageReport) (pDamage, pDamageRegion, pDamage->closure);
         break;
     case DamageReportDeltaRegion:
         RegionNull(&tmpRegion);
         RegionSubtract(&tmpRegion, pDamageRegion, &pDamage->damage);
         if (RegionNotEmpty(&tmpRegion)) {
-            RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+            if (pDamage->maxRects) {
+                /* Report what coalescing added as well, later damage
+                 * there would not be a delta any more */
+                RegionRec oldDamage;
+
+                RegionNull(&oldDamage);
+                RegionCopy(&oldDamage, &pDamage->damage);
+                damageAccumulate(pDamage, pDamageRegion);
+                RegionSubtract(&tmpRegion, &pDamage->damage, &oldDamage);
+                RegionUninit(&oldDamage);
+            }
+            else
+                RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
             (*pDamage->damageReport) (pDamage, &tmpRegion, pDamage->closure);
         }
         RegionUninit(&tmpRegion);
         break;
     case DamageReportBoundingBox:
         tmpBox = *RegionExtents(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         if (!BOX_SAME(&tmpBox, RegionExtents(&pDamage->damage))) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
@@ -1930,14 +2156,14 @@ DamageReportDamage(DamagePtr pDamage, RegionPtr pDamageRegion)
         break;
     case DamageReportNonEmpty:
         was_empty = !RegionNotEmpty(&pDamage->damage);
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         if (was_empty && RegionNotEmpty(&pDamage->damage)) {
             (*pDamage->damageReport) (pDamage, &pDamage->damage,
                                       pDamage->closure);
         }
         break;
     case DamageReportNone:
-        RegionUnion(&pDamage->damage, &pDamage->damage, pDamageRegion);
+        damageAccumulate(pDamage, pDamageRegion);
         break;
     }
 }
@@ -110,6 +110,12 @@ extern _X_EXPORT void
 extern _X_EXPORT void
  DamageSetReportAfterOp(DamagePtr pDamage, Bool reportAfter);
 
+/* Keep the damage accumulated in pDamage to at most maxRects boxes, merging
+ * nearby boxes (drawing over some undamaged area) when it grows past that.
+ * 0, the default, keeps the exact region. */
+extern _X_EXPORT void
+ DamageSetMaxRects(DamagePtr pDamage, int maxRects);
+
 extern _X_EXPORT DamageScreenFuncsPtr DamageGetScreenFuncs(ScreenPtr);
 
 #endif                          /* _DAMAGE_H_ */
@@ -50,6 +50,7 @@ typedef struct _damage {
     RegionRec pendingDamage;    /* will be flushed post submission at the latest */
     ScreenPtr pScreen;
     PrivateRec *devPrivates;
+    int maxRects;               /* coalesce damage past this many boxes, 0: never */
 } DamageRec;
 
 typedef struct _damageScrPriv {
@@ -73,6 +74,13 @@ typedef struct _damageScrPriv {
 
     /* Table of wrappable function pointers */
     DamageScreenFuncsRec funcs;
+
+    /* Statistics, logged when the screen is closed */
+    unsigned long appends;      /* regions added to a listener */
+    unsigned long appendRects;  /* boxes in them */
+    unsigned long coalesces;    /* times a listener's damage was coalesced */
+    unsigned long coalescedRects;       /* boxes merged away doing it */
+    CARD64 appendMicros;        /* time spent appending and reporting */
 } DamageScrPrivRec, *DamageScrPrivPtr;
 
 typedef struct _damageGCPriv {
@@ -49,6 +49,10 @@ static DevPrivateKeyRec shadowScrPrivateKeyRec;
     real->mem = priv->mem; \
 }
 
+/* The update functions copy the damage box by box; more boxes than this
+ * are merged, copying some undamaged pixels instead */
+#define SHADOW_DAMAGE_MAX_RECTS 32
+
 static void
 shadowRedisplay(ScreenPtr pScreen)
 {
@@ -129,6 +133,7 @@ shadowSetup(ScreenPtr pScreen)
         free(pBuf);
         return FALSE;
     }
+    DamageSetMaxRects(pBuf->pDamage, SHADOW_DAMAGE_MAX_RECTS);
 
     wrap(pBuf, pScreen, CloseScreen);
     wrap(pBuf, pScreen, GetImage);
@@ -125,6 +125,65 @@ static void DoTimer(OsTimerPtr timer, CARD32 now, volatile OsTimerPtr *prev);
 static void CheckAllTimers(void);
 static volatile OsTimerPtr timers = NULL;
 
+#ifndef WIN32
+/* Convert a select() style timeout to milliseconds, rounding up so
+ * that short sleeps don't turn into a busy loop */
+static int
+WaitTimeToMillis(struct timeval *wt)
+{
+    if (!wt)
+        return -1;
+    return wt->tv_sec * MILLI_PER_SECOND +
+        (wt->tv_usec + (1000000 / MILLI_PER_SECOND) - 1) /
+        (1000000 / MILLI_PER_SECOND);
+}
+
+/* ospoll callback for descriptors a block handler put in the mask */
+static void
+BlockHandlerFdReady(int fd, int xevents, void *data)
+{
+    if (xevents & (X_NOTIFY_READ | X_NOTIFY_ERROR))
+        FD_SET(fd, &LastSelectMask);
+}
+
+/*
+ * Block handlers may still add descriptors of their own to the select
+ * mask they are handed.  Those are only watched for the one wait, as
+ * nothing tells us when they are closed.  Descriptors registered already,
+ * such as devices and general sockets, keep their own callbacks, so only
+ * the ones added here are removed again.
+ */
+static void
+PollBlockHandlerFds(fd_set *fds, Bool add)
+{
+    static fd_set added;
+    int i, fd;
+    fd_mask mask;
+
+    if (!XFD_ANYSET(fds))
+        return;
+    for (i = 0; i < howmany(XFD_SETSIZE, NFDBITS); i++) {
+        mask = fds->fds_bits[i];
+        while (mask) {
+            fd = mffs(mask) - 1;
+            mask &= ~((fd_mask) 1 << fd);
+            fd += i * (sizeof(fd_mask) * 8);
+            if (!add) {
+                if (FD_ISSET(fd, &added)) {
+                    ospoll_remove(server_poll, fd);
+                    FD_CLR(fd, &added);
+                }
+            }
+            else if (!ospoll_contains(server_poll, fd) &&
+                     ospoll_add(server_poll, fd, BlockHandlerFdReady, NULL)) {
+                ospoll_listen(server_poll, fd, X_NOTIFY_READ);
+                FD_SET(fd, &added);
+            }
+        }
+    }
+}
+#endif
+
 /*****************
  * WaitForSomething:
  *     Make the server suspend until there is
@@ -139,6 +198,9 @@ static volatile OsTimerPtr timers = NULL;
  *     saved, depending on the hardware).  So, WaitForSomething()
  *     has to handle this also (that's why the select() has a timeout.
  *     For more info on ClientsWithInput, see ReadRequestFromClient().
+ *     On everything but Windows the wait itself goes through the ospoll
+ *     event backend instead of select(); descriptors must be registered
+ *     through connection.c (AddGeneralSocket and friends) to be seen.
  *     pClientsReady is an array to store ready client->index values into.
  *****************/
 
@@ -149,7 +211,11 @@ WaitForSomething(int *pClientsReady)
     struct timeval waittime, *wt;
     INT32 timeout = 0;
     fd_set clientsReadable;
+#ifdef WIN32
     fd_set clientsWritable;
+#else
+    fd_set blockHandlerFds;
+#endif
     int curclient;
     int selecterr;
     static int nready;
@@ -222,6 +288,25 @@ WaitForSomething(int *pClientsReady)
         if (NewOutputPending)
             FlushAllOutput();
         /* keep this check close to select() call to minimize race */
+#ifndef WIN32
+        /* ospoll callbacks fill in LastSelectMask and handle writable
+         * clients themselves, see connection.c.  Whatever the block
+         * handlers added beyond the server's own descriptors is polled
+         * along with them. */
+        XFD_COPYSET(&LastSelectMask, &blockHandlerFds);
+        XFD_UNSET(&blockHandlerFds, &AllSockets);
+        XFD_UNSET(&blockHandlerFds, &AllClients);
+        FD_ZERO(&LastSelectMask);
+        if (dispatchException)
+            i = -1;
+        else {
+            PollBlockHandlerFds(&blockHandlerFds, TRUE);
+            i = ospoll_wait(server_poll, WaitTimeToMillis(wt));
+            selecterr = GetErrno();
+            PollBlockHandlerFds(&blockHandlerFds, FALSE);
+            errno = selecterr;
+        }
+#else
         if (dispatchException)
             i = -1;
         else if (AnyClientsWriteBlocked) {
@@ -231,6 +316,7 @@ WaitForSomething(int *pClientsReady)
         else {
             i = Select(MaxClients, &LastSelectMask, NULL, NULL, wt);
         }
+#endif
         selecterr = GetErrno();
         WakeupHandler(i, (void *) &LastSelectMask);
         if (i <= 0) {           /* An error or timeout occurred */
@@ -302,6 +388,7 @@ WaitForSomething(int *pClientsReady)
             }
             if (someReady)
                 XFD_ORSET(&LastSelectMask, &ClientsWithInput, &LastSelectMask);
+#ifdef WIN32
             if (AnyClientsWriteBlocked && XFD_ANYSET(&clientsWritable)) {
                 NewOutputPending = TRUE;
                 XFD_ORSET(&OutputPending, &clientsWritable, &OutputPending);
@@ -309,6 +396,7 @@ WaitForSomething(int *pClientsReady)
                 if (!XFD_ANYSET(&ClientsWriteBlocked))
                     AnyClientsWriteBlocked = FALSE;
             }
+#endif
 
             XFD_ANDSET(&devicesReadable, &LastSelectMask, &EnabledDevices);
             XFD_ANDSET(&clientsReadable, &LastSelectMask, &AllClients);
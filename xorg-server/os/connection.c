@@ -160,6 +160,77 @@ static fd_set SavedAllSockets;
 static fd_set SavedClientsWithInput;
 int GrabInProgress = 0;
 
+#ifndef WIN32
+struct ospoll *server_poll;
+
+/*
+ * ospoll callback for listeners, input devices and other general
+ * sockets; WaitForSomething and the wakeup handlers still look at
+ * LastSelectMask, so just record the descriptor there.
+ */
+static void
+SocketReady(int fd, int xevents, void *data)
+{
+    if (xevents & (X_NOTIFY_READ | X_NOTIFY_ERROR))
+        FD_SET(fd, &LastSelectMask);
+}
+
+/*
+ * ospoll callback for client connections.  A hangup is reported as
+ * readable so that ReadRequestFromClient notices it.
+ */
+static void
+ClientReady(int fd, int xevents, void *data)
+{
+    if (xevents & (X_NOTIFY_READ | X_NOTIFY_ERROR))
+        FD_SET(fd, &LastSelectMask);
+    if (xevents & X_NOTIFY_WRITE) {
+        ospoll_mute(server_poll, fd, X_NOTIFY_WRITE);
+        NewOutputPending = TRUE;
+        FD_SET(fd, &OutputPending);
+        FD_CLR(fd, &ClientsWriteBlocked);
+        if (!XFD_ANYSET(&ClientsWriteBlocked))
+            AnyClientsWriteBlocked = FALSE;
+    }
+}
+
+/* Register a non-client descriptor for reading */
+static void
+PollSocket(int fd)
+{
+    if (!server_poll && !(server_poll = ospoll_create()))
+        FatalError("Cannot create event backend: %s\n", strerror(errno));
+    ospoll_add(server_poll, fd, SocketReady, NULL);
+    ospoll_listen(server_poll, fd, X_NOTIFY_READ);
+}
+
+/* Keep the read interest of fd in step with AllSockets */
+static void
+SetPollInterest(int fd)
+{
+    if (FD_ISSET(fd, &AllSockets))
+        ospoll_listen(server_poll, fd, X_NOTIFY_READ);
+    else
+        ospoll_mute(server_poll, fd, X_NOTIFY_READ);
+}
+
+static void
+SetAllClientsPollInterest(void)
+{
+    int i;
+
+    for (i = 1; i < currentMaxClients; i++) {
+        ClientPtr client = clients[i];
+
+        if (client && client->osPrivate)
+            SetPollInterest(((OsCommPtr) client->osPrivate)->fd);
+    }
+}
+#else
+#define SetPollInterest(fd)
+#define SetAllClientsPollInterest()
+#endif
+
 #if !defined(WIN32)
 int *ConnectionTranslation = NULL;
 #else
@@ -469,6 +540,9 @@ CreateWellKnownSockets(void)
 
         ListenTransFds[i-1] = fd;
         FD_SET(fd, &WellKnownConnections);
+#ifndef WIN32
+        PollSocket(fd);
+#endif
 
         if (!_XSERVTransIsLocal (ListenTransConns[i-1])) {
             int protocol = 0;
@@ -516,6 +590,9 @@ ResetWellKnownSockets(void)
                  */
 
                 FD_CLR(ListenTransFds[i], &WellKnownConnections);
+#ifndef WIN32
+                ospoll_remove(server_poll, ListenTransFds[i]);
+#endif
                 ListenTransFds[i] = ListenTransFds[ListenTransCount - 1];
                 ListenTransConns[i] = ListenTransConns[ListenTransCount - 1];
                 ListenTransCount -= 1;
@@ -529,6 +606,10 @@ ResetWellKnownSockets(void)
                 int newfd = _XSERVTransGetConnectionNumber(ListenTransConns[i]);
 
                 FD_CLR(ListenTransFds[i], &WellKnownConnections);
+#ifndef WIN32
+                ospoll_remove(server_poll, ListenTransFds[i]);
+                PollSocket(newfd);
+#endif
                 ListenTransFds[i] = newfd;
                 FD_SET(newfd, &WellKnownConnections);
             }
@@ -552,6 +633,11 @@ CloseWellKnownConnections(void)
 
     for (i = 0; i < ListenTransCount; i++) {
         if (ListenTransConns[i] != NULL) {
+#ifndef WIN32
+            if (server_poll)
+                ospoll_remove(server_poll,
+                              _XSERVTransGetConnectionNumber(ListenTransConns[i]));
+#endif
             _XSERVTransClose(ListenTransConns[i]);
             ListenTransConns[i] = NULL;
         }
@@ -804,7 +890,19 @@ AllocNewConnection(XtransConnInfo trans_conn, int fd, CARD32 conn_time)
     oc->output = (ConnectionOutputPtr) NULL;
     oc->auth_id = None;
     oc->conn_time = conn_time;
+    oc->req_len_peak = 0;
+    oc->input_moved = 0;
+    oc->out_peak = 0;
+#ifndef WIN32
+    if (!ospoll_add(server_poll, fd, ClientReady, NULL)) {
+        free(oc);
+        return NullClient;
+    }
+#endif
     if (!(client = NextAvailableClient((void *) oc))) {
+#ifndef WIN32
+        ospoll_remove(server_poll, fd);
+#endif
         free(oc);
         return NullClient;
     }
@@ -822,6 +920,7 @@ AllocNewConnection(XtransConnInfo trans_conn, int fd, CARD32 conn_time)
         FD_SET(fd, &AllClients);
         FD_SET(fd, &AllSockets);
     }
+    SetPollInterest(fd);
 
 #ifdef DEBUG
     ErrorF("AllocNewConnection: client index = %d, socket fd = %d\n",
@@ -984,6 +1083,9 @@ CloseDownFileDescriptor(OsCommPtr oc)
 {
     int connection = oc->fd;
 
+#ifndef WIN32
+    ospoll_remove(server_poll, connection);
+#endif
     if (oc->trans_conn) {
         _XSERVTransDisconnect(oc->trans_conn);
         _XSERVTransClose(oc->trans_conn);
@@ -1094,6 +1196,9 @@ CloseDownConnection(ClientPtr client)
 #endif
     if (oc->output)
         FlushClient(client, oc, (char *) NULL, 0);
+    if (oc->input_moved)
+        LogMessageVerb(X_INFO, 4, "Client %d copied %lu bytes of its input\n",
+                       client->index, oc->input_moved);
 #ifdef XDMCP
     XdmcpCloseDisplay(oc->fd);
 #endif
@@ -1111,6 +1216,9 @@ AddGeneralSocket(int fd)
     FD_SET(fd, &AllSockets);
     if (GrabInProgress)
         FD_SET(fd, &SavedAllSockets);
+#ifndef WIN32
+    PollSocket(fd);
+#endif
 }
 
 void
@@ -1126,6 +1234,10 @@ RemoveGeneralSocket(int fd)
     FD_CLR(fd, &AllSockets);
     if (GrabInProgress)
         FD_CLR(fd, &SavedAllSockets);
+#ifndef WIN32
+    if (server_poll)
+        ospoll_remove(server_poll, fd);
+#endif
 }
 
 void
@@ -1171,6 +1283,7 @@ OnlyListenToOneClient(ClientPtr client)
         FD_SET(connection, &AllClients);
         XFD_ORSET(&AllSockets, &AllSockets, &AllClients);
         GrabInProgress = client->index;
+        SetAllClientsPollInterest();
     }
     return rc;
 }
@@ -1188,6 +1301,7 @@ ListenToAllClients(void)
         XFD_ORSET(&AllClients, &AllClients, &SavedAllClients);
         XFD_ORSET(&ClientsWithInput, &ClientsWithInput, &SavedClientsWithInput);
         GrabInProgress = 0;
+        SetAllClientsPollInterest();
     }
 }
 
@@ -1217,6 +1331,7 @@ IgnoreClient(ClientPtr client)
         FD_CLR(connection, &AllSockets);
         FD_CLR(connection, &AllClients);
         FD_CLR(connection, &LastSelectMask);
+        SetPollInterest(connection);
     }
     else {
         if (FD_ISSET(connection, &SavedClientsWithInput))
@@ -1251,6 +1366,7 @@ AttendClient(ClientPtr client)
         FD_SET(connection, &LastSelectMask);
         if (FD_ISSET(connection, &IgnoredClientsWithInput))
             FD_SET(connection, &ClientsWithInput);
+        SetPollInterest(connection);
     }
     else {
         FD_SET(connection, &SavedAllClients);
@@ -1295,6 +1411,7 @@ MakeClientGrabPervious(ClientPtr client)
         }
         FD_CLR(connection, &AllSockets);
         FD_CLR(connection, &AllClients);
+        SetPollInterest(connection);
         isItTimeToYield = TRUE;
     }
 
@@ -1350,6 +1467,9 @@ ListenOnOpenFD(int fd, int noxauth)
 
     FD_SET(fd, &WellKnownConnections);
     FD_SET(fd, &AllSockets);
+#ifndef WIN32
+    PollSocket(fd);
+#endif
 
     /* Increment the count */
     ListenTransCount++;
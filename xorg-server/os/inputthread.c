@@ -0,0 +1,497 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/X.h>
+#include "os.h"
+
+Bool InputThreadEnable = FALSE;
+
+#ifdef INPUTTHREAD
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
+#include "misc.h"
+#include "list.h"
+#include "osdep.h"
+
+/*
+ * The input thread sleeps in its own ospoll on the registered devices
+ * plus a control descriptor used to tell it about device changes and
+ * shutdown.  Device read procs run with the input lock held, the same
+ * lock the main thread takes wherever it used to block SIGIO.  Events
+ * go through mieqEnqueue, which the input thread is the only producer
+ * for; after reading, the thread pokes a notify descriptor that sits in
+ * the main thread's ospoll so WaitForSomething wakes up.
+ *
+ * Device records are only freed by the input thread (or by the main
+ * thread while the input thread isn't running), so a ready callback can
+ * always look at its record; unregistering just marks it removed.
+ */
+
+typedef enum {
+    DEVICE_ADDED,
+    DEVICE_RUNNING,
+    DEVICE_REMOVED
+} InputThreadDeviceState;
+
+typedef struct _InputThreadDevice {
+    struct xorg_list node;
+    InputReadProcPtr readInputProc;
+    void *readInputArgs;
+    int fd;
+    InputThreadDeviceState state;
+} InputThreadDevice;
+
+typedef struct _InputThreadInfo {
+    pthread_t thread;
+    Bool started;               /* thread is valid */
+    Bool running;               /* cleared to make the thread exit */
+    Bool changed;               /* devs needs syncing into fds */
+    struct ospoll *fds;
+    struct xorg_list devs;
+    int control[2];             /* main -> input thread */
+    int notify[2];              /* input thread -> main */
+    int notifyPending;
+} InputThreadInfo;
+
+static InputThreadInfo inputThreadInfo = {
+    .control = {-1, -1},
+    .notify = {-1, -1},
+};
+
+#ifdef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+static pthread_mutex_t input_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+#else
+static pthread_mutex_t input_mutex;
+static Bool input_mutex_initialized;
+#endif
+static int input_mutex_count;  /* only touched with input_mutex held */
+
+static void
+InputMutexInit(void)
+{
+#ifndef PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+    /* first use is from the command line, long before any thread exists */
+    if (!input_mutex_initialized) {
+        pthread_mutexattr_t attr;
+
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&input_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        input_mutex_initialized = TRUE;
+    }
+#endif
+}
+
+void
+InputThreadLock(void)
+{
+    InputMutexInit();
+    pthread_mutex_lock(&input_mutex);
+    ++input_mutex_count;
+}
+
+void
+InputThreadUnlock(void)
+{
+    --input_mutex_count;
+    pthread_mutex_unlock(&input_mutex);
+}
+
+void
+InputThreadForceUnlock(void)
+{
+    if (!InputThreadEnable)
+        return;
+    InputMutexInit();
+    /* drop every level we hold, leave the lock alone if someone else has it */
+    if (pthread_mutex_trylock(&input_mutex) == 0) {
+        ++input_mutex_count;
+        while (input_mutex_count > 0)
+            InputThreadUnlock();
+    }
+}
+
+Bool
+InputThreadSelf(void)
+{
+    return inputThreadInfo.started &&
+        pthread_equal(pthread_self(), inputThreadInfo.thread);
+}
+
+/*
+ * An eventfd where available, a non-blocking pipe otherwise.  fds[0] is
+ * polled, fds[1] written to.
+ */
+static Bool
+NotifierCreate(int fds[2])
+{
+#ifdef HAVE_SYS_EVENTFD_H
+    fds[0] = fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    return fds[0] >= 0;
+#else
+    int i;
+
+    if (pipe(fds) < 0)
+        return FALSE;
+    for (i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return TRUE;
+#endif
+}
+
+static void
+NotifierClose(int fds[2])
+{
+    if (fds[1] != fds[0])
+        close(fds[1]);
+    close(fds[0]);
+    fds[0] = fds[1] = -1;
+}
+
+static void
+NotifierSignal(int fd)
+{
+    uint64_t one = 1;
+    int ret;
+
+    do {
+        ret = write(fd, &one, sizeof(one));
+    } while (ret < 0 && errno == EINTR);
+}
+
+static void
+NotifierDrain(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+/* Main thread side of the notify descriptor */
+static void
+InputThreadNotified(int fd, int xevents, void *data)
+{
+    NotifierDrain(fd);
+    /* events enqueued from here on will poke us again */
+    (void) __atomic_exchange_n(&inputThreadInfo.notifyPending, FALSE,
+                               __ATOMIC_SEQ_CST);
+}
+
+static void
+InputThreadNotifyMain(void)
+{
+    if (!__atomic_exchange_n(&inputThreadInfo.notifyPending, TRUE,
+                             __ATOMIC_SEQ_CST))
+        NotifierSignal(inputThreadInfo.notify[1]);
+}
+
+static void
+InputThreadControl(int fd, int xevents, void *data)
+{
+    NotifierDrain(fd);
+}
+
+static void
+InputReady(int fd, int xevents, void *data)
+{
+    InputThreadDevice *dev = data;
+
+    InputThreadLock();
+    if (dev->state == DEVICE_RUNNING) {
+        dev->readInputProc(fd, dev->readInputArgs);
+        /* a dead device would keep us spinning until it is removed */
+        if (xevents & X_NOTIFY_ERROR)
+            ospoll_mute(inputThreadInfo.fds, fd, X_NOTIFY_READ);
+    }
+    InputThreadUnlock();
+    InputThreadNotifyMain();
+}
+
+/* Bring the poll set in line with the device list, input lock held */
+static void
+InputThreadSyncDevices(void)
+{
+    InputThreadDevice *dev, *next;
+
+    xorg_list_for_each_entry_safe(dev, next, &inputThreadInfo.devs, node) {
+        switch (dev->state) {
+        case DEVICE_ADDED:
+            if (!ospoll_add(inputThreadInfo.fds, dev->fd, InputReady, dev)) {
+                ErrorFSigSafe("input-thread: cannot watch fd %d\n", dev->fd);
+                break;
+            }
+            ospoll_listen(inputThreadInfo.fds, dev->fd, X_NOTIFY_READ);
+            dev->state = DEVICE_RUNNING;
+            break;
+        case DEVICE_REMOVED:
+            ospoll_remove(inputThreadInfo.fds, dev->fd);
+            xorg_list_del(&dev->node);
+            free(dev);
+            break;
+        case DEVICE_RUNNING:
+            break;
+        }
+    }
+    inputThreadInfo.changed = FALSE;
+}
+
+static Bool
+InputThreadSetup(void)
+{
+    if (inputThreadInfo.fds)
+        return TRUE;
+    xorg_list_init(&inputThreadInfo.devs);
+    if (!(inputThreadInfo.fds = ospoll_create()))
+        return FALSE;
+    if (!NotifierCreate(inputThreadInfo.control) ||
+        !ospoll_add(inputThreadInfo.fds, inputThreadInfo.control[0],
+                    InputThreadControl, NULL)) {
+        ospoll_destroy(inputThreadInfo.fds);
+        inputThreadInfo.fds = NULL;
+        return FALSE;
+    }
+    ospoll_listen(inputThreadInfo.fds, inputThreadInfo.control[0],
+                  X_NOTIFY_READ);
+    return TRUE;
+}
+
+/* Called with the input lock held after changing the device list */
+static void
+InputThreadChanged(void)
+{
+    inputThreadInfo.changed = TRUE;
+    if (inputThreadInfo.running)
+        NotifierSignal(inputThreadInfo.control[1]);
+    else
+        InputThreadSyncDevices();
+}
+
+/*
+ * Have the input thread call readInputProc whenever fd is readable.
+ * Returns FALSE if the input thread is not in use, in which case the
+ * caller reads the device itself.
+ */
+Bool
+InputThreadRegisterDev(int fd, InputReadProcPtr readInputProc,
+                       void *readInputArgs)
+{
+    InputThreadDevice *dev;
+
+    if (!InputThreadEnable || fd < 0)
+        return FALSE;
+
+    InputThreadLock();
+    if (!InputThreadSetup()) {
+        InputThreadUnlock();
+        return FALSE;
+    }
+    xorg_list_for_each_entry(dev, &inputThreadInfo.devs, node) {
+        if (dev->fd == fd && dev->state != DEVICE_REMOVED) {
+            dev->readInputProc = readInputProc;
+            dev->readInputArgs = readInputArgs;
+            InputThreadUnlock();
+            return TRUE;
+        }
+    }
+    dev = calloc(1, sizeof(InputThreadDevice));
+    if (!dev) {
+        InputThreadUnlock();
+        return FALSE;
+    }
+    dev->fd = fd;
+    dev->readInputProc = readInputProc;
+    dev->readInputArgs = readInputArgs;
+    dev->state = DEVICE_ADDED;
+    xorg_list_append(&dev->node, &inputThreadInfo.devs);
+    InputThreadChanged();
+    InputThreadUnlock();
+    return TRUE;
+}
+
+/*
+ * Stop reading fd.  Once this returns the read proc is not called for
+ * fd any more and the caller may close it.
+ */
+Bool
+InputThreadUnregisterDev(int fd)
+{
+    InputThreadDevice *dev;
+
+    if (!InputThreadEnable || !inputThreadInfo.fds)
+        return FALSE;
+
+    InputThreadLock();
+    xorg_list_for_each_entry(dev, &inputThreadInfo.devs, node) {
+        if (dev->fd == fd && dev->state != DEVICE_REMOVED) {
+            dev->state = DEVICE_REMOVED;
+            InputThreadChanged();
+            InputThreadUnlock();
+            return TRUE;
+        }
+    }
+    InputThreadUnlock();
+    return FALSE;
+}
+
+static void *
+InputThreadDoWork(void *arg)
+{
+    for (;;) {
+        Bool running;
+
+        InputThreadLock();
+        if (inputThreadInfo.changed)
+            InputThreadSyncDevices();
+        running = inputThreadInfo.running;
+        InputThreadUnlock();
+        if (!running)
+            break;
+
+        if (ospoll_wait(inputThreadInfo.fds, -1) < 0 && errno != EINTR)
+            ErrorFSigSafe("input-thread: poll failed: %d\n", errno);
+    }
+    return NULL;
+}
+
+/*
+ * Start the input thread for this server generation.  Devices may have
+ * been registered already, they are picked up on the first iteration.
+ */
+void
+InputThreadInit(void)
+{
+    sigset_t set, old;
+
+    if (!InputThreadEnable || inputThreadInfo.running)
+        return;
+
+    InputThreadLock();
+    if (!InputThreadSetup())
+        FatalError("input-thread: cannot create poll set\n");
+    InputThreadUnlock();
+
+    if (!NotifierCreate(inputThreadInfo.notify) ||
+        !ospoll_add(server_poll, inputThreadInfo.notify[0],
+                    InputThreadNotified, NULL))
+        FatalError("input-thread: cannot create notify descriptor\n");
+    ospoll_listen(server_poll, inputThreadInfo.notify[0], X_NOTIFY_READ);
+    inputThreadInfo.notifyPending = FALSE;
+
+    /* the thread starts by taking the lock, so it sees thread set */
+    InputThreadLock();
+    inputThreadInfo.changed = TRUE;
+    inputThreadInfo.running = TRUE;
+
+    /* signals are for the main thread, the new thread inherits this mask */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    if (pthread_create(&inputThreadInfo.thread, NULL,
+                       InputThreadDoWork, NULL) != 0)
+        FatalError("input-thread: cannot create thread: %s\n",
+                   strerror(errno));
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    inputThreadInfo.started = TRUE;
+    InputThreadUnlock();
+}
+
+/* Stop the input thread at the end of a server generation */
+void
+InputThreadFini(void)
+{
+    if (!inputThreadInfo.running)
+        return;
+
+    InputThreadLock();
+    inputThreadInfo.running = FALSE;
+    InputThreadUnlock();
+    NotifierSignal(inputThreadInfo.control[1]);
+    pthread_join(inputThreadInfo.thread, NULL);
+    inputThreadInfo.started = FALSE;
+
+    ospoll_remove(server_poll, inputThreadInfo.notify[0]);
+    NotifierClose(inputThreadInfo.notify);
+}
+
+#else                           /* INPUTTHREAD */
+
+Bool
+InputThreadRegisterDev(int fd, InputReadProcPtr readInputProc,
+                       void *readInputArgs)
+{
+    return FALSE;
+}
+
+Bool
+InputThreadUnregisterDev(int fd)
+{
+    return FALSE;
+}
+
+Bool
+InputThreadSelf(void)
+{
+    return FALSE;
+}
+
+void
+InputThreadLock(void)
+{
+}
+
+void
+InputThreadUnlock(void)
+{
+}
+
+void
+InputThreadForceUnlock(void)
+{
+}
+
+void
+InputThreadInit(void)
+{
+}
+
+void
+InputThreadFini(void)
+{
+}
+
+#endif                          /* INPUTTHREAD */
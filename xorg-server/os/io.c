@@ -78,6 +78,7 @@ SOFTWARE.
 #include "opaque.h"
 #include "dixstruct.h"
 #include "misc.h"
+#include "reqstats.h"
 
 CallbackListPtr ReplyCallback;
 CallbackListPtr FlushCallback;
@@ -90,17 +91,43 @@ typedef struct _connectionInput {
     int lenLastReq;
     int size;
     unsigned int ignoreBytes;   /* bytes to ignore before the next request */
+    char *spill;                /* readv target for data behind a large request */
+    int spillcnt;               /* count of bytes in spill */
+    int spillsize;
 } ConnectionInput;
 
+/*
+ * Output that has to wait behind data which could not be written yet.
+ * Large caller-owned buffers (WriteToClientNoCopy) are queued by
+ * reference and handed back through release once written; everything
+ * else is copied into chunks that are allocated together with the
+ * record (end marks the end of such a chunk).
+ */
+typedef struct _outputExtra {
+    struct _outputExtra *next;
+    const char *buf;            /* next byte to write */
+    int count;                  /* bytes of buf left to write */
+    int pad;                    /* padding left to write after buf */
+    const char *end;            /* end of a copied chunk, NULL if by reference */
+    OsReleaseProcPtr release;
+    void *data;
+} OutputExtraRec, *OutputExtraPtr;
+
 typedef struct _connectionOutput {
     struct _connectionOutput *next;
     unsigned char *buf;
     int size;
     int count;
+    OutputExtraPtr extras;      /* queued behind buf while write blocked */
+    OutputExtraPtr lastExtra;
 } ConnectionOutput;
 
 static ConnectionInputPtr AllocateInputBuffer(void);
-static ConnectionOutputPtr AllocateOutputBuffer(void);
+static ConnectionOutputPtr AllocateOutputBuffer(int size);
+static int FlushClientRelease(ClientPtr who, OsCommPtr oc,
+                              const void *extraBuf, int extraCount,
+                              int padsize, OsReleaseProcPtr release,
+                              void *data);
 
 /* If EAGAIN and EWOULDBLOCK are distinct errno values, then we check errno
  * for both EAGAIN and EWOULDBLOCK, because some supposedly POSIX
@@ -134,6 +161,8 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
 #define MAX_TIMES_PER         10
 #define BUFSIZE 4096
 #define BUFWATERMARK 8192
+#define PEAK_DECAY_SHIFT 5      /* peaks decay by 1/32 per request or flush */
+#define MAX_FLUSH_IOV 64
 
 /*
  *   A lot of the code in this file manipulates a ConnectionInputPtr:
@@ -163,6 +192,18 @@ static OsCommPtr AvailableInput = (OsCommPtr) NULL;
  *  needed = the length of the request that we're trying to
  *  read.  Watch out: needed sometimes counts bytes and sometimes
  *  counts CARD32's.
+ *
+ *  A request that does not fit gets a buffer of exactly its own size,
+ *  and only the part already read is copied into it.  The previous
+ *  buffer is kept as the "spill" buffer: the rest of the large request
+ *  is read with readv() into buffer and anything the client sent after
+ *  it lands in spill, which becomes the current buffer once the large
+ *  request has been processed.  Data in spill always logically follows
+ *  the data in buffer.
+ *
+ *  Large buffers are kept as long as the client keeps sending requests
+ *  of similar size (tracked in OsCommRec.req_len_peak) instead of being
+ *  shrunk back to BUFSIZE after every request.
  */
 
 /*****************************************************************
@@ -211,6 +252,99 @@ YieldControlDeath(void)
     timesThisConnection = 0;
 }
 
+/* How much input buffer space this client is expected to need */
+static int
+InputBufferTarget(OsCommPtr oc)
+{
+    return max(BUFSIZE, oc->req_len_peak);
+}
+
+static void
+FreeSpill(ConnectionInputPtr oci)
+{
+    free(oci->spill);
+    oci->spill = NULL;
+    oci->spillcnt = 0;
+    oci->spillsize = 0;
+}
+
+/* Does buf hold at least one whole request? */
+static Bool
+WholeRequest(ClientPtr client, char *buf, unsigned int count)
+{
+    xReq *request = (xReq *) buf;
+    unsigned int len;
+
+    if (count < sizeof(xReq))
+        return FALSE;
+    len = get_req_len(request, client) << 2;
+    if (len)
+        return count >= len;
+    return client->big_requests && count >= sizeof(xBigReq) &&
+        count >= (get_big_req_len(request, client) << 2);
+}
+
+/* Count input bytes copied after reading, for the client's statistics */
+static inline void
+InputMoved(ClientPtr client, OsCommPtr oc, unsigned long count)
+{
+    oc->input_moved += count;
+    ReqStatsInputMoved(client, count);
+}
+
+/*
+ * Move data read behind a large request in front again.  Normally the
+ * large request has been consumed by now and the buffers are simply
+ * swapped; the large buffer stays around as spill space if the client
+ * is likely to need it again.
+ */
+static Bool
+DrainSpill(ClientPtr client, OsCommPtr oc, ConnectionInputPtr oci)
+{
+    unsigned int gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
+    char *ibuf;
+
+    if (!oci->spillcnt) {
+        if (oci->spill && oci->spillsize > InputBufferTarget(oc))
+            FreeSpill(oci);
+        return TRUE;
+    }
+
+    if (!gotnow) {
+        int isize = oci->size;
+
+        ibuf = oci->buffer;
+        oci->buffer = oci->bufptr = oci->spill;
+        oci->bufcnt = oci->spillcnt;
+        oci->size = oci->spillsize;
+        oci->spill = ibuf;
+        oci->spillcnt = 0;
+        oci->spillsize = isize;
+        if (oci->spillsize > InputBufferTarget(oc))
+            FreeSpill(oci);
+        return TRUE;
+    }
+
+    /* Something (InsertFakeRequest) left data in front of the spill */
+    if (oci->bufptr != oci->buffer) {
+        memmove(oci->buffer, oci->bufptr, gotnow);
+        InputMoved(client, oc, gotnow);
+        oci->bufptr = oci->buffer;
+    }
+    if (gotnow + oci->spillcnt > oci->size) {
+        ibuf = (char *) realloc(oci->buffer, gotnow + oci->spillcnt);
+        if (!ibuf)
+            return FALSE;
+        oci->size = gotnow + oci->spillcnt;
+        oci->buffer = oci->bufptr = ibuf;
+    }
+    memcpy(oci->buffer + gotnow, oci->spill, oci->spillcnt);
+    InputMoved(client, oc, oci->spillcnt);
+    oci->bufcnt = gotnow + oci->spillcnt;
+    oci->spillcnt = 0;
+    return TRUE;
+}
+
 /* If an input buffer was empty, either free it if it is too big or link it
  * into our list of free input buffers.  This means that different clients can
  * share the same input buffer (at different times).  This was done to save
@@ -223,15 +357,19 @@ NextAvailableInput(OsCommPtr oc)
         if (AvailableInput != oc) {
             ConnectionInputPtr aci = AvailableInput->input;
 
-            if (aci->size > BUFWATERMARK) {
-                free(aci->buffer);
-                free(aci);
-            }
-            else {
+            FreeSpill(aci);
+            if (aci->size <= BUFWATERMARK) {
                 aci->next = FreeInputs;
                 FreeInputs = aci;
+                AvailableInput->input = NULL;
             }
-            AvailableInput->input = NULL;
+            else if (aci->size > InputBufferTarget(AvailableInput)) {
+                free(aci->buffer);
+                free(aci);
+                AvailableInput->input = NULL;
+            }
+            /* else the client regularly sends requests this big, so
+             * let it keep its buffer */
         }
         AvailableInput = NULL;
     }
@@ -276,6 +414,11 @@ ReadRequestFromClient(ClientPtr client)
 
     oci->bufptr += oci->lenLastReq;
 
+    if (!DrainSpill(client, oc, oci)) {
+        YieldControlDeath();
+        return -1;
+    }
+
     need_header = FALSE;
     move_header = FALSE;
     gotnow = oci->bufcnt + oci->buffer - oci->bufptr;
@@ -334,20 +477,39 @@ ReadRequestFromClient(ClientPtr client)
         if ((gotnow == 0) || ((oci->bufptr - oci->buffer + needed) > oci->size)) {
             /* no data, or the request is too big to fit in the buffer */
 
-            if ((gotnow > 0) && (oci->bufptr != oci->buffer))
-                /* save the data we've already read */
-                memmove(oci->buffer, oci->bufptr, gotnow);
             if (needed > oci->size) {
-                /* make buffer bigger to accomodate request */
+                /* give the request a buffer of its own, reusing the
+                 * spill buffer if it is big enough */
                 char *ibuf;
+                int isize;
 
-                ibuf = (char *) realloc(oci->buffer, needed);
-                if (!ibuf) {
-                    YieldControlDeath();
-                    return -1;
+                if (oci->spill && oci->spillsize >= needed) {
+                    ibuf = oci->spill;
+                    isize = oci->spillsize;
+                }
+                else {
+                    FreeSpill(oci);
+                    ibuf = (char *) malloc(needed);
+                    if (!ibuf) {
+                        YieldControlDeath();
+                        return -1;
+                    }
+                    isize = needed;
                 }
-                oci->size = needed;
+                if (gotnow > 0) {
+                    memcpy(ibuf, oci->bufptr, gotnow);
+                    InputMoved(client, oc, gotnow);
+                }
+                oci->spill = oci->buffer;
+                oci->spillsize = oci->size;
+                oci->spillcnt = 0;
                 oci->buffer = ibuf;
+                oci->size = isize;
+            }
+            else if ((gotnow > 0) && (oci->bufptr != oci->buffer)) {
+                /* save the data we've already read */
+                memmove(oci->buffer, oci->bufptr, gotnow);
+                InputMoved(client, oc, gotnow);
             }
             oci->bufptr = oci->buffer;
             oci->bufcnt = gotnow;
@@ -364,8 +526,25 @@ ReadRequestFromClient(ClientPtr client)
             YieldControlDeath();
             return -1;
         }
-        result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
-                                 oci->size - oci->bufcnt);
+        if (oci->spill && !need_header && !oci->ignoreBytes &&
+            oci->bufptr + needed == oci->buffer + oci->size) {
+            /* the request fills the buffer, catch what follows it in
+             * the spill buffer with the same system call */
+            struct iovec iov[2];
+
+            iov[0].iov_base = oci->buffer + oci->bufcnt;
+            iov[0].iov_len = oci->size - oci->bufcnt;
+            iov[1].iov_base = oci->spill;
+            iov[1].iov_len = oci->spillsize;
+            result = _XSERVTransReadv(oc->trans_conn, iov, 2);
+            if (result > (int) iov[0].iov_len) {
+                oci->spillcnt = result - iov[0].iov_len;
+                result = iov[0].iov_len;
+            }
+        }
+        else
+            result = _XSERVTransRead(oc->trans_conn, oci->buffer + oci->bufcnt,
+                                     oci->size - oci->bufcnt);
         if (result <= 0) {
             if ((result < 0) && ETEST(errno)) {
 #if defined(SVR4) && defined(__i386__) && !defined(sun)
@@ -381,16 +560,20 @@ ReadRequestFromClient(ClientPtr client)
         }
         oci->bufcnt += result;
         gotnow += result;
-        /* free up some space after huge requests */
+        /* free up some space after huge requests, unless the client
+         * keeps sending them */
         if ((oci->size > BUFWATERMARK) &&
+            (oci->size > InputBufferTarget(oc)) && !oci->spillcnt &&
             (oci->bufcnt < BUFSIZE) && (needed < BUFSIZE)) {
             char *ibuf;
 
+            FreeSpill(oci);
             ibuf = (char *) realloc(oci->buffer, BUFSIZE);
             if (ibuf) {
                 oci->size = BUFSIZE;
                 oci->buffer = ibuf;
                 oci->bufptr = ibuf + oci->bufcnt - gotnow;
+                InputMoved(client, oc, oci->bufcnt);
             }
         }
         if (need_header && gotnow >= needed) {
@@ -440,6 +623,11 @@ ReadRequestFromClient(ClientPtr client)
         }
         needed = 0;
     }
+    else {
+        oc->req_len_peak -= oc->req_len_peak >> PEAK_DECAY_SHIFT;
+        if (needed > oc->req_len_peak)
+            oc->req_len_peak = needed;
+    }
 
     oci->lenLastReq = needed;
 
@@ -452,24 +640,11 @@ ReadRequestFromClient(ClientPtr client)
      */
 
     gotnow -= needed;
-    if (gotnow >= sizeof(xReq)) {
-        request = (xReq *) (oci->bufptr + needed);
-        if (gotnow >= (result = (get_req_len(request, client) << 2))
-            && (result ||
-                (client->big_requests &&
-                 (gotnow >= sizeof(xBigReq) &&
-                  gotnow >= (get_big_req_len(request, client) << 2))))
-            )
-            FD_SET(fd, &ClientsWithInput);
-        else {
-            if (!SmartScheduleDisable)
-                FD_CLR(fd, &ClientsWithInput);
-            else
-                YieldControlNoInput(fd);
-        }
-    }
+    if (WholeRequest(client, oci->bufptr + needed, gotnow) ||
+        (!gotnow && WholeRequest(client, oci->spill, oci->spillcnt)))
+        FD_SET(fd, &ClientsWithInput);
     else {
-        if (!gotnow)
+        if (!gotnow && !oci->spillcnt)
             AvailableInput = oc;
         if (!SmartScheduleDisable)
             FD_CLR(fd, &ClientsWithInput);
@@ -729,8 +904,96 @@ SetCriticalOutputPending(void)
  *    this routine as int.
  *****************/
 
-int
-WriteToClient(ClientPtr who, int count, const void *__buf)
+/* How much output buffer space this client is expected to need */
+static int
+OutputBufferTarget(OsCommPtr oc)
+{
+    return max(BUFSIZE, oc->out_peak);
+}
+
+static void
+FreeOutputExtras(ConnectionOutputPtr oco)
+{
+    OutputExtraPtr e;
+
+    while ((e = oco->extras)) {
+        oco->extras = e->next;
+        if (e->release)
+            (*e->release) (e->data);
+        free(e);
+    }
+    oco->lastExtra = NULL;
+}
+
+/*
+ * Queue output behind everything already pending, by reference when the
+ * caller provided a release function and copied otherwise.
+ */
+static Bool
+QueueOutputExtra(ConnectionOutputPtr oco, const char *buf, int count,
+                 int pad, OsReleaseProcPtr release, void *data)
+{
+    OutputExtraPtr e = oco->lastExtra;
+
+    if (release) {
+        e = malloc(sizeof(OutputExtraRec));
+        if (!e)
+            return FALSE;
+        e->buf = buf;
+        e->count = count;
+        e->pad = pad;
+        e->end = NULL;
+        e->release = release;
+        e->data = data;
+    }
+    else if (e && e->end && e->end - (e->buf + e->count) >= count + pad) {
+        char *dst = (char *) e->buf + e->count;
+
+        memcpy(dst, buf, count);
+        memset(dst + count, '\0', pad);
+        e->count += count + pad;
+        return TRUE;
+    }
+    else {
+        int size = max(BUFSIZE, count + pad);
+        char *dst;
+
+        e = malloc(sizeof(OutputExtraRec) + size);
+        if (!e)
+            return FALSE;
+        dst = (char *) (e + 1);
+        memcpy(dst, buf, count);
+        memset(dst + count, '\0', pad);
+        e->buf = dst;
+        e->count = count + pad;
+        e->pad = 0;
+        e->end = dst + size;
+        e->release = NULL;
+        e->data = NULL;
+    }
+    e->next = NULL;
+    if (oco->lastExtra)
+        oco->lastExtra->next = e;
+    else
+        oco->extras = e;
+    oco->lastExtra = e;
+    return TRUE;
+}
+
+static void
+AbortClientOutput(ClientPtr who, OsCommPtr oc)
+{
+    if (oc->trans_conn) {
+        _XSERVTransDisconnect(oc->trans_conn);
+        _XSERVTransClose(oc->trans_conn);
+        oc->trans_conn = NULL;
+    }
+    MarkClientException(who);
+}
+
+static int
+DoWriteToClient(ClientPtr who, int count, const void *__buf,
+                OsReleaseProcPtr release, void *data)
 {
     OsCommPtr oc;
     ConnectionOutputPtr oco;
@@ -740,10 +1003,14 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 #ifdef DEBUG_COMMUNICATION
     Bool multicount = FALSE;
 #endif
-    if (!count || !who || who == serverClient || who->clientGone)
+    if (!count || !who || who == serverClient || who->clientGone) {
+        if (release)
+            (*release) (data);
         return 0;
+    }
     oc = who->osPrivate;
     oco = oc->output;
+    ReqStatsBytesOut(who, count);
 #ifdef DEBUG_COMMUNICATION
     {
         char info[128];
@@ -786,16 +1053,14 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
 #endif
 
     if (!oco) {
-        if ((oco = FreeOutputs)) {
+        if (FreeOutputs && OutputBufferTarget(oc) <= BUFSIZE) {
+            oco = FreeOutputs;
             FreeOutputs = oco->next;
         }
-        else if (!(oco = AllocateOutputBuffer())) {
-            if (oc->trans_conn) {
-                _XSERVTransDisconnect(oc->trans_conn);
-                _XSERVTransClose(oc->trans_conn);
-                oc->trans_conn = NULL;
-            }
-            MarkClientException(who);
+        else if (!(oco = AllocateOutputBuffer(OutputBufferTarget(oc)))) {
+            AbortClientOutput(who, oc);
+            if (release)
+                (*release) (data);
             return -1;
         }
         oc->output = oco;
@@ -843,6 +1108,20 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         }
     }
 #endif
+    if (oco->extras) {
+        /* still waiting for the client to take earlier output */
+        if (!QueueOutputExtra(oco, buf, count, padBytes, release, data)) {
+            AbortClientOutput(who, oc);
+            FreeOutputExtras(oco);
+            oco->count = 0;
+            if (release)
+                (*release) (data);
+            return -1;
+        }
+        NewOutputPending = TRUE;
+        FD_SET(oc->fd, &OutputPending);
+        return count;
+    }
     if (oco->count == 0 || oco->count + count + padBytes > oco->size) {
         FD_CLR(oc->fd, &OutputPending);
         if (!XFD_ANYSET(&OutputPending)) {
@@ -853,7 +1132,8 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         if (FlushCallback)
             CallCallbacks(&FlushCallback, NULL);
 
-        return FlushClient(who, oc, buf, count);
+        return FlushClientRelease(who, oc, buf, count, padBytes,
+                                  release, data);
     }
 
     NewOutputPending = TRUE;
@@ -864,9 +1144,34 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
         memset(oco->buf + oco->count, '\0', padBytes);
         oco->count += padBytes;
     }
+    if (release)
+        (*release) (data);
     return count;
 }
 
+int
+WriteToClient(ClientPtr who, int count, const void *buf)
+{
+    return DoWriteToClient(who, count, buf, NULL, NULL);
+}
+
+/*****************
+ * WriteToClientNoCopy
+ *    Like WriteToClient, but if the client cannot take all of buf right
+ *    away the rest is queued by reference rather than copied into the
+ *    output buffer.  buf must stay valid and unchanged until release(data)
+ *    is called, which may happen before this returns.  Small payloads are
+ *    still copied (and released at once), so this only pays off for large
+ *    replies.
+ *****************/
+
+int
+WriteToClientNoCopy(ClientPtr who, int count, const void *buf,
+                    OsReleaseProcPtr release, void *data)
+{
+    return DoWriteToClient(who, count, buf, release, data);
+}
+
  /********************
  * FlushClient()
  *    If the client isn't keeping up with us, then we try to continue
@@ -878,70 +1183,128 @@ WriteToClient(ClientPtr who, int count, const void *__buf)
  **********************/
 
 int
-FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
+FlushClient(ClientPtr who, OsCommPtr oc, const void *extraBuf, int extraCount)
+{
+    return FlushClientRelease(who, oc, extraBuf, extraCount,
+                              padding_for_int32(extraCount), NULL, NULL);
+}
+
+/* Drop len written bytes from the front of the pending output */
+static void
+ConsumeOutput(ConnectionOutputPtr oco, long len,
+              const char **extraBuf, int *extraCount, int *padsize)
+{
+    OutputExtraPtr e;
+    long n;
+
+    n = min(len, oco->count);
+    if (n) {
+        oco->count -= n;
+        if (oco->count)
+            memmove(oco->buf, oco->buf + n, oco->count);
+        len -= n;
+    }
+    while ((e = oco->extras)) {
+        n = min(len, e->count);
+        e->buf += n;
+        e->count -= n;
+        len -= n;
+        n = min(len, e->pad);
+        e->pad -= n;
+        len -= n;
+        if (e->count || e->pad)
+            break;
+        oco->extras = e->next;
+        if (!oco->extras)
+            oco->lastExtra = NULL;
+        if (e->release)
+            (*e->release) (e->data);
+        free(e);
+    }
+    n = min(len, *extraCount);
+    *extraBuf += n;
+    *extraCount -= n;
+    len -= n;
+    *padsize -= min(len, *padsize);
+}
+
+/*
+ * Write out the buffered output, anything queued behind it and then
+ * extraBuf plus padsize bytes of padding.  If release is set extraBuf is
+ * caller-owned, it is queued by reference if the client blocks and
+ * release(data) is called once it has been written.
+ */
+static int
+FlushClientRelease(ClientPtr who, OsCommPtr oc,
+                   const void *__extraBuf, int extraCount, int padsize,
+                   OsReleaseProcPtr release, void *data)
 {
     ConnectionOutputPtr oco = oc->output;
     int connection = oc->fd;
     XtransConnInfo trans_conn = oc->trans_conn;
-    struct iovec iov[3];
+    struct iovec iov[MAX_FLUSH_IOV];
     static char padBuffer[3];
     const char *extraBuf = __extraBuf;
-    long written;
-    long padsize;
+    int requested = extraCount;
+    OutputExtraPtr e;
+    long buffered;
     long notWritten;
     long todo;
 
-    if (!oco)
-	return 0;
-    written = 0;
-    padsize = padding_for_int32(extraCount);
+    if (!oco) {
+        if (release)
+            (*release) (data);
+        return 0;
+    }
+    /* only what went through the buffer says how big it should be */
+    buffered = oco->count;
+    if (oco->extras && (extraCount || padsize)) {
+        /* keep the order, the new data goes behind the queue */
+        if (!QueueOutputExtra(oco, extraBuf, extraCount, padsize,
+                              release, data))
+            goto abort;
+        extraCount = padsize = 0;
+        release = NULL;
+    }
     notWritten = oco->count + extraCount + padsize;
-    if (!notWritten)
+    for (e = oco->extras; e; e = e->next)
+        notWritten += e->count + e->pad;
+    if (!notWritten) {
+        if (release)
+            (*release) (data);
         return 0;
+    }
 
     todo = notWritten;
     while (notWritten) {
-        long before = written;  /* amount of whole thing written */
         long remain = todo;     /* amount to try this time, <= notWritten */
         int i = 0;
         long len;
 
-        /* You could be very general here and have "in" and "out" iovecs
-         * and write a loop without using a macro, but what the heck.  This
-         * translates to:
-         *
-         *     how much of this piece is new?
-         *     if more new then we are trying this time, clamp
-         *     if nothing new
-         *         then bump down amount already written, for next piece
-         *         else put new stuff in iovec, will need all of next piece
-         *
-         * Note that todo had better be at least 1 or else we'll end up
-         * writing 0 iovecs.
-         */
+        /* Build the longest prefix of the pending pieces that fits in
+         * both remain and the iovec array */
 #define InsertIOV(pointer, length) \
-	len = (length) - before; \
-	if (len > remain) \
-	    len = remain; \
-	if (len <= 0) { \
-	    before = (-len); \
-	} else { \
+	if ((length) > 0 && remain > 0 && i < MAX_FLUSH_IOV) { \
+	    len = min((long) (length), remain); \
 	    iov[i].iov_len = len; \
-	    iov[i].iov_base = (pointer) + before;	\
+	    iov[i].iov_base = (char *) (pointer); \
 	    i++; \
 	    remain -= len; \
-	    before = 0; \
 	}
 
-        InsertIOV((char *) oco->buf, oco->count)
-            InsertIOV((char *) extraBuf, extraCount)
-            InsertIOV(padBuffer, padsize)
+        InsertIOV(oco->buf, oco->count)
+        for (e = oco->extras; e; e = e->next) {
+            InsertIOV(e->buf, e->count)
+            InsertIOV(padBuffer, e->pad)
+        }
+        InsertIOV(extraBuf, extraCount)
+        InsertIOV(padBuffer, padsize)
 
-            errno = 0;
+        errno = 0;
         if (trans_conn && (len = _XSERVTransWritev(trans_conn, iov, i)) >= 0) {
-            written += len;
             notWritten -= len;
             todo = notWritten;
+            ConsumeOutput(oco, len, &extraBuf, &extraCount, &padsize);
         }
         else if (ETEST(errno)
 #ifdef SUNSYSV                  /* check for another brain-damaged OS bug */
@@ -957,72 +1320,69 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
             errno=0;
             FD_SET(connection, &ClientsWriteBlocked);
             AnyClientsWriteBlocked = TRUE;
+#ifndef WIN32
+            ospoll_listen(server_poll, connection, X_NOTIFY_WRITE);
+#endif
 
-            if (written < oco->count) {
-                if (written > 0) {
-                    oco->count -= written;
-                    memmove((char *) oco->buf,
-                            (char *) oco->buf + written, oco->count);
-                    written = 0;
-                }
-            }
-            else {
-                written -= oco->count;
-                oco->count = 0;
-            }
-
-            if (notWritten > oco->size) {
-                unsigned char *obuf = NULL;
-
-                if (notWritten + BUFSIZE <= INT_MAX) {
-                    obuf = realloc(oco->buf, notWritten + BUFSIZE);
+            if (extraCount || padsize) {
+                if (release || oco->extras) {
+                    if (!QueueOutputExtra(oco, extraBuf, extraCount, padsize,
+                                          release, data))
+                        goto abort;
                 }
-                if (!obuf) {
-                    _XSERVTransDisconnect(oc->trans_conn);
-                    _XSERVTransClose(oc->trans_conn);
-                    oc->trans_conn = NULL;
-                    MarkClientException(who);
-                    oco->count = 0;
-                    return -1;
+                else {
+                    long need = oco->count + extraCount + padsize;
+
+                    if (need > oco->size) {
+                        unsigned char *obuf = NULL;
+
+                        if (need + BUFSIZE <= INT_MAX)
+                            obuf = realloc(oco->buf, need + BUFSIZE);
+                        if (!obuf)
+                            goto abort;
+                        oco->size = need + BUFSIZE;
+                        oco->buf = obuf;
+                    }
+                    memmove((char *) oco->buf + oco->count,
+                            extraBuf, extraCount);
+                    memset((char *) oco->buf + oco->count + extraCount,
+                           '\0', padsize);
+                    oco->count = need;
                 }
-                oco->size = notWritten + BUFSIZE;
-                oco->buf = obuf;
             }
-
-            /* If the amount written extended into the padBuffer, then the
-               difference "extraCount - written" may be less than 0 */
-            if ((len = extraCount - written) > 0)
-                memmove((char *) oco->buf + oco->count,
-                        extraBuf + written, len);
-
-            oco->count = notWritten;    /* this will include the pad */
+            else if (release)
+                (*release) (data);
             /* return only the amount explicitly requested */
-            return extraCount;
+            return requested;
         }
 #ifdef EMSGSIZE                 /* check for another brain-damaged OS bug */
         else if (errno == EMSGSIZE) {
             todo >>= 1;
         }
 #endif
-        else {
-            if (oc->trans_conn) {
-                _XSERVTransDisconnect(oc->trans_conn);
-                _XSERVTransClose(oc->trans_conn);
-                oc->trans_conn = NULL;
-            }
-            MarkClientException(who);
-            oco->count = 0;
-            return -1;
-        }
+        else
+            goto abort;
     }
 
     /* everything was flushed out */
     oco->count = 0;
+    if (release)
+        (*release) (data);
     /* check to see if this client was write blocked */
     if (AnyClientsWriteBlocked) {
         FD_CLR(oc->fd, &ClientsWriteBlocked);
         if (!XFD_ANYSET(&ClientsWriteBlocked))
             AnyClientsWriteBlocked = FALSE;
+#ifndef WIN32
+        ospoll_mute(server_poll, oc->fd, X_NOTIFY_WRITE);
+#endif
+    }
+    oc->out_peak -= oc->out_peak >> PEAK_DECAY_SHIFT;
+    if (buffered > oc->out_peak)
+        oc->out_peak = min(buffered, INT_MAX - BUFSIZE);
+    if (oco->size > BUFSIZE && oco->size <= OutputBufferTarget(oc)) {
+        /* the client regularly produces this much, keep the buffer */
+        return requested;
     }
     if (oco->size > BUFWATERMARK) {
         free(oco->buf);
@@ -1033,7 +1393,15 @@ FlushClient(ClientPtr who, OsCommPtr oc, const void *__extraBuf, int extraCount)
         FreeOutputs = oco;
     }
     oc->output = (ConnectionOutputPtr) NULL;
-    return extraCount;          /* return only the amount explicitly requested */
+    return requested;           /* return only the amount explicitly requested */
+
+ abort:
+    AbortClientOutput(who, oc);
+    FreeOutputExtras(oco);
+    oco->count = 0;
+    if (release)
+        (*release) (data);
+    return -1;
 }
 
 static ConnectionInputPtr
@@ -1054,24 +1422,29 @@ AllocateInputBuffer(void)
     oci->bufcnt = 0;
     oci->lenLastReq = 0;
     oci->ignoreBytes = 0;
+    oci->spill = NULL;
+    oci->spillcnt = 0;
+    oci->spillsize = 0;
     return oci;
 }
 
 static ConnectionOutputPtr
-AllocateOutputBuffer(void)
+AllocateOutputBuffer(int size)
 {
     ConnectionOutputPtr oco;
 
     oco = malloc(sizeof(ConnectionOutput));
     if (!oco)
         return NULL;
-    oco->buf = calloc(1, BUFSIZE);
+    oco->buf = calloc(1, size);
     if (!oco->buf) {
         free(oco);
         return NULL;
     }
-    oco->size = BUFSIZE;
+    oco->size = size;
     oco->count = 0;
+    oco->extras = NULL;
+    oco->lastExtra = NULL;
     return oco;
 }
 
@@ -1084,7 +1457,8 @@ FreeOsBuffers(OsCommPtr oc)
     if (AvailableInput == oc)
         AvailableInput = (OsCommPtr) NULL;
     if ((oci = oc->input)) {
-        if (FreeInputs) {
+        FreeSpill(oci);
+        if (FreeInputs || oci->size > BUFWATERMARK) {
             free(oci->buffer);
             free(oci);
         }
@@ -1098,7 +1472,8 @@ FreeOsBuffers(OsCommPtr oc)
         }
     }
     if ((oco = oc->output)) {
-        if (FreeOutputs) {
+        FreeOutputExtras(oco);
+        if (FreeOutputs || oco->size > BUFWATERMARK) {
             free(oco->buf);
             free(oco);
         }
@@ -1118,6 +1493,7 @@ ResetOsBuffers(void)
 
     while ((oci = FreeInputs)) {
         FreeInputs = oci->next;
+        FreeSpill(oci);
         free(oci->buffer);
         free(oci);
     }
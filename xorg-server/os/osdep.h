@@ -148,6 +148,9 @@ typedef struct _osComm {
     XID auth_id;                /* authorization id */
     CARD32 conn_time;           /* timestamp if not established, else 0  */
     struct _XtransConnInfo *trans_conn; /* transport connection object */
+    int req_len_peak;           /* decaying peak request length, sizes input */
+    unsigned long input_moved;  /* input bytes copied around after reading */
+    int out_peak;               /* decaying peak of bytes buffered per flush */
 } OsCommRec, *OsCommPtr;
 
 extern int FlushClient(ClientPtr /*who */ ,
@@ -182,6 +185,11 @@ extern void ClearConnectionTranslation(void);
 extern Bool NewOutputPending;
 extern Bool AnyClientsWriteBlocked;
 
+#ifndef WIN32
+#include "ospoll.h"
+extern struct ospoll *server_poll;
+#endif
+
 extern WorkQueuePtr workQueue;
 
 /* in WaitFor.c */
@@ -0,0 +1,385 @@
+/*
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "misc.h"
+#include "ospoll.h"
+
+#if defined(HAVE_EPOLL_CREATE1)
+#include <sys/epoll.h>
+#define EPOLL   1
+#elif defined(HAVE_POLL)
+#include <poll.h>
+#define POLL    1
+#else
+#error "ospoll needs epoll or poll"
+#endif
+
+/*
+ * Registered descriptors are kept in an array sorted by fd so that
+ * listen/mute/remove are a binary search away.  The epoll backend only
+ * uses the array for bookkeeping; the poll backend keeps a parallel
+ * array of struct pollfd that is handed straight to the kernel.
+ */
+
+struct ospollfd {
+    int                 fd;
+    int                 xevents;
+    ospoll_callback_ptr callback;
+    void                *data;
+};
+
+struct ospoll {
+    struct ospollfd     *osfds;
+    int                 num;
+    int                 size;
+#if EPOLL
+    int                 epoll_fd;
+    struct epoll_event  *events;
+#endif
+#if POLL
+    struct pollfd       *fds;
+    struct pollfd       *ready;
+#endif
+};
+
+/* Returns the index of fd, or -(insertion point) - 1 if not present */
+static int
+ospoll_find(struct ospoll *ospoll, int fd)
+{
+    int lo = 0;
+    int hi = ospoll->num - 1;
+
+    while (lo <= hi) {
+        int m = (lo + hi) >> 1;
+        int t = ospoll->osfds[m].fd;
+
+        if (t < fd)
+            lo = m + 1;
+        else if (t > fd)
+            hi = m - 1;
+        else
+            return m;
+    }
+    return -(lo + 1);
+}
+
+#if EPOLL
+static uint32_t
+ospoll_epoll_events(int xevents)
+{
+    uint32_t events = 0;
+
+    if (xevents & X_NOTIFY_READ)
+        events |= EPOLLIN;
+    if (xevents & X_NOTIFY_WRITE)
+        events |= EPOLLOUT;
+    return events;
+}
+
+/*
+ * epoll reports hangups even for descriptors with no events selected,
+ * so muted descriptors are taken out of the epoll set altogether.
+ */
+static void
+ospoll_epoll_update(struct ospoll *ospoll, struct ospollfd *osfd, int old)
+{
+    struct epoll_event ev;
+    int op;
+
+    if (osfd->xevents == X_NOTIFY_NONE)
+        op = EPOLL_CTL_DEL;
+    else if (old == X_NOTIFY_NONE)
+        op = EPOLL_CTL_ADD;
+    else
+        op = EPOLL_CTL_MOD;
+    ev.events = ospoll_epoll_events(osfd->xevents);
+    ev.data.fd = osfd->fd;
+    (void) epoll_ctl(ospoll->epoll_fd, op, osfd->fd, &ev);
+}
+#endif
+
+#if POLL
+static short
+ospoll_poll_events(int xevents)
+{
+    short events = 0;
+
+    if (xevents & X_NOTIFY_READ)
+        events |= POLLIN;
+    if (xevents & X_NOTIFY_WRITE)
+        events |= POLLOUT;
+    return events;
+}
+#endif
+
+struct ospoll *
+ospoll_create(void)
+{
+    struct ospoll *ospoll = calloc(1, sizeof (struct ospoll));
+
+    if (!ospoll)
+        return NULL;
+#if EPOLL
+    ospoll->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ospoll->epoll_fd < 0) {
+        free(ospoll);
+        return NULL;
+    }
+#endif
+    return ospoll;
+}
+
+void
+ospoll_destroy(struct ospoll *ospoll)
+{
+    if (!ospoll)
+        return;
+#if EPOLL
+    close(ospoll->epoll_fd);
+    free(ospoll->events);
+#endif
+#if POLL
+    free(ospoll->fds);
+    free(ospoll->ready);
+#endif
+    free(ospoll->osfds);
+    free(ospoll);
+}
+
+static Bool
+ospoll_grow(struct ospoll *ospoll)
+{
+    int size = ospoll->size ? ospoll->size * 2 : 64;
+    struct ospollfd *osfds;
+
+    osfds = realloc(ospoll->osfds, size * sizeof (struct ospollfd));
+    if (!osfds)
+        return FALSE;
+    ospoll->osfds = osfds;
+#if EPOLL
+    {
+        struct epoll_event *events;
+
+        events = realloc(ospoll->events,
+                         size * sizeof (struct epoll_event));
+        if (!events)
+            return FALSE;
+        ospoll->events = events;
+    }
+#endif
+#if POLL
+    {
+        struct pollfd *fds, *ready;
+
+        fds = realloc(ospoll->fds, size * sizeof (struct pollfd));
+        if (!fds)
+            return FALSE;
+        ospoll->fds = fds;
+        ready = realloc(ospoll->ready, size * sizeof (struct pollfd));
+        if (!ready)
+            return FALSE;
+        ospoll->ready = ready;
+    }
+#endif
+    ospoll->size = size;
+    return TRUE;
+}
+
+/*
+ * Register fd with no events enabled, use ospoll_listen to turn them on.  Registering an fd that is
+ * already present just replaces its callback.
+ */
+Bool
+ospoll_add(struct ospoll *ospoll, int fd,
+           ospoll_callback_ptr callback, void *data)
+{
+    struct ospollfd *osfd;
+    int pos = ospoll_find(ospoll, fd);
+
+    if (pos >= 0) {
+        osfd = &ospoll->osfds[pos];
+        osfd->callback = callback;
+        osfd->data = data;
+        return TRUE;
+    }
+
+    if (ospoll->num == ospoll->size && !ospoll_grow(ospoll))
+        return FALSE;
+
+    pos = -pos - 1;
+    memmove(&ospoll->osfds[pos + 1], &ospoll->osfds[pos],
+            (ospoll->num - pos) * sizeof (struct ospollfd));
+#if POLL
+    memmove(&ospoll->fds[pos + 1], &ospoll->fds[pos],
+            (ospoll->num - pos) * sizeof (struct pollfd));
+    ospoll->fds[pos].fd = -1;
+    ospoll->fds[pos].events = 0;
+    ospoll->fds[pos].revents = 0;
+#endif
+    ospoll->num++;
+
+    osfd = &ospoll->osfds[pos];
+    osfd->fd = fd;
+    osfd->xevents = X_NOTIFY_NONE;
+    osfd->callback = callback;
+    osfd->data = data;
+    return TRUE;
+}
+
+/* Is fd registered? */
+Bool
+ospoll_contains(struct ospoll *ospoll, int fd)
+{
+    return ospoll_find(ospoll, fd) >= 0;
+}
+
+/* Must be called before fd is closed */
+void
+ospoll_remove(struct ospoll *ospoll, int fd)
+{
+    int pos = ospoll_find(ospoll, fd);
+
+    if (pos < 0)
+        return;
+
+#if EPOLL
+    if (ospoll->osfds[pos].xevents != X_NOTIFY_NONE)
+        (void) epoll_ctl(ospoll->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+    ospoll->num--;
+    memmove(&ospoll->osfds[pos], &ospoll->osfds[pos + 1],
+            (ospoll->num - pos) * sizeof (struct ospollfd));
+#if POLL
+    memmove(&ospoll->fds[pos], &ospoll->fds[pos + 1],
+            (ospoll->num - pos) * sizeof (struct pollfd));
+#endif
+}
+
+static void
+ospoll_set_events(struct ospoll *ospoll, int pos, int xevents)
+{
+    struct ospollfd *osfd = &ospoll->osfds[pos];
+    int old = osfd->xevents;
+
+    if (old == xevents)
+        return;
+    osfd->xevents = xevents;
+#if EPOLL
+    ospoll_epoll_update(ospoll, osfd, old);
+#endif
+#if POLL
+    /* poll() skips negative descriptors, hangups included */
+    ospoll->fds[pos].fd = xevents ? osfd->fd : -1;
+    ospoll->fds[pos].events = ospoll_poll_events(xevents);
+#endif
+}
+
+void
+ospoll_listen(struct ospoll *ospoll, int fd, int xevents)
+{
+    int pos = ospoll_find(ospoll, fd);
+
+    if (pos >= 0)
+        ospoll_set_events(ospoll, pos, ospoll->osfds[pos].xevents | xevents);
+}
+
+void
+ospoll_mute(struct ospoll *ospoll, int fd, int xevents)
+{
+    int pos = ospoll_find(ospoll, fd);
+
+    if (pos >= 0)
+        ospoll_set_events(ospoll, pos, ospoll->osfds[pos].xevents & ~xevents);
+}
+
+/*
+ * Wait up to timeout milliseconds (-1 for ever) and invoke the callback
+ * of every ready descriptor.  Callbacks may listen, mute or remove any
+ * descriptor, including their own.  Returns the number of ready
+ * descriptors, or -1 with errno set.
+ */
+int
+ospoll_wait(struct ospoll *ospoll, int timeout)
+{
+    int nready;
+    int i;
+
+#if EPOLL
+    nready = epoll_wait(ospoll->epoll_fd, ospoll->events,
+                        ospoll->size ? ospoll->size : 1, timeout);
+    for (i = 0; i < nready; i++) {
+        /* callbacks may grow ospoll->events, don't hold on to it */
+        int fd = ospoll->events[i].data.fd;
+        uint32_t events = ospoll->events[i].events;
+        int pos = ospoll_find(ospoll, fd);
+        int xevents = 0;
+
+        if (pos < 0)
+            continue;
+        if (events & EPOLLIN)
+            xevents |= X_NOTIFY_READ;
+        if (events & EPOLLOUT)
+            xevents |= X_NOTIFY_WRITE;
+        if (events & (EPOLLERR | EPOLLHUP))
+            xevents |= X_NOTIFY_ERROR;
+        ospoll->osfds[pos].callback(fd, xevents, ospoll->osfds[pos].data);
+    }
+#endif
+#if POLL
+    int nfound = 0;
+
+    nready = poll(ospoll->fds, ospoll->num, timeout);
+    if (nready <= 0)
+        return nready;
+
+    /* Snapshot the ready set, callbacks may reshuffle ospoll->fds */
+    for (i = 0; i < ospoll->num && nfound < nready; i++)
+        if (ospoll->fds[i].revents)
+            ospoll->ready[nfound++] = ospoll->fds[i];
+
+    for (i = 0; i < nfound; i++) {
+        int fd = ospoll->ready[i].fd;
+        short revents = ospoll->ready[i].revents;
+        int pos = ospoll_find(ospoll, fd);
+        int xevents = 0;
+
+        if (pos < 0)
+            continue;
+        if (revents & POLLIN)
+            xevents |= X_NOTIFY_READ;
+        if (revents & POLLOUT)
+            xevents |= X_NOTIFY_WRITE;
+        if (revents & (POLLERR | POLLHUP | POLLNVAL))
+            xevents |= X_NOTIFY_ERROR;
+        ospoll->osfds[pos].callback(fd, xevents, ospoll->osfds[pos].data);
+    }
+#endif
+    return nready;
+}
@@ -120,6 +120,7 @@ __stdcall unsigned long GetTickCount(void);
 #include "opaque.h"
 
 #include "dixstruct.h"
+#include "reqstats.h"
 
 #include "xkbsrv.h"
 
@@ -159,6 +160,7 @@ Bool noSecurityExtension = FALSE;
 #endif
 #ifdef RES
 Bool noResExtension = FALSE;
+Bool noReqStatsExtension = FALSE;
 #endif
 #ifdef XF86BIGFONT
 Bool noXFree86BigfontExtension = FALSE;
@@ -199,6 +201,8 @@ Bool CoreDump;
 
 Bool enableIndirectGLX = TRUE;
 
+Bool enableGLXThreads = FALSE;
+
 #ifdef PANORAMIX
 Bool PanoramiXExtensionDisabledHack = FALSE;
 #endif
@@ -565,10 +569,14 @@ UseMsg(void)
     ErrorF("-f #                   bell base (0-100)\n");
     ErrorF("-fc string             cursor font\n");
     ErrorF("-fn string             default font name\n");
+    ErrorF("-fontindex             write fonts.idx into font directories\n");
     ErrorF("-fp string             default font path\n");
     ErrorF("-help                  prints message with these options\n");
     ErrorF("+iglx                  Allow creating indirect GLX contexts (default)\n");
     ErrorF("-iglx                  Prohibit creating indirect GLX contexts\n");
+#ifdef GLX_RENDER_THREADS
+    ErrorF("-glxthreads            run indirect GL rendering on per-context threads\n");
+#endif
     ErrorF("-I                     ignore all remaining arguments\n");
 #ifdef RLIMIT_DATA
     ErrorF("-ld int                limit data space to N Kb\n");
@@ -592,6 +600,7 @@ UseMsg(void)
     ErrorF("-r                     turns off auto-repeat\n");
     ErrorF("r                      turns on auto-repeat \n");
     ErrorF("-render [default|mono|gray|color] set render color alloc policy\n");
+    ErrorF("-reqstats              collect per-request and per-client statistics\n");
     ErrorF("-retro                 start with classic stipple\n");
     ErrorF("-seat string           seat to run on\n");
     ErrorF("-t #                   default pointer threshold (pixels/t)\n");
@@ -606,7 +615,12 @@ UseMsg(void)
 #endif
     ErrorF
         ("-dumbSched             Disable smart scheduling, enable old behavior\n");
+#ifdef INPUTTHREAD
+    ErrorF("-inputthread           read input devices in a separate thread\n");
+#endif
     ErrorF("-schedInterval int     Set scheduler interval in msec\n");
+    ErrorF("-schedPolicy fair|priority  Set smart scheduling policy\n");
+    ErrorF("-schedClass w:name,... Give clients named name a scheduling weight of w\n");
     ErrorF("+extension name        Enable extension\n");
     ErrorF("-extension name        Disable extension\n");
 #ifdef XDMCP
@@ -825,6 +839,8 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-fontindex") == 0)
+            FontFileWriteIndexes = TRUE;
         else if (strcmp(argv[i], "-fp") == 0) {
             if (++i < argc) {
                 defaultFontPath = argv[i];
@@ -840,6 +856,10 @@ ProcessCommandLine(int argc, char *argv[])
             enableIndirectGLX = TRUE;
         else if (strcmp(argv[i], "-iglx") == 0)
             enableIndirectGLX = FALSE;
+#ifdef GLX_RENDER_THREADS
+        else if (strcmp(argv[i], "-glxthreads") == 0)
+            enableGLXThreads = TRUE;
+#endif
         else if ((skip = XkbProcessArguments(argc, argv, i)) != 0) {
             if (skip > 0)
                 i += skip - 1;
@@ -1012,6 +1032,14 @@ ProcessCommandLine(int argc, char *argv[])
         else if ((skip = XdmcpOptions(argc, argv, i)) != i) {
             i = skip - 1;
         }
+#endif
+        else if (strcmp(argv[i], "-reqstats") == 0) {
+            ReqStatsEnabled = TRUE;
+        }
+#ifdef INPUTTHREAD
+        else if (strcmp(argv[i], "-inputthread") == 0) {
+            InputThreadEnable = TRUE;
+        }
 #endif
 #ifdef SMART_SCHEDULE_POSSIBLE
         else if (strcmp(argv[i], "-dumbSched") == 0) {
@@ -1032,6 +1060,18 @@ ProcessCommandLine(int argc, char *argv[])
             else
                 UseMsg();
         }
+        else if (strcmp(argv[i], "-schedPolicy") == 0) {
+            if (++i < argc && strcmp(argv[i], "fair") == 0)
+                SmartScheduleFair = TRUE;
+            else if (i < argc && strcmp(argv[i], "priority") == 0)
+                SmartScheduleFair = FALSE;
+            else
+                UseMsg();
+        }
+        else if (strcmp(argv[i], "-schedClass") == 0) {
+            if (++i >= argc || !SmartScheduleAddClass(argv[i]))
+                UseMsg();
+        }
 #endif
         else if (strcmp(argv[i], "-render") == 0) {
             if (++i < argc) {
@@ -1296,6 +1336,16 @@ static int BlockedSignalCount;
 void
 OsBlockSignals(void)
 {
+#ifdef INPUTTHREAD
+    /* Whichever thread we are on, the other one may be touching the
+     * same input state, so hold the input lock for the whole section.
+     * The input thread runs with every signal blocked already. */
+    if (InputThreadEnable) {
+        InputThreadLock();
+        if (InputThreadSelf())
+            return;
+    }
+#endif
 #ifdef SIG_BLOCK
     if (BlockedSignalCount++ == 0) {
         sigset_t set;
@@ -1330,6 +1380,14 @@ static sigset_t PreviousSigIOMask;
 int
 OsBlockSIGIO(void)
 {
+#ifdef INPUTTHREAD
+    /* Devices are read by the input thread rather than from SIGIO, so
+     * keeping them out of the way means holding the input lock. */
+    if (InputThreadEnable) {
+        InputThreadLock();
+        return 0;
+    }
+#endif
 #ifdef SIGIO
 #ifdef SIG_BLOCK
     if (sigio_blocked++ == 0) {
@@ -1350,6 +1408,12 @@ OsBlockSIGIO(void)
 void
 OsReleaseSIGIO(void)
 {
+#ifdef INPUTTHREAD
+    if (InputThreadEnable) {
+        InputThreadUnlock();
+        return;
+    }
+#endif
 #ifdef SIGIO
 #ifdef SIG_BLOCK
     if (--sigio_blocked == 0) {
@@ -1365,12 +1429,22 @@ OsReleaseSIGIO(void)
 void
 OsReleaseSignals(void)
 {
+#ifdef INPUTTHREAD
+    if (InputThreadEnable && InputThreadSelf()) {
+        InputThreadUnlock();
+        return;
+    }
+#endif
 #ifdef SIG_BLOCK
     if (--BlockedSignalCount == 0) {
         sigprocmask(SIG_SETMASK, &PreviousSignalMask, 0);
         OsReleaseSIGIO();
     }
 #endif
+#ifdef INPUTTHREAD
+    if (InputThreadEnable)
+        InputThreadUnlock();
+#endif
 }
 
 void
@@ -1384,6 +1458,9 @@ OsResetSignals(void)
         OsReleaseSIGIO();
 #endif
 #endif
+#ifdef INPUTTHREAD
+    InputThreadForceUnlock();
+#endif
 }
 
 /*
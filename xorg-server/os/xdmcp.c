@@ -1119,6 +1119,16 @@ get_xdmcp_sock(void)
       } 
     }
 #endif                          /* STREAMSCONN */
+#ifndef WIN32
+    /* XdmcpBlockHandler adding the sockets to the select mask is not
+     * seen by the ospoll backend, register them once instead */
+    if (xdmcpSocket >= 0)
+        AddGeneralSocket(xdmcpSocket);
+#if defined(IPv6) && defined(AF_INET6)
+    if (xdmcpSocket6 >= 0)
+        AddGeneralSocket(xdmcpSocket6);
+#endif
+#endif
 }
 
 static void
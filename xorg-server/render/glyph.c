@@ -46,42 +46,214 @@
 #include "mipict.h"
 
 /*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
+ * Glyph hash tables are open addressed with linear probing and sized to
+ * a power of two.  Signatures are either glyph ids, which clients tend to
+ * hand out sequentially, or the first word of the glyph's SHA1; both are
+ * run through a cheap integer mix before being masked to the table size.
+ * Entries in the global tables are then told apart by comparing the full
+ * SHA1.
+ *
+ * A table is kept at most three quarters full, counting deleted slots.
+ * When it would go over, a table with room for the live entries plus a
+ * margin is allocated and the old table is kept around: each following
+ * insertion or deletion moves a few slots of it over, so that a glyph
+ * set with a million glyphs never stalls the server to rehash them all
+ * at once.  Lookups check both tables while this is going on.
  */
-static GlyphHashSetRec glyphHashSets[] = {
-    {32, 43, 41},
-    {64, 73, 71},
-    {128, 151, 149},
-    {256, 283, 281},
-    {512, 571, 569},
-    {1024, 1153, 1151},
-    {2048, 2269, 2267},
-    {4096, 4519, 4517},
-    {8192, 9013, 9011},
-    {16384, 18043, 18041},
-    {32768, 36109, 36107},
-    {65536, 72091, 72089},
-    {131072, 144409, 144407},
-    {262144, 288361, 288359},
-    {524288, 576883, 576881},
-    {1048576, 1153459, 1153457},
-    {2097152, 2307163, 2307161},
-    {4194304, 4613893, 4613891},
-    {8388608, 9227641, 9227639},
-    {16777216, 18455029, 18455027},
-    {33554432, 36911011, 36911009},
-    {67108864, 73819861, 73819859},
-    {134217728, 147639589, 147639587},
-    {268435456, 295279081, 295279079},
-    {536870912, 590559793, 590559791}
-};
-
-#define NGLYPHHASHSETS	(sizeof(glyphHashSets)/sizeof(glyphHashSets[0]))
+#define GLYPH_HASH_MIN_SIZE	32
+#define GLYPH_HASH_MOVE		8
 
 static GlyphHashRec globalGlyphs[GlyphFormatNum];
 
+static inline CARD32
+GlyphHashIndex(CARD32 signature, CARD32 size)
+{
+    signature ^= signature >> 16;
+    signature *= 0x7feb352d;
+    signature ^= signature >> 15;
+    return signature & (size - 1);
+}
+
+static GlyphRefPtr
+GlyphHashLookupTable(GlyphRefPtr table, CARD32 size,
+                     CARD32 signature, Bool match, unsigned char sha1[20])
+{
+    CARD32 elt;
+    GlyphPtr glyph;
+
+    if (!size)
+        return NULL;
+
+    for (elt = GlyphHashIndex(signature, size);; elt = (elt + 1) & (size - 1)) {
+        glyph = table[elt].glyph;
+        if (!glyph)
+            return NULL;
+        if (glyph != DeletedGlyph && table[elt].signature == signature &&
+            (!match || memcmp(glyph->sha1, sha1, 20) == 0))
+            return &table[elt];
+    }
+}
+
+static GlyphRefPtr
+GlyphHashLookup(GlyphHashPtr hash,
+                CARD32 signature, Bool match, unsigned char sha1[20])
+{
+    GlyphRefPtr gr;
+
+    gr = GlyphHashLookupTable(hash->table, hash->size, signature, match, sha1);
+    if (!gr && hash->oldEntries)
+        gr = GlyphHashLookupTable(hash->oldTable, hash->oldSize,
+                                  signature, match, sha1);
+    return gr;
+}
+
+/* The caller makes sure that the signature isn't already there */
+static void
+GlyphHashStore(GlyphHashPtr hash, CARD32 signature, GlyphPtr glyph)
+{
+    CARD32 elt;
+    GlyphRefPtr gr;
+
+    for (elt = GlyphHashIndex(signature, hash->size);;
+         elt = (elt + 1) & (hash->size - 1)) {
+        gr = &hash->table[elt];
+        if (!gr->glyph || gr->glyph == DeletedGlyph)
+            break;
+    }
+    if (!gr->glyph)
+        hash->tableUsed++;
+    gr->signature = signature;
+    gr->glyph = glyph;
+}
+
+static void
+GlyphHashMove(GlyphHashPtr hash, CARD32 count)
+{
+    GlyphRefPtr gr;
+
+    while (hash->oldTable && count--) {
+        gr = &hash->oldTable[hash->oldNext++];
+        if (gr->glyph && gr->glyph != DeletedGlyph) {
+            GlyphHashStore(hash, gr->signature, gr->glyph);
+            hash->oldEntries--;
+        }
+        if (!hash->oldEntries || hash->oldNext == hash->oldSize) {
+            free(hash->oldTable);
+            hash->oldTable = NULL;
+            hash->oldSize = hash->oldEntries = hash->oldNext = 0;
+        }
+    }
+}
+
+/*
+ * Moves enough of the old table over that it will be gone by the time
+ * the new table fills up: the new one has at least twice the room, or
+ * when shrinking, the old one is a bounded multiple of its size.
+ */
+static void
+GlyphHashStep(GlyphHashPtr hash)
+{
+    if (hash->oldTable)
+        GlyphHashMove(hash, GLYPH_HASH_MOVE *
+                      max(1, hash->oldSize / hash->size));
+}
+
+/* Starts moving everything over to a table with room for entries */
+static Bool
+GlyphHashResize(GlyphHashPtr hash, CARD64 entries)
+{
+    CARD32 size = GLYPH_HASH_MIN_SIZE;
+    GlyphRefPtr table;
+
+    while (size / 8 * 3 < entries) {
+        if (size >= 0x80000000 / sizeof(GlyphRefRec))
+            return FALSE;
+        size <<= 1;
+    }
+
+    table = calloc(size, sizeof(GlyphRefRec));
+    if (!table)
+        return FALSE;
+
+    /* Only one resize at a time; this is rare, the new table being roomy */
+    FlushGlyphHash(hash);
+
+    if (hash->tableEntries) {
+        hash->oldTable = hash->table;
+        hash->oldSize = hash->size;
+        hash->oldEntries = hash->tableEntries;
+        hash->oldNext = 0;
+    }
+    else
+        free(hash->table);
+
+    hash->table = table;
+    hash->size = size;
+    hash->tableUsed = 0;
+    return TRUE;
+}
+
+static Bool
+GlyphHashReserve(GlyphHashPtr hash, CARD32 change)
+{
+    CARD64 filled = (CARD64) hash->tableUsed + hash->oldEntries + change;
+
+    if (filled * 4 <= (CARD64) hash->size * 3)
+        return TRUE;
+    return GlyphHashResize(hash, (CARD64) hash->tableEntries + change);
+}
+
+static Bool
+GlyphHashInsert(GlyphHashPtr hash, CARD32 signature, GlyphPtr glyph)
+{
+    GlyphHashStep(hash);
+    if (!GlyphHashReserve(hash, 1))
+        return FALSE;
+    GlyphHashStore(hash, signature, glyph);
+    hash->tableEntries++;
+    return TRUE;
+}
+
+static void
+GlyphHashRemove(GlyphHashPtr hash, GlyphRefPtr gr)
+{
+    if (gr >= hash->oldTable && gr < hash->oldTable + hash->oldSize)
+        hash->oldEntries--;
+    gr->glyph = DeletedGlyph;
+    gr->signature = 0;
+    hash->tableEntries--;
+
+    GlyphHashStep(hash);
+}
+
+/*
+ * Not done on every removal, as that would undo what ResizeGlyphSet()
+ * reserved when adding glyphs replaces others.
+ */
+static void
+GlyphHashShrink(GlyphHashPtr hash)
+{
+    if (!hash->oldTable && hash->size > GLYPH_HASH_MIN_SIZE &&
+        hash->tableEntries < hash->size / 16)
+        (void) GlyphHashResize(hash, hash->tableEntries);
+}
+
+/* Finishes any resize, leaving every entry in hash->table */
+void
+FlushGlyphHash(GlyphHashPtr hash)
+{
+    if (hash->oldTable)
+        GlyphHashMove(hash, hash->oldSize);
+}
+
+static void
+FreeGlyphHash(GlyphHashPtr hash)
+{
+    free(hash->table);
+    free(hash->oldTable);
+    memset(hash, 0, sizeof(*hash));
+}
+
 void
 GlyphUninit(ScreenPtr pScreen)
 {
@@ -90,10 +262,9 @@ GlyphUninit(ScreenPtr pScreen)
     int fdepth, i;
 
     for (fdepth = 0; fdepth < GlyphFormatNum; fdepth++) {
-        if (!globalGlyphs[fdepth].hashSet)
-            continue;
+        FlushGlyphHash(&globalGlyphs[fdepth]);
 
-        for (i = 0; i < globalGlyphs[fdepth].hashSet->size; i++) {
+        for (i = 0; i < globalGlyphs[fdepth].size; i++) {
             glyph = globalGlyphs[fdepth].table[i].glyph;
             if (glyph && glyph != DeletedGlyph) {
                 if (GetGlyphPicture(glyph, pScreen)) {
@@ -106,61 +277,6 @@ GlyphUninit(ScreenPtr pScreen)
     }
 }
 
-GlyphHashSetPtr
-FindGlyphHashSet(CARD32 filled)
-{
-    int i;
-
-    for (i = 0; i < NGLYPHHASHSETS; i++)
-        if (glyphHashSets[i].entries >= filled)
-            return &glyphHashSets[i];
-    return 0;
-}
-
-GlyphRefPtr
-FindGlyphRef(GlyphHashPtr hash,
-             CARD32 signature, Bool match, unsigned char sha1[20])
-{
-    CARD32 elt, step, s;
-    GlyphPtr glyph;
-    GlyphRefPtr table, gr, del;
-    CARD32 tableSize = hash->hashSet->size;
-
-    table = hash->table;
-    elt = signature % tableSize;
-    step = 0;
-    del = 0;
-    for (;;) {
-        gr = &table[elt];
-        s = gr->signature;
-        glyph = gr->glyph;
-        if (!glyph) {
-            if (del)
-                gr = del;
-            break;
-        }
-        if (glyph == DeletedGlyph) {
-            if (!del)
-                del = gr;
-            else if (gr == del)
-                break;
-        }
-        else if (s == signature &&
-                 (!match || memcmp(glyph->sha1, sha1, 20) == 0)) {
-            break;
-        }
-        if (!step) {
-            step = signature % hash->hashSet->rehash;
-            if (!step)
-                step = 1;
-        }
-        elt += step;
-        if (elt >= tableSize)
-            elt -= tableSize;
-    }
-    return gr;
-}
-
 int
 HashGlyph(xGlyphInfo * gi,
           CARD8 *bits, unsigned long size, unsigned char sha1[20])
@@ -189,44 +305,10 @@ FindGlyphByHash(unsigned char sha1[20], int format)
     GlyphRefPtr gr;
     CARD32 signature = *(CARD32 *) sha1;
 
-    if (!globalGlyphs[format].hashSet)
-        return NULL;
-
-    gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, sha1);
-
-    if (gr->glyph && gr->glyph != DeletedGlyph)
-        return gr->glyph;
-    else
-        return NULL;
-}
-
-#ifdef CHECK_DUPLICATES
-void
-DuplicateRef(GlyphPtr glyph, char *where)
-{
-    ErrorF("Duplicate Glyph 0x%x from %s\n", glyph, where);
+    gr = GlyphHashLookup(&globalGlyphs[format], signature, TRUE, sha1);
+    return gr ? gr->glyph : NULL;
 }
 
-void
-CheckDuplicates(GlyphHashPtr hash, char *where)
-{
-    GlyphPtr g;
-    int i, j;
-
-    for (i = 0; i < hash->hashSet->size; i++) {
-        g = hash->table[i].glyph;
-        if (!g || g == DeletedGlyph)
-            continue;
-        for (j = i + 1; j < hash->hashSet->size; j++)
-            if (hash->table[j].glyph == g)
-                DuplicateRef(g, where);
-    }
-}
-#else
-#define CheckDuplicates(a,b)
-#define DuplicateRef(a,b)
-#endif
-
 static void
 FreeGlyphPicture(GlyphPtr glyph)
 {
@@ -248,68 +330,53 @@ FreeGlyphPicture(GlyphPtr glyph)
 void
 FreeGlyph(GlyphPtr glyph, int format)
 {
-    CheckDuplicates(&globalGlyphs[format], "FreeGlyph");
     if (--glyph->refcnt == 0) {
         GlyphRefPtr gr;
-        int i;
-        int first;
         CARD32 signature;
 
-        first = -1;
-        for (i = 0; i < globalGlyphs[format].hashSet->size; i++)
-            if (globalGlyphs[format].table[i].glyph == glyph) {
-                if (first != -1)
-                    DuplicateRef(glyph, "FreeGlyph check");
-                first = i;
-            }
-
         signature = *(CARD32 *) glyph->sha1;
-        gr = FindGlyphRef(&globalGlyphs[format], signature, TRUE, glyph->sha1);
-        if (gr - globalGlyphs[format].table != first)
-            DuplicateRef(glyph, "Found wrong one");
-        if (gr->glyph && gr->glyph != DeletedGlyph) {
-            gr->glyph = DeletedGlyph;
-            gr->signature = 0;
-            globalGlyphs[format].tableEntries--;
-        }
+        gr = GlyphHashLookup(&globalGlyphs[format], signature,
+                             TRUE, glyph->sha1);
+        if (gr && gr->glyph == glyph)
+            GlyphHashRemove(&globalGlyphs[format], gr);
 
         FreeGlyphPicture(glyph);
         dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
     }
 }
 
+/*
+ * Can't fail: ResizeGlyphSet() has made room in both tables beforehand.
+ */
 void
 AddGlyph(GlyphSetPtr glyphSet, GlyphPtr glyph, Glyph id)
 {
+    GlyphHashPtr global = &globalGlyphs[glyphSet->fdepth];
     GlyphRefPtr gr;
+    GlyphPtr old;
     CARD32 signature;
 
-    CheckDuplicates(&globalGlyphs[glyphSet->fdepth], "AddGlyph top global");
     /* Locate existing matching glyph */
     signature = *(CARD32 *) glyph->sha1;
-    gr = FindGlyphRef(&globalGlyphs[glyphSet->fdepth], signature,
-                      TRUE, glyph->sha1);
-    if (gr->glyph && gr->glyph != DeletedGlyph && gr->glyph != glyph) {
+    gr = GlyphHashLookup(global, signature, TRUE, glyph->sha1);
+    if (gr && gr->glyph != glyph) {
         FreeGlyphPicture(glyph);
         dixFreeObjectWithPrivates(glyph, PRIVATE_GLYPH);
         glyph = gr->glyph;
     }
-    else if (gr->glyph != glyph) {
-        gr->glyph = glyph;
-        gr->signature = signature;
-        globalGlyphs[glyphSet->fdepth].tableEntries++;
-    }
+    else if (!gr)
+        GlyphHashInsert(global, signature, glyph);
 
     /* Insert/replace glyphset value */
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
+    gr = GlyphHashLookup(&glyphSet->hash, id, FALSE, 0);
     ++glyph->refcnt;
-    if (gr->glyph && gr->glyph != DeletedGlyph)
-        FreeGlyph(gr->glyph, glyphSet->fdepth);
+    if (gr) {
+        old = gr->glyph;
+        gr->glyph = glyph;
+        FreeGlyph(old, glyphSet->fdepth);
+    }
     else
-        glyphSet->hash.tableEntries++;
-    gr->glyph = glyph;
-    gr->signature = id;
-    CheckDuplicates(&globalGlyphs[glyphSet->fdepth], "AddGlyph bottom");
+        GlyphHashInsert(&glyphSet->hash, id, glyph);
 }
 
 Bool
@@ -318,12 +385,13 @@ DeleteGlyph(GlyphSetPtr glyphSet, Glyph id)
     GlyphRefPtr gr;
     GlyphPtr glyph;
 
-    gr = FindGlyphRef(&glyphSet->hash, id, FALSE, 0);
-    glyph = gr->glyph;
-    if (glyph && glyph != DeletedGlyph) {
-        gr->glyph = DeletedGlyph;
-        glyphSet->hash.tableEntries--;
+    gr = GlyphHashLookup(&glyphSet->hash, id, FALSE, 0);
+    if (gr) {
+        glyph = gr->glyph;
+        GlyphHashRemove(&glyphSet->hash, gr);
         FreeGlyph(glyph, glyphSet->fdepth);
+        GlyphHashShrink(&glyphSet->hash);
+        GlyphHashShrink(&globalGlyphs[glyphSet->fdepth]);
         return TRUE;
     }
     return FALSE;
@@ -332,12 +400,10 @@ DeleteGlyph(GlyphSetPtr glyphSet, Glyph id)
 GlyphPtr
 FindGlyph(GlyphSetPtr glyphSet, Glyph id)
 {
-    GlyphPtr glyph;
+    GlyphRefPtr gr;
 
-    glyph = FindGlyphRef(&glyphSet->hash, id, FALSE, 0)->glyph;
-    if (glyph == DeletedGlyph)
-        glyph = 0;
-    return glyph;
+    gr = GlyphHashLookup(&glyphSet->hash, id, FALSE, 0);
+    return gr ? gr->glyph : NULL;
 }
 
 GlyphPtr
@@ -383,63 +449,15 @@ AllocateGlyph(xGlyphInfo * gi, int fdepth)
     return 0;
 }
 
-Bool
-AllocateGlyphHash(GlyphHashPtr hash, GlyphHashSetPtr hashSet)
-{
-    hash->table = calloc(hashSet->size, sizeof(GlyphRefRec));
-    if (!hash->table)
-        return FALSE;
-    hash->hashSet = hashSet;
-    hash->tableEntries = 0;
-    return TRUE;
-}
-
-Bool
-ResizeGlyphHash(GlyphHashPtr hash, CARD32 change, Bool global)
-{
-    CARD32 tableEntries;
-    GlyphHashSetPtr hashSet;
-    GlyphHashRec newHash;
-    GlyphRefPtr gr;
-    GlyphPtr glyph;
-    int i;
-    int oldSize;
-    CARD32 s;
-
-    tableEntries = hash->tableEntries + change;
-    hashSet = FindGlyphHashSet(tableEntries);
-    if (hashSet == hash->hashSet)
-        return TRUE;
-    if (global)
-        CheckDuplicates(hash, "ResizeGlyphHash top");
-    if (!AllocateGlyphHash(&newHash, hashSet))
-        return FALSE;
-    if (hash->table) {
-        oldSize = hash->hashSet->size;
-        for (i = 0; i < oldSize; i++) {
-            glyph = hash->table[i].glyph;
-            if (glyph && glyph != DeletedGlyph) {
-                s = hash->table[i].signature;
-                gr = FindGlyphRef(&newHash, s, global, glyph->sha1);
-
-                gr->signature = s;
-                gr->glyph = glyph;
-                ++newHash.tableEntries;
-            }
-        }
-        free(hash->table);
-    }
-    *hash = newHash;
-    if (global)
-        CheckDuplicates(hash, "ResizeGlyphHash bottom");
-    return TRUE;
-}
-
+/*
+ * Makes room for change more glyphs in the glyph set and in the global
+ * table, so that the AddGlyph() calls that follow can't fail.
+ */
 Bool
 ResizeGlyphSet(GlyphSetPtr glyphSet, CARD32 change)
 {
-    return (ResizeGlyphHash(&glyphSet->hash, change, FALSE) &&
-            ResizeGlyphHash(&globalGlyphs[glyphSet->fdepth], change, TRUE));
+    return (GlyphHashReserve(&glyphSet->hash, change) &&
+            GlyphHashReserve(&globalGlyphs[glyphSet->fdepth], change));
 }
 
 GlyphSetPtr
@@ -447,19 +465,11 @@ AllocateGlyphSet(int fdepth, PictFormatPtr format)
 {
     GlyphSetPtr glyphSet;
 
-    if (!globalGlyphs[fdepth].hashSet) {
-        if (!AllocateGlyphHash(&globalGlyphs[fdepth], &glyphHashSets[0]))
-            return FALSE;
-    }
-
     glyphSet = dixAllocateObjectWithPrivates(GlyphSetRec, PRIVATE_GLYPHSET);
     if (!glyphSet)
         return FALSE;
 
-    if (!AllocateGlyphHash(&glyphSet->hash, &glyphHashSets[0])) {
-        free(glyphSet);
-        return FALSE;
-    }
+    memset(&glyphSet->hash, 0, sizeof(glyphSet->hash));
     glyphSet->refcnt = 1;
     glyphSet->fdepth = fdepth;
     glyphSet->format = format;
@@ -472,28 +482,72 @@ FreeGlyphSet(void *value, XID gid)
     GlyphSetPtr glyphSet = (GlyphSetPtr) value;
 
     if (--glyphSet->refcnt == 0) {
-        CARD32 i, tableSize = glyphSet->hash.hashSet->size;
-        GlyphRefPtr table = glyphSet->hash.table;
+        CARD32 i;
+        GlyphRefPtr table;
         GlyphPtr glyph;
 
-        for (i = 0; i < tableSize; i++) {
+        FlushGlyphHash(&glyphSet->hash);
+        table = glyphSet->hash.table;
+        for (i = 0; i < glyphSet->hash.size; i++) {
             glyph = table[i].glyph;
             if (glyph && glyph != DeletedGlyph)
                 FreeGlyph(glyph, glyphSet->fdepth);
         }
-        if (!globalGlyphs[glyphSet->fdepth].tableEntries) {
-            free(globalGlyphs[glyphSet->fdepth].table);
-            globalGlyphs[glyphSet->fdepth].table = 0;
-            globalGlyphs[glyphSet->fdepth].hashSet = 0;
-        }
+        if (!globalGlyphs[glyphSet->fdepth].tableEntries)
+            FreeGlyphHash(&globalGlyphs[glyphSet->fdepth]);
         else
-            ResizeGlyphHash(&globalGlyphs[glyphSet->fdepth], 0, TRUE);
-        free(table);
+            GlyphHashShrink(&globalGlyphs[glyphSet->fdepth]);
+        FreeGlyphHash(&glyphSet->hash);
         dixFreeObjectWithPrivates(glyphSet, PRIVATE_GLYPHSET);
     }
     return Success;
 }
 
+static void
+GlyphTableBytes(GlyphRefPtr table, CARD32 tableSize, ResourceSizePtr size)
+{
+    ResourceSizeRec pictureSize;
+    PicturePtr picture;
+    GlyphPtr glyph;
+    CARD32 i;
+    int s;
+
+    for (i = 0; i < tableSize; i++) {
+        glyph = table[i].glyph;
+        if (!glyph || glyph == DeletedGlyph)
+            continue;
+
+        size->resourceSize += glyph->size / glyph->refcnt;
+        for (s = 0; s < screenInfo.numScreens; s++) {
+            picture = GetGlyphPicture(glyph, screenInfo.screens[s]);
+            if (!picture)
+                continue;
+            GetResourceTypeSizeFunc(PictureType) (picture, 0, &pictureSize);
+            size->pixmapRefSize += pictureSize.pixmapRefSize / glyph->refcnt;
+        }
+    }
+}
+
+/*
+ * X-Resource accounting: a glyph set is charged for its tables and for
+ * its share of each glyph, glyphs being shared by every set holding the
+ * same image.  The pictures holding the glyph images on each screen count
+ * as pixmap memory.
+ */
+void
+GetGlyphSetBytes(void *value, XID gid, ResourceSizePtr size)
+{
+    GlyphSetPtr glyphSet = (GlyphSetPtr) value;
+    GlyphHashPtr hash = &glyphSet->hash;
+
+    size->resourceSize = (hash->size + hash->oldSize) * sizeof(GlyphRefRec);
+    size->pixmapRefSize = 0;
+    size->refCnt = glyphSet->refcnt;
+
+    GlyphTableBytes(hash->table, hash->size, size);
+    GlyphTableBytes(hash->oldTable, hash->oldSize, size);
+}
+
 static void
 GlyphExtents(int nlist, GlyphListPtr list, GlyphPtr * glyphs, BoxPtr extents)
 {
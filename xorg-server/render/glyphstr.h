@@ -31,6 +31,7 @@
 #include "regionstr.h"
 #include "miscstruct.h"
 #include "privates.h"
+#include "resource.h"
 
 #define GlyphFormat1	0
 #define GlyphFormat4	1
@@ -57,16 +58,21 @@ typedef struct _GlyphRef {
 
 #define DeletedGlyph	((GlyphPtr) 1)
 
-typedef struct _GlyphHashSet {
-    CARD32 entries;
-    CARD32 size;
-    CARD32 rehash;
-} GlyphHashSetRec, *GlyphHashSetPtr;
-
+/*
+ * Open addressed, with a power of two size.  When it fills up, a new
+ * table is allocated and the entries of the old one are moved over a
+ * few at a time by later insertions and deletions, while lookups look
+ * in both.
+ */
 typedef struct _GlyphHash {
     GlyphRefPtr table;
-    GlyphHashSetPtr hashSet;
-    CARD32 tableEntries;
+    CARD32 size;                /* 0 until the first insertion */
+    CARD32 tableEntries;        /* glyphs in both tables */
+    CARD32 tableUsed;           /* slots of table ever filled */
+    GlyphRefPtr oldTable;
+    CARD32 oldSize;
+    CARD32 oldEntries;          /* glyphs still in oldTable */
+    CARD32 oldNext;             /* first slot of oldTable not yet moved */
 } GlyphHashRec, *GlyphHashPtr;
 
 typedef struct _GlyphSet {
@@ -93,12 +99,6 @@ typedef struct _GlyphList {
 extern _X_EXPORT void
  GlyphUninit(ScreenPtr pScreen);
 
-extern _X_EXPORT GlyphHashSetPtr FindGlyphHashSet(CARD32 filled);
-
-extern _X_EXPORT GlyphRefPtr
-FindGlyphRef(GlyphHashPtr hash,
-             CARD32 signature, Bool match, unsigned char sha1[20]);
-
 extern _X_EXPORT GlyphPtr FindGlyphByHash(unsigned char sha1[20], int format);
 
 extern _X_EXPORT int
@@ -119,11 +119,8 @@ extern _X_EXPORT GlyphPtr FindGlyph(GlyphSetPtr glyphSet, Glyph id);
 
 extern _X_EXPORT GlyphPtr AllocateGlyph(xGlyphInfo * gi, int format);
 
-extern _X_EXPORT Bool
- AllocateGlyphHash(GlyphHashPtr hash, GlyphHashSetPtr hashSet);
-
-extern _X_EXPORT Bool
- ResizeGlyphHash(GlyphHashPtr hash, CARD32 change, Bool global);
+extern _X_EXPORT void
+ FlushGlyphHash(GlyphHashPtr hash);
 
 extern _X_EXPORT Bool
  ResizeGlyphSet(GlyphSetPtr glyphSet, CARD32 change);
@@ -133,6 +130,9 @@ extern _X_EXPORT GlyphSetPtr AllocateGlyphSet(int fdepth, PictFormatPtr format);
 extern _X_EXPORT int
  FreeGlyphSet(void *value, XID gid);
 
+extern _X_EXPORT void
+ GetGlyphSetBytes(void *value, XID gid, ResourceSizePtr size);
+
 #define GLYPH_HAS_GLYPH_PICTURE_ACCESSOR 1 /* used for api compat */
 extern _X_EXPORT PicturePtr
  GetGlyphPicture(GlyphPtr glyph, ScreenPtr pScreen);
@@ -0,0 +1,167 @@
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "scrnintstr.h"
+#include "regionstr.h"
+#include "damage.h"
+
+/*
+ * Checks the coalescing DamageSetMaxRects() asks for: whatever the
+ * damage looks like, afterwards it must have at most maxRects boxes and
+ * still cover everything that was damaged.
+ */
+
+#define N_REGIONS       500
+
+static const int max_rects[] = { 1, 2, 3, 4, 7, 16, 64 };
+
+static void
+check_coalesce(DamagePtr pDamage, RegionPtr pInput, int maxRects)
+{
+    RegionPtr pDamaged = DamageRegion(pDamage);
+    int nInput = RegionNumRects(pInput);
+    RegionRec missed;
+
+    DamageSetMaxRects(pDamage, 0);
+    assert(RegionCopy(pDamaged, pInput));
+    DamageSetMaxRects(pDamage, maxRects);
+
+    assert(RegionNumRects(pDamaged) <= maxRects);
+    if (nInput <= maxRects)
+        assert(RegionEqual(pDamaged, pInput));
+
+    RegionNull(&missed);
+    RegionSubtract(&missed, pInput, pDamaged);
+    assert(!RegionNotEmpty(&missed));
+    RegionUninit(&missed);
+
+    /* and merging boxes never reaches outside the damage */
+    assert(RegionExtents(pDamaged)->x1 >= RegionExtents(pInput)->x1 &&
+           RegionExtents(pDamaged)->y1 >= RegionExtents(pInput)->y1 &&
+           RegionExtents(pDamaged)->x2 <= RegionExtents(pInput)->x2 &&
+           RegionExtents(pDamaged)->y2 <= RegionExtents(pInput)->y2);
+}
+
+static void
+add_box(RegionPtr pRegion, int x1, int y1, int x2, int y2)
+{
+    BoxRec box = { x1, y1, x2, y2 };
+    RegionRec r;
+
+    RegionInit(&r, &box, 1);
+    assert(RegionUnion(pRegion, pRegion, &r));
+    RegionUninit(&r);
+}
+
+/* n boxes of up to size by size anywhere in a width by height area */
+static void
+make_random_region(RegionPtr pRegion, int n, int width, int height, int size)
+{
+    int i, x, y;
+
+    for (i = 0; i < n; i++) {
+        x = rand() % width;
+        y = rand() % height;
+        add_box(pRegion, x, y, x + 1 + rand() % size, y + 1 + rand() % size);
+    }
+}
+
+static void
+check_region(DamagePtr pDamage, RegionPtr pInput)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(max_rects); i++)
+        check_coalesce(pDamage, pInput, max_rects[i]);
+}
+
+static void
+damage_coalesce_test(void)
+{
+    ScreenRec screen;
+    DamagePtr pDamage;
+    RegionRec input;
+    int i, j;
+
+    memset(&screen, 0, sizeof(screen));
+    screenInfo.numScreens = 1;
+    screenInfo.screens[0] = &screen;
+    assert(dixAllocatePrivates(&screen.devPrivates, PRIVATE_SCREEN));
+    assert(DamageSetup(&screen));
+
+    pDamage = DamageCreate(NULL, NULL, DamageReportNone, TRUE, &screen, NULL);
+    assert(pDamage);
+
+    RegionNull(&input);
+
+    /* Empty damage and a single box stay as they are */
+    check_region(pDamage, &input);
+    add_box(&input, 10, 10, 20, 20);
+    check_region(pDamage, &input);
+    RegionEmpty(&input);
+
+    /* A checkerboard: many rows of many boxes, none of them touching */
+    for (i = 0; i < 32; i++)
+        for (j = (i & 1); j < 32; j += 2)
+            add_box(&input, j * 8, i * 8, j * 8 + 8, i * 8 + 8);
+    check_region(pDamage, &input);
+    RegionEmpty(&input);
+
+    /* A column and a row of boxes far apart */
+    for (i = 0; i < 100; i++)
+        add_box(&input, 0, i * 20, 10, i * 20 + 10);
+    check_region(pDamage, &input);
+    RegionEmpty(&input);
+    for (i = 0; i < 100; i++)
+        add_box(&input, i * 20, 0, i * 20 + 10, 10);
+    check_region(pDamage, &input);
+    RegionEmpty(&input);
+
+    /* Two clusters in opposite corners, mostly empty in between */
+    make_random_region(&input, 50, 100, 100, 10);
+    for (i = 0; i < 50; i++) {
+        int x = 30000 + rand() % 100, y = 30000 + rand() % 100;
+
+        add_box(&input, x, y, x + 1 + rand() % 10, y + 1 + rand() % 10);
+    }
+    check_region(pDamage, &input);
+    RegionEmpty(&input);
+
+    /* Anything else: text-like runs of small boxes up to big overlaps */
+    srand(0x5eed);
+    for (i = 0; i < N_REGIONS; i++) {
+        int n = 1 + rand() % 300;
+
+        switch (i % 3) {
+        case 0:
+            make_random_region(&input, n, 1920, 1080, 16);
+            break;
+        case 1:
+            make_random_region(&input, n, 1920, 1080, 400);
+            break;
+        default:
+            make_random_region(&input, n, 200, 32000, 3);
+            break;
+        }
+        check_region(pDamage, &input);
+        RegionEmpty(&input);
+    }
+
+    RegionUninit(&input);
+    DamageDestroy(pDamage);
+}
+
+int
+main(int argc, char **argv)
+{
+    damage_coalesce_test();
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include <X11/fonts/fntfilst.h>
+/* After fontmisc.h, which turns assert() off */
+#include <assert.h>
+
+/*
+ * Lists fonts from a directory of a few thousand bitmap fonts with the
+ * patterns applications use, through FontFileFindNamesInDir() and its
+ * XLFD index, and by trying PatternMatch() on every name, as it did
+ * before the index.  Checks both find the same names and prints how long
+ * each took, best of a few tries.
+ */
+
+#define TRIES           5
+/* dix.h has it, but can't be included with the font library headers */
+#define ARRAY_SIZE(a)   ((int) (sizeof(a) / sizeof((a)[0])))
+
+static const char *foundries[] = { "misc", "adobe", "b&h", "bitstream" };
+static const char *families[] = {
+    "fixed", "courier", "helvetica", "times", "lucida", "lucidatypewriter",
+    "new century schoolbook", "terminal", "clean", "charter", "utopia",
+    "symbol",
+};
+static const char *weights[] = { "medium", "bold" };
+static const char *slants[] = { "r", "o", "i" };
+static const int sizes[] = { 8, 10, 11, 12, 13, 14, 17, 18, 20, 24, 25, 34 };
+static const char *registries[] = {
+    "iso8859-1", "iso8859-2", "iso8859-15", "iso10646-1",
+};
+
+static const char *patterns[] = {
+    "-*-*-medium-r-*",
+    "-*-*-medium-r-*-*-*-*-*-*-*-*-*-*",
+    "-*-fixed-*",
+    "-*-courier-bold-o-*-*-24-*",
+    "-*-*-*-*-*-*-13-*-*-*-*-*-iso8859-1",
+    "-*-helvetica-*-*-*-*-*-*-*-*-*-*-iso10646-1",
+    "*-iso8859-15",
+    "-misc-*-medium-*",
+    "-*-*-*-*-normal--*-*-*-*-?-*-*-*",
+    "*",
+    "alias*",
+};
+
+static FontRendererRec renderer = {
+    ".pcf.gz", 7, NULL, NULL, NULL, NULL, 0, 0
+};
+
+static FontDirectoryPtr
+make_dir(void)
+{
+    FontDirectoryPtr dir = FontFileMakeDir("/bench/", 100);
+    char name[MAXFONTNAMELEN], file[MAXFONTFILENAMELEN], alias[32];
+    int fo, fa, w, sl, sz, r, n = 0;
+
+    assert(dir);
+    for (fo = 0; fo < ARRAY_SIZE(foundries); fo++)
+    for (fa = 0; fa < ARRAY_SIZE(families); fa++)
+    for (w = 0; w < ARRAY_SIZE(weights); w++)
+    for (sl = 0; sl < ARRAY_SIZE(slants); sl++)
+    for (sz = 0; sz < ARRAY_SIZE(sizes); sz++)
+    for (r = 0; r < ARRAY_SIZE(registries); r++) {
+        if ((fo + fa + sl + r) % 3 == 0)
+            continue;
+        snprintf(name, sizeof(name),
+                 "-%s-%s-%s-%s-normal--%d-%d-75-75-%c-%d-%s",
+                 foundries[fo], families[fa], weights[w], slants[sl],
+                 sizes[sz], sizes[sz] * 10, fa < 2 ? 'c' : 'p',
+                 sizes[sz] * 5, registries[r]);
+        snprintf(file, sizeof(file), "f%d.pcf.gz", n);
+        assert(FontFileAddFontFile(dir, name, file));
+        if (n++ % 7 == 0) {
+            snprintf(alias, sizeof(alias), "alias%d", n);
+            assert(FontFileAddFontAlias(dir, alias, name));
+        }
+    }
+    FontFileSortDir(dir);
+    return dir;
+}
+
+static void
+make_pattern(FontNameRec *pat, char *buf, const char *pattern)
+{
+    strcpy(buf, pattern);
+    pat->name = buf;
+    pat->length = strlen(buf);
+    pat->ndashes = FontFileCountDashes(buf, pat->length);
+}
+
+/* Every name that matches, as found without the index */
+static int
+scan(FontTablePtr table, FontNameRec *pat, char **found)
+{
+    int i, n = 0;
+
+    for (i = 0; i < table->used; i++)
+        if (FontFileMatchName(table->entries[i].name.name,
+                              table->entries[i].name.length, pat))
+            found[n++] = table->entries[i].name.name;
+    return n;
+}
+
+static FontNamesPtr
+list(FontTablePtr table, FontNameRec *pat)
+{
+    FontNamesPtr names = MakeFontNamesRecord(100);
+
+    assert(names);
+    assert(FontFileFindNamesInDir(table, pat, table->used, names) ==
+           Successful);
+    return names;
+}
+
+static Bool
+bench(FontTablePtr table, const char *pattern, char **found)
+{
+    FontNameRec pat;
+    FontNamesPtr names;
+    FontEntryPtr entry;
+    char buf[MAXFONTNAMELEN];
+    CARD64 start, scanTime = 0, indexTime = 0;
+    Bool ok = TRUE;
+    int try, n, i;
+
+    make_pattern(&pat, buf, pattern);
+
+    n = scan(table, &pat, found);
+    names = list(table, &pat);
+    if (names->nnames != n)
+        ok = FALSE;
+    for (i = 0; ok && i < n; i++)
+        if (strcmp(names->names[i], found[i]))
+            ok = FALSE;
+    entry = FontFileFindNameInDir(table, &pat);
+    if (n ? !entry || strcmp(entry->name.name, found[0]) : entry != NULL)
+        ok = FALSE;
+    FreeFontNames(names);
+
+    for (try = 0; try < TRIES; try++) {
+        start = GetTimeInMicros();
+        scan(table, &pat, found);
+        start = GetTimeInMicros() - start;
+        if (try == 0 || start < scanTime)
+            scanTime = start;
+
+        start = GetTimeInMicros();
+        FreeFontNames(list(table, &pat));
+        start = GetTimeInMicros() - start;
+        if (try == 0 || start < indexTime)
+            indexTime = start;
+    }
+
+    printf("  %-44s %6d %10.0f us scan %10.0f us index%s\n", pattern, n,
+           (double) scanTime, (double) indexTime, ok ? "" : "  MISMATCH");
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    FontDirectoryPtr dir;
+    FontNameRec pat;
+    char buf[MAXFONTNAMELEN];
+    char **found;
+    CARD64 start;
+    Bool ok = TRUE;
+    int i;
+
+    assert(FontFileRegisterRenderer(&renderer));
+    dir = make_dir();
+    found = malloc(dir->nonScalable.used * sizeof(char *));
+    assert(found);
+
+    /* The index is made by the first wildcard search */
+    make_pattern(&pat, buf, "-*-*-*-*-*-*-*-*-*-*-*-*-*-*");
+    start = GetTimeInMicros();
+    FreeFontNames(list(&dir->nonScalable, &pat));
+    printf("%d names, first listing with the index made in %.0f us\n",
+           dir->nonScalable.used, (double) (GetTimeInMicros() - start));
+
+    for (i = 0; i < ARRAY_SIZE(patterns); i++)
+        ok = bench(&dir->nonScalable, patterns[i], found) && ok;
+
+    free(found);
+    FontFileFreeDir(dir);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,342 @@
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "fb.h"
+#include "picturestr.h"
+#include "fbpict.h"
+
+/*
+ * Draws screens of terminal text through the pixman glyph cache, the way
+ * fbGlyphs() did before the glyph atlas, and through the atlas, checks
+ * that both produce the same pixels and prints glyphs per second for
+ * each, best of a few tries.  Every line is one run through a mask, as
+ * Xft sends them.
+ */
+
+#define COLUMNS         80
+#define ROWS            50
+#define CELL_WIDTH      8
+#define CELL_HEIGHT     16
+#define ASCENT          12
+#define N_GLYPHS        95
+#define SCREENS         10
+#define TRIES           5
+
+typedef struct {
+    const char *name;
+    pixman_format_code_t glyphFormat;
+    Bool componentAlpha;
+    pixman_format_code_t maskFormat;
+    int advance;                /* less than CELL_WIDTH for kerned text */
+} Workload;
+
+static const Workload workloads[] = {
+    { "a8", PIXMAN_a8, FALSE, PIXMAN_a8, CELL_WIDTH },
+    { "a4", PIXMAN_a4, FALSE, PIXMAN_a8, CELL_WIDTH },
+    { "a1", PIXMAN_a1, FALSE, PIXMAN_a8, CELL_WIDTH },
+    { "argb-ca", PIXMAN_a8r8g8b8, TRUE, PIXMAN_a8r8g8b8, CELL_WIDTH },
+    { "a8-kern", PIXMAN_a8, FALSE, PIXMAN_a8, CELL_WIDTH - 2 },
+    { "a8-argb", PIXMAN_a8, FALSE, PIXMAN_a8r8g8b8, CELL_WIDTH - 2 },
+    { "argb-a8", PIXMAN_a8r8g8b8, TRUE, PIXMAN_a8, CELL_WIDTH - 2 },
+};
+
+typedef struct {
+    unsigned char sha1[20];
+    pixman_image_t *image;
+} TestGlyph;
+
+static TestGlyph glyphs[N_GLYPHS];
+static int text[ROWS][COLUMNS];
+static pixman_image_t *src, *dst;
+static CARD32 *dstInit;
+
+static CARD32
+crc32(CARD32 crc, const void *data, size_t size)
+{
+    const CARD8 *p = data;
+    int i;
+
+    crc = ~crc;
+    while (size--) {
+        crc ^= *p++;
+        for (i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void
+make_glyphs(const Workload *w)
+{
+    int i, x, y;
+
+    for (i = 0; i < N_GLYPHS; i++) {
+        TestGlyph *g = &glyphs[i];
+        pixman_image_t *image;
+        CARD8 *bits;
+        int stride;
+
+        if (g->image)
+            pixman_image_unref(g->image);
+
+        image = pixman_image_create_bits(w->glyphFormat,
+                                         CELL_WIDTH, CELL_HEIGHT, NULL, 0);
+        assert(image);
+        pixman_image_set_component_alpha(image, w->componentAlpha);
+        bits = (CARD8 *) pixman_image_get_data(image);
+        stride = pixman_image_get_stride(image);
+
+        /* Some ink in the middle of the cell, blank all around it */
+        for (y = 2; y < CELL_HEIGHT - 2; y++) {
+            for (x = 1; x < CELL_WIDTH - 1; x++) {
+                CARD32 v = random();
+
+                if (v & 0x10000)
+                    continue;
+                switch (w->glyphFormat) {
+                case PIXMAN_a1:
+                    bits[y * stride + x / 8] |= 0x80 >> (x & 7);
+                    break;
+                case PIXMAN_a4:
+                    bits[y * stride + x / 2] |= (v & 0xf) << (x & 1) * 4;
+                    break;
+                case PIXMAN_a8:
+                    bits[y * stride + x] = v;
+                    break;
+                default:
+                    ((CARD32 *) (bits + y * stride))[x] = v * 2654435761U;
+                    break;
+                }
+            }
+        }
+        g->image = image;
+
+        memset(g->sha1, 0, sizeof(g->sha1));
+        g->sha1[0] = i;
+        g->sha1[1] = w - workloads;
+        g->sha1[19] = 0x5a;
+    }
+}
+
+static void
+reset_dst(void)
+{
+    memcpy(pixman_image_get_data(dst), dstInit,
+           pixman_image_get_stride(dst) * ROWS * CELL_HEIGHT);
+}
+
+static void
+draw_cache(const Workload *w, void *closure)
+{
+    pixman_glyph_cache_t *cache = closure;
+    pixman_glyph_t run[COLUMNS];
+    pixman_box32_t extents;
+    int row, col;
+
+    for (row = 0; row < ROWS; row++) {
+        pixman_glyph_cache_freeze(cache);
+
+        for (col = 0; col < COLUMNS; col++) {
+            TestGlyph *g = &glyphs[text[row][col]];
+            const void *cached;
+
+            if (!(cached = pixman_glyph_cache_lookup(cache, g, NULL)))
+                cached = pixman_glyph_cache_insert(cache, g, NULL, 0, ASCENT,
+                                                   g->image);
+            assert(cached);
+            run[col].x = col * w->advance;
+            run[col].y = row * CELL_HEIGHT + ASCENT;
+            run[col].glyph = cached;
+        }
+
+        pixman_glyph_get_extents(cache, COLUMNS, run, &extents);
+        pixman_composite_glyphs(PIXMAN_OP_OVER, src, dst, w->maskFormat,
+                                extents.x1, extents.y1,
+                                extents.x1, extents.y1,
+                                extents.x1, extents.y1,
+                                extents.x2 - extents.x1,
+                                extents.y2 - extents.y1,
+                                cache, COLUMNS, run);
+
+        pixman_glyph_cache_thaw(cache);
+    }
+}
+
+static void
+draw_atlas(const Workload *w, void *closure)
+{
+    FbGlyphAtlasPtr atlas = closure;
+    FbAtlasGlyphPosRec run[COLUMNS];
+    CARD32 format = w->glyphFormat;
+    Bool drawn;
+    int row, col;
+
+    for (row = 0; row < ROWS; row++) {
+        fbGlyphAtlasBeginRun(atlas);
+
+        for (col = 0; col < COLUMNS; col++) {
+            TestGlyph *g = &glyphs[text[row][col]];
+            FbAtlasGlyphPtr cached;
+
+            if (!(cached = fbGlyphAtlasLookup(atlas, g->sha1, format)))
+                cached = fbGlyphAtlasInsert(atlas, g->sha1, format, g->image,
+                                            0, ASCENT);
+            assert(cached);
+            run[col].x = col * w->advance;
+            run[col].y = row * CELL_HEIGHT + ASCENT;
+            run[col].glyph = cached;
+        }
+
+        drawn = fbGlyphAtlasComposite(atlas, PIXMAN_OP_OVER, src, dst,
+                                      w->maskFormat, 0, 0, 0, 0,
+                                      COLUMNS, run);
+        assert(drawn);
+    }
+}
+
+typedef void (*DrawProc) (const Workload *w, void *closure);
+
+static void
+time_draw(const char *what, const Workload *w, DrawProc draw, void *closure)
+{
+    CARD64 best = 0;
+    int try, i;
+
+    for (try = 0; try < TRIES; try++) {
+        CARD64 start = GetTimeInMicros(), elapsed;
+
+        for (i = 0; i < SCREENS; i++)
+            draw(w, closure);
+        elapsed = GetTimeInMicros() - start;
+        if (try == 0 || elapsed < best)
+            best = elapsed;
+    }
+
+    printf("  %-8s %-6s %12.0f glyphs/s\n", w->name, what,
+           (double) ROWS * COLUMNS * SCREENS * 1000000 / max(best, 1));
+}
+
+static Bool
+bench(const Workload *w)
+{
+    pixman_glyph_cache_t *cache = pixman_glyph_cache_create();
+    FbGlyphAtlasPtr atlas = fbGlyphAtlasCreate();
+    CARD32 cacheCrc, atlasCrc;
+    size_t size = pixman_image_get_stride(dst) * ROWS * CELL_HEIGHT;
+
+    assert(cache && atlas);
+    make_glyphs(w);
+
+    reset_dst();
+    draw_cache(w, cache);
+    cacheCrc = crc32(0, pixman_image_get_data(dst), size);
+
+    reset_dst();
+    draw_atlas(w, atlas);
+    atlasCrc = crc32(0, pixman_image_get_data(dst), size);
+
+    time_draw("cache", w, draw_cache, cache);
+    time_draw("atlas", w, draw_atlas, atlas);
+
+    if (cacheCrc != atlasCrc)
+        printf("  %-8s MISMATCH %08x %08x\n", w->name,
+               (unsigned int) cacheCrc, (unsigned int) atlasCrc);
+
+    fbGlyphAtlasDestroy(atlas);
+    pixman_glyph_cache_destroy(cache);
+    return cacheCrc == atlasCrc;
+}
+
+/*
+ * Fills the atlas several times over with distinct glyphs, a run at a
+ * time: every insert has to succeed by evicting old pages, and glyphs
+ * of the current run must never be evicted.
+ */
+static void
+evict(void)
+{
+    FbGlyphAtlasPtr atlas = fbGlyphAtlasCreate();
+    pixman_image_t *image;
+    FbAtlasGlyphPtr run[COLUMNS];
+    unsigned char sha1[20];
+    int line, col;
+
+    image = pixman_image_create_bits(PIXMAN_a8, CELL_WIDTH, CELL_HEIGHT,
+                                     NULL, 0);
+    assert(atlas && image);
+    memset(sha1, 0, sizeof(sha1));
+
+    for (line = 0; line < 1000; line++) {
+        fbGlyphAtlasBeginRun(atlas);
+        for (col = 0; col < COLUMNS; col++) {
+            memcpy(sha1, &line, sizeof(line));
+            sha1[sizeof(line)] = col;
+            assert(!fbGlyphAtlasLookup(atlas, sha1, PICT_a8));
+            run[col] = fbGlyphAtlasInsert(atlas, sha1, PICT_a8, image, 0, 0);
+            assert(run[col]);
+        }
+        for (col = 0; col < COLUMNS; col++) {
+            sha1[sizeof(line)] = col;
+            assert(fbGlyphAtlasLookup(atlas, sha1, PICT_a8) == run[col]);
+        }
+    }
+
+    /* The first lines are long gone, the last one is still there */
+    line = 0;
+    memcpy(sha1, &line, sizeof(line));
+    sha1[sizeof(line)] = 0;
+    assert(!fbGlyphAtlasLookup(atlas, sha1, PICT_a8));
+
+    pixman_image_unref(image);
+    fbGlyphAtlasDestroy(atlas);
+}
+
+int
+main(int argc, char **argv)
+{
+    size_t size;
+    Bool ok = TRUE;
+    int row, col, i;
+    pixman_color_t color = { 0x2000, 0xc000, 0x4000, 0xe000 };
+
+    srandom(0x5eed);
+
+    for (row = 0; row < ROWS; row++)
+        for (col = 0; col < COLUMNS; col++)
+            text[row][col] = random() % N_GLYPHS;
+
+    src = pixman_image_create_solid_fill(&color);
+    dst = pixman_image_create_bits(PIXMAN_a8r8g8b8, COLUMNS * CELL_WIDTH,
+                                   ROWS * CELL_HEIGHT, NULL, 0);
+    assert(src && dst);
+
+    size = pixman_image_get_stride(dst) * ROWS * CELL_HEIGHT;
+    dstInit = malloc(size);
+    assert(dstInit);
+    for (i = 0; i < size / sizeof(CARD32); i++)
+        dstInit[i] = random();
+
+    printf("%dx%d cells of %dx%d, %d screens, best of %d\n",
+           COLUMNS, ROWS, CELL_WIDTH, CELL_HEIGHT, SCREENS, TRIES);
+
+    evict();
+
+    for (i = 0; i < ARRAY_SIZE(workloads); i++)
+        ok = bench(&workloads[i]) && ok;
+
+    for (i = 0; i < N_GLYPHS; i++)
+        pixman_image_unref(glyphs[i].image);
+    pixman_image_unref(src);
+    pixman_image_unref(dst);
+    free(dstInit);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "picturestr.h"
+#include "glyphstr.h"
+
+/*
+ * Checks the glyph set and global glyph hash tables through the calls
+ * the RENDER requests make, and prints how long the slowest AddGlyphs
+ * batch took: with the tables resized incrementally it should stay
+ * close to the average however many glyphs there are.
+ */
+
+#define N_GLYPHS        (256 * 1024)
+#define BATCH           256
+
+static void
+make_sha1(unsigned char sha1[20], int n)
+{
+    memset(sha1, 0, 20);
+    /* Like a real digest, the signature word is spread out */
+    *(CARD32 *) sha1 = n * 2654435761U;
+    memcpy(sha1 + 4, &n, sizeof(n));
+}
+
+static GlyphPtr
+make_glyph(int n)
+{
+    xGlyphInfo gi = { 0 };
+    GlyphPtr glyph = AllocateGlyph(&gi, GlyphFormat8);
+
+    assert(glyph);
+    make_sha1(glyph->sha1, n);
+    return glyph;
+}
+
+/* Adds glyphs first..first + count - 1 as ids base + i, the way
+ * ProcRenderAddGlyphs() does */
+static void
+add_glyphs(GlyphSetPtr glyphSet, Glyph base, int first, int count)
+{
+    CARD64 start, elapsed, slowest = 0, total = 0;
+    int i, j, n, batches = 0;
+
+    for (i = 0; i < count; i += n) {
+        n = min(BATCH, count - i);
+        start = GetTimeInMicros();
+        assert(ResizeGlyphSet(glyphSet, n));
+        for (j = i; j < i + n; j++)
+            AddGlyph(glyphSet, make_glyph(first + j), base + j);
+        elapsed = GetTimeInMicros() - start;
+        total += elapsed;
+        slowest = max(slowest, elapsed);
+        batches++;
+    }
+
+    printf("  %8d glyphs %10.1f us/batch average %10.1f us slowest\n",
+           count, (double) total / batches, (double) slowest);
+}
+
+static void
+check_glyphs(GlyphSetPtr glyphSet, Glyph base, int first, int count, int step)
+{
+    unsigned char sha1[20];
+    GlyphPtr glyph;
+    int i;
+
+    for (i = 0; i < count; i += step) {
+        glyph = FindGlyph(glyphSet, base + i);
+        assert(glyph);
+        make_sha1(sha1, first + i);
+        assert(memcmp(glyph->sha1, sha1, 20) == 0);
+        assert(FindGlyphByHash(sha1, GlyphFormat8) == glyph);
+    }
+}
+
+static void
+glyph_hash_test(void)
+{
+    GlyphSetPtr a, b;
+    GlyphPtr glyph;
+    unsigned char sha1[20];
+    ResourceSizeRec sizeA, sizeB;
+    int i;
+
+    a = AllocateGlyphSet(GlyphFormat8, NULL);
+    b = AllocateGlyphSet(GlyphFormat8, NULL);
+    assert(a && b);
+
+    assert(!FindGlyph(a, 0));
+    make_sha1(sha1, 0);
+    assert(!FindGlyphByHash(sha1, GlyphFormat8));
+
+    add_glyphs(a, 0, 0, N_GLYPHS);
+    check_glyphs(a, 0, 0, N_GLYPHS, 1);
+    assert(a->hash.tableEntries == N_GLYPHS);
+    assert(!FindGlyph(a, N_GLYPHS));
+
+    /* The second half of a's images again, under other ids: shared */
+    add_glyphs(b, 0x100000, N_GLYPHS / 2, N_GLYPHS / 2);
+    for (i = 0; i < N_GLYPHS / 2; i++) {
+        glyph = FindGlyph(b, 0x100000 + i);
+        assert(glyph == FindGlyph(a, N_GLYPHS / 2 + i));
+        assert(glyph->refcnt == 2);
+    }
+
+    GetGlyphSetBytes(a, 0, &sizeA);
+    GetGlyphSetBytes(b, 0, &sizeB);
+    assert(sizeA.resourceSize > sizeB.resourceSize);
+    assert(sizeB.resourceSize >=
+           N_GLYPHS / 2 * (sizeof(GlyphRec) + sizeof(xGlyphInfo)) / 2);
+
+    /* Odd ids go away, from the set and, when unshared, globally */
+    for (i = 1; i < N_GLYPHS; i += 2)
+        assert(DeleteGlyph(a, i));
+    assert(!DeleteGlyph(a, 1));
+    assert(a->hash.tableEntries == N_GLYPHS / 2);
+    check_glyphs(a, 0, 0, N_GLYPHS, 2);
+    for (i = 1; i < N_GLYPHS / 2; i += 2) {
+        assert(!FindGlyph(a, i));
+        make_sha1(sha1, i);
+        assert(!FindGlyphByHash(sha1, GlyphFormat8));
+    }
+    check_glyphs(b, 0x100000, N_GLYPHS / 2, N_GLYPHS / 2, 1);
+
+    /* Replacing an id drops the old glyph */
+    assert(ResizeGlyphSet(a, 1));
+    AddGlyph(a, make_glyph(N_GLYPHS), 0);
+    make_sha1(sha1, N_GLYPHS);
+    assert(FindGlyph(a, 0) == FindGlyphByHash(sha1, GlyphFormat8));
+    make_sha1(sha1, 0);
+    assert(!FindGlyphByHash(sha1, GlyphFormat8));
+
+    FreeGlyphSet(a, 0);
+    check_glyphs(b, 0x100000, N_GLYPHS / 2, N_GLYPHS / 2, 1);
+    assert(FindGlyph(b, 0x100000)->refcnt == 1);
+
+    FreeGlyphSet(b, 0);
+    make_sha1(sha1, N_GLYPHS - 1);
+    assert(!FindGlyphByHash(sha1, GlyphFormat8));
+}
+
+int
+main(int argc, char **argv)
+{
+    glyph_hash_test();
+
+    return 0;
+}
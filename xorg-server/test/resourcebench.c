@@ -0,0 +1,156 @@
+#ifdef HAVE_DIX_CONFIG_H
+#include <dix-config.h>
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <X11/X.h>
+#include "misc.h"
+#include "os.h"
+#include "dixstruct.h"
+#include "resource.h"
+
+/*
+ * Checks the per-client resource table and times it at a few sizes.
+ * The numbers are only meant to be compared with each other: lookups
+ * and frees should cost about the same per resource at every size.
+ */
+
+static RESTYPE TestType, OtherType;
+static int freed;
+static XID lastFreed;
+
+static int
+count_delete(void *value, XID id)
+{
+    freed++;
+    lastFreed = (XID) (intptr_t) value;
+    return Success;
+}
+
+static void
+count_found(void *value, XID id, void *cdata)
+{
+    (*(int *) cdata)++;
+}
+
+static void
+report(const char *what, int n, CARD64 start)
+{
+    CARD64 elapsed = GetTimeInMicros() - start;
+
+    printf("  %-8s %8d resources %10.1f ns/op\n", what, n,
+           elapsed * 1000.0 / n);
+}
+
+static void
+bench(ClientPtr client, int n)
+{
+    XID base = client->clientAsMask;
+    CARD64 start;
+    int i, found;
+
+    printf("%d resources\n", n);
+
+    start = GetTimeInMicros();
+    for (i = 0; i < n; i++)
+        assert(AddResource(base + i, TestType, (void *) (intptr_t) i));
+    report("add", n, start);
+
+    start = GetTimeInMicros();
+    for (i = 0; i < n; i++) {
+        void *value;
+
+        assert(dixLookupResourceByType(&value, base + i, TestType, NULL,
+                                       DixReadAccess) == Success);
+        assert(value == (void *) (intptr_t) i);
+    }
+    report("lookup", n, start);
+
+    start = GetTimeInMicros();
+    for (i = 0; i < n; i++) {
+        void *value;
+
+        assert(dixLookupResourceByType(&value, base + n + i, TestType, NULL,
+                                       DixReadAccess) == BadValue);
+    }
+    report("miss", n, start);
+
+    found = 0;
+    FindClientResourcesByType(client, TestType, count_found, &found);
+    assert(found == n);
+
+    freed = 0;
+    start = GetTimeInMicros();
+    for (i = 0; i < n; i += 2)
+        FreeResource(base + i, RT_NONE);
+    report("free", (n + 1) / 2, start);
+    assert(freed == (n + 1) / 2);
+
+    freed = 0;
+    FreeClientResources(client);
+    assert(freed == n / 2);
+}
+
+/* Resources sharing an id are freed newest first */
+static void
+shared_ids(ClientPtr client)
+{
+    XID id = client->clientAsMask | 42;
+    void *value;
+    int i;
+
+    assert(InitClientResources(client));
+    /* enough neighbours to force the table through a few rehashes */
+    for (i = 0; i < 1000; i++) {
+        assert(AddResource(id + 1 + i, OtherType, (void *) (intptr_t) 0));
+        if (i % 100 == 0)
+            assert(AddResource(id, i == 900 ? TestType : OtherType,
+                               (void *) (intptr_t) (i + 1)));
+    }
+
+    freed = 0;
+    FreeResourceByType(id, TestType, FALSE);
+    assert(freed == 1 && lastFreed == 901);
+
+    freed = 0;
+    lastFreed = 0;
+    FreeResource(id, RT_NONE);
+    assert(freed == 9 && lastFreed == 1);
+    assert(dixLookupResourceByClass(&value, id, RC_ANY, NULL,
+                                    DixReadAccess) == BadValue);
+
+    freed = 0;
+    FreeClientResources(client);
+    assert(freed == 1000);
+}
+
+int
+main(int argc, char **argv)
+{
+    ClientRec server_client, client;
+    int n;
+
+    serverClient = &server_client;
+    InitClient(serverClient, 0, (void *) NULL);
+    if (!InitClientResources(serverClient))
+        FatalError("couldn't init server resources");
+
+    TestType = CreateNewResourceType(count_delete, "ResourceBenchTest");
+    OtherType = CreateNewResourceType(count_delete, "ResourceBenchOther");
+    assert(TestType && OtherType);
+
+    InitClient(&client, 1, (void *) NULL);
+    clients[1] = &client;
+
+    shared_ids(&client);
+
+    for (n = 1000; n <= 1000000; n *= 10) {
+        assert(InitClientResources(&client));
+        bench(&client, n);
+    }
+
+    clients[1] = NULL;
+    return 0;
+}
@@ -32,6 +32,7 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 
 #include <stdio.h>
 #include <ctype.h>
+#include <sys/stat.h>
 #include <X11/X.h>
 #include <X11/Xos.h>
 #include <X11/Xproto.h>
@@ -44,6 +45,20 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #include <xkbsrv.h>
 #include <X11/extensions/XI.h>
 #include "xkb.h"
+#include "xsha1.h"
+
+#include <fcntl.h>
+#ifdef WIN32
+#include <io.h>
+#endif
+
+#ifdef XKBCOMP_LIBRARY
+#ifdef _MSC_VER
+#include <X11/Xwindows.h>
+#else
+#include <dlfcn.h>
+#endif
+#endif
 
         /*
          * If XKM_OUTPUT_DIR specifies a path without a leading slash, it is
@@ -57,10 +72,15 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define	XKM_OUTPUT_DIR	"compiled/"
 #endif
 
-#define	PRE_ERROR_MSG "\"The XKEYBOARD keymap compiler (xkbcomp) reports:\""
-#define	ERROR_PREFIX	"\"> \""
-#define	POST_ERROR_MSG1 "\"Errors from xkbcomp are not fatal to the X server\""
-#define	POST_ERROR_MSG2 "\"End of messages from xkbcomp\""
+#define	PRE_ERROR_TEXT	"The XKEYBOARD keymap compiler (xkbcomp) reports:"
+#define	ERROR_PREFIX_TEXT	"> "
+#define	POST_ERROR_TEXT1 "Errors from xkbcomp are not fatal to the X server"
+#define	POST_ERROR_TEXT2 "End of messages from xkbcomp"
+
+#define	PRE_ERROR_MSG	"\"" PRE_ERROR_TEXT "\""
+#define	ERROR_PREFIX	"\"" ERROR_PREFIX_TEXT "\""
+#define	POST_ERROR_MSG1 "\"" POST_ERROR_TEXT1 "\""
+#define	POST_ERROR_MSG2 "\"" POST_ERROR_TEXT2 "\""
 
 #if defined(WIN32)
 #define PATHSEPARATOR "\\"
@@ -68,8 +88,32 @@ THE USE OR PERFORMANCE OF THIS SOFTWARE.
 #define PATHSEPARATOR "/"
 #endif
 
+        /*
+         * Keymaps compiled from RMLVO names are kept in the output
+         * directory as cache-<sha1>.xkm, the sha1 taken over the RMLVO
+         * names, the components needed and the modification times of the
+         * xkb data directories, so that the next server (or the next
+         * keyboard with the same settings) loads the xkm instead of
+         * running xkbcomp.  Installing or removing data files changes the
+         * directory times; a file edited in place is not noticed until
+         * the cache file is removed.  The cache is only used in an output
+         * directory nobody else can write to, not in /tmp, and only files
+         * of our own are loaded from it.
+         */
+static unsigned xkmCacheHits, xkmCacheMisses;
+
+static const char *xkmCacheDirs[] = {
+    "", "/rules", "/keycodes", "/types", "/compat", "/symbols", "/geometry"
+};
+
 static unsigned
-LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn);
+LoadXKM(unsigned want, unsigned need, const char *keymap,
+        const char *cacheName, XkbDescPtr *xkbRtrn);
+
+static unsigned
+LoadXKMBuffer(unsigned want, unsigned need, const char *name,
+              const void *data, size_t size, const char *cacheName,
+              XkbDescPtr *xkbRtrn);
 
 static void
 OutputDirectory(char *outdir, size_t size)
@@ -93,6 +137,16 @@ OutputDirectory(char *outdir, size_t size)
     }
 }
 
+/**
+ * The warning level for xkbcomp, from the -xkbdebug flags.
+ */
+static int
+XkbCompWarningLevel(void)
+{
+    return (xkbDebugFlags < 2) ? 1 :
+        ((xkbDebugFlags > 10) ? 10 : (int) xkbDebugFlags);
+}
+
 /**
  * Callback invoked by XkbRunXkbComp. Write to out to talk to xkbcomp.
  */
@@ -151,9 +205,7 @@ RunXkbComp(xkbcomp_buffer_callback callback, void *userdata)
     if (asprintf(&buf,
                  "\"%s%sxkbcomp\" -w %d %s -xkm \"%s\" "
                  "-em1 %s -emp %s -eml %s \"%s%s.xkm\"",
-                 xkbbindir, xkbbindirsep,
-                 ((xkbDebugFlags < 2) ? 1 :
-                  ((xkbDebugFlags > 10) ? 10 : (int) xkbDebugFlags)),
+                 xkbbindir, xkbbindirsep, XkbCompWarningLevel(),
                  xkbbasedirflag ? xkbbasedirflag : "", xkmfile,
                  PRE_ERROR_MSG, ERROR_PREFIX, POST_ERROR_MSG1,
                  xkm_output_dir, keymap) == -1)
@@ -209,6 +261,193 @@ RunXkbComp(xkbcomp_buffer_callback callback, void *userdata)
     return NULL;
 }
 
+#ifdef XKBCOMP_LIBRARY
+        /*
+         * libxkbcomp is xkbcomp's compiler in a shared library; with it a
+         * keymap is compiled without starting a process and without the
+         * files in between.  It is loaded the first time a keymap is
+         * compiled, and xkbcomp is run as before if it can't be.  The
+         * library returns an xkm, read with XkmReadBuffer like the program's:
+         * its keyboard descriptions are libX11's and not the server's,
+         * which is also why it must be bound to its own libX11 and
+         * libxkbfile (RTLD_DEEPBIND) instead of the server's functions of
+         * the same names.  These types match xkbcomplib.h.
+         */
+#if defined(_MSC_VER) || defined(RTLD_DEEPBIND)
+#define XKBCOMP_USE_LIBRARY
+#endif
+#endif
+
+#ifdef XKBCOMP_USE_LIBRARY
+typedef void (*XkbCompSetMessagesProc) (const char *pre,
+                                        const char *prefix,
+                                        const char *post);
+typedef int (*XkbCompCompileKeymapProc) (const char *keymap, size_t length,
+                                         const char *root,
+                                         unsigned warningLevel,
+                                         void **xkmRtrn,
+                                         size_t *xkmLengthRtrn);
+typedef void (*XkbCompFreeProc) (void *xkm);
+
+static struct {
+    Bool tried;
+    XkbCompSetMessagesProc setMessages;
+    XkbCompCompileKeymapProc compileKeymap;
+    XkbCompFreeProc free;
+} xkbcompLib;
+
+/**
+ * Load libxkbcomp if it hasn't been tried yet.  Returns TRUE if it is
+ * there to compile with.
+ */
+static Bool
+XkbCompLibraryLoaded(void)
+{
+#ifdef _MSC_VER
+    HMODULE lib;
+#else
+    void *lib;
+#endif
+
+    if (xkbcompLib.tried)
+        return xkbcompLib.compileKeymap != NULL;
+    xkbcompLib.tried = TRUE;
+
+#ifdef _MSC_VER
+    lib = LoadLibrary(XKBCOMP_LIBRARY);
+    if (lib != NULL) {
+        xkbcompLib.setMessages = (XkbCompSetMessagesProc)
+            GetProcAddress(lib, "XkbCompSetMessages");
+        xkbcompLib.compileKeymap = (XkbCompCompileKeymapProc)
+            GetProcAddress(lib, "XkbCompCompileKeymap");
+        xkbcompLib.free = (XkbCompFreeProc) GetProcAddress(lib, "XkbCompFree");
+    }
+#else
+    lib = dlopen(XKBCOMP_LIBRARY, RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+    if (lib != NULL) {
+        xkbcompLib.setMessages = dlsym(lib, "XkbCompSetMessages");
+        xkbcompLib.compileKeymap = dlsym(lib, "XkbCompCompileKeymap");
+        xkbcompLib.free = dlsym(lib, "XkbCompFree");
+    }
+#endif
+    if (lib == NULL) {
+        LogMessageVerb(X_INFO, 3, "XKB: %s not loaded, running xkbcomp\n",
+                       XKBCOMP_LIBRARY);
+        return FALSE;
+    }
+    if (!xkbcompLib.setMessages || !xkbcompLib.compileKeymap ||
+        !xkbcompLib.free) {
+        LogMessage(X_WARNING, "XKB: %s is not usable, running xkbcomp\n",
+                   XKBCOMP_LIBRARY);
+#ifdef _MSC_VER
+        FreeLibrary(lib);
+#else
+        dlclose(lib);
+#endif
+        xkbcompLib.compileKeymap = NULL;
+        return FALSE;
+    }
+    LogMessageVerb(X_INFO, 3, "XKB: Compiling keymaps with %s\n",
+                   XKBCOMP_LIBRARY);
+    return TRUE;
+}
+
+/**
+ * Let the callback write the keymap source into memory.  Returns the
+ * source, to be freed, or NULL.
+ */
+static char *
+WriteKeymapSource(xkbcomp_buffer_callback callback, void *userdata,
+                  size_t *lengthRtrn)
+{
+    char *source = NULL;
+    size_t length = 0;
+    FILE *out;
+    Bool ok;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    out = open_memstream(&source, &length);
+    if (out == NULL)
+        return NULL;
+    (*callback)(out, userdata);
+    ok = fclose(out) == 0;
+#else
+    long end;
+#ifdef WIN32
+    char tmpname[PATH_MAX];
+    int fd = -1;
+
+    /* Created exclusively, so nobody can have a file waiting under the
+     * name; _O_TEMPORARY deletes it on close */
+    snprintf(tmpname, sizeof(tmpname), "%s\\xkb_XXXXXX", Win32TempDir());
+    if (_mktemp_s(tmpname, strlen(tmpname) + 1) == 0)
+        fd = _open(tmpname, _O_RDWR | _O_CREAT | _O_EXCL | _O_BINARY |
+                   _O_SHORT_LIVED | _O_TEMPORARY, _S_IREAD | _S_IWRITE);
+    out = fd >= 0 ? _fdopen(fd, "w+b") : NULL;
+    if (out == NULL && fd >= 0)
+        _close(fd);
+#else
+    out = tmpfile();
+#endif
+    if (out == NULL)
+        return NULL;
+    (*callback)(out, userdata);
+    ok = fflush(out) == 0 && (end = ftell(out)) >= 0;
+    if (ok) {
+        length = end;
+        source = malloc(length ? length : 1);
+        rewind(out);
+        ok = source && fread(source, 1, length, out) == length;
+    }
+    fclose(out);
+#endif
+    if (!ok) {
+        free(source);
+        return NULL;
+    }
+    *lengthRtrn = length;
+    return source;
+}
+
+/**
+ * Compile the keymap the callback writes with libxkbcomp and load it as
+ * LoadXKM does.
+ */
+static unsigned
+CompileXkbLib(xkbcomp_buffer_callback callback, void *userdata,
+              unsigned want, unsigned need, const char *cacheName,
+              XkbDescPtr *xkbRtrn)
+{
+    char *source;
+    size_t length, xkmLength;
+    void *xkm;
+    unsigned have;
+
+    *xkbRtrn = NULL;
+    source = WriteKeymapSource(callback, userdata, &length);
+    if (source == NULL) {
+        LogMessage(X_ERROR, "XKB: Could not write keymap: not enough memory\n");
+        return 0;
+    }
+
+    (*xkbcompLib.setMessages) (PRE_ERROR_TEXT, ERROR_PREFIX_TEXT,
+                               POST_ERROR_TEXT1);
+    if (!(*xkbcompLib.compileKeymap) (source, length, XkbBaseDirectory,
+                                      XkbCompWarningLevel(), &xkm,
+                                      &xkmLength)) {
+        free(source);
+        LogMessage(X_ERROR, "Error compiling keymap (%s)\n", XKBCOMP_LIBRARY);
+        return 0;
+    }
+    free(source);
+
+    have = LoadXKMBuffer(want, need, XKBCOMP_LIBRARY, xkm, xkmLength,
+                         cacheName, xkbRtrn);
+    (*xkbcompLib.free) (xkm);
+    return have;
+}
+#endif /* XKBCOMP_USE_LIBRARY */
+
 typedef struct {
     XkbDescPtr xkb;
     XkbComponentNamesPtr names;
@@ -286,89 +525,313 @@ XkbDDXLoadKeymapFromString(DeviceIntPtr keybd,
 
     *xkbRtrn = NULL;
 
+    /* Not the library: Xwayland is sent a keymap on every layout switch,
+     * and the library never frees the source it parses */
     map_name = RunXkbComp(xkb_write_keymap_string_cb, &map);
     if (!map_name) {
         LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
         return 0;
     }
 
-    have = LoadXKM(want, need, map_name, xkbRtrn);
+    have = LoadXKM(want, need, map_name, NULL, xkbRtrn);
     free(map_name);
 
     return have;
 }
 
-static FILE *
-XkbDDXOpenConfigFile(const char *mapName, char *fileNameRtrn, int fileNameRtrnLen)
+/**
+ * Write the path of the xkm file mapName in the output directory to buf.
+ */
+static Bool
+XkmOutputFileName(const char *mapName, char *buf, size_t size)
 {
-    char buf[PATH_MAX], xkm_output_dir[PATH_MAX];
-    FILE *file;
+    char xkm_output_dir[PATH_MAX];
 
-    buf[0] = '\0';
-    if (mapName != NULL) {
-        OutputDirectory(xkm_output_dir, sizeof(xkm_output_dir));
-        if ((XkbBaseDirectory != NULL) && (xkm_output_dir[0] != '/')
+    OutputDirectory(xkm_output_dir, sizeof(xkm_output_dir));
+    if ((XkbBaseDirectory != NULL) && (xkm_output_dir[0] != '/')
 #ifdef WIN32
-            && (!isalpha(xkm_output_dir[0]) || xkm_output_dir[1] != ':')
+        && (!isalpha(xkm_output_dir[0]) || xkm_output_dir[1] != ':')
 #endif
-            ) {
-            if (snprintf(buf, PATH_MAX, "%s/%s%s.xkm", XkbBaseDirectory,
-                         xkm_output_dir, mapName) >= PATH_MAX)
-                buf[0] = '\0';
-        }
-        else {
-            if (snprintf(buf, PATH_MAX, "%s%s.xkm", xkm_output_dir, mapName)
-                >= PATH_MAX)
-                buf[0] = '\0';
-        }
-        if (buf[0] != '\0')
-            file = fopen(buf, "rb");
-        else
-            file = NULL;
+        ) {
+        if (snprintf(buf, size, "%s/%s%s.xkm", XkbBaseDirectory,
+                     xkm_output_dir, mapName) >= size)
+            return FALSE;
     }
-    else
+    else {
+        if (snprintf(buf, size, "%s%s.xkm", xkm_output_dir, mapName) >= size)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static FILE *
+XkbDDXOpenConfigFile(const char *mapName, char *fileNameRtrn, int fileNameRtrnLen)
+{
+    char buf[PATH_MAX];
+    FILE *file;
+
+    if (mapName != NULL && XkmOutputFileName(mapName, buf, sizeof(buf)))
+        file = fopen(buf, "rb");
+    else {
+        buf[0] = '\0';
         file = NULL;
+    }
     if ((fileNameRtrn != NULL) && (fileNameRtrnLen > 0)) {
         strlcpy(fileNameRtrn, buf, fileNameRtrnLen);
     }
     return file;
 }
 
-static unsigned
-LoadXKM(unsigned want, unsigned need, const char *keymap, XkbDescPtr *xkbRtrn)
+/**
+ * Is path in a directory that only we or root can write to?
+ * Anyone could plant a keymap there for us to load otherwise.  Windows
+ * has a temporary directory per user.
+ */
+static Bool
+XkmCachePrivateDir(const char *path)
 {
-    FILE *file;
-    char fileName[PATH_MAX];
+#ifndef WIN32
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    struct stat st;
+
+    if (slash == NULL || slash - path + 1 >= sizeof(dir))
+        return FALSE;
+    memcpy(dir, path, slash - path + 1);
+    dir[slash - path + 1] = '\0';
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+        return FALSE;
+    return (st.st_uid == geteuid() || st.st_uid == 0) &&
+        !(st.st_mode & (S_IWGRP | S_IWOTH));
+#else
+    return TRUE;
+#endif
+}
+
+/**
+ * Hash the RMLVO names, need and the times of the xkb data directories
+ * and write the path of the cache file for them to buf.  Returns FALSE
+ * if there is no private directory to keep the cache in.
+ */
+static Bool
+XkmCacheFileName(XkbRMLVOSet * rmlvo, unsigned need, char *buf, size_t size)
+{
+    const char *strings[] = {
+        rmlvo->rules, rmlvo->model, rmlvo->layout, rmlvo->variant,
+        rmlvo->options, XkbBaseDirectory, XkbBinDirectory
+    };
+    char path[PATH_MAX], name[sizeof("cache-") + 40];
+    unsigned char sha1[20];
+    struct stat st;
+    time_t mtime;
+    void *ctx;
+    int i, ok;
+
+    if (XkbBaseDirectory == NULL)
+        return FALSE;
+
+    ctx = x_sha1_init();
+    if (!ctx)
+        return FALSE;
+
+    ok = x_sha1_update(ctx, &need, sizeof(need));
+    for (i = 0; ok && i < ARRAY_SIZE(strings); i++) {
+        const char *str = strings[i] ? strings[i] : "";
+
+        ok = x_sha1_update(ctx, (void *) str, strlen(str) + 1);
+    }
+    for (i = 0; ok && i <= ARRAY_SIZE(xkmCacheDirs); i++) {
+        /* the rules file itself last */
+        if (i < ARRAY_SIZE(xkmCacheDirs))
+            snprintf(path, sizeof(path), "%s%s", XkbBaseDirectory,
+                     xkmCacheDirs[i]);
+        else
+            snprintf(path, sizeof(path), "%s/rules/%s", XkbBaseDirectory,
+                     rmlvo->rules ? rmlvo->rules : "");
+        mtime = stat(path, &st) == 0 ? st.st_mtime : 0;
+        ok = x_sha1_update(ctx, &mtime, sizeof(mtime));
+    }
+    if (!x_sha1_final(ctx, sha1) || !ok)
+        return FALSE;
+
+    strcpy(name, "cache-");
+    for (i = 0; i < sizeof(sha1); i++)
+        sprintf(name + strlen("cache-") + 2 * i, "%02x", sha1[i]);
+
+    return XkmOutputFileName(name, buf, size) && XkmCachePrivateDir(buf);
+}
+
+/**
+ * Load a cached keymap with at least need in it, or return NULL.  Cache
+ * files that can't be parsed are removed.
+ */
+static XkbDescPtr
+XkmCacheLoad(const char *cacheName, unsigned need)
+{
+    XkbDescPtr xkb = NULL;
     unsigned missing;
+    size_t size;
+    void *data;
+    FILE *file;
+#ifndef WIN32
+    struct stat st;
+    int fd;
 
-    file = XkbDDXOpenConfigFile(keymap, fileName, PATH_MAX);
+    /* only a file we wrote, which nobody else can have rewritten */
+    fd = open(cacheName, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        LogMessage(X_WARNING, "XKB: Ignoring cached keymap %s, which is "
+                   "not the server's own\n", cacheName);
+        close(fd);
+        return NULL;
+    }
+    file = fdopen(fd, "rb");
     if (file == NULL) {
-        LogMessage(X_ERROR, "Couldn't open compiled keymap file %s\n",
-                   fileName);
-        return 0;
+        close(fd);
+        return NULL;
+    }
+#else
+    file = fopen(cacheName, "rb");
+    if (file == NULL)
+        return NULL;
+#endif
+    data = XkmSlurpFile(file, &size);
+    fclose(file);
+    if (data == NULL)
+        return NULL;
+
+    missing = XkmReadBuffer(data, size, need, XkmAllIndicesMask, &xkb);
+    free(data);
+    if (xkb && (missing & need)) {
+        XkbFreeKeyboard(xkb, 0, TRUE);
+        xkb = NULL;
     }
-    missing = XkmReadFile(file, need, want, xkbRtrn);
+    if (!xkb) {
+        LogMessage(X_WARNING, "XKB: Removing bad cached keymap %s\n",
+                   cacheName);
+        (void) unlink(cacheName);
+    }
+    return xkb;
+}
+
+/**
+ * Write a compiled keymap to the cache.  It goes to a new file of our own
+ * first and is renamed into place, so that other servers never see half
+ * of it.
+ */
+static void
+XkmCacheStore(const char *cacheName, const void *data, size_t size)
+{
+    char tmpName[PATH_MAX];
+    FILE *file;
+    int fd = -1;
+    Bool ok;
+
+    if (snprintf(tmpName, sizeof(tmpName), "%s-XXXXXX", cacheName)
+        >= sizeof(tmpName))
+        return;
+
+#ifndef WIN32
+    fd = mkstemp(tmpName);
+    file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+#else
+    if (_mktemp_s(tmpName, strlen(tmpName) + 1) == 0)
+        fd = _open(tmpName, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+                   _S_IREAD | _S_IWRITE);
+    file = fd >= 0 ? _fdopen(fd, "wb") : NULL;
+#endif
+    if (file == NULL) {
+        if (fd >= 0) {
+            close(fd);
+            (void) unlink(tmpName);
+        }
+        return;
+    }
+    ok = fwrite(data, size, 1, file) == 1;
+    if (fclose(file) != 0)
+        ok = FALSE;
+#ifdef WIN32
+    if (ok)
+        (void) unlink(cacheName);
+#endif
+    if (!ok || rename(tmpName, cacheName) != 0)
+        (void) unlink(tmpName);
+}
+
+/**
+ * Load the xkm in data, compiled from name, and if it has everything in
+ * need and cacheName is not NULL, store it in the cache as well.
+ */
+static unsigned
+LoadXKMBuffer(unsigned want, unsigned need, const char *name,
+              const void *data, size_t size, const char *cacheName,
+              XkbDescPtr *xkbRtrn)
+{
+    unsigned missing;
+
+    missing = XkmReadBuffer(data, size, need, want, xkbRtrn);
     if (*xkbRtrn == NULL) {
-        LogMessage(X_ERROR, "Error loading keymap %s\n", fileName);
-        fclose(file);
-        (void) unlink(fileName);
+        LogMessage(X_ERROR, "Error loading keymap %s\n", name);
         return 0;
     }
     else {
-        DebugF("Loaded XKB keymap %s, defined=0x%x\n", fileName,
+        DebugF("Loaded XKB keymap %s, defined=0x%x\n", name,
                (*xkbRtrn)->defined);
     }
+    if (cacheName && !(missing & need))
+        XkmCacheStore(cacheName, data, size);
+    return (need | want) & (~missing);
+}
+
+/**
+ * Load the compiled keymap file keymap as LoadXKMBuffer does.
+ */
+static unsigned
+LoadXKM(unsigned want, unsigned need, const char *keymap,
+        const char *cacheName, XkbDescPtr *xkbRtrn)
+{
+    FILE *file;
+    char fileName[PATH_MAX];
+    unsigned have;
+    size_t size;
+    void *data;
+
+    *xkbRtrn = NULL;
+    file = XkbDDXOpenConfigFile(keymap, fileName, PATH_MAX);
+    if (file == NULL) {
+        LogMessage(X_ERROR, "Couldn't open compiled keymap file %s\n",
+                   fileName);
+        return 0;
+    }
+    data = XkmSlurpFile(file, &size);
     fclose(file);
     (void) unlink(fileName);
-    return (need | want) & (~missing);
+    if (data == NULL) {
+        LogMessage(X_ERROR, "Error reading keymap %s\n", fileName);
+        return 0;
+    }
+    have = LoadXKMBuffer(want, need, fileName, data, size, cacheName,
+                         xkbRtrn);
+    free(data);
+    return have;
 }
 
-unsigned
-XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
-                        XkbComponentNamesPtr names,
-                        unsigned want,
-                        unsigned need,
-                        XkbDescPtr *xkbRtrn, char *nameRtrn, int nameRtrnLen)
+/*
+ * Compile and load the keymap names describe.  Unless inProcess is set,
+ * xkbcomp is always run: the library never frees the source it parses,
+ * which is fine for the keymaps the server compiles for its devices but
+ * not for those any client can ask for.
+ */
+static unsigned
+LoadKeymapByNames(DeviceIntPtr keybd,
+                  XkbComponentNamesPtr names,
+                  unsigned want,
+                  unsigned need,
+                  XkbDescPtr *xkbRtrn, char *nameRtrn, int nameRtrnLen,
+                  const char *cacheName, Bool inProcess)
 {
     XkbDescPtr xkb;
 
@@ -385,13 +848,41 @@ XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
                    keybd->name ? keybd->name : "(unnamed keyboard)");
         return 0;
     }
+#ifdef XKBCOMP_USE_LIBRARY
+    else if (inProcess && XkbCompLibraryLoaded()) {
+        XkbKeymapNamesCtx ctx = {
+            .xkb = xkb,
+            .names = names,
+            .want = want,
+            .need = need
+        };
+
+        /* there is no compiled keymap file to name */
+        if (nameRtrn && nameRtrnLen > 0)
+            *nameRtrn = '\0';
+        return CompileXkbLib(xkb_write_keymap_for_names_cb, &ctx, want, need,
+                             cacheName, xkbRtrn);
+    }
+#endif
     else if (!XkbDDXCompileKeymapByNames(xkb, names, want, need,
                                          nameRtrn, nameRtrnLen)) {
         LogMessage(X_ERROR, "XKB: Couldn't compile keymap\n");
         return 0;
     }
 
-    return LoadXKM(want, need, nameRtrn, xkbRtrn);
+    return LoadXKM(want, need, nameRtrn, cacheName, xkbRtrn);
+}
+
+unsigned
+XkbDDXLoadKeymapByNames(DeviceIntPtr keybd,
+                        XkbComponentNamesPtr names,
+                        unsigned want,
+                        unsigned need,
+                        XkbDescPtr *xkbRtrn, char *nameRtrn, int nameRtrnLen)
+{
+    /* for GetKbdByName */
+    return LoadKeymapByNames(keybd, names, want, need, xkbRtrn,
+                             nameRtrn, nameRtrnLen, NULL, FALSE);
 }
 
 Bool
@@ -469,12 +960,31 @@ XkbCompileKeymapForDevice(DeviceIntPtr dev, XkbRMLVOSet * rmlvo, int need)
     XkbDescPtr xkb = NULL;
     unsigned int provided;
     XkbComponentNamesRec kccgst = { 0 };
-    char name[PATH_MAX];
+    char name[PATH_MAX], cacheName[PATH_MAX];
+    Bool cached;
+
+    /* Incomplete names are filled in from the device's current keymap,
+     * so only a device without one can use the cache */
+    cached = (!dev->key || !dev->key->xkbInfo || !dev->key->xkbInfo->desc) &&
+        XkmCacheFileName(rmlvo, need, cacheName, sizeof(cacheName));
+    if (cached) {
+        xkb = XkmCacheLoad(cacheName, need);
+        if (xkb)
+            xkmCacheHits++;
+        else
+            xkmCacheMisses++;
+        LogMessage(X_INFO, "XKB: Keymap cache %s for %s (%u hits, %u misses)\n",
+                   xkb ? "hit" : "miss", cacheName, xkmCacheHits,
+                   xkmCacheMisses);
+        if (xkb)
+            return xkb;
+    }
 
     if (XkbRMLVOtoKcCGST(dev, rmlvo, &kccgst)) {
         provided =
-            XkbDDXLoadKeymapByNames(dev, &kccgst, XkmAllIndicesMask, need, &xkb,
-                                    name, PATH_MAX);
+            LoadKeymapByNames(dev, &kccgst, XkmAllIndicesMask, need, &xkb,
+                              name, PATH_MAX, cached ? cacheName : NULL,
+                              TRUE);
         if ((need & provided) != need) {
             if (xkb) {
                 XkbFreeKeyboard(xkb, 0, TRUE);